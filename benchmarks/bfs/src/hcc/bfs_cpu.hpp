@@ -0,0 +1,159 @@
+/*
+ * Multithreaded host BFS, which the host backend can run instead of the
+ * queue kernels.
+ *
+ * Levels relax edges exactly as visit_node does.  Each frontier is cut
+ * into tasks of a fixed number of edges rather than of nodes, so a node
+ * with more edges than that is split, and its adjacency list is spread
+ * over as many tasks.  The tasks are an untiled launch, whose workers
+ * split and steal ranges of tasks; see hc_host_runtime.hpp.
+ *
+ * Every thread appends the nodes it discovers to its own buffer.  As with
+ * LocalQueues::size_prefix_sum and concatenate, the buffers are then
+ * placed with a prefix sum of their sizes and copied into the next
+ * frontier in parallel, so no tail is shared between threads.
+ *
+ *   BFS_ENGINE=cpu         run this engine instead of the queue kernels
+ *   BFS_CPU_EDGES=<n>      edges per task, 1024 by default
+ */
+
+#ifdef HC_HOST_BACKEND
+
+#include <deque>
+#include <mutex>
+
+// Whether BFS_ENGINE asks for the host loops
+static bool bfsCpuEngine()
+{
+  const char *engine = getenv("BFS_ENGINE");
+  return engine != NULL && strcmp(engine, "cpu") == 0;
+}
+
+// The nodes one thread discovers during a level.  A cache line each, so
+// that threads appending to their own do not share one.
+struct alignas(64) bfs_thread_queue {
+  std::vector<int> elems;
+};
+
+// One queue per thread that has run a level, in the order they first did
+static std::deque<bfs_thread_queue> bfsThreadQueues;
+static std::mutex bfsThreadQueuesLock;
+
+static bfs_thread_queue &threadQueue()
+{
+  static thread_local bfs_thread_queue *mine = NULL;
+  if (mine == NULL) {
+    std::lock_guard<std::mutex> g(bfsThreadQueuesLock);
+    bfsThreadQueues.push_back(bfs_thread_queue());
+    mine = &bfsThreadQueues.back();
+  }
+  return *mine;
+}
+
+// Blacken the frontier f and set pre[i] to the number of edges of f[0] to
+// f[i - 1].  Returns the edges of the whole frontier.
+static long long
+frontierScan(const Node *nodes, int *color, const int *f, int frontier,
+             long long *pre)
+{
+  int parts = std::min(frontier / 4096 + 1, 256);
+  std::vector<long long> sums(parts + 1, 0);
+  long long *sum = sums.data();
+  parallel_for_each(extent<1>(parts), [=](index<1> p) {
+    long long s = 0;
+    for (int i = (long)frontier * p[0] / parts;
+         i < (long)frontier * (p[0] + 1) / parts; i++) {
+      color[f[i]] = BLACK;
+      s += nodes[f[i]].y;
+    }
+    sum[p[0] + 1] = s;
+  });
+  for (int p = 0; p < parts; p++)
+    sum[p + 1] += sum[p];
+  parallel_for_each(extent<1>(parts), [=](index<1> p) {
+    long long s = sum[p[0]];
+    for (int i = (long)frontier * p[0] / parts;
+         i < (long)frontier * (p[0] + 1) / parts; i++) {
+      pre[i] = s;
+      s += nodes[f[i]].y;
+    }
+  });
+  return sum[parts];
+}
+
+// Relax edges lo to hi - 1 of the frontier, counted as in pre
+static void
+relaxEdges(const Node *nodes, const Edge *edges, int *cost, int *color,
+           const int *f, const long long *pre, int frontier, long long lo,
+           long long hi, int gray_shade)
+{
+  std::vector<int> &found = threadQueue().elems;
+  int i = std::upper_bound(pre, pre + frontier, lo) - pre - 1;
+  for (long long pos = lo; pos < hi; i++) {
+    Node node = nodes[f[i]];
+    int first = node.x + (int)(pos - pre[i]);
+    int last = node.x + (int)std::min<long long>(node.y, hi - pre[i]);
+    int cur_cost = cost[f[i]];
+    for (int e = first; e < last; e++) {
+      int id = edges[e].x;
+      int c = cur_cost + edges[e].y;
+      if (c < cost[id] && atomic_fetch_min(&cost[id], c) > c &&
+          atomic_exchange(&color[id], gray_shade) != gray_shade)
+        found.push_back(id);
+    }
+    pos += last - first;
+  }
+}
+
+// Shortest-path costs from source into cost, which holds INF for every
+// node but the source on entry, as the queue kernels compute them.
+// color holds WHITE for every node on entry and the kernels' colors on
+// exit.
+static void
+cpuBfs(const Node *nodes, const Edge *edges, int num_of_nodes, int source,
+       int *cost, int *color)
+{
+  const char *s = getenv("BFS_CPU_EDGES");
+  long long per = (s && atoll(s) > 0) ? atoll(s) : 1024;
+  std::vector<int> queues[2];
+  queues[0].resize(num_of_nodes);
+  queues[1].resize(num_of_nodes);
+  std::vector<long long> pre(num_of_nodes);
+  queues[0][0] = source;
+
+  int frontier = 1;
+  for (int k = 0; frontier > 0; k++) {
+    const int *f = queues[k % 2].data();
+    int *next = queues[(k + 1) % 2].data();
+    int gray_shade = k % 2 == 0 ? GRAY0 : GRAY1;
+
+    long long *prefix = pre.data();
+    long long total = frontierScan(nodes, color, f, frontier, prefix);
+    long long tasks = (total + per - 1) / per;
+    parallel_for_each(extent<1>(tasks), [=](index<1> t) {
+      relaxEdges(nodes, edges, cost, color, f, prefix, frontier, t[0] * per,
+                 std::min(total, (t[0] + 1) * per), gray_shade);
+    });
+
+    // Place and gather the threads' queues
+    std::vector<int> offset(1, 0);
+    std::vector<bfs_thread_queue *> threads;
+    {
+      std::lock_guard<std::mutex> g(bfsThreadQueuesLock);
+      for (size_t q = 0; q < bfsThreadQueues.size(); q++) {
+        threads.push_back(&bfsThreadQueues[q]);
+        offset.push_back(offset.back() + bfsThreadQueues[q].elems.size());
+      }
+    }
+    bfs_thread_queue *const *queue = threads.data();
+    const int *off = offset.data();
+    parallel_for_each(extent<1>(threads.size()), [=](index<1> q) {
+      std::vector<int> &elems = queue[q[0]]->elems;
+      std::copy(elems.begin(), elems.end(), next + off[q[0]]);
+      elems.clear();
+    });
+    frontier = offset.back();
+  }
+}
+
+#endif
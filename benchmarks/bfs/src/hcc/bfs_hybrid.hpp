@@ -0,0 +1,407 @@
+/*
+ * Direction-optimizing BFS (Beamer, Asanovic and Patterson, SC'12).
+ *
+ * Levels are expanded top-down from a queue of frontier nodes while the
+ * frontier is small.  Once the edges out of the frontier exceed 1/alpha
+ * of the edges into unvisited nodes, levels go bottom-up instead: every
+ * unvisited node scans its in-edges for a parent in a bitmap of the
+ * frontier and stops at the first one it finds.  On low-diameter graphs
+ * that skips most of the edges of the large middle levels.  Traversal
+ * returns to top-down for the small levels at the end.
+ *
+ *   BFS_DIRECTION=hybrid   run this engine instead of the queue kernels
+ *   BFS_ALPHA=<a>          go bottom-up once the frontier's edges exceed
+ *                          1/a of the unexplored edges, 14 by default
+ *   BFS_BETA=<b>           go top-down once a shrinking frontier has at
+ *                          most 1/b of the nodes, 24 by default
+ *   BFS_ENGINE=cpu         on the host backend, run multithreaded host
+ *                          loops instead of the HC kernels
+ *
+ * Levels count hops, so they are shortest paths only when every edge has
+ * the same cost c, and the costs stored are then c times the level.  On
+ * graphs with mixed edge costs the benchmark runs its other engines
+ * instead.  Kernel time is accounted to a "top-down" and a "bottom-up"
+ * sub-timer.
+ */
+
+#include <algorithm>
+
+typedef unsigned int bfs_word;	// 32 nodes of a frontier bitmap
+#define BFS_WORD_BITS 32
+#define BFS_TILE 256
+
+// What a direction-optimizing traversal did
+struct bfs_direction_stats {
+  int levels;
+  int bottomUpLevels;
+  long long edgesExamined;	// edges the traversal looked at
+  long long edgesTopDown;	// edges a top-down traversal looks at
+};
+
+// Totals over the nodes a level discovers
+struct bfs_level {
+  int found;		// nodes discovered, the next frontier
+  int outEdges;		// their out-edges
+  int inEdges;		// their in-edges
+  int examined;		// edges examined by the level
+};
+
+// Whether BFS_DIRECTION selects this engine
+static bool bfsHybrid()
+{
+  const char *s = getenv("BFS_DIRECTION");
+  return s && strcmp(s, "hybrid") == 0;
+}
+
+static double envDouble(const char *name, double dflt)
+{
+  const char *s = getenv(name);
+  return (s && atof(s) > 0) ? atof(s) : dflt;
+}
+
+// The cost every edge has, or -1 if they differ
+static int uniformEdgeCost(const Edge *edges, int num_of_edges)
+{
+  for (int i = 1; i < num_of_edges; i++)
+    if (edges[i].y != edges[0].y)
+      return -1;
+  return num_of_edges ? edges[0].y : 1;
+}
+
+// The in-edges of every node, for the bottom-up levels: the sources of
+// the edges into v are src[start[v]] to src[start[v + 1] - 1].
+static void transposeGraph(const Node *nodes, const Edge *edges,
+                           int num_of_nodes, std::vector<int> &start,
+                           std::vector<int> &src)
+{
+  start.assign(num_of_nodes + 1, 0);
+  for (int u = 0; u < num_of_nodes; u++)
+    for (int i = nodes[u].x; i < nodes[u].x + nodes[u].y; i++)
+      start[edges[i].x + 1]++;
+  for (int v = 0; v < num_of_nodes; v++)
+    start[v + 1] += start[v];
+  src.resize(start[num_of_nodes]);
+  std::vector<int> fill(start.begin(), start.end() - 1);
+  for (int u = 0; u < num_of_nodes; u++)
+    for (int i = nodes[u].x; i < nodes[u].x + nodes[u].y; i++)
+      src[fill[edges[i].x]++] = u;
+}
+
+//-------------------------------------------------
+// Accelerator levels.  counters holds the fields of a bfs_level.
+//-------------------------------------------------
+
+// Claim the unvisited neighbours of the queued frontier for 'level' and
+// queue them in next
+static void
+kernelTopDown(array_view<const Node>& nodes, array_view<const Edge>& edges,
+              array_view<const int>& inStart, array_view<int>& cost,
+              array_view<const int>& queue, int frontier,
+              array_view<int>& next, array_view<int>& counters, int level)
+{
+  parallel_for_each(extent<1>(frontier), [=](index<1> idx) [[hc]]
+  {
+    Node node = nodes[queue[idx[0]]];
+    for (int i = node.x; i < node.x + node.y; i++) {
+      int v = edges[i].x;
+      int unvisited = INF;
+      if (cost[v] == INF &&
+          atomic_compare_exchange(&cost[v], &unvisited, level)) {
+        next[atomic_fetch_add(&counters[0], 1)] = v;
+        atomic_fetch_add(&counters[1], nodes[v].y);
+        atomic_fetch_add(&counters[2], inStart[v + 1] - inStart[v]);
+      }
+    }
+  });
+}
+
+// Each unvisited node looks for a parent in the frontier bitmap; those
+// that find one join 'level', the next bitmap and the queue in next.
+// next_bits must be clear.
+static void
+kernelBottomUp(array_view<const Node>& nodes, array_view<const int>& inStart,
+               array_view<const int>& inSrc, array_view<int>& cost,
+               array_view<const bfs_word>& bits, array_view<bfs_word>& next_bits,
+               array_view<int>& next, array_view<int>& counters,
+               int num_of_nodes, int level)
+{
+  int tiles = (num_of_nodes + BFS_TILE - 1) / BFS_TILE;
+  parallel_for_each(extent<1>(tiles * BFS_TILE).tile(BFS_TILE),
+                    [=](tiled_index<1> tidx) [[hc]]
+  {
+    tile_static int examined;
+    if (tidx.local[0] == 0)
+      examined = 0;
+    tidx.barrier.wait();
+
+    int v = tidx.global[0], scanned = 0;
+    if (v < num_of_nodes && cost[v] == INF) {
+      for (int i = inStart[v]; i < inStart[v + 1]; i++) {
+        int u = inSrc[i];
+        scanned++;
+        if (bits[u / BFS_WORD_BITS] & (1u << (u % BFS_WORD_BITS))) {
+          cost[v] = level;
+          atomic_fetch_or(&next_bits[v / BFS_WORD_BITS],
+                          1u << (v % BFS_WORD_BITS));
+          next[atomic_fetch_add(&counters[0], 1)] = v;
+          atomic_fetch_add(&counters[1], nodes[v].y);
+          atomic_fetch_add(&counters[2], inStart[v + 1] - inStart[v]);
+          break;
+        }
+      }
+    }
+    if (scanned)
+      atomic_fetch_add(&examined, scanned);
+    tidx.barrier.wait();
+    if (tidx.local[0] == 0)
+      atomic_fetch_add(&counters[3], examined);
+  });
+}
+
+// Set the bits of the queued frontier in a clear bitmap
+static void
+kernelQueueToBitmap(array_view<const int>& queue, int frontier,
+                    array_view<bfs_word>& bits)
+{
+  parallel_for_each(extent<1>(frontier), [=](index<1> idx) [[hc]]
+  {
+    int u = queue[idx[0]];
+    atomic_fetch_or(&bits[u / BFS_WORD_BITS], 1u << (u % BFS_WORD_BITS));
+  });
+}
+
+static void kernelClear(array_view<bfs_word>& bits)
+{
+  parallel_for_each(bits.get_extent(), [=](index<1> idx) [[hc]]
+  {
+    bits[idx] = 0;
+  });
+}
+
+#ifdef HC_HOST_BACKEND
+//-------------------------------------------------
+// Multithreaded host levels.  Each chunk of work collects what it finds
+// locally; the chunks' queues are then concatenated in parallel.
+//-------------------------------------------------
+
+#define BFS_CPU_CHUNK 4096	// bottom-up nodes per chunk, whole words
+
+struct bfs_cpu_chunk {
+  std::vector<int> found;
+  long long outEdges, inEdges, examined;
+};
+
+// Concatenate the chunks' queues into next and total their counts
+static bfs_level cpuGather(std::vector<bfs_cpu_chunk> &chunks, int *next)
+{
+  std::vector<int> offset(chunks.size() + 1, 0);
+  bfs_level r = {0, 0, 0, 0};
+  for (size_t c = 0; c < chunks.size(); c++) {
+    offset[c + 1] = offset[c] + (int)chunks[c].found.size();
+    r.outEdges += chunks[c].outEdges;
+    r.inEdges += chunks[c].inEdges;
+    r.examined += chunks[c].examined;
+  }
+  r.found = offset[chunks.size()];
+  bfs_cpu_chunk *chunk = chunks.data();
+  int *off = offset.data();
+  parallel_for_each(extent<1>(chunks.size()), [=](index<1> c) {
+    std::copy(chunk[c[0]].found.begin(), chunk[c[0]].found.end(),
+              next + off[c[0]]);
+  });
+  return r;
+}
+
+static bfs_level
+cpuTopDown(const Node *nodes, const Edge *edges, const int *inStart,
+           int *cost, const int *queue, int frontier, int *next, int level)
+{
+  // Small chunks, since frontier nodes can differ widely in degree
+  int per = 64;
+  std::vector<bfs_cpu_chunk> chunks((frontier + per - 1) / per);
+  bfs_cpu_chunk *chunk = chunks.data();
+  parallel_for_each(extent<1>(chunks.size()), [=](index<1> c) {
+    bfs_cpu_chunk &out = chunk[c[0]];
+    out.outEdges = out.inEdges = out.examined = 0;
+    int end = std::min(frontier, (c[0] + 1) * per);
+    for (int q = c[0] * per; q < end; q++) {
+      const Node &node = nodes[queue[q]];
+      out.examined += node.y;
+      for (int i = node.x; i < node.x + node.y; i++) {
+        int v = edges[i].x, unvisited = INF;
+        if (cost[v] == INF &&
+            atomic_compare_exchange(&cost[v], &unvisited, level)) {
+          out.found.push_back(v);
+          out.outEdges += nodes[v].y;
+          out.inEdges += inStart[v + 1] - inStart[v];
+        }
+      }
+    }
+  });
+  return cpuGather(chunks, next);
+}
+
+// Chunks cover whole words of next_bits, so they set bits without atomics.
+// next_bits must be clear.
+static bfs_level
+cpuBottomUp(const Node *nodes, const int *inStart, const int *inSrc,
+            int *cost, const bfs_word *bits, bfs_word *next_bits, int *next,
+            int num_of_nodes, int level)
+{
+  std::vector<bfs_cpu_chunk> chunks((num_of_nodes + BFS_CPU_CHUNK - 1) /
+                                    BFS_CPU_CHUNK);
+  bfs_cpu_chunk *chunk = chunks.data();
+  parallel_for_each(extent<1>(chunks.size()), [=](index<1> c) {
+    bfs_cpu_chunk &out = chunk[c[0]];
+    out.outEdges = out.inEdges = out.examined = 0;
+    int end = std::min(num_of_nodes, (c[0] + 1) * BFS_CPU_CHUNK);
+    for (int v = c[0] * BFS_CPU_CHUNK; v < end; v++) {
+      if (cost[v] != INF)
+        continue;
+      for (int i = inStart[v]; i < inStart[v + 1]; i++) {
+        int u = inSrc[i];
+        if (bits[u / BFS_WORD_BITS] & (1u << (u % BFS_WORD_BITS))) {
+          out.examined += i - inStart[v] + 1;
+          cost[v] = level;
+          next_bits[v / BFS_WORD_BITS] |= 1u << (v % BFS_WORD_BITS);
+          out.found.push_back(v);
+          out.outEdges += nodes[v].y;
+          out.inEdges += inStart[v + 1] - inStart[v];
+          goto found;
+        }
+      }
+      out.examined += inStart[v + 1] - inStart[v];
+    found:;
+    }
+  });
+  return cpuGather(chunks, next);
+}
+#endif
+
+// Direction-optimizing BFS from source into cost, which holds INF for
+// every node but the source on entry.  Every edge costs unit, as returned
+// by uniformEdgeCost.
+static void
+hybridBfs(const Node *h_nodes, const Edge *h_edges, int num_of_nodes,
+          int num_of_edges, int unit, int source, int *h_cost,
+          struct pb_TimerSet *timers, bfs_direction_stats *stats)
+{
+  double alpha = envDouble("BFS_ALPHA", 14), beta = envDouble("BFS_BETA", 24);
+  bool cpu = false;
+#ifdef HC_HOST_BACKEND
+  cpu = bfsCpuEngine();
+#endif
+
+  pb_SwitchToTimer(timers, pb_TimerID_COMPUTE);
+  std::vector<int> inStart, inSrc;
+  transposeGraph(h_nodes, h_edges, num_of_nodes, inStart, inSrc);
+  int words = (num_of_nodes + BFS_WORD_BITS - 1) / BFS_WORD_BITS;
+  std::vector<int> queues[2];
+  std::vector<bfs_word> bitmaps[2];
+  for (int i = 0; i < 2; i++) {
+    queues[i].resize(num_of_nodes);
+    bitmaps[i].resize(words);
+  }
+
+  pb_SwitchToTimer(timers, pb_TimerID_COPY);
+  array_view<const Node> d_nodes(num_of_nodes, h_nodes);
+  array_view<const Edge> d_edges(num_of_edges, h_edges);
+  array_view<const int> d_inStart(num_of_nodes + 1, inStart.data());
+  array_view<const int> d_inSrc(inSrc.size(), inSrc.data());
+  array_view<int> d_cost(num_of_nodes, h_cost);
+  array_view<int> d_queue[2] = {array_view<int>(num_of_nodes, queues[0]),
+                                array_view<int>(num_of_nodes, queues[1])};
+  array_view<bfs_word> d_bits[2] = {array_view<bfs_word>(words, bitmaps[0]),
+                                    array_view<bfs_word>(words, bitmaps[1])};
+  array_view<int> counters(4);
+
+  pb_AddSubTimer(timers, (char *)"top-down", pb_TimerID_KERNEL);
+  pb_AddSubTimer(timers, (char *)"bottom-up", pb_TimerID_KERNEL);
+
+  // The frontier is queue q, and while bottom-up also bitmap q
+  int q = 0, frontier = 1, previous = 0;
+  bool bottomUp = false;
+  long long frontierEdges = h_nodes[source].y;
+  long long unexploredEdges = (long long)inSrc.size() -
+                              (inStart[source + 1] - inStart[source]);
+  queues[0][0] = source;
+  d_queue[0][0] = source;
+  memset(stats, 0, sizeof(*stats));
+
+  for (int level = 1; frontier > 0; level++) {
+    if (!bottomUp && frontierEdges > unexploredEdges / alpha) {
+      bottomUp = true;
+      pb_SwitchToSubTimer(timers, (char *)"bottom-up", pb_TimerID_KERNEL);
+      if (cpu) {
+        std::fill(bitmaps[q].begin(), bitmaps[q].end(), 0);
+        for (int i = 0; i < frontier; i++)
+          bitmaps[q][queues[q][i] / BFS_WORD_BITS] |=
+            1u << (queues[q][i] % BFS_WORD_BITS);
+      } else {
+        array_view<const int> queue = d_queue[q];
+        kernelClear(d_bits[q]);
+        kernelQueueToBitmap(queue, frontier, d_bits[q]);
+      }
+    } else if (bottomUp && frontier < previous &&
+               frontier <= num_of_nodes / beta) {
+      bottomUp = false;
+    }
+    pb_SwitchToSubTimer(timers, bottomUp ? (char *)"bottom-up" :
+                        (char *)"top-down", pb_TimerID_KERNEL);
+
+    bfs_level r;
+#ifdef HC_HOST_BACKEND
+    if (cpu) {
+      if (bottomUp) {
+        std::fill(bitmaps[1 - q].begin(), bitmaps[1 - q].end(), 0);
+        r = cpuBottomUp(h_nodes, inStart.data(), inSrc.data(), h_cost,
+                        bitmaps[q].data(), bitmaps[1 - q].data(),
+                        queues[1 - q].data(), num_of_nodes, level);
+      } else {
+        r = cpuTopDown(h_nodes, h_edges, inStart.data(), h_cost,
+                       queues[q].data(), frontier, queues[1 - q].data(),
+                       level);
+      }
+    } else
+#endif
+    {
+      for (int i = 0; i < 4; i++)
+        counters[i] = 0;
+      array_view<const int> queue = d_queue[q];
+      if (bottomUp) {
+        array_view<const bfs_word> bits = d_bits[q];
+        kernelClear(d_bits[1 - q]);
+        kernelBottomUp(d_nodes, d_inStart, d_inSrc, d_cost, bits,
+                       d_bits[1 - q], d_queue[1 - q], counters, num_of_nodes,
+                       level);
+      } else {
+        kernelTopDown(d_nodes, d_edges, d_inStart, d_cost, queue, frontier,
+                      d_queue[1 - q], counters, level);
+      }
+      counters.synchronize();
+      r.found = counters[0];
+      r.outEdges = counters[1];
+      r.inEdges = counters[2];
+      r.examined = bottomUp ? counters[3] : (int)frontierEdges;
+    }
+
+    stats->levels++;
+    stats->bottomUpLevels += bottomUp;
+    stats->edgesExamined += r.examined;
+    stats->edgesTopDown += frontierEdges;
+    previous = frontier;
+    frontier = r.found;
+    frontierEdges = r.outEdges;
+    unexploredEdges -= r.inEdges;
+    q = 1 - q;
+  }
+
+  pb_SwitchToTimer(timers, pb_TimerID_COPY);
+  d_cost.synchronize();
+  if (unit != 1) {
+    pb_SwitchToTimer(timers, pb_TimerID_COMPUTE);
+    for (int v = 0; v < num_of_nodes; v++)
+      if (h_cost[v] != INF)
+        h_cost[v] *= unit;
+  }
+}
@@ -13,3 +13,11 @@
 #define GRAY1 16677220
 #define BLACK 16677221
 #define W_QUEUE_SIZE 400
+
+#ifdef HC_HOST_BACKEND
+//the host runtime does not keep NUM_SM tiles resident at the same time,
+//so the inter-block barrier of BFS_kernel_multi_blk_inGPU would never release
+#define GLOBAL_BARRIER 0
+#else
+#define GLOBAL_BARRIER 1
+#endif
@@ -63,18 +63,26 @@ struct LocalQueues {
       (index < (block_dim & MOD_OP));
   }
 
-  // Append 'value' to queue number 'index'.  If queue is full, the
-  // append operation fails and *overflow is set to 1.
-  void append(int index, array_view<int>& overflow, int value) [[hc]] {
+  // Append 'value' to queue number 'index'.  If queue is full, the value
+  // spills to the next free entry of 'spill' instead; spill_count[0]
+  // counts them.
+  void append(int index, array_view<int>& spill, array_view<int>& spill_count,
+              int value) [[hc]] {
     // Queue may be accessed concurrently, so
     // use an atomic operation to reserve a queue index.
     int tail_index = atomic_fetch_add(&tail[index], 1);
     if (tail_index >= W_QUEUE_SIZE)
-      overflow[0] = 1;
+      spill[atomic_fetch_add(&spill_count[0], 1)] = value;
     else
       elems[index][tail_index] = value;
   }
 
+  // The number of elements in queue n.  tail[n] also counts the values
+  // that spilled.
+  int size(int index) [[hc]] {
+    return tail[index] < W_QUEUE_SIZE ? tail[index] : W_QUEUE_SIZE;
+  }
+
   // Perform a scan on the number of elements in queues in a a LocalQueue.
   // This function should be executed by one thread in a thread block.
   //
@@ -88,9 +96,9 @@ struct LocalQueues {
   int size_prefix_sum(int (&prefix_q)[NUM_BIN]) [[hc]] {
     prefix_q[0] = 0;
     for(int i = 1; i < NUM_BIN; i++){
-      prefix_q[i] = prefix_q[i-1] + tail[i-1];
+      prefix_q[i] = prefix_q[i-1] + size(i-1);
     }
-    return prefix_q[NUM_BIN-1] + tail[NUM_BIN-1];
+    return prefix_q[NUM_BIN-1] + size(NUM_BIN-1);
   }
 
   // Concatenate and copy all queues to the destination.
@@ -102,7 +110,7 @@ struct LocalQueues {
     int q_i = threadId & MOD_OP; // w-queue index
     int local_shift = threadId >> EXP; // shift within a w-queue
 
-    while(local_shift < tail[q_i]){
+    while(local_shift < size(q_i)){
       dst[prefix_q[q_i] + local_shift] = elems[q_i][local_shift];
 
       //multiple threads are copying elements at the same time,
@@ -116,7 +124,7 @@ struct LocalQueues {
     int q_i = threadId & MOD_OP; // w-queue index
     int local_shift = threadId >> EXP; // shift within a w-queue
 
-    while(local_shift < tail[q_i]){
+    while(local_shift < size(q_i)){
       dst[prefix_q[q_i] + local_shift] = elems[q_i][local_shift];
 
       //multiple threads are copying elements at the same time,
@@ -147,7 +155,8 @@ void start_global_barrier(int fold, int* count, tiled_index<1>& tidx) [[hc]] {
 //
 // 'pid' is the ID of the node to process.
 // 'index' is the local queue to use, chosen based on the thread ID.
-// The output goes in 'local_q' and 'overflow'.
+// The output goes in 'local_q', or 'spill' once that is full, and the
+// out-edges of the nodes put on the queue are added to 'next_edges'.
 // Other parameters are inputs.
 void
 visit_node(int pid,
@@ -155,7 +164,9 @@ visit_node(int pid,
 	   LocalQueues &local_q,
        array_view<Node>& g_graph_node,
        array_view<Edge>& g_graph_edge,
-	   array_view<int>& overflow,
+	   array_view<int>& spill,
+	   array_view<int>& spill_count,
+	   int &next_edges,
 	   array_view<int>& g_color,
 	   array_view<int>& g_cost,
 	   int gray_shade) [[hc]]
@@ -178,7 +189,8 @@ visit_node(int pid,
       int old_color = atomic_exchange(&g_color[id],gray_shade);
       if(old_color != gray_shade) {
 	//push to the queue
-	local_q.append(index, overflow, id);
+	local_q.append(index, spill, spill_count, id);
+	atomic_fetch_add(&next_edges, g_graph_node[id].y);
       }
     }
   }
@@ -192,6 +204,10 @@ visit_node(int pid,
 // 2) the intermediate queues are stored in shared memory (next_wf)
 //\param q1: the current frontier queue when the kernel is launched
 //\param q2: the new frontier queue when the  kernel returns
+//\param spill: the nodes that overflowed the local queues, counted in
+//              spill_count; the kernel stops after a level that spills them,
+//              and before one with more edges than spill holds
+//\param next_edges: the out-edges of the new frontier when the kernel returns
 //--------------------------------------------------
 void
 BFS_in_GPU_kernel(tiled_index<1>& tidx,
@@ -205,12 +221,16 @@ BFS_in_GPU_kernel(tiled_index<1>& tidx,
                   array_view<int>& tail,
                   int gray_shade,
                   int k,
-                  array_view<int>& overflow) [[hc]]
+                  array_view<int>& spill,
+                  array_view<int>& spill_count,
+                  array_view<int>& next_edges) [[hc]]
 {
   tile_static LocalQueues local_q;
   tile_static int prefix_q[NUM_BIN];
   tile_static int next_wf[MAX_THREADS_PER_BLOCK];
   tile_static int  tot_sum;
+  tile_static int  edges_sm;//out-edges of the new frontier
+  tile_static int  spilled;
   int threadId = tidx.local[0];
   int blockId = tidx.tile[0];
   if(threadId == 0)	
@@ -219,6 +239,8 @@ BFS_in_GPU_kernel(tiled_index<1>& tidx,
     if(threadId < NUM_BIN){
       local_q.reset(threadId, tidx.tile_dim[0]);
     }
+    if(threadId == 0)
+      edges_sm = 0;
     tidx.barrier.wait();
     int tid = blockId*MAX_THREADS_PER_BLOCK + threadId;
     if( tid<no_of_nodes)
@@ -232,17 +254,20 @@ BFS_in_GPU_kernel(tiled_index<1>& tidx,
       // Visit a node from the current frontier; update costs, colors, and
       // output queue
       visit_node(pid, threadId & MOD_OP, local_q, g_graph_nodes, g_graph_edges,
-              overflow, g_color, g_cost, gray_shade);
+              spill, spill_count, edges_sm, g_color, g_cost, gray_shade);
     }
     tidx.barrier.wait();
     if(threadId == 0){
       tail[0] = tot_sum = local_q.size_prefix_sum(prefix_q);
+      spilled = atomic_fetch_or(&spill_count[0], 0);
+      next_edges[0] = edges_sm;
     }
     tidx.barrier.wait();
 
     if(tot_sum == 0)//the new frontier becomes empty; BFS is over
       return;
-    if(tot_sum <= MAX_THREADS_PER_BLOCK){
+    if(tot_sum <= MAX_THREADS_PER_BLOCK && spilled == 0 &&
+       edges_sm <= spill.get_extent()[0]){
       //the new frontier is still within one-block limit;
       //stay in current kernel
       local_q.concatenate(next_wf, prefix_q, threadId);
@@ -256,7 +281,8 @@ BFS_in_GPU_kernel(tiled_index<1>& tidx,
       }
     }
     else{
-      //the new frontier outgrows one-block limit; terminate current kernel
+      //the new frontier outgrows one-block limit, or the local queues or
+      //the spill buffer; terminate current kernel
       local_q.concatenate(q2, prefix_q, threadId);
       return;
     }
@@ -278,6 +304,7 @@ BFS_in_GPU_kernel(tiled_index<1>& tidx,
 //                the k value may need to be adjusted when this kernel returns.
 //\param global_kt: the total number of global synchronizations,
 //                   or the number of times to call "start_global_barrier"
+//\param spill, spill_count, next_edges: as for "BFS_in_GPU_kernel"
 //--------------------------------------------------------------
 void
 BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
@@ -294,7 +321,9 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
                            array_view<int>& switch_k,
                            array_view<int>& max_nodes_per_block,
                            array_view<int>& global_kt,
-                           array_view<int>& overflow,
+                           array_view<int>& spill,
+                           array_view<int>& spill_count,
+                           array_view<int>& next_edges,
                            array_view<int>& count,
                            array_view<int>& no_of_nodes_vol,
                            array_view<int>& stay_vol) [[hc]]
@@ -304,6 +333,7 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
    tile_static int shift;
    tile_static int no_of_nodes_sm;
    tile_static int odd_time;// the odd level of propagation within current kernel
+   tile_static int edges_sm;// out-edges of this block's share of the new frontier
    int threadId = tidx.local[0];
    int blockId = tidx.tile[0];
    if(threadId == 0){
@@ -316,8 +346,10 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
      if(threadId < NUM_BIN){
        local_q.reset(threadId, tidx.tile_dim[0]);
      }
-     if(threadId == 0)
+     if(threadId == 0){
        no_of_nodes_sm = no_of_nodes_vol[0];
+       edges_sm = 0;
+     }
      tidx.barrier.wait();
 
      int tid = blockId*MAX_THREADS_PER_BLOCK + threadId;
@@ -333,7 +365,7 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
        // Visit a node from the current frontier; update costs, colors, and
        // output queue
        visit_node(pid, threadId & MOD_OP, local_q, g_graph_nodes, g_graph_edges,
-               overflow, g_color, g_cost, gray_shade);
+               spill, spill_count, edges_sm, g_color, g_cost, gray_shade);
      }
      tidx.barrier.wait();
 
@@ -341,13 +373,14 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
      if(threadId == 0){
        int tot_sum = local_q.size_prefix_sum(prefix_q);
        shift = atomic_fetch_add(&tail[0], tot_sum);
+       atomic_fetch_add(&next_edges[0], edges_sm);
      }
      tidx.barrier.wait();
 
      // Copy to the current output queue in global memory
      int q_i = threadId & MOD_OP;
      int local_shift = threadId >> EXP;
-     while (local_shift < local_q.tail[q_i]) {
+     while (local_shift < local_q.size(q_i)) {
          if (odd_time)
              q2[shift+prefix_q[q_i]+local_shift] = local_q.elems[q_i][local_shift];
          else
@@ -367,10 +400,12 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
      start_global_barrier(kt+1, &count[0], tidx);
      if(blockId == 0 && threadId == 0){
        stay_vol[0] = 0;
-       if(tail[0]< NUM_SM*MAX_THREADS_PER_BLOCK && tail[0] > MAX_THREADS_PER_BLOCK){
+       if(tail[0]< NUM_SM*MAX_THREADS_PER_BLOCK && tail[0] > MAX_THREADS_PER_BLOCK &&
+          spill_count[0] == 0 && next_edges[0] <= spill.get_extent()[0]){
          stay_vol[0] = 1;
          no_of_nodes_vol[0] = tail[0];
          tail[0] = 0;
+         next_edges[0] = 0;
        }
      }
      start_global_barrier(kt+2, &count[0], tidx);
@@ -400,6 +435,8 @@ BFS_kernel_multi_blk_inGPU(tiled_index<1>& tidx,
   \param tail: pointer to the location of the tail of the new frontier. *tail is the size of the new frontier
   \param gray_shade: the shade of the gray in current BFS propagation. See GRAY0, GRAY1 macro definitions for more details
   \param k: the level of current propagation in the BFS tree. k= 0 for the first propagation.
+  \param spill: the nodes that overflowed the local queues, counted in spill_count
+  \param next_edges: the out-edges of the new frontier
  ***********************************************************************/
 void
 BFS_kernel(tiled_index<1>& tidx,
@@ -413,18 +450,23 @@ BFS_kernel(tiled_index<1>& tidx,
            array_view<int>& tail,
            int gray_shade,
            int k,
-           array_view<int>& overflow) [[hc]]
+           array_view<int>& spill,
+           array_view<int>& spill_count,
+           array_view<int>& next_edges) [[hc]]
 {
   tile_static LocalQueues local_q;
   tile_static int prefix_q[NUM_BIN];//the number of elementss in the w-queues ahead of
   //current w-queue, a.k.a prefix sum
   tile_static int shift;
+  tile_static int edges_sm;//out-edges of this block's share of the new frontier
 
   int threadId = tidx.local[0];
   int blockId = tidx.tile[0];
   if(threadId < NUM_BIN){
     local_q.reset(threadId, tidx.tile_dim[0]);
   }
+  if(threadId == 0)
+    edges_sm = 0;
   tidx.barrier.wait();
 
   //first, propagate and add the new frontier elements into w-queues
@@ -434,7 +476,7 @@ BFS_kernel(tiled_index<1>& tidx,
     // Visit a node from the current frontier; update costs, colors, and
     // output queue
     visit_node(q1[tid], threadId & MOD_OP, local_q, g_graph_nodes, g_graph_edges,
-            overflow, g_color, g_cost, gray_shade);
+            spill, spill_count, edges_sm, g_color, g_cost, gray_shade);
   }
   tidx.barrier.wait();
 
@@ -445,6 +487,7 @@ BFS_kernel(tiled_index<1>& tidx,
     //the offset or "shift" of the block-level queue within the
     //grid-level queue is determined by atomic operation
     shift = atomic_fetch_add(&tail[0],tot_sum);
+    atomic_fetch_add(&next_edges[0], edges_sm);
   }
   tidx.barrier.wait();
 
@@ -29,7 +29,16 @@
 #include <string.h>
 #include <math.h>
 #include <parboil.h>
+#include <pb_io.h>
+#include <pb_verify.h>
+#include <pb_memory.h>
+#include <limits.h>
+#include <algorithm>
 #include <deque>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <hc.hpp>
 #include "config.h"
@@ -47,9 +56,176 @@ struct Edge {
 using namespace hc;
 
 #include "kernel.hpp"
+#include "bfs_cpu.hpp"
+#include "bfs_hybrid.hpp"
 const int h_top = 1;
 const int zero = 0;
 
+// Threads that expand a CSR graph: PARBOIL_IO_THREADS, else the worker
+// count of the host runtime
+static int io_threads()
+{
+  const char *s = getenv("PARBOIL_IO_THREADS");
+  if (!s || !*s)
+    s = getenv("HC_HOST_THREADS");
+  long n = (s && *s) ? atol(s) : (long)std::thread::hardware_concurrency();
+  return n < 1 ? 1 : (int)n;
+}
+
+// Run fn(0) ... fn(n-1) on n threads, fn(0) on the calling one
+template <typename Fn>
+static void parallel_for(int n, Fn fn)
+{
+  std::vector<std::thread> threads;
+  for (int t = 1; t < n; t++)
+    threads.push_back(std::thread(fn, t));
+  fn(0);
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+}
+
+// Load a graph from a container in CSR form (see common/datagen/pbconvert):
+// uint64_t "offsets", int32_t "targets", optional int32_t "weights", which
+// default to 1, and "source".  The mapped arrays are expanded into the
+// node and edge records of the kernels on all threads.
+static bool
+read_csr(struct pb_Container *graph, Node **nodes, Edge **edges,
+         int *num_of_nodes, int *num_of_edges, int *source)
+{
+  pb_Span<uint64_t> offsets = pb_GetSpan<uint64_t>(graph, "offsets");
+  pb_Span<int32_t> targets = pb_GetSpan<int32_t>(graph, "targets");
+  pb_Span<int32_t> weights = {NULL, 0};
+  pb_Span<int32_t> src = pb_GetSpan<int32_t>(graph, "source");
+  if (pb_ContainerArray(graph, "weights"))
+    weights = pb_GetSpan<int32_t>(graph, "weights");
+  if (!offsets.data || !targets.data || src.size != 1 ||
+      (pb_ContainerArray(graph, "weights") && weights.size != targets.size))
+    return false;
+  if (offsets.size < 1 || offsets[offsets.size - 1] != targets.size) {
+    fprintf(stderr, "The offsets do not cover the %zu edges\n", targets.size);
+    return false;
+  }
+  // Node records hold the first edge as an int
+  if (offsets.size - 1 > INT_MAX || targets.size > INT_MAX) {
+    fprintf(stderr, "The graph has %zu nodes and %zu edges; bfs supports "
+            "up to %d of each\n", offsets.size - 1, targets.size, INT_MAX);
+    return false;
+  }
+
+  int n = offsets.size - 1, m = targets.size;
+  Node *node = (Node *)pb_AllocLarge("bfs nodes", sizeof(Node) * ((size_t)n + 1));
+  Edge *edge = (Edge *)pb_AllocLarge("bfs edges", sizeof(Edge) * ((size_t)m + 1));
+  if (!node || !edge)
+    return false;
+  // The offsets must not decrease, which with the last one equal to m
+  // keeps every edge range inside the targets, and targets must be nodes
+  int threads = io_threads();
+  std::vector<char> bad(threads, 0);
+  char *badThread = bad.data();
+  parallel_for(threads, [=](int t) {
+    for (long v = (long)n * t / threads; v < (long)n * (t + 1) / threads; v++) {
+      if (offsets[v] > offsets[v + 1])
+        badThread[t] = 1;
+      node[v].x = offsets[v];
+      node[v].y = offsets[v + 1] - offsets[v];
+    }
+    for (long i = (long)m * t / threads; i < (long)m * (t + 1) / threads; i++) {
+      if (targets[i] < 0 || targets[i] >= n)
+        badThread[t] = 1;
+      edge[i].x = targets[i];
+      edge[i].y = weights.data ? weights[i] : 1;
+    }
+  });
+  if (std::count(bad.begin(), bad.end(), 1) || src[0] < 0 || src[0] >= n) {
+    fprintf(stderr, "The CSR arrays of the graph are inconsistent\n");
+    pb_FreeLarge(node);
+    pb_FreeLarge(edge);
+    return false;
+  }
+  *nodes = node;
+  *edges = edge;
+  *num_of_nodes = n;
+  *num_of_edges = m;
+  *source = src[0];
+  return true;
+}
+
+// Read a cost file in the format written by main, for verification
+static bool
+read_costs(const char *file, int num_of_nodes, std::vector<int> &cost)
+{
+  FILE *f = fopen(file, "r");
+  int n, id;
+  if (!f || fscanf(f, "%d", &n) != 1 || n != num_of_nodes) {
+    fprintf(stderr, "Expecting the costs of %d nodes in %s\n",
+            num_of_nodes, file);
+    if (f)
+      fclose(f);
+    return false;
+  }
+  cost.resize(n);
+  for (int i = 0; i < n; i++) {
+    if (fscanf(f, "%d %d", &id, &cost[i]) != 2 || id != i) {
+      fprintf(stderr, "%s is truncated\n", file);
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Shortest-path costs from the source on the CPU, for verification.  Edge
+// costs are nonnegative, so Dijkstra's algorithm finds the fixed point the
+// kernels relax towards.
+static void
+cpu_costs(const Node *nodes, const Edge *edges, int num_of_nodes,
+          int source, std::vector<int> &cost)
+{
+  typedef std::pair<int, int> Entry;	// (cost, node)
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+
+  cost.assign(num_of_nodes, INF);
+  cost[source] = 0;
+  heap.push(Entry(0, source));
+  while (!heap.empty()) {
+    Entry e = heap.top();
+    heap.pop();
+    if (e.first > cost[e.second])
+      continue;
+    const Node &node = nodes[e.second];
+    for (int i = node.x; i < node.x + node.y; i++) {
+      int c = e.first + edges[i].y;
+      if (c < cost[edges[i].x]) {
+        cost[edges[i].x] = c;
+        heap.push(Entry(c, edges[i].x));
+      }
+    }
+  }
+}
+
+// Check the costs against the reference file (-v) and the CPU (-V).
+// Returns 0 if every check passes.
+static int
+verify(struct pb_Parameters *params, const int *h_cost, const Node *nodes,
+       const Edge *edges, int num_of_nodes, int source)
+{
+  std::vector<int> ref;
+  int status = 0;
+
+  if (params->refFile) {
+    if (!read_costs(params->refFile, num_of_nodes, ref) ||
+        pb_CompareInts("cost", h_cost, ref.data(), num_of_nodes))
+      status = -1;
+  }
+  if (params->verifyGold) {
+    cpu_costs(nodes, edges, num_of_nodes, source, ref);
+    if (pb_CompareInts("cost (CPU)", h_cost, ref.data(), num_of_nodes))
+      status = -1;
+  }
+  return status;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Main Program
 ////////////////////////////////////////////////////////////////////////////////
@@ -71,42 +247,77 @@ int main(int argc, char** argv)
   }
 
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
-  //Read in Graph from a file
-  fp = fopen(params->inpFiles[0],"r");
-  if(!fp)
+  Node* h_graph_nodes;
+  Edge* h_graph_edges;
+  int source;
+  struct pb_Container *graph = NULL;
+  bool csr = false;
+  if (pb_IsContainerFile(params->inpFiles[0]))
   {
-    printf("Error Reading graph file\n");
-    return 0;
+    //Map the graph in place from a container file
+    graph = pb_OpenContainer(params->inpFiles[0], 0);
+    if (!graph)
+      exit(-1);
+    csr = pb_ContainerArray(graph, "offsets") != NULL;
   }
-  int source;
-
-  fscanf(fp,"%d",&num_of_nodes);
-  // allocate host memory
-  Node* h_graph_nodes = (Node*) malloc(sizeof(Node)*num_of_nodes);
-  int *color = (int*) malloc(sizeof(int)*num_of_nodes);
-  int start, edgeno;
-  // initalize the memory
-  for( unsigned int i = 0; i < num_of_nodes; i++)
+  if (csr)
   {
-    fscanf(fp,"%d %d",&start,&edgeno);
-    h_graph_nodes[i].x = start;
-    h_graph_nodes[i].y = edgeno;
-    color[i]=WHITE;
+    //Expand a CSR graph into node and edge records
+    if (!read_csr(graph, &h_graph_nodes, &h_graph_edges, &num_of_nodes,
+                  &num_of_edges, &source))
+      exit(-1);
   }
-  //read the source node from the file
-  fscanf(fp,"%d",&source);
-  fscanf(fp,"%d",&num_of_edges);
-  int id,cost;
-  Edge* h_graph_edges = (Edge*) malloc(sizeof(Edge)*num_of_edges);
-  for(int i=0; i < num_of_edges ; i++)
+  else if (graph)
   {
-    fscanf(fp,"%d",&id);
-    fscanf(fp,"%d",&cost);
-    h_graph_edges[i].x = id;
-    h_graph_edges[i].y = cost;
+    pb_Span<Node> nodes = pb_GetSpan<Node>(graph, "nodes");
+    pb_Span<Edge> edges = pb_GetSpan<Edge>(graph, "edges");
+    pb_Span<int32_t> src = pb_GetSpan<int32_t>(graph, "source");
+    if (!nodes.data || !edges.data || src.size != 1)
+      exit(-1);
+    num_of_nodes = nodes.size;
+    h_graph_nodes = nodes.data;
+    num_of_edges = edges.size;
+    h_graph_edges = edges.data;
+    source = src[0];
   }
-  if(fp)
-    fclose(fp);
+  else
+  {
+    //Read in Graph from a file
+    fp = fopen(params->inpFiles[0],"r");
+    if(!fp)
+    {
+      printf("Error Reading graph file\n");
+      return 0;
+    }
+    fscanf(fp,"%d",&num_of_nodes);
+    // allocate host memory
+    h_graph_nodes = (Node*) malloc(sizeof(Node)*num_of_nodes);
+    int start, edgeno;
+    // initalize the memory
+    for( unsigned int i = 0; i < num_of_nodes; i++)
+    {
+      fscanf(fp,"%d %d",&start,&edgeno);
+      h_graph_nodes[i].x = start;
+      h_graph_nodes[i].y = edgeno;
+    }
+    //read the source node from the file
+    fscanf(fp,"%d",&source);
+    fscanf(fp,"%d",&num_of_edges);
+    int id,cost;
+    h_graph_edges = (Edge*) malloc(sizeof(Edge)*num_of_edges);
+    for(int i=0; i < num_of_edges ; i++)
+    {
+      fscanf(fp,"%d",&id);
+      fscanf(fp,"%d",&cost);
+      h_graph_edges[i].x = id;
+      h_graph_edges[i].y = cost;
+    }
+    if(fp)
+      fclose(fp);
+  }
+  int *color = (int*) malloc(sizeof(int)*num_of_nodes);
+  for( unsigned int i = 0; i < num_of_nodes; i++)
+    color[i]=WHITE;
 
   // allocate mem for the result on host side
   int* h_cost = (int*) malloc( sizeof(int)*num_of_nodes);
@@ -156,19 +367,52 @@ int main(int argc, char** argv)
   array_view<int> global_kt_d(1);
   global_kt_d[0] = zero;
 
-  int h_overflow = 0;
-  array_view<int> d_overflow(1);
-  d_overflow[0] = h_overflow;
+  //Nodes that overflow the local queues spill to d_spill, which holds as
+  //many as the frontier has out-edges, and join the frontier after the
+  //kernel
+  array_view<int> d_spill(std::max(h_graph_nodes[source].y, 1));
+  array_view<int> spill_count(1);
+  array_view<int> next_edges(1);
+  spill_count[0] = 0;
+  int spill_launches = 0, launches = 0;
+  long long spilled = 0;
   array_view<int> count(1);
   array_view<int> no_of_nodes_val(1);
   array_view<int> stay_vol(1);
   count[0] = 0;
   no_of_nodes_val[0] = 0;
   stay_vol[0] = 0;
-  do
+
+  //Direction-optimizing traversal or the host engine instead of the queue
+  //kernels
+  bool hybrid = bfsHybrid(), cpu = false;
+  int unit = hybrid ? uniformEdgeCost(h_graph_edges, num_of_edges) : 0;
+  if (unit < 0) {
+    printf("Edge costs differ, which the direction-optimizing BFS cannot "
+           "follow; ignoring BFS_DIRECTION=hybrid\n");
+    hybrid = false;
+  }
+#ifdef HC_HOST_BACKEND
+  cpu = !hybrid && bfsCpuEngine();
+#endif
+  if (cpu)
+    cpuBfs(h_graph_nodes, h_graph_edges, num_of_nodes, source, h_cost, color);
+  if (hybrid) {
+    bfs_direction_stats stats;
+    hybridBfs(h_graph_nodes, h_graph_edges, num_of_nodes, num_of_edges, unit,
+              source, h_cost, &timers, &stats);
+    printf("Direction-optimizing BFS: %d levels, %d bottom-up, "
+           "%lld edges examined of %lld top-down (%.1fx fewer)\n",
+           stats.levels, stats.bottomUpLevels, stats.edgesExamined,
+           stats.edgesTopDown,
+           stats.edgesTopDown / (double)std::max(stats.edgesExamined, 1LL));
+  }
+
+  while (!hybrid && !cpu)
   {
     num_t = tail[0];
     tail[0] = zero;
+    next_edges[0] = zero;
 
     if(num_t == 0){//frontier is empty
       break;
@@ -185,7 +429,7 @@ int main(int argc, char** argv)
     }
     if(num_of_blocks == 1)//will call "BFS_in_GPU_kernel"
       num_of_threads_per_block = MAX_THREADS_PER_BLOCK;
-    if(num_of_blocks >1 && num_of_blocks <= NUM_SM)// will call "BFS_kernel_multi_blk_inGPU"
+    if(GLOBAL_BARRIER && num_of_blocks >1 && num_of_blocks <= NUM_SM)// will call "BFS_kernel_multi_blk_inGPU"
       num_of_blocks = NUM_SM;
 
     //assume "num_of_blocks" can not be very large
@@ -197,16 +441,17 @@ int main(int argc, char** argv)
         parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                 {
                     BFS_in_GPU_kernel(tidx, d_q1,d_q2, d_graph_nodes,
-                    d_graph_edges, d_color, d_cost,num_t , tail,GRAY0,k,d_overflow);
+                    d_graph_edges, d_color, d_cost,num_t , tail,GRAY0,k,d_spill,spill_count,next_edges);
                 });
       }
-      else if(num_of_blocks <= NUM_SM){
+      else if(GLOBAL_BARRIER && num_of_blocks <= NUM_SM){
           num_td[0] = num_t;
               parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                       {
                       BFS_kernel_multi_blk_inGPU (tidx, d_q1,d_q2, d_graph_nodes,
                           d_graph_edges, d_color, d_cost, num_td, tail,GRAY0,k,
-                          switch_kd, max_nodes_per_block_d, global_kt_d,d_overflow,
+                          switch_kd, max_nodes_per_block_d, global_kt_d,
+                          d_spill, spill_count, next_edges,
                           count, no_of_nodes_val, stay_vol);
                       });
           switch_k = switch_kd[0];
@@ -218,7 +463,7 @@ int main(int argc, char** argv)
           parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                   {
                   BFS_kernel(tidx, d_q1,d_q2, d_graph_nodes,
-                      d_graph_edges, d_color, d_cost, num_t, tail,GRAY0,k,d_overflow);
+                      d_graph_edges, d_color, d_cost, num_t, tail,GRAY0,k,d_spill,spill_count,next_edges);
                   });
       }
     }
@@ -227,16 +472,17 @@ int main(int argc, char** argv)
           parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                   {
                   BFS_in_GPU_kernel(tidx, d_q2,d_q1, d_graph_nodes,
-                      d_graph_edges, d_color, d_cost, num_t, tail,GRAY1,k,d_overflow);
+                      d_graph_edges, d_color, d_cost, num_t, tail,GRAY1,k,d_spill,spill_count,next_edges);
                   });
       }
-      else if(num_of_blocks <= NUM_SM){
+      else if(GLOBAL_BARRIER && num_of_blocks <= NUM_SM){
           num_td[0] = num_t;
           parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                   {
                   BFS_kernel_multi_blk_inGPU(tidx, d_q2,d_q1, d_graph_nodes,
                       d_graph_edges, d_color, d_cost, num_td, tail,GRAY1,k,
-                      switch_kd, max_nodes_per_block_d, global_kt_d,d_overflow,
+                      switch_kd, max_nodes_per_block_d, global_kt_d,
+                      d_spill, spill_count, next_edges,
                       count, no_of_nodes_val, stay_vol);
                   });
           switch_k = switch_kd[0];
@@ -248,35 +494,66 @@ int main(int argc, char** argv)
           parallel_for_each(tile, [&] (tiled_index<1> tidx) [[hc]]
                   {
                   BFS_kernel(tidx, d_q2,d_q1, d_graph_nodes,
-                      d_graph_edges, d_color, d_cost, num_t, tail, GRAY1,k,d_overflow);
+                      d_graph_edges, d_color, d_cost, num_t, tail, GRAY1,k,d_spill,spill_count,next_edges);
                   });
       }
     }
     k++;
-    h_overflow = d_overflow[0];
-    if(h_overflow) {
-      printf("Error: local queue was overflown. Need to increase W_LOCAL_QUEUE\n");
-      return 0;
+    launches++;
+
+    //Put the spilled nodes behind the ones of the local queues, in the
+    //queue of the next launch
+    int h_spill = spill_count[0];
+    if(h_spill) {
+      array_view<int> &q = k%2 == 0 ? d_q1 : d_q2;
+      int base = tail[0];
+      parallel_for_each(extent<1>(h_spill), [&] (index<1> i) [[hc]]
+              {
+              q[base + i[0]] = d_spill[i];
+              });
+      tail[0] = base + h_spill;
+      spill_count[0] = 0;
+      spill_launches++;
+      spilled += h_spill;
     }
-  } while(1);
+    //The next level cannot spill more nodes than its frontier has edges
+    if(next_edges[0] > d_spill.get_extent()[0])
+      d_spill = array_view<int>(next_edges[0]);
+  }
   pb_SwitchToTimer(&timers, pb_TimerID_COPY);
   printf("GPU kernel done\n");
+  if (!hybrid && !cpu)
+    printf("Local queue spills: %lld nodes in %d of %d launches, "
+           "spill buffer of %d nodes\n", spilled, spill_launches, launches,
+           d_spill.get_extent()[0]);
 
   // copy result from device to host
   d_cost.synchronize();
   d_color.synchronize();
 
+  pb_SwitchToTimer(&timers, pb_TimerID_NONE);
+  int status = verify(params, h_cost, h_graph_nodes, h_graph_edges,
+                      num_of_nodes, source);
+
   //Store the result into a file
-  pb_SwitchToTimer(&timers, pb_TimerID_IO);
-  FILE *fp = fopen(params->outFile,"w");
-  fprintf(fp, "%d\n", num_of_nodes);
-  for(int i=0;i<num_of_nodes;i++)
-    fprintf(fp,"%d %d\n",i,h_cost[i]);
-  fclose(fp);
+  if (params->outFile) {
+    pb_SwitchToTimer(&timers, pb_TimerID_IO);
+    FILE *fp = fopen(params->outFile,"w");
+    fprintf(fp, "%d\n", num_of_nodes);
+    for(int i=0;i<num_of_nodes;i++)
+      fprintf(fp,"%d %d\n",i,h_cost[i]);
+    fclose(fp);
+  }
 
   // cleanup memory
+  if (csr) {
+    pb_FreeLarge(h_graph_nodes);
+    pb_FreeLarge(h_graph_edges);
+  }
+  if (graph)
+    pb_CloseContainer(graph);
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
   pb_PrintTimerSet(&timers);
   pb_FreeParameters(params);
-  return 0;
+  return status;
 }
@@ -21,7 +21,12 @@
 #include <string.h>
 #include <math.h>
 #include <parboil.h>
+#include <pb_io.h>
+#include <pb_verify.h>
 #include <deque>
+#include <functional>
+#include <queue>
+#include <vector>
 #include <iostream>
 #include <hc.hpp>
 
@@ -43,6 +48,82 @@ using namespace hc;
 const int h_top = 1;
 const int zero = 0;
 
+// Read a cost file in the format written by main, for verification
+static bool
+read_costs(const char *file, int num_of_nodes, std::vector<int> &cost)
+{
+  FILE *f = fopen(file, "r");
+  int n, id;
+  if (!f || fscanf(f, "%d", &n) != 1 || n != num_of_nodes) {
+    fprintf(stderr, "Expecting the costs of %d nodes in %s\n",
+            num_of_nodes, file);
+    if (f)
+      fclose(f);
+    return false;
+  }
+  cost.resize(n);
+  for (int i = 0; i < n; i++) {
+    if (fscanf(f, "%d %d", &id, &cost[i]) != 2 || id != i) {
+      fprintf(stderr, "%s is truncated\n", file);
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Shortest-path costs from the source on the CPU, for verification.  Edge
+// costs are nonnegative, so Dijkstra's algorithm finds the fixed point the
+// kernels relax towards.
+static void
+cpu_costs(const Node *nodes, const Edge *edges, int num_of_nodes,
+          int source, std::vector<int> &cost)
+{
+  typedef std::pair<int, int> Entry;	// (cost, node)
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+
+  cost.assign(num_of_nodes, INF);
+  cost[source] = 0;
+  heap.push(Entry(0, source));
+  while (!heap.empty()) {
+    Entry e = heap.top();
+    heap.pop();
+    if (e.first > cost[e.second])
+      continue;
+    const Node &node = nodes[e.second];
+    for (int i = node.x; i < node.x + node.y; i++) {
+      int c = e.first + edges[i].y;
+      if (c < cost[edges[i].x]) {
+        cost[edges[i].x] = c;
+        heap.push(Entry(c, edges[i].x));
+      }
+    }
+  }
+}
+
+// Check the costs against the reference file (-v) and the CPU (-V).
+// Returns 0 if every check passes.
+static int
+verify(struct pb_Parameters *params, const int *h_cost, const Node *nodes,
+       const Edge *edges, int num_of_nodes, int source)
+{
+  std::vector<int> ref;
+  int status = 0;
+
+  if (params->refFile) {
+    if (!read_costs(params->refFile, num_of_nodes, ref) ||
+        pb_CompareInts("cost", h_cost, ref.data(), num_of_nodes))
+      status = -1;
+  }
+  if (params->verifyGold) {
+    cpu_costs(nodes, edges, num_of_nodes, source, ref);
+    if (pb_CompareInts("cost (CPU)", h_cost, ref.data(), num_of_nodes))
+      status = -1;
+  }
+  return status;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Main Program
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,42 +146,65 @@ int main(int argc, char** argv)
 
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
   //printf("Reading File\n");
-  //Read in Graph from a file
-  fp = fopen(params->inpFiles[0],"r");
-  if(!fp)
-  {
-    printf("Error Reading graph file\n");
-    return 0;
-  }
+  Node* h_graph_nodes;
+  Edge* h_graph_edges;
   int source;
-
-  fscanf(fp,"%d",&num_of_nodes);
-  // allocate host memory
-  Node* h_graph_nodes = (Node*) malloc(sizeof(Node)*num_of_nodes);
-  int *color = (int*) malloc(sizeof(int)*num_of_nodes);
-  int start, edgeno;
-  // initalize the memory
-  for( unsigned int i = 0; i < num_of_nodes; i++)
+  struct pb_Container *graph = NULL;
+  if (pb_IsContainerFile(params->inpFiles[0]))
   {
-    fscanf(fp,"%d %d",&start,&edgeno);
-    h_graph_nodes[i].x = start;
-    h_graph_nodes[i].y = edgeno;
-    color[i]=WHITE;
+    //Map the graph in place from a container file
+    graph = pb_OpenContainer(params->inpFiles[0], 0);
+    if (!graph)
+      exit(-1);
+    pb_Span<Node> nodes = pb_GetSpan<Node>(graph, "nodes");
+    pb_Span<Edge> edges = pb_GetSpan<Edge>(graph, "edges");
+    pb_Span<int32_t> src = pb_GetSpan<int32_t>(graph, "source");
+    if (!nodes.data || !edges.data || src.size != 1)
+      exit(-1);
+    num_of_nodes = nodes.size;
+    h_graph_nodes = nodes.data;
+    num_of_edges = edges.size;
+    h_graph_edges = edges.data;
+    source = src[0];
   }
-  //read the source node from the file
-  fscanf(fp,"%d",&source);
-  fscanf(fp,"%d",&num_of_edges);
-  int id,cost;
-  Edge* h_graph_edges = (Edge*) malloc(sizeof(Edge)*num_of_edges);
-  for(int i=0; i < num_of_edges ; i++)
+  else
   {
-    fscanf(fp,"%d",&id);
-    fscanf(fp,"%d",&cost);
-    h_graph_edges[i].x = id;
-    h_graph_edges[i].y = cost;
+    //Read in Graph from a file
+    fp = fopen(params->inpFiles[0],"r");
+    if(!fp)
+    {
+      printf("Error Reading graph file\n");
+      return 0;
+    }
+    fscanf(fp,"%d",&num_of_nodes);
+    // allocate host memory
+    h_graph_nodes = (Node*) malloc(sizeof(Node)*num_of_nodes);
+    int start, edgeno;
+    // initalize the memory
+    for( unsigned int i = 0; i < num_of_nodes; i++)
+    {
+      fscanf(fp,"%d %d",&start,&edgeno);
+      h_graph_nodes[i].x = start;
+      h_graph_nodes[i].y = edgeno;
+    }
+    //read the source node from the file
+    fscanf(fp,"%d",&source);
+    fscanf(fp,"%d",&num_of_edges);
+    int id,cost;
+    h_graph_edges = (Edge*) malloc(sizeof(Edge)*num_of_edges);
+    for(int i=0; i < num_of_edges ; i++)
+    {
+      fscanf(fp,"%d",&id);
+      fscanf(fp,"%d",&cost);
+      h_graph_edges[i].x = id;
+      h_graph_edges[i].y = cost;
+    }
+    if(fp)
+      fclose(fp);
   }
-  if(fp)
-    fclose(fp);
+  int *color = (int*) malloc(sizeof(int)*num_of_nodes);
+  for( unsigned int i = 0; i < num_of_nodes; i++)
+    color[i]=WHITE;
 
   // allocate mem for the result on host side
   int* h_cost = (int*) malloc( sizeof(int)*num_of_nodes);
@@ -185,21 +289,31 @@ int main(int argc, char** argv)
   d_cost.synchronize();
   d_color.synchronize();
 
+  pb_SwitchToTimer(&timers, pb_TimerID_NONE);
+  int status = verify(params, h_cost, h_graph_nodes, h_graph_edges,
+                      num_of_nodes, source);
+
   //Store the result into a file
-  pb_SwitchToTimer(&timers, pb_TimerID_IO);
-  FILE *fp = fopen(params->outFile,"w");
-  fprintf(fp, "%d\n", num_of_nodes);
-  for(int i=0;i<num_of_nodes;i++)
-    fprintf(fp,"%d %d\n",i,h_cost[i]);
-  fclose(fp);
+  if (params->outFile) {
+    pb_SwitchToTimer(&timers, pb_TimerID_IO);
+    FILE *fp = fopen(params->outFile,"w");
+    fprintf(fp, "%d\n", num_of_nodes);
+    for(int i=0;i<num_of_nodes;i++)
+      fprintf(fp,"%d %d\n",i,h_cost[i]);
+    fclose(fp);
+  }
 
   // cleanup memory
-  free( h_graph_nodes);
-  free( h_graph_edges);
+  if (graph)
+    pb_CloseContainer(graph);
+  else {
+    free( h_graph_nodes);
+    free( h_graph_edges);
+  }
   free( color);
   free( h_cost);
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
   pb_PrintTimerSet(&timers);
   pb_FreeParameters(params);
-  return 0;
+  return status;
 }
@@ -15,6 +15,7 @@
 #include "atom.h"
 #include "cutoff.h"
 #include "parboil.h"
+#include "pb_memory.h"
 
 using namespace hc;
 
@@ -109,6 +110,8 @@ static void hcc_cutoff_potential_lattice(
     float cutoff2,          /* square of cutoff distance */
     float inv_cutoff2,
     const array_view<float>& regionZeroAddr,/* address of lattice regions starting at origin */
+    int xRegionDim,         /* number of lattice regions along x */
+    int yRegionDim,         /* number of lattice regions along y */
     int zRegionIndex,
     const array_view<const int3>& NbrList
     ) [[hc]]
@@ -117,8 +120,7 @@ static void hcc_cutoff_potential_lattice(
   tile_static int3 myBinIndex;
 
   int tz = tidx.local[2], ty = tidx.local[1], tx = tidx.local[0];
-  int bz = tidx.tile[2], by = tidx.tile[1], bx = tidx.tile[0];
-  int gz = tidx.tile_dim[2], gy = tidx.tile_dim[1], gx = tidx.tile_dim[0];
+  int by = tidx.tile[1], bx = tidx.tile[0];
 
   //const int xRegionIndex = (bx >> 2);
   //const int yRegionIndex = by;
@@ -203,8 +205,8 @@ static void hcc_cutoff_potential_lattice(
 
   /* store into global memory */
   /* this is the start of the sub-region indexed by tid */
-  int mySubRegionAddr = ((zRegionIndex*gy
-        + by)*(gx>>2) + (bx >> 2))*REGION_SIZE
+  int mySubRegionAddr = ((zRegionIndex*yRegionDim
+        + by)*xRegionDim + (bx >> 2))*REGION_SIZE
         + (bx&3)*SUB_REGION_SIZE;
   regionZeroAddr[mySubRegionAddr + tid] = energy;
 }
@@ -281,7 +283,9 @@ extern "C" int gpu_compute_cutoff_potential_lattice(
   binDim.y = (int) ceil(lny * h * BIN_INVLEN) + 2*c;
   binDim.z = (int) ceil(lnz * h * BIN_INVLEN) + 2*c;
   nbins = binDim.x * binDim.y * binDim.z;
-  binBaseAddr = (float4 *) calloc(nbins * BIN_DEPTH, sizeof(float4));
+  binBaseAddr = (float4 *) pb_AllocLarge("cutcp atom bins",
+      nbins * BIN_DEPTH * sizeof(float4));
+  if (binBaseAddr == NULL) return -1;
   binZeroAddr = binBaseAddr + ((c * binDim.y + c) * binDim.x + c) * BIN_DEPTH;
 
   bincntBaseAddr = (int *) calloc(nbins, sizeof(int));
@@ -484,14 +488,41 @@ extern "C" int gpu_compute_cutoff_potential_lattice(
   g.z = 1 * b.z;
   tiled_extent<3> text = extent<3>(g.x, g.y, g.z).tile(b.x, b.y, b.z);
 
+  /* work of each region plane, for the roofline report: every tile reads
+   * the neighbor list and the atom bins it names and writes its sub-region,
+   * and every lattice point tests each binned atom of those bins, which
+   * takes 8 flops; the 7 more flops for atoms within the cutoff are not
+   * counted, so the flop figure is a lower bound.  Not part of the
+   * benchmark, so no timer runs meanwhile */
+  pb_SwitchToTimer(timers, pb_TimerID_NONE);
+  double plane_bytes = 4.0 * xRegionDim * yRegionDim *
+    (nbrlistlen * (BIN_SIZE * sizeof(float) + sizeof(int3)) +
+     SUB_REGION_SIZE * sizeof(float));
+  std::vector<double> plane_flops(zRegionDim);
+  for (zRegionIndex = 0;  zRegionIndex < zRegionDim;  zRegionIndex++) {
+    double atoms_tested = 0;
+    for (j = 0;  j < yRegionDim;  j++) {
+      for (i = 0;  i < xRegionDim;  i++) {
+        /* same bin as myBinIndex in the kernel */
+        int bx = (int) floorf((8 * i + 4) * h * BIN_INVLEN);
+        int by = (int) floorf((8 * j + 4) * h * BIN_INVLEN);
+        int bz = (int) floorf((8 * zRegionIndex + 4) * h * BIN_INVLEN);
+        for (n = 0;  n < nbrlistlen;  n++) {
+          atoms_tested += bincntZeroAddr[((bz + nbrlist[n].z) * binDim.y
+              + by + nbrlist[n].y) * binDim.x + bx + nbrlist[n].x];
+        }
+      }
+    }
+    plane_flops[zRegionIndex] = 8.0 * REGION_SIZE * atoms_tested;
+  }
+
   /* allocate and initialize memory on HCC device */
   pb_SwitchToTimer(timers, pb_TimerID_COPY);
   if (verbose) {
     printf("Allocating %.2fMB on HCC device for potentials\n",
            lnall * sizeof(float) / (double) (1024*1024));
   }
-  std::vector<float> l(lnall);
-  array_view<float> regionZeroHcc(lnall, l);
+  array_view<float> regionZeroHcc(lnall, regionZeroAddr);
   if (verbose) {
     printf("Allocating %.2fMB on HCC device for atom bins\n",
            nbins * BIN_DEPTH * sizeof(float4) / (double) (1024*1024));
@@ -511,9 +542,12 @@ extern "C" int gpu_compute_cutoff_potential_lattice(
     fflush(stdout);
     parallel_for_each(text, [=] (tiled_index<3> tidx) [[hc]] {
             hcc_cutoff_potential_lattice(tidx, binDim.x, binDim.y, binZeroHcc, h,
-                cutoff2, inv_cutoff2, regionZeroHcc, zRegionIndex, NbrList);
+                cutoff2, inv_cutoff2, regionZeroHcc, xRegionDim, yRegionDim,
+                zRegionIndex, NbrList);
             }
             ).wait();
+    pb_AddWork(timers, NULL, pb_TimerID_KERNEL, plane_bytes,
+               plane_flops[zRegionIndex]);
   }
   printf("Finished HCC kernel calls                        \n");
 
@@ -560,7 +594,7 @@ extern "C" int gpu_compute_cutoff_potential_lattice(
 
   /* cleanup memory allocations */
   free(regionZeroAddr);
-  free(binBaseAddr);
+  pb_FreeLarge(binBaseAddr);
   free(bincntBaseAddr);
   free_atom(extra);
 
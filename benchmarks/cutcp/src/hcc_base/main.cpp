@@ -12,6 +12,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include "parboil.h"
+#include "pb_verify.h"
 #include "atom.h"
 #include "cutoff.h"
 #include "output.h"
@@ -24,6 +25,21 @@
 #define CUTOFF6OVERLAP       64
 #define CUTOFFCPU         16384
 
+/* The sum of the absolute values of all lattice potentials */
+static float
+lattice_abspotential(Lattice *lattice)
+{
+  float *lattice_data = lattice->lattice;
+  int size = lattice->dim.nx * lattice->dim.ny * lattice->dim.nz;
+  double abspotential = 0.0;
+  int i;
+
+  for (i = 0; i < size; i++)
+    abspotential += fabs((double) lattice_data[i]);
+
+  return (float) abspotential;
+}
+
 void
 write_lattice_summary(const char *filename, Lattice *lattice)
 {
@@ -42,14 +58,7 @@ write_lattice_summary(const char *filename, Lattice *lattice)
 
   /* Write the sum of the the absolute values of all lattice potentials */
   {
-    double abspotential = 0.0;
-    float tmp;
-    int i;
-
-    for (i = 0; i < nx * ny * nz; i++)
-      abspotential += fabs((double) lattice_data[i]);
-
-    tmp = (float) abspotential;
+    float tmp = lattice_abspotential(lattice);
 
     fwrite(&tmp, 1, sizeof(float), outfile);
   }
@@ -76,6 +85,58 @@ write_lattice_summary(const char *filename, Lattice *lattice)
 }
 
 
+/* Compare a lattice with the summary of a reference lattice written by
+ * write_lattice_summary.  Returns 0 if they match. */
+static int
+compare_lattice_summary(const char *filename, Lattice *lattice,
+                        const struct pb_Tolerance *tol)
+{
+  float *lattice_data = lattice->lattice;
+  int nx = lattice->dim.nx;
+  int ny = lattice->dim.ny;
+  int nz = lattice->dim.nz;
+  int plane_size = nx * ny;
+  float abspotential, ref_abspotential;
+  uint32_t ref_plane_size;
+  float *ref_planes;
+  int status = 0;
+
+  FILE *infile = fopen(filename, "r");
+
+  if (infile == NULL) {
+    fprintf(stderr, "Cannot open reference file\n");
+    return -1;
+  }
+  if (fread(&ref_abspotential, sizeof(float), 1, infile) != 1 ||
+      fread(&ref_plane_size, sizeof(uint32_t), 1, infile) != 1 ||
+      ref_plane_size != (uint32_t) plane_size) {
+    fprintf(stderr, "Expecting a summary of a %dx%dx%d lattice in %s\n",
+            nx, ny, nz, filename);
+    fclose(infile);
+    return -1;
+  }
+  ref_planes = (float *) malloc(2 * plane_size * sizeof(float));
+  if (fread(ref_planes, sizeof(float), 2 * plane_size, infile)
+      != (size_t) (2 * plane_size)) {
+    fprintf(stderr, "%s is truncated\n", filename);
+    status = -1;
+  }
+  else {
+    abspotential = lattice_abspotential(lattice);
+    if (pb_CompareFloats("potential sum", &abspotential, &ref_abspotential,
+                         1, tol) ||
+        pb_CompareFloats("plane z=0", lattice_data, ref_planes,
+                         plane_size, tol) ||
+        pb_CompareFloats("plane z=nz-1", lattice_data + (nz-1) * plane_size,
+                         ref_planes + plane_size, plane_size, tol))
+      status = -1;
+  }
+
+  free(ref_planes);
+  fclose(infile);
+  return status;
+}
+
 int appenddata(const char *filename, int size, double time) {
   FILE *fp;
   fp=fopen(filename, "a");
@@ -151,6 +212,7 @@ int main(int argc, char *argv[]) {
   float padding = 0.5f;		/* Bounding box padding distance */
 
   int n;
+  int status = 0;
 
   struct pb_Parameters *parameters;
   struct pb_TimerSet timers;
@@ -216,6 +278,34 @@ int main(int argc, char *argv[]) {
 
   printf("\n");
 
+  /*
+   * Verify against a reference summary and against the CPU implementation.
+   * The kernels sum the same contributions in a different order.
+   */
+  pb_SwitchToTimer(&timers, pb_TimerID_NONE);
+  {
+    struct pb_Tolerance tol = pb_RelativeTolerance(ERRTOL, ERRTOL);
+
+    if (parameters->refFile &&
+        compare_lattice_summary(parameters->refFile, gpu_lattice, &tol))
+      status = -1;
+
+    if (parameters->verifyGold) {
+      Lattice *cpu_lattice = create_lattice(lattice_dim);
+
+      if (cpu_compute_cutoff_potential_lattice(cpu_lattice, cutoff, atom) ||
+          remove_exclusions(cpu_lattice, exclcutoff, atom)) {
+        fprintf(stderr, "Computation failed for cpu lattice\n");
+        exit(1);
+      }
+      if (pb_CompareFloats("lattice (CPU)", gpu_lattice->lattice,
+                           cpu_lattice->lattice, lattice_dim.nx *
+                           lattice_dim.ny * lattice_dim.nz, &tol))
+        status = -1;
+      destroy_lattice(cpu_lattice);
+    }
+  }
+
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
 
   /* Print output */
@@ -232,5 +322,5 @@ int main(int argc, char *argv[]) {
   pb_PrintTimerSet(&timers);
   pb_FreeParameters(parameters);
 
-  return 0;
+  return status;
 }
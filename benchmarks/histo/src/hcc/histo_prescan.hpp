@@ -10,8 +10,8 @@ void histo_prescan_kernel (
     tile_static float Avg[PRESCAN_THREADS];
     tile_static float StdDev[PRESCAN_THREADS];
 
-    int tx = tidx.tile[0];
-    int bx = tidx.local[0];
+    int tx = tidx.local[0];
+    int bx = tidx.tile[0];
     int dx = tidx.tile_dim[0];
 
     int stride = size * dx/N;
@@ -48,24 +48,13 @@ if(tx < stride__){\
     // Add all the averages and standard deviations from all the threads
     // and take their arithmetic average (as a simplified approximation of the
     // real average and standard deviation.
-#if (PRESCAN_THREADS >= 32)
-    for (int stride = PRESCAN_THREADS/2; stride >= 32; stride = stride >> 1){
+    // Tiles do not run in lockstep on every target, so each step of the
+    // reduction is separated by a barrier, down to the last pair.
+    for (int stride = PRESCAN_THREADS/2; stride >= 2; stride = stride >> 1){
         tidx.barrier.wait();
 	SUM(stride);
     }
-#endif
-#if (PRESCAN_THREADS >= 16)
-    SUM(16);
-#endif
-#if (PRESCAN_THREADS >= 8)
-    SUM(8);
-#endif
-#if (PRESCAN_THREADS >= 4)
-    SUM(4);
-#endif
-#if (PRESCAN_THREADS >= 2)
-    SUM(2);
-#endif
+    tidx.barrier.wait();
 
     if (tx == 0){
         float avg = Avg[0]+Avg[1];
@@ -8,6 +8,7 @@
 
 
 #include <parboil.h>
+#include <pb_memory.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -105,7 +106,11 @@ int main(int argc, char* argv[]) {
 
   array_view<unsigned int> input(even_width*(((img_height+UNROLL-1)/UNROLL)*UNROLL));
   array_view<uchar4> sm_mappings(img_width*img_height);
-  array_view<unsigned int> global_subhisto(BLOCK_X*img_width*histo_height);
+  unsigned int* subhisto = (unsigned int*) pb_AllocLarge("histo sub-histograms",
+      BLOCK_X*img_width*histo_height*sizeof(unsigned int));
+  if (subhisto == NULL)
+    return -1;
+  array_view<unsigned int> global_subhisto(BLOCK_X*img_width*histo_height, subhisto);
   array_view<unsigned short> global_histo(img_width*histo_height);
   array_view<unsigned int> global_overflow(img_width*histo_height);
   array_view<unsigned char> final_histo(img_width*histo_height);
@@ -184,6 +189,7 @@ int main(int argc, char* argv[]) {
 
   free(img);
   free(histo);
+  pb_FreeLarge(subhisto);
 
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
@@ -13,10 +13,17 @@
 
 /*############################################################################*/
 
-//Unchangeable settings: volume simulation size for the given example
+//Volume simulation size: 120x120x150 for the given example.  Other
+//obstacle files need a build with -DSIZE_X=... -DSIZE_Y=... -DSIZE_Z=...
+#ifndef SIZE_X
 #define SIZE_X (120)
+#endif
+#ifndef SIZE_Y
 #define SIZE_Y (120)
+#endif
+#ifndef SIZE_Z
 #define SIZE_Z (150)
+#endif
 
 //Changeable settings
 //Padding in each dimension
@@ -15,6 +15,7 @@
 #include <string.h>
 #include <float.h>
 #include <hc.hpp>
+#include <pb_memory.h>
 using namespace hc;
 
 // includes, project
@@ -40,15 +41,13 @@ void HCC_LBM_performStreamCollide( array_view<float>& srcGrid, array_view<float>
 void LBM_allocateGrid( float** ptr ) {
 	const size_t size   = TOTAL_PADDED_CELLS*N_CELL_ENTRIES*sizeof( float );
 
-	*ptr = (float*)malloc( size );
+	*ptr = (float*)pb_AllocLarge( "LBM grid", size );
 	if( ! *ptr ) {
 		printf( "LBM_allocateGrid: could not allocate %.1f MByte\n",
 				size / (1024.0*1024.0) );
 		exit( 1 );
 	}
 
-	memset( *ptr, 0, size );
-
 	printf( "LBM_allocateGrid: allocated %.1f MByte\n",
 			size / (1024.0*1024.0) );
 	
@@ -59,20 +58,24 @@ void LBM_allocateGrid( float** ptr ) {
 
 void HCC_LBM_allocateGrid( array_view<float>** ptr ) {
 	const size_t size = TOTAL_PADDED_CELLS*N_CELL_ENTRIES;
-    *ptr = new array_view<float>(size);
+	float *grid = (float*)pb_AllocLarge( "HCC LBM grid", size*sizeof( float ) );
+	if( ! grid ) exit( 1 );
+    *ptr = new array_view<float>(size, grid);
 }
 
 /*############################################################################*/
 
 void LBM_freeGrid( float** ptr ) {
-	free( *ptr-MARGIN );
+	pb_FreeLarge( *ptr-MARGIN );
 	*ptr = NULL;
 }
 
 /******************************************************************************/
 
 void HCC_LBM_freeGrid(array_view<float>* ptr) {
+    float *grid = ptr->data();
     delete ptr;
+    pb_FreeLarge(grid);
 }
 
 /*############################################################################*/
@@ -173,6 +176,20 @@ void LBM_initializeSpecialCellsForLDC( float* grid ) {
 
 /*############################################################################*/
 
+int LBM_countFluidCells( float* grid ) {
+	int nFluidCells = 0;
+
+	SWEEP_VAR
+
+	SWEEP_START( 0, 0, 0, 0, 0, SIZE_Z )
+	if( ! TEST_FLAG_SWEEP( grid, OBSTACLE )) nFluidCells++;
+	SWEEP_END
+
+	return nFluidCells;
+}
+
+/*############################################################################*/
+
 void LBM_showGridStatistics( float* grid ) {
 	int nObstacleCells = 0,
 	    nAccelCells    = 0,
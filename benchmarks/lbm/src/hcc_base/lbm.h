@@ -19,6 +19,7 @@ void LBM_initializeGrid( float* grid );
 void LBM_initializeSpecialCellsForLDC( float* grid );
 void LBM_loadObstacleFile( float* grid, const char* filename );
 void LBM_swapGrids( array_view<float>** grid1, array_view<float>** grid2 );
+int LBM_countFluidCells( float* grid );
 void LBM_showGridStatistics( float* Grid );
 void LBM_storeVelocityField( float* grid, const char* filename,
                            const BOOL binary );
@@ -24,6 +24,15 @@ using namespace hc;
 
 static array_view<float> *HCC_srcGrid, *HCC_dstGrid;
 
+/* Work of one stream-collide step, for the roofline report.  Each cell
+ * gathers N_DISTR_FUNCS distributions plus its flags and scatters
+ * N_DISTR_FUNCS results; a fluid cell takes 200 flops in
+ * performStreamCollide_kernel, while obstacle cells only swap theirs. */
+#define STEP_BYTES ((double)TOTAL_CELLS*(N_CELL_ENTRIES+N_DISTR_FUNCS)*sizeof(float))
+#define STEP_FLOPS ((double)fluidCells*200)
+
+static int fluidCells;
+
 /*############################################################################*/
 
 struct pb_TimerSet timers;
@@ -47,6 +56,7 @@ int main( int nArgs, char* arg[] ) {
 	for( t = 1; t <= param.nTimeSteps; t++ ) {
                 pb_SwitchToTimer(&timers, pb_TimerID_KERNEL);
 		HCC_LBM_performStreamCollide( *HCC_srcGrid, *HCC_dstGrid );
+                pb_AddWork(&timers, NULL, pb_TimerID_KERNEL, STEP_BYTES, STEP_FLOPS);
                 pb_SwitchToTimer(&timers, pb_TimerID_COMPUTE);
 		LBM_swapGrids( &HCC_srcGrid, &HCC_dstGrid );
 
@@ -92,9 +102,11 @@ void MAIN_parseCommandLine( int nArgs, char* arg[], MAIN_Param* param, struct pb
 		if( fileStat.st_size != SIZE_X*SIZE_Y*SIZE_Z+(SIZE_Y+1)*SIZE_Z ) {
 			printf( "MAIN_parseCommandLine:\n"
 					"\tsize of file '%s' is %i bytes\n"
-					"\texpected size is %i bytes\n",
+					"\texpected size is %i bytes for a %ix%ix%i grid\n"
+					"\t(set SIZE_X, SIZE_Y and SIZE_Z at build time)\n",
 					param->obstacleFilename, (int) fileStat.st_size,
-					SIZE_X*SIZE_Y*SIZE_Z+(SIZE_Y+1)*SIZE_Z );
+					SIZE_X*SIZE_Y*SIZE_Z+(SIZE_Y+1)*SIZE_Z,
+					SIZE_X, SIZE_Y, SIZE_Z );
 			exit( 1 );
 		}
 	}
@@ -141,6 +153,7 @@ void MAIN_initialize( const MAIN_Param* param ) {
 	pb_SwitchToTimer(&timers, pb_TimerID_COMPUTE);
 	LBM_initializeSpecialCellsForLDC( TEMP_srcGrid );
 	LBM_initializeSpecialCellsForLDC( TEMP_dstGrid );
+	fluidCells = LBM_countFluidCells( TEMP_srcGrid );
 	
         pb_SwitchToTimer(&timers, pb_TimerID_COPY);
 	
@@ -12,6 +12,8 @@
 #include <math.h>
 #include <cuda.h>
 #include "parboil.h"
+#include "pb_verify.h"
+#include "pb_memory.h"
 
 #include "UDTypes.h"
 #include "CUDA_interface.h"
@@ -66,14 +68,7 @@ void setParameters(FILE* file, parameters* p){
  * Returns the number of samples read successfully.
  ************************************************************/
 unsigned int readSampleData(parameters params, FILE* uksdata_f, ReconstructionSample* samples){
-  unsigned int i;
-
-  for(i=0; i<params.numSamples; i++){
-    if (feof(uksdata_f)){
-      break;
-    }
-    fread((void*) &(samples[i]), sizeof(ReconstructionSample), 1, uksdata_f);
-  }
+  unsigned int i = fread((void*) samples, sizeof(ReconstructionSample), params.numSamples, uksdata_f);
 
   float kScale[3];
   kScale[0] = float(params.aquisitionMatrixSize[0])/(float(params.reconstructionMatrixSize[0])*float(params.kMax[0]));
@@ -178,8 +173,8 @@ int main (int argc, char* argv[]){
 
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
-  gridData_gold = (cmplx*) calloc (gridNumElems, sizeof(cmplx));
-  sampleDensity_gold = (float*) calloc (gridNumElems, sizeof(float));
+  gridData_gold = (cmplx*) pb_AllocLarge ("gridData_gold", gridNumElems*sizeof(cmplx));
+  sampleDensity_gold = (float*) pb_AllocLarge ("sampleDensity_gold", gridNumElems*sizeof(float));
   if (sampleDensity_gold == NULL || gridData_gold == NULL){
     printf("ERROR: Unable to allocate memory for output data\n");
     exit(1);
@@ -206,19 +201,23 @@ int main (int argc, char* argv[]){
 
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
+  // The GPU accumulates the samples of a grid point in a different order
+  struct pb_Tolerance tol = pb_RelativeTolerance(1e-4, 1e-4);
   int passed=1;
-  for (int i=0; i<gridNumElems; i++){
-    if(sampleDensity[i] != sampleDensity_gold[i]) {
-      passed=0;
-      break;
-    }
-  }
-  //(passed) ? printf("Comparing GPU and Gold results... PASSED\n"):printf("Comparing GPU and Gold results... FAILED\n");
+  if (pb_CompareFloats("sampleDensity", sampleDensity, sampleDensity_gold,
+                       gridNumElems, &tol))
+    passed=0;
+  if (pb_CompareFloats("gridData", (float*) gridData, (float*) gridData_gold,
+                       2*gridNumElems, &tol))
+    passed=0;
 
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
 
   FILE* outfile;
-  if(!(outfile=fopen(prms->outFile,"w")))
+  if(prms->outFile == NULL)
+  {
+        // Nothing to write, the comparison above is the result
+  } else if(!(outfile=fopen(prms->outFile,"w")))
   {
         printf("Cannot open output file!\n");
   } else {
@@ -234,12 +233,12 @@ int main (int argc, char* argv[]){
   cudaFreeHost(samples);
   cudaFreeHost(gridData);
   cudaFreeHost(sampleDensity);
-  free(gridData_gold);
-  free(sampleDensity_gold);
+  pb_FreeLarge(gridData_gold);
+  pb_FreeLarge(sampleDensity_gold);
 
   printf("\n");
   pb_PrintTimerSet(&timers);
   pb_FreeParameters(prms);
 
-  return 0;
+  return passed ? 0 : -1;
 }
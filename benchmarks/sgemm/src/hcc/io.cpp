@@ -13,46 +13,304 @@
 #include<fstream>
 #include<iostream>
 #include<vector>
+#include<algorithm>
+#include<thread>
+#include<charconv>
+#include<string>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<pb_io.h>
 
+// Threads of the text reader and writer: PARBOIL_IO_THREADS, else the
+// worker count of the host runtime
+static int ioThreads()
+{
+  const char *s = getenv("PARBOIL_IO_THREADS");
+  if (!s || !*s)
+    s = getenv("HC_HOST_THREADS");
+  long n = (s && *s) ? atol(s) : (long)std::thread::hardware_concurrency();
+  return n < 1 ? 1 : (int)n;
+}
+
+// Run fn(0) ... fn(n-1) on n threads, fn(0) on the calling one
+template <typename Fn>
+static void parallelFor(int n, Fn fn)
+{
+  std::vector<std::thread> threads;
+  for (int t = 1; t < n; t++)
+    threads.push_back(std::thread(fn, t));
+  fn(0);
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+}
+
+static inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char *skipSpace(const char *p, const char *end)
+{
+  while (p < end && isSpace(*p))
+    p++;
+  return p;
+}
+
+// Parse a number of the text format, which may start with '+' like for
+// operator>>.  Returns the end of the token, or NULL if it is not one.
+template <typename T>
+static const char *parseToken(const char *p, const char *end, T &value)
+{
+  if (p < end && *p == '+' && p + 1 < end && !isSpace(p[1]) && p[1] != '-')
+    p++;
+  std::from_chars_result r = std::from_chars(p, end, value);
+  if (r.ec != std::errc() || (r.ptr < end && !isSpace(*r.ptr)))
+    return NULL;
+  return r.ptr;
+}
+
+// Read a text matrix: the number of rows and columns, then the elements
+// column by column, separated by white space.  The file is mapped and
+// split at white space into one range per thread; each thread counts the
+// numbers of its range, then converts them into its part of v.
 bool readColMajorMatrixFile(const char *fn, int &nr_row, int &nr_col, std::vector<float>&v)
 {
   std::cerr << "Opening file:"<< fn << std::endl;
-  std::fstream f(fn, std::fstream::in);
-  if ( !f.good() ) {
+  int fd = open(fn, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(fn);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void *map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(fn);
     return false;
   }
+  if (size)
+    madvise(map, size, MADV_SEQUENTIAL);
+  const char *begin = (const char *)map, *end = begin + size;
 
   // Read # of rows and cols
-  f >> nr_row;
-  f >> nr_col;
-
-  float data;
+  const char *p = skipSpace(begin, end);
+  if (p < end)
+    p = parseToken(p, end, nr_row);
+  if (p)
+    p = parseToken(skipSpace(p, end), end, nr_col);
+  if (!p || nr_row < 0 || nr_col < 0) {
+    std::cerr << fn << " does not start with the matrix dimensions" << std::endl;
+    if (map)
+      munmap(map, size);
+    return false;
+  }
   std::cerr << "Matrix dimension: "<<nr_row<<"x"<<nr_col<<std::endl;
-  while (f.good() ) {
-    f >> data;
-    v.push_back(data);
+
+  // Ranges of the elements, each starting at white space
+  size_t body = end - p;
+  int threads = ioThreads();
+  if ((size_t)threads > body / 4096 + 1)
+    threads = body / 4096 + 1;
+  std::vector<const char *> bounds(threads + 1);
+  bounds[0] = p;
+  bounds[threads] = end;
+  for (int t = 1; t < threads; t++) {
+    const char *b = std::max(bounds[t - 1], p + body * t / threads);
+    while (b < end && !isSpace(*b))
+      b++;
+    bounds[t] = b;
   }
-  v.pop_back(); // remove the duplicated last element
 
+  std::vector<size_t> counts(threads + 1, 0);
+  parallelFor(threads, [&](int t) {
+    size_t n = 0;
+    bool inToken = false;
+    for (const char *c = bounds[t]; c < bounds[t + 1]; c++) {
+      bool token = !isSpace(*c);
+      n += token && !inToken;
+      inToken = token;
+    }
+    counts[t + 1] = n;
+  });
+  for (int t = 0; t < threads; t++)
+    counts[t + 1] += counts[t];
+
+  size_t expected = (size_t)nr_row * nr_col;
+  bool ok = counts[threads] == expected;
+  if (!ok)
+    std::cerr << "Expecting " << nr_row << "x" << nr_col << " values in " << fn
+      << ", found " << counts[threads] << std::endl;
+  else {
+    v.resize(expected);
+    std::vector<const char *> bad(threads, (const char *)NULL);
+    parallelFor(threads, [&](int t) {
+      float *out = v.data() + counts[t];
+      const char *c = skipSpace(bounds[t], bounds[t + 1]);
+      while (c < bounds[t + 1]) {
+        const char *next = parseToken(c, bounds[t + 1], *out++);
+        if (!next) {
+          bad[t] = c;
+          return;
+        }
+        c = skipSpace(next, bounds[t + 1]);
+      }
+    });
+    for (int t = 0; t < threads && ok; t++)
+      if (bad[t]) {
+        const char *e = bad[t];
+        while (e < end && !isSpace(*e) && e - bad[t] < 32)
+          e++;
+        std::cerr << fn << ": bad number '" << std::string(bad[t], e)
+          << "' at byte " << bad[t] - begin << std::endl;
+        ok = false;
+      }
+  }
+  if (map)
+    munmap(map, size);
+  return ok;
 }
 
+// Write a text matrix readable by readColMajorMatrixFile, the elements
+// printed like by operator<<.  Threads format consecutive ranges of a
+// block of the matrix into their buffers, which are then written in
+// order.
 bool writeColMajorMatrixFile(const char *fn, int nr_row, int nr_col, std::vector<float>&v)
 {
   std::cerr << "Opening file:"<< fn << " for write." << std::endl;
-  std::fstream f(fn, std::fstream::out);
-  if ( !f.good() ) {
+  FILE *f = fopen(fn, "w");
+  if (!f) {
+    perror(fn);
     return false;
   }
 
-  // Read # of rows and cols
-  f << nr_row << " "<<nr_col<<" ";
+  // Write # of rows and cols
+  fprintf(f, "%d %d ", nr_row, nr_col);
 
-  float data;
   std::cerr << "Matrix dimension: "<<nr_row<<"x"<<nr_col<<std::endl;
-  for (int i = 0; i < v.size(); ++i) {
-    f << v[i] << ' ';
+  const size_t perThread = 1 << 20;
+  int threads = ioThreads();
+  std::vector<std::string> text(threads);
+  bool ok = true;
+  for (size_t done = 0; done < v.size() && ok; ) {
+    size_t block = std::min(v.size() - done, perThread * threads);
+    parallelFor(threads, [&](int t) {
+      size_t first = done + block * t / threads;
+      size_t last = done + block * (t + 1) / threads;
+      std::string &s = text[t];
+      char number[32];
+      s.clear();
+      for (size_t i = first; i < last; i++) {
+        std::to_chars_result r = std::to_chars(number, number + sizeof(number) - 1,
+            v[i], std::chars_format::general, 6);
+        *r.ptr++ = ' ';
+        s.append(number, r.ptr);
+      }
+    });
+    for (int t = 0; t < threads && ok; t++)
+      ok = fwrite(text[t].data(), 1, text[t].size(), f) == text[t].size();
+    done += block;
   }
-  f << "\n";
-  return true;
+  fputc('\n', f);
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok)
+    std::cerr << "Error writing " << fn << std::endl;
+  return ok;
+}
+
+// Load a column-major matrix from a text file into v, or map it from a
+// container file, whose "matrix" array holds nr_col columns of nr_row
+// floats.  fp16 and bf16 containers are widened into v.  Returns the
+// matrix, which for a float container stays valid until *container is
+// closed; NULL on error.
+const float *loadColMajorMatrix(const char *fn, int &nr_row, int &nr_col,
+    std::vector<float>&v, struct pb_Container **container)
+{
+  *container = NULL;
+  if (!pb_IsContainerFile(fn)) {
+    if (!readColMajorMatrixFile(fn, nr_row, nr_col, v))
+      return NULL;
+    return v.data();
+  }
+
+  struct pb_Container *c = pb_OpenContainer(fn, 0);
+  if (!c)
+    return NULL;
+  const struct pb_Array *a = pb_ContainerArray(c, "matrix");
+  if (!a || a->rank != 2 || (a->type != pb_Type_F32 &&
+        a->type != pb_Type_F16 && a->type != pb_Type_BF16)) {
+    std::cerr << "Expecting a float matrix 'matrix' in " << fn << std::endl;
+    pb_CloseContainer(c);
+    return NULL;
+  }
+  nr_col = a->dims[0];
+  nr_row = a->dims[1];
+  std::cerr << "Mapped file:" << fn << std::endl
+    << "Matrix dimension: " << nr_row << "x" << nr_col << std::endl;
+  if (a->type != pb_Type_F32) {
+    v.resize(a->count);
+    pb_HalfToFloats(a->type, (const uint16_t *)a->data, v.data(), a->count);
+    pb_CloseContainer(c);
+    return v.data();
+  }
+  *container = c;
+  return (const float *)a->data;
+}
 
+// The matrix of fn, of 'count' elements, stored as pb_Type_F16 or
+// pb_Type_BF16.  A container of that type is mapped in place; otherwise
+// src, the matrix loaded by loadColMajorMatrix, is narrowed into v.
+// Returns the matrix, which for a container stays valid until *container
+// is closed; NULL on error.
+const uint16_t *loadColMajorMatrixHalf(const char *fn, pb_Type type,
+    const float *src, size_t count, std::vector<uint16_t>&v,
+    struct pb_Container **container)
+{
+  *container = NULL;
+  if (pb_IsContainerFile(fn)) {
+    struct pb_Container *c = pb_OpenContainer(fn, 0);
+    if (!c)
+      return NULL;
+    const struct pb_Array *a = pb_ContainerArray(c, "matrix");
+    if (a && a->type == type && a->count == count) {
+      *container = c;
+      return (const uint16_t *)a->data;
+    }
+    pb_CloseContainer(c);
+  }
+
+  v.resize(count);
+  pb_FloatsToHalf(type, src, v.data(), count);
+  return v.data();
+}
+
+// Write a column-major matrix as the "matrix" array of a container, with
+// elements of type pb_Type_F32, pb_Type_F16 or pb_Type_BF16
+bool writeColMajorMatrixContainer(const char *fn, int nr_row, int nr_col,
+    const std::vector<float>&v, pb_Type type)
+{
+  std::cerr << "Opening file:"<< fn << " for write." << std::endl;
+  struct pb_ContainerWriter *w = pb_CreateContainer(fn);
+  if (!w)
+    return false;
+
+  size_t dims[2] = {(size_t)nr_col, (size_t)nr_row};
+  int status;
+  if (type == pb_Type_F32)
+    status = pb_WriteArray(w, "matrix", type, sizeof(float), 2, dims, v.data());
+  else {
+    std::vector<uint16_t> half(v.size());
+    pb_FloatsToHalf(type, v.data(), half.data(), v.size());
+    status = pb_WriteArray(w, "matrix", type, sizeof(uint16_t), 2, dims,
+        half.data());
+  }
+  return pb_CloseContainerWriter(w) == 0 && status == 0;
 }
@@ -12,20 +12,168 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <malloc.h>
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <parboil.h>
+#include <pb_io.h>
+#include <pb_verify.h>
 #include <iostream>
 #include <hc.hpp>
 using namespace hc;
 #include "sgemm_kernel.hpp"
+#include "sgemm_stream.hpp"
+#include "sgemm_strassen.hpp"
+#include "sgemm_sweep.hpp"
 
 // I/O routines
 extern bool readColMajorMatrixFile(const char *fn, int &nr_row, int &nr_col, std::vector<float>&v);
 extern bool writeColMajorMatrixFile(const char *fn, int, int, std::vector<float>&);
+extern const float *loadColMajorMatrix(const char *fn, int &nr_row, int &nr_col,
+    std::vector<float>&v, struct pb_Container **container);
+extern const uint16_t *loadColMajorMatrixHalf(const char *fn, pb_Type type,
+    const float *src, size_t count, std::vector<uint16_t>&v,
+    struct pb_Container **container);
+extern bool writeColMajorMatrixContainer(const char *fn, int, int,
+    const std::vector<float>&, pb_Type);
+
+// Element type named by an environment variable: f32 (or fp32), f16 (or
+// fp16), bf16 or int8 (or i8), else dflt.  Exits on an unknown name.
+static pb_Type envType(const char *var, pb_Type dflt)
+{
+  const char *s = getenv(var);
+  if (s == NULL || *s == 0)
+    return dflt;
+  if (strcmp(s, "f32") == 0 || strcmp(s, "fp32") == 0)
+    return pb_Type_F32;
+  if (strcmp(s, "f16") == 0 || strcmp(s, "fp16") == 0)
+    return pb_Type_F16;
+  if (strcmp(s, "bf16") == 0)
+    return pb_Type_BF16;
+  if (strcmp(s, "int8") == 0 || strcmp(s, "i8") == 0)
+    return pb_Type_I8;
+  fprintf(stderr, "Unknown %s=%s, expecting fp32, fp16, bf16 or int8\n", var, s);
+  exit(-1);
+}
+
+static const char *typeName(pb_Type type)
+{
+  return type == pb_Type_F16 ? "fp16" : type == pb_Type_BF16 ? "bf16" :
+    type == pb_Type_I8 ? "int8" : "fp32";
+}
+
+// Unit roundoff of the storage type of A and B; for int8, half a step of
+// the quantisation relative to the largest magnitude
+static double unitRoundoff(pb_Type type)
+{
+  return type == pb_Type_F16 ? 1.0 / 2048 : type == pb_Type_BF16 ? 1.0 / 256
+    : type == pb_Type_I8 ? 1.0 / 254 : FLT_EPSILON / 2;
+}
+
+// Quantise the rows of a column-major matrix to int8, symmetrically, each
+// with its own scale: X(i, j) is about q(i, j) * scale[i]
+static void quantizeRows(const float *X, int rows, int cols,
+    std::vector<int8_t> &q, std::vector<float> &scale)
+{
+  std::vector<float> maxAbs(rows, 0.0f);
+  for (size_t j = 0; j < (size_t)cols; j++)
+    for (int i = 0; i < rows; i++)
+      maxAbs[i] = std::max(maxAbs[i], fabsf(X[i + j * rows]));
+  scale.resize(rows);
+  for (int i = 0; i < rows; i++)
+    scale[i] = maxAbs[i] > 0 ? maxAbs[i] / 127 : 1.0f;
+  q.resize((size_t)rows * cols);
+  for (size_t j = 0; j < (size_t)cols; j++)
+    for (int i = 0; i < rows; i++)
+      q[i + j * rows] = (int8_t)rintf(X[i + j * rows] / scale[i]);
+}
+
+// C = A * B on the CPU, for verification: A is m x k and B^T is n x k,
+// both column-major, and the dot products are accumulated in double
+void computeGold(float *C, const float *A, const float *BT,
+    unsigned int m, unsigned int n, unsigned int k)
+{
+  std::vector<double> acc(m);
+  for (unsigned int j = 0; j < n; j++) {
+    std::fill(acc.begin(), acc.end(), 0.0);
+    for (unsigned int l = 0; l < k; l++) {
+      const float *a = A + (size_t)l * m;
+      double b = BT[j + (size_t)l * n];
+      for (unsigned int i = 0; i < m; i++)
+        acc[i] += a[i] * b;
+    }
+    for (unsigned int i = 0; i < m; i++)
+      C[i + (size_t)j * m] = acc[i];
+  }
+}
+
+// Check the m x n result C against the reference file (-v) and the CPU
+// product (-V).  A k-term dot product in float is off by at most about
+// k*eps times the sum of the magnitudes of its terms, which bounds the
+// absolute error; inputs stored with unit roundoff u add 2u per term, and
+// int8 a third u for the requantised output, and
+// each level of Strassen-Winograd multiplies the bound by about 9.
+// Returns 0 if every check passes.
+static int verifyResult(struct pb_Parameters *params, const float *A,
+    const float *BT, const std::vector<float> &C, int m, int n, int k,
+    pb_Type inputType, int strassenLevels)
+{
+  float maxA = 0, maxB = 0;
+  for (size_t i = 0; i < (size_t)m * k; i++)
+    maxA = std::max(maxA, fabsf(A[i]));
+  for (size_t i = 0; i < (size_t)n * k; i++)
+    maxB = std::max(maxB, fabsf(BT[i]));
+  struct pb_Tolerance tol =
+    pb_RelativeTolerance(1e-5, (double)k * (FLT_EPSILON +
+          (inputType == pb_Type_F32 ? 0 : (inputType == pb_Type_I8 ? 3 : 2) *
+           unitRoundoff(inputType))) *
+        pow(9.0, strassenLevels) * maxA * maxB);
+  int status = 0;
+
+  if (params->refFile) {
+    std::vector<float> ref;
+    struct pb_Container *file;
+    int rows, cols;
+    const float *R = loadColMajorMatrix(params->refFile, rows, cols, ref, &file);
+    if (!R || rows != m || cols != n) {
+      if (R)
+        std::cerr << "Expecting a " << m << "x" << n << " reference" << std::endl;
+      status = -1;
+    } else if (pb_CompareFloats("C", C.data(), R, C.size(), &tol))
+      status = -1;
+    pb_CloseContainer(file);
+  }
+  if (params->verifyGold) {
+    std::vector<float> gold(C.size());
+    computeGold(gold.data(), A, BT, m, n, k);
+    if (pb_CompareFloats("C (CPU)", C.data(), gold.data(), C.size(), &tol))
+      status = -1;
+  }
+  return status;
+}
+
+// Report how far C, computed by 'what', is from the classical fp32
+// product C32; u is the unit roundoff of the inputs
+static void reportError(const char *what, double u, const std::vector<float> &C,
+    const std::vector<float> &C32)
+{
+  double maxAbs = 0, maxRef = 0, sumSq = 0;
+  for (size_t i = 0; i < C.size(); i++) {
+    double d = fabs((double)C[i] - C32[i]);
+    maxAbs = std::max(maxAbs, d);
+    maxRef = std::max(maxRef, (double)fabsf(C32[i]));
+    sumSq += d * d;
+  }
+  std::cout << what << " vs fp32: max abs error " << maxAbs
+    << ", max error relative to max |C| " << (maxRef > 0 ? maxAbs / maxRef : 0)
+    << ", RMS error " << (C.empty() ? 0 : sqrt(sumSq / C.size()))
+    << " (unit roundoff " << u << ")" << std::endl;
+}
 
 int
 main (int argc, char *argv[]) {
@@ -37,6 +185,16 @@ main (int argc, char *argv[]) {
   int matArow, matAcol;
   int matBrow, matBcol;
   std::vector<float> matA, matBT;
+  const float *A, *BT;
+  struct pb_Container *fileA, *fileBT;
+  // Storage of A and B: SGEMM_PRECISION=fp32 (default), fp16, bf16 or int8
+  pb_Type precision = envType("SGEMM_PRECISION", pb_Type_F32);
+  std::vector<uint16_t> matAh, matBTh;
+  const uint16_t *Ah = NULL, *BTh = NULL;
+  struct pb_Container *fileAh = NULL, *fileBTh = NULL;
+  // SGEMM_STRASSEN=1 multiplies fp32 inputs by Strassen-Winograd
+  bool strassen = getenv("SGEMM_STRASSEN") && atoi(getenv("SGEMM_STRASSEN"));
+  strassen_stats strassenOps = {0, 0.0, 0.0};
   accelerator acc;
   accelerator_view av = acc.get_default_view();
 
@@ -45,6 +203,14 @@ main (int argc, char *argv[]) {
   /* Read command line. Expect 3 inputs: A, B and B^T
      in column-major layout*/
   params = pb_ReadParameters(&argc, argv);
+
+  // A sweep over shapes synthesised in memory needs no inputs
+  if (getenv("SGEMM_SWEEP") && atoi(getenv("SGEMM_SWEEP"))) {
+    int status = sweepSgemm(av, params, &timers, precision);
+    pb_FreeParameters(params);
+    return status;
+  }
+
   if ((params->inpFiles[0] == NULL)
       || (params->inpFiles[1] == NULL)
       || (params->inpFiles[2] == NULL)
@@ -54,18 +220,37 @@ main (int argc, char *argv[]) {
       exit(-1);
     }
 
+  // Matrices larger than memory are streamed from their files
+  if (getenv("SGEMM_STREAM") && atoi(getenv("SGEMM_STREAM"))) {
+    int status = streamSgemm(av, params, &timers);
+    pb_FreeParameters(params);
+    return status;
+  }
+
   /* Read in data */
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
 
   // load A
-  readColMajorMatrixFile(params->inpFiles[0],
-      matArow, matAcol, matA);
+  A = loadColMajorMatrix(params->inpFiles[0],
+      matArow, matAcol, matA, &fileA);
   // copy A to device memory
   A_sz = matArow*matAcol;
 
   // load B^T
-  readColMajorMatrixFile(params->inpFiles[2],
-      matBcol, matBrow, matBT);
+  BT = loadColMajorMatrix(params->inpFiles[2],
+      matBcol, matBrow, matBT, &fileBT);
+  if (!A || !BT)
+    exit(-1);
+
+  // Half-width copies, mapped from containers of that type or narrowed
+  if (precision == pb_Type_F16 || precision == pb_Type_BF16) {
+    Ah = loadColMajorMatrixHalf(params->inpFiles[0], precision, A,
+        (size_t)matArow * matAcol, matAh, &fileAh);
+    BTh = loadColMajorMatrixHalf(params->inpFiles[2], precision, BT,
+        (size_t)matBrow * matBcol, matBTh, &fileBTh);
+    if (!Ah || !BTh)
+      exit(-1);
+  }
 
   pb_SwitchToTimer( &timers, pb_TimerID_COMPUTE );
   B_sz = matBrow*matBcol;
@@ -75,35 +260,152 @@ main (int argc, char *argv[]) {
 
   // HCC memory allocation
   std::vector<float> matC(matArow*matBcol);
-  array_view<const float> dA(A_sz, matA);
-  array_view<const float> dB(B_sz, matBT);
+  array_view<const float> dA(A_sz, A);
+  array_view<const float> dB(B_sz, BT);
   array_view<float> dC(C_sz, matC);
 
-  // Copy A and B^T into device memory
-  pb_SwitchToTimer( &timers, pb_TimerID_COPY );
-  dA.synchronize_to(av);
-  dB.synchronize_to(av);
+  if (precision == pb_Type_F32) {
+    // Copy A and B^T into device memory
+    pb_SwitchToTimer( &timers, pb_TimerID_COPY );
+    dA.synchronize_to(av);
+    dB.synchronize_to(av);
 
-  pb_SwitchToTimer( &timers, pb_TimerID_KERNEL );
+    pb_SwitchToTimer( &timers, pb_TimerID_KERNEL );
 
-  // Use standard sgemm interface
-  regtileSgemm(av, 'N', 'T', matArow, matBcol, matAcol, 1.0f, \
-      dA, matArow, dB, matBcol, 0.0f, dC, matArow);
+    if (strassen) {
+      strassenSgemm(av, 'N', 'T', matArow, matBcol, matAcol, 1.0f,
+          dA, matArow, dB, matBcol, 0.0f, dC, matArow, strassenCutoff(),
+          &strassenOps);
+      double classical = 2. * matArow * matBcol * matAcol;
+      double done = strassenOps.multiplyFlops + strassenOps.addFlops;
+      std::cout << "Strassen-Winograd: " << strassenOps.levels
+        << " levels, " << done / 1e9 << " GFLOP instead of "
+        << classical / 1e9 << " (" << 100. * (1. - done / classical)
+        << "% fewer)" << std::endl;
+    } else {
+      // Use standard sgemm interface
+      regtileSgemm(av, 'N', 'T', matArow, matBcol, matAcol, 1.0f, \
+          dA, matArow, dB, matBcol, 0.0f, dC, matArow);
+    }
+  } else if (precision == pb_Type_I8) {
+    // A quantised per row and B per column, the int32 products
+    // requantised to int8 in the kernel's epilogue and dequantised after
+    std::vector<int8_t> matAq, matBTq, matCq(C_sz);
+    std::vector<float> scaleA, scaleB;
+    quantizeRows(A, matArow, matAcol, matAq, scaleA);
+    quantizeRows(BT, matBcol, matBrow, matBTq, scaleB);
+    array_view<const int8_t> dAq(A_sz, matAq);
+    array_view<const int8_t> dBq(B_sz, matBTq);
+    array_view<int8_t> dCq(C_sz, matCq);
 
-  if (params->outFile) {
+    // The scale of C, from the int32 products
+    float scaleC;
+    {
+      std::vector<int32_t> acc(C_sz);
+      array_view<int32_t> dAcc(C_sz, acc);
+      regtileIgemm(av, 'N', 'T', matArow, matBcol, matAcol, dAq, matArow,
+          dBq, matBcol, dAcc, matArow);
+      dAcc.synchronize();
+      float maxC = 0;
+      for (size_t j = 0; j < (size_t)matBcol; j++)
+        for (int i = 0; i < matArow; i++)
+          maxC = std::max(maxC, fabsf(acc[i + j * matArow] * scaleA[i] * scaleB[j]));
+      scaleC = maxC > 0 ? maxC / 127 : 1.0f;
+    }
+
+    pb_SwitchToTimer( &timers, pb_TimerID_COPY );
+    dAq.synchronize_to(av);
+    dBq.synchronize_to(av);
+
+    pb_SwitchToTimer( &timers, pb_TimerID_KERNEL );
+    regtileIgemm(av, 'N', 'T', matArow, matBcol, matAcol, dAq, matArow,
+        dBq, matBcol, dCq, matArow,
+        makeRequantEpilogue(1.0f / scaleC, 0, scaleA.data(), scaleB.data()));
+    std::cout << "int8 kernel: "
+#ifdef HC_HOST_BACKEND
+      << (useCpuEngine() ? cpuIgemmKernelName() : "tiled")
+#else
+      << "tiled"
+#endif
+      << ", output scale " << scaleC << std::endl;
+
+    pb_SwitchToTimer( &timers, pb_TimerID_COPY );
+    dCq.synchronize();
+    pb_SwitchToTimer( &timers, pb_TimerID_COMPUTE );
+    for (size_t i = 0; i < C_sz; i++)
+      matC[i] = matCq[i] * scaleC;
+  } else {
+    // The same with A and B^T in half-width storage
+    array_view<const uint16_t> dAh(A_sz, Ah);
+    array_view<const uint16_t> dBh(B_sz, BTh);
+    pb_SwitchToTimer( &timers, pb_TimerID_COPY );
+    dAh.synchronize_to(av);
+    dBh.synchronize_to(av);
+
+    pb_SwitchToTimer( &timers, pb_TimerID_KERNEL );
+
+    if (precision == pb_Type_BF16)
+      regtileSgemmHalf<bf16_format>(av, 'N', 'T', matArow, matBcol, matAcol,
+          1.0f, dAh, matArow, dBh, matBcol, 0.0f, dC, matArow);
+    else
+      regtileSgemmHalf<fp16_format>(av, 'N', 'T', matArow, matBcol, matAcol,
+          1.0f, dAh, matArow, dBh, matBcol, 0.0f, dC, matArow);
+  }
+
+  // A and B are read and C written once at least; C is not read as beta is 0
+  pb_AddWork(&timers, NULL, pb_TimerID_KERNEL,
+      pb_TypeSize(precision) * ((double)A_sz + B_sz) +
+      (precision == pb_Type_I8 ? 1 : sizeof(float)) * C_sz,
+      2. * matArow * matBcol * matAcol);
+
+  if (params->outFile || params->refFile || params->verifyGold ||
+      precision != pb_Type_F32 || strassenOps.levels > 0) {
     pb_SwitchToTimer( &timers, pb_TimerID_COPY );
     dC.synchronize();
-    /* Write C to file */
+  }
+
+  // The error of reduced-precision storage or of Strassen-Winograd,
+  // against the classical fp32 path
+  if (precision != pb_Type_F32 || strassenOps.levels > 0) {
+    pb_SwitchToTimer(&timers, pb_TimerID_COMPUTE);
+    std::vector<float> matC32(C_sz);
+    array_view<float> dC32(C_sz, matC32);
+    regtileSgemm(av, 'N', 'T', matArow, matBcol, matAcol, 1.0f,
+        dA, matArow, dB, matBcol, 0.0f, dC32, matArow);
+    dC32.synchronize();
+    if (precision != pb_Type_F32)
+      reportError((std::string(typeName(precision)) + " inputs").c_str(),
+          unitRoundoff(precision), matC, matC32);
+    else
+      reportError("Strassen-Winograd", unitRoundoff(precision), matC, matC32);
+  }
+
+  if (params->outFile) {
+    /* Write C to file: text, or a container of the element type given
+     * by SGEMM_OUTPUT_TYPE */
     pb_SwitchToTimer(&timers, pb_TimerID_IO);
-    writeColMajorMatrixFile(params->outFile,
-	matArow, matBcol, matC);
+    if (getenv("SGEMM_OUTPUT_TYPE") == NULL)
+      writeColMajorMatrixFile(params->outFile,
+	  matArow, matBcol, matC);
+    else if (envType("SGEMM_OUTPUT_TYPE", pb_Type_F32) == pb_Type_I8)
+      std::cerr << "SGEMM_OUTPUT_TYPE=int8 is not a container type" << std::endl;
+    else
+      writeColMajorMatrixContainer(params->outFile, matArow, matBcol, matC,
+          envType("SGEMM_OUTPUT_TYPE", pb_Type_F32));
   }
 
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
+  int status = verifyResult(params, A, BT, matC, matArow, matBcol, matAcol,
+      precision, strassenOps.levels);
+
   double GPUtime = pb_GetElapsedTime(&(timers.timers[pb_TimerID_KERNEL]));
   std::cout<< "GFLOPs = " << 2.* matArow * matBcol * matAcol/GPUtime/1e9 << std::endl;
   pb_PrintTimerSet(&timers);
+  pb_CloseContainer(fileA);
+  pb_CloseContainer(fileBT);
+  pb_CloseContainer(fileAh);
+  pb_CloseContainer(fileBTh);
   pb_FreeParameters(params);
-  return 0;
+  return status;
 }
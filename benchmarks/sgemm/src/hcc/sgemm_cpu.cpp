@@ -0,0 +1,496 @@
+/*
+ * Packed, cache-blocked SGEMM for the host CPU, after GotoBLAS and BLIS:
+ *
+ *   for jc over n by NC           B panel, KC x NC, packed once, in L3
+ *    for pc over k by KC
+ *     for ic over m by MC         A block, MC x KC, packed per task, in L2
+ *      for jr over NC by NR       B sliver, KC x NR, in L1
+ *       for ir over MC by MR      MR x NR micro-kernel, C tile in registers
+ *
+ * Packing lays the slivers out in the order the micro-kernel reads them,
+ * with op() applied and edges padded with zeros, so every transpose runs
+ * the same kernel.  The (ic, jr-range) macro-tiles of a panel are spread
+ * over the workers of the host HC runtime.
+ *
+ * A and B may also be stored as fp16 or bf16 (sgemm_half.h); packing
+ * widens them, so the rest of the engine only sees floats.
+ *
+ * Batches of small matrices skip the panel split: each worker runs whole
+ * products through the same loop nest, one matrix at a time.
+ *
+ * The micro-kernel is picked at run time: AVX-512 32x12, AVX2/FMA 16x6,
+ * or portable 8x4.  SGEMM_CPU_ISA=avx512|avx2|generic forces one.
+ */
+
+#include <hc.hpp>
+#include "sgemm_cpu.h"
+#include "sgemm_half.h"
+
+#ifdef HC_HOST_BACKEND
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace hc;
+
+namespace {
+
+// C[0:mr, 0:nr] = alpha * a * b + beta * C, from an mr x kc sliver of A and
+// a kc x nr sliver of B.  C is not read when beta is 0.
+typedef void (*micro_kernel)(int kc, const float *a, const float *b,
+    float *c, int ldc, float alpha, float beta);
+
+struct engine {
+  const char *name;
+  int mr, nr;                   // Register tile
+  int mc, kc, nc;               // Cache blocks, multiples of mr and nr
+  micro_kernel kernel;
+};
+
+const int MAX_TILE = 32 * 12;   // Largest mr * nr
+const int MAX_KC = 384;         // Largest kc
+
+template <int MR, int NR>
+void micro_generic(int kc, const float *a, const float *b, float *c,
+    int ldc, float alpha, float beta)
+{
+  float acc[NR][MR] = {};
+  for (int l = 0; l < kc; l++, a += MR, b += NR)
+    for (int j = 0; j < NR; j++)
+      for (int i = 0; i < MR; i++)
+        acc[j][i] += a[i] * b[j];
+
+  for (int j = 0; j < NR; j++)
+    for (int i = 0; i < MR; i++)
+      c[i + j * ldc] = beta == 0.0f ? alpha * acc[j][i]
+                                    : alpha * acc[j][i] + beta * c[i + j * ldc];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 16 x 6: two vectors of a column of C per column, 12 accumulators.
+__attribute__((target("avx2,fma")))
+void micro_avx2(int kc, const float *a, const float *b, float *c,
+    int ldc, float alpha, float beta)
+{
+  __m256 acc[6][2];
+  for (int j = 0; j < 6; j++)
+    acc[j][0] = acc[j][1] = _mm256_setzero_ps();
+
+  for (int l = 0; l < kc; l++, a += 16, b += 6) {
+    __m256 a0 = _mm256_load_ps(a), a1 = _mm256_load_ps(a + 8);
+#pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) {
+      __m256 bj = _mm256_broadcast_ss(b + j);
+      acc[j][0] = _mm256_fmadd_ps(a0, bj, acc[j][0]);
+      acc[j][1] = _mm256_fmadd_ps(a1, bj, acc[j][1]);
+    }
+  }
+
+  __m256 va = _mm256_set1_ps(alpha), vb = _mm256_set1_ps(beta);
+  for (int j = 0; j < 6; j++) {
+    float *cj = c + (size_t)j * ldc;
+    __m256 r0 = _mm256_mul_ps(va, acc[j][0]), r1 = _mm256_mul_ps(va, acc[j][1]);
+    if (beta != 0.0f) {
+      r0 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(cj), r0);
+      r1 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(cj + 8), r1);
+    }
+    _mm256_storeu_ps(cj, r0);
+    _mm256_storeu_ps(cj + 8, r1);
+  }
+}
+
+// 32 x 12: 24 accumulators, two loads and one broadcast per column.
+__attribute__((target("avx512f")))
+void micro_avx512(int kc, const float *a, const float *b, float *c,
+    int ldc, float alpha, float beta)
+{
+  __m512 acc[12][2];
+  for (int j = 0; j < 12; j++)
+    acc[j][0] = acc[j][1] = _mm512_setzero_ps();
+
+  for (int l = 0; l < kc; l++, a += 32, b += 12) {
+    __m512 a0 = _mm512_load_ps(a), a1 = _mm512_load_ps(a + 16);
+    _mm_prefetch((const char *)(a + 256), _MM_HINT_T0);
+#pragma GCC unroll 12
+    for (int j = 0; j < 12; j++) {
+      __m512 bj = _mm512_set1_ps(b[j]);
+      acc[j][0] = _mm512_fmadd_ps(a0, bj, acc[j][0]);
+      acc[j][1] = _mm512_fmadd_ps(a1, bj, acc[j][1]);
+    }
+  }
+
+  __m512 va = _mm512_set1_ps(alpha), vb = _mm512_set1_ps(beta);
+  for (int j = 0; j < 12; j++) {
+    float *cj = c + (size_t)j * ldc;
+    __m512 r0 = _mm512_mul_ps(va, acc[j][0]), r1 = _mm512_mul_ps(va, acc[j][1]);
+    if (beta != 0.0f) {
+      r0 = _mm512_fmadd_ps(vb, _mm512_loadu_ps(cj), r0);
+      r1 = _mm512_fmadd_ps(vb, _mm512_loadu_ps(cj + 16), r1);
+    }
+    _mm512_storeu_ps(cj, r0);
+    _mm512_storeu_ps(cj + 16, r1);
+  }
+}
+#endif
+
+const engine engines[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  { "avx512", 32, 12, 192, 384, 3072, micro_avx512 },
+  { "avx2", 16, 6, 128, 256, 3072, micro_avx2 },
+#endif
+  { "generic", 8, 4, 64, 256, 1024, micro_generic<8, 4> },
+};
+
+bool supported(const engine &e)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (strcmp(e.name, "avx512") == 0)
+    return __builtin_cpu_supports("avx512f");
+  if (strcmp(e.name, "avx2") == 0)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+  return true;
+}
+
+const engine &select_engine()
+{
+  static const engine *chosen = [] {
+    const char *isa = getenv("SGEMM_CPU_ISA");
+    const size_t count = sizeof(engines) / sizeof(engines[0]);
+    for (size_t i = 0; i < count; i++)
+      if (isa != NULL && *isa && strcmp(isa, engines[i].name) == 0) {
+        if (supported(engines[i]))
+          return &engines[i];
+        std::cerr << "SGEMM_CPU_ISA=" << isa << " is not supported here" << std::endl;
+      }
+    for (size_t i = 0; i < count; i++)
+      if (supported(engines[i]))
+        return &engines[i];
+    return &engines[count - 1];
+  }();
+  return *chosen;
+}
+
+struct aligned_free {
+  void operator()(float *p) const { free(p); }
+};
+typedef std::unique_ptr<float, aligned_free> buffer;
+
+float *allocate(size_t floats)
+{
+  size_t bytes = (floats * sizeof(float) + 63) / 64 * 64;
+  return static_cast<float *>(aligned_alloc(64, bytes ? bytes : 64));
+}
+
+// Elements of float inputs, and widening of rows of each input format
+struct fp32_format {
+  typedef float storage;
+};
+
+template <typename Format>
+struct widener {
+  static void row(const uint16_t *src, float *dst, int n)
+  {
+    pb_HalfToFloats(Format::type, src, dst, n);
+  }
+};
+
+template <>
+struct widener<fp32_format> {
+  static void row(const float *src, float *dst, int n)
+  {
+    memcpy(dst, src, n * sizeof(float));
+  }
+};
+
+// Pack op(A)[i0:i0+mc, p0:p0+kc] as mr-row slivers, each kc columns of mr
+// consecutive values.  Rows past mc are zero.
+template <typename Format>
+void packA(const engine &e, bool trans, const typename Format::storage *A,
+    int lda, int i0, int mc, int p0, int kc, float *buf)
+{
+  alignas(64) float row[MAX_KC];
+
+  for (int ir = 0; ir < mc; ir += e.mr, buf += (size_t)e.mr * kc) {
+    int rows = std::min(e.mr, mc - ir);
+    if (!trans) {
+      for (int l = 0; l < kc; l++) {
+        const typename Format::storage *src = A + (i0 + ir) + (size_t)(p0 + l) * lda;
+        float *dst = buf + (size_t)l * e.mr;
+        widener<Format>::row(src, dst, rows);
+        for (int i = rows; i < e.mr; i++)
+          dst[i] = 0.0f;
+      }
+    } else {
+      // op(A)(i, l) = A[l + i*lda]: read each row of op(A) contiguously
+      for (int i = 0; i < e.mr; i++) {
+        if (i < rows)
+          widener<Format>::row(A + p0 + (size_t)(i0 + ir + i) * lda, row, kc);
+        for (int l = 0; l < kc; l++)
+          buf[(size_t)l * e.mr + i] = i < rows ? row[l] : 0.0f;
+      }
+    }
+  }
+}
+
+// Pack op(B)[p0:p0+kc, j0+jr] for the nr-column sliver starting at jr, as
+// kc rows of nr consecutive values.  Columns past nc are zero.
+template <typename Format>
+void packB(const engine &e, bool trans, const typename Format::storage *B,
+    int ldb, int p0, int kc, int j0, int jr, int nc, float *buf)
+{
+  alignas(64) float col[MAX_KC];
+  int cols = std::min(e.nr, nc - jr);
+
+  if (trans) {
+    // op(B)(l, j) = B[j + l*ldb]: a row of the sliver is contiguous
+    for (int l = 0; l < kc; l++) {
+      const typename Format::storage *src = B + (j0 + jr) + (size_t)(p0 + l) * ldb;
+      float *dst = buf + (size_t)l * e.nr;
+      widener<Format>::row(src, dst, cols);
+      for (int j = cols; j < e.nr; j++)
+        dst[j] = 0.0f;
+    }
+  } else {
+    for (int j = 0; j < e.nr; j++) {
+      if (j < cols)
+        widener<Format>::row(B + p0 + (size_t)(j0 + jr + j) * ldb, col, kc);
+      for (int l = 0; l < kc; l++)
+        buf[(size_t)l * e.nr + j] = j < cols ? col[l] : 0.0f;
+    }
+  }
+}
+
+// Multiply a packed mc x kc block of A by the packed slivers of B covering
+// nc columns, into the C block at c.  Edge tiles go through a scratch tile.
+// On the last panel of k, the epilogue, if any, is applied to each tile
+// while it is in cache; (i0, j0) is the position of c in C.
+void macroKernel(const engine &e, int mc, int nc, int kc, const float *pa,
+    const float *pb, float *c, int ldc, float alpha, float beta,
+    const cpu_epilogue *epilogue = NULL, int i0 = 0, int j0 = 0)
+{
+  alignas(64) float tile[MAX_TILE];
+
+  for (int jr = 0; jr < nc; jr += e.nr) {
+    int cols = std::min(e.nr, nc - jr);
+    const float *b = pb + (size_t)jr * kc;
+    for (int ir = 0; ir < mc; ir += e.mr) {
+      int rows = std::min(e.mr, mc - ir);
+      const float *a = pa + (size_t)ir * kc;
+      float *cij = c + ir + (size_t)jr * ldc;
+      if (rows == e.mr && cols == e.nr) {
+        e.kernel(kc, a, b, cij, ldc, alpha, beta);
+      } else {
+        e.kernel(kc, a, b, tile, e.mr, 1.0f, 0.0f);
+        for (int j = 0; j < cols; j++)
+          for (int i = 0; i < rows; i++) {
+            float &out = cij[i + (size_t)j * ldc];
+            out = beta == 0.0f ? alpha * tile[i + j * e.mr]
+                               : alpha * tile[i + j * e.mr] + beta * out;
+          }
+      }
+      if (epilogue)
+        epilogue->apply(epilogue->state, cij, ldc, i0 + ir, j0 + jr, rows, cols);
+    }
+  }
+}
+
+// Scratch of at least 'floats' floats, kept per thread across calls
+float *scratch(buffer &buf, size_t &size, size_t floats)
+{
+  if (size < floats) {
+    buf.reset(allocate(floats));
+    size = floats;
+  }
+  return buf.get();
+}
+
+// C = beta * C, for products with nothing to multiply
+void scaleC(int m, int n, float beta, float *C, int ldc)
+{
+  for (int j = 0; j < n; j++)
+    for (int i = 0; i < m; i++)
+      C[i + (size_t)j * ldc] = beta == 0.0f ? 0.0f : beta * C[i + (size_t)j * ldc];
+}
+
+// One product on the calling thread, for batches spread by matrix
+void serialSgemm(const engine &e, bool ta, bool tb, int m, int n, int k,
+    float alpha, const float *A, int lda, const float *B, int ldb,
+    float beta, float *C, int ldc)
+{
+  if (m <= 0 || n <= 0)
+    return;
+  if (k <= 0 || alpha == 0.0f) {
+    scaleC(m, n, beta, C, ldc);
+    return;
+  }
+
+  static thread_local buffer panel, block;
+  static thread_local size_t panel_size, block_size;
+  // Sized to the product, which is small in a batch
+  const size_t kc_max = std::min(e.kc, k);
+  const size_t nc_max = (std::min(e.nc, n) + e.nr - 1) / e.nr * e.nr;
+  const size_t mc_max = (std::min(e.mc, m) + e.mr - 1) / e.mr * e.mr;
+  float *pb = scratch(panel, panel_size, kc_max * nc_max);
+  float *pa = scratch(block, block_size, mc_max * kc_max);
+
+  for (int jc = 0; jc < n; jc += e.nc) {
+    const int nc = std::min(e.nc, n - jc);
+    for (int pc = 0; pc < k; pc += e.kc) {
+      const int kc = std::min(e.kc, k - pc);
+      for (int jr = 0; jr < nc; jr += e.nr)
+        packB<fp32_format>(e, tb, B, ldb, pc, kc, jc, jr, nc, pb + (size_t)jr * kc);
+      for (int ic = 0; ic < m; ic += e.mc) {
+        const int mc = std::min(e.mc, m - ic);
+        packA<fp32_format>(e, ta, A, lda, ic, mc, pc, kc, pa);
+        macroKernel(e, mc, nc, kc, pa, pb, C + ic + (size_t)jc * ldc, ldc,
+                    alpha, pc == 0 ? beta : 1.0f);
+      }
+    }
+  }
+}
+
+bool transposed(char t) { return t == 'T' || t == 't' || t == 'C' || t == 'c'; }
+bool valid(char t) { return transposed(t) || t == 'N' || t == 'n'; }
+
+// cpuSgemm with A and B stored in the given format
+template <typename Format>
+void runSgemm(char transa, char transb, int m, int n, int k, float alpha,
+    const typename Format::storage *A, int lda,
+    const typename Format::storage *B, int ldb, float beta,
+    float *C, int ldc, const cpu_epilogue *epilogue)
+{
+  if (!valid(transa) || !valid(transb)) {
+    std::cerr << "unsupported value of 'transa' or 'transb' in cpuSgemm()" << std::endl;
+    return;
+  }
+  if (m <= 0 || n <= 0)
+    return;
+
+  // Nothing to multiply: C = beta * C
+  if (k <= 0 || alpha == 0.0f) {
+    scaleC(m, n, beta, C, ldc);
+    if (epilogue)
+      epilogue->apply(epilogue->state, C, ldc, 0, 0, m, n);
+    return;
+  }
+
+  const engine &e = select_engine();
+  const bool ta = transposed(transa), tb = transposed(transb);
+  const int workers = std::max(1u, accelerator().get_cu_count());
+  buffer panel(allocate((size_t)e.kc * e.nc));
+
+  for (int jc = 0; jc < n; jc += e.nc) {
+    const int nc = std::min(e.nc, n - jc);
+    const int slivers = (nc + e.nr - 1) / e.nr;
+
+    // Split the panel's columns so that there are a few tasks per worker,
+    // but keep at least 8 slivers per task to amortize packing A.
+    const int mblocks = (m + e.mc - 1) / e.mc;
+    int nsplit = std::max(1, std::min(slivers / 8, (4 * workers + mblocks - 1) / mblocks));
+    const int per_task = (slivers + nsplit - 1) / nsplit * e.nr;
+    nsplit = (nc + per_task - 1) / per_task;
+
+    for (int pc = 0; pc < k; pc += e.kc) {
+      const int kc = std::min(e.kc, k - pc);
+      const float beta_pc = pc == 0 ? beta : 1.0f;
+      const cpu_epilogue *ep = pc + kc >= k ? epilogue : NULL;
+      float *pb = panel.get();
+
+      parallel_for_each(extent<1>(slivers), [=](index<1> s) {
+        packB<Format>(e, tb, B, ldb, pc, kc, jc, s[0] * e.nr, nc,
+              pb + (size_t)s[0] * e.nr * kc);
+      });
+
+      parallel_for_each(extent<2>(mblocks, nsplit), [=](index<2> t) {
+        static thread_local buffer block;
+        static thread_local size_t block_size;
+        float *pa = scratch(block, block_size, (size_t)e.mc * e.kc);
+
+        const int ic = t[0] * e.mc, mc = std::min(e.mc, m - ic);
+        const int jr = t[1] * per_task, cols = std::min(per_task, nc - jr);
+        packA<Format>(e, ta, A, lda, ic, mc, pc, kc, pa);
+        macroKernel(e, mc, cols, kc, pa, pb + (size_t)jr * kc,
+                    C + ic + (size_t)(jc + jr) * ldc, ldc, alpha, beta_pc,
+                    ep, ic, jc + jr);
+      });
+    }
+  }
+}
+
+} // namespace
+
+const char *cpuSgemmKernelName()
+{
+  return select_engine().name;
+}
+
+void cpuSgemm(char transa, char transb, int m, int n, int k, float alpha,
+    const float *A, int lda, const float *B, int ldb, float beta,
+    float *C, int ldc, const cpu_epilogue *epilogue)
+{
+  runSgemm<fp32_format>(transa, transb, m, n, k, alpha, A, lda, B, ldb,
+      beta, C, ldc, epilogue);
+}
+
+void cpuSgemmHalf(pb_Type type, char transa, char transb, int m, int n, int k,
+    float alpha, const uint16_t *A, int lda, const uint16_t *B, int ldb,
+    float beta, float *C, int ldc, const cpu_epilogue *epilogue)
+{
+  if (type == pb_Type_BF16)
+    runSgemm<bf16_format>(transa, transb, m, n, k, alpha, A, lda, B, ldb,
+        beta, C, ldc, epilogue);
+  else if (type == pb_Type_F16)
+    runSgemm<fp16_format>(transa, transb, m, n, k, alpha, A, lda, B, ldb,
+        beta, C, ldc, epilogue);
+  else
+    std::cerr << "unsupported element type in cpuSgemmHalf()" << std::endl;
+}
+
+void cpuSgemmStridedBatched(char transa, char transb, int m, int n, int k,
+    float alpha, const float *A, int lda, long long strideA,
+    const float *B, int ldb, long long strideB, float beta,
+    float *C, int ldc, long long strideC, int batchCount)
+{
+  if (!valid(transa) || !valid(transb)) {
+    std::cerr << "unsupported value of 'transa' or 'transb' in cpuSgemmStridedBatched()" << std::endl;
+    return;
+  }
+  if (batchCount <= 0)
+    return;
+
+  const engine &e = select_engine();
+  const bool ta = transposed(transa), tb = transposed(transb);
+  parallel_for_each(extent<1>(batchCount), [=](index<1> i) {
+    serialSgemm(e, ta, tb, m, n, k, alpha, A + i[0] * strideA, lda,
+                B + i[0] * strideB, ldb, beta, C + i[0] * strideC, ldc);
+  });
+}
+
+void cpuSgemmBatched(char transa, char transb, int m, int n, int k,
+    float alpha, const float *const A[], int lda,
+    const float *const B[], int ldb, float beta,
+    float *const C[], int ldc, int batchCount)
+{
+  if (!valid(transa) || !valid(transb)) {
+    std::cerr << "unsupported value of 'transa' or 'transb' in cpuSgemmBatched()" << std::endl;
+    return;
+  }
+  if (batchCount <= 0)
+    return;
+
+  const engine &e = select_engine();
+  const bool ta = transposed(transa), tb = transposed(transb);
+  parallel_for_each(extent<1>(batchCount), [=](index<1> i) {
+    serialSgemm(e, ta, tb, m, n, k, alpha, A[i[0]], lda, B[i[0]], ldb,
+                beta, C[i[0]], ldc);
+  });
+}
+
+#endif // HC_HOST_BACKEND
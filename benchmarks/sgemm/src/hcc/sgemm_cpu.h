@@ -0,0 +1,73 @@
+/*
+ * Packed, cache-blocked SGEMM for the host CPU.
+ *
+ * C = alpha * op(A) * op(B) + beta * C with column-major matrices, where
+ * op(X) is X for 'N' and X^T for 'T', as in BLAS sgemm and regtileSgemm.
+ * Built only for the host backend (common/platform/hcc.host.mk), where
+ * regtileSgemm runs on it; SGEMM_ENGINE=kernel keeps the tiled kernel.
+ */
+
+#ifndef SGEMM_CPU_H
+#define SGEMM_CPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pb_io.h>
+
+// Applied to each block of C as soon as its final value is stored, while
+// the block is in cache: rows i0 to i0+rows-1 and columns j0 to j0+cols-1
+// of C, stored at c.  state is passed through to apply.
+struct cpu_epilogue {
+  void (*apply)(const void *state, float *c, int ldc, int i0, int j0,
+      int rows, int cols);
+  const void *state;
+};
+
+void cpuSgemm(char transa, char transb, int m, int n, int k, float alpha,
+    const float *A, int lda, const float *B, int ldb, float beta,
+    float *C, int ldc, const cpu_epilogue *epilogue = NULL);
+
+// cpuSgemm with A and B stored as pb_Type_F16 or pb_Type_BF16 (see
+// sgemm_half.h).  They are widened to float as they are packed, so the
+// micro-kernel and its accumulators stay in float.
+void cpuSgemmHalf(pb_Type type, char transa, char transb, int m, int n, int k,
+    float alpha, const uint16_t *A, int lda, const uint16_t *B, int ldb,
+    float beta, float *C, int ldc, const cpu_epilogue *epilogue = NULL);
+
+// batchCount products of the same shape, matrix i starting i * stride
+// elements after A, B and C.  Whole products are spread over the workers,
+// which suits batches of small matrices.
+void cpuSgemmStridedBatched(char transa, char transb, int m, int n, int k,
+    float alpha, const float *A, int lda, long long strideA,
+    const float *B, int ldb, long long strideB, float beta,
+    float *C, int ldc, long long strideC, int batchCount);
+
+// As cpuSgemmStridedBatched, with matrix i at A[i], B[i] and C[i]
+void cpuSgemmBatched(char transa, char transb, int m, int n, int k,
+    float alpha, const float *const A[], int lda,
+    const float *const B[], int ldb, float beta,
+    float *const C[], int ldc, int batchCount);
+
+// Name of the micro-kernel cpuSgemm runs on this CPU.
+const char *cpuSgemmKernelName();
+
+// Takes the final int32 values of a block of an int8 product, rows i0 to
+// i0+rows-1 and columns j0 to j0+cols-1, stored at acc, to convert and
+// store them.  state is passed through to store.
+struct cpu_int_store {
+  void (*store)(const void *state, const int32_t *acc, int ldacc, int i0,
+      int j0, int rows, int cols);
+  const void *state;
+};
+
+// C = op(A) * op(B) with int8 A and B and exact int32 accumulation, into
+// C or, if store is not NULL, through it (C is then unused).  Runs on
+// VNNI (vpdpbusd) when the CPU has it.
+void cpuIgemm(char transa, char transb, int m, int n, int k,
+    const int8_t *A, int lda, const int8_t *B, int ldb,
+    int32_t *C, int ldc, const cpu_int_store *store = NULL);
+
+// Name of the micro-kernel cpuIgemm runs on this CPU.
+const char *cpuIgemmKernelName();
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Epilogues of the sgemm kernels.
+ *
+ * An epilogue is a functor applied to each element of C as the kernel
+ * stores it, so that bias, activation and clamping take no extra pass
+ * over C:
+ *
+ *   float operator()(float v, int i, int j) const [[hc]]
+ *
+ * gets v = alpha * (op(A) * op(B))(i, j) + beta * C(i, j) and returns
+ * the value to store at row i, column j.  It is a template argument of
+ * regtileSgemm, so it is inlined into the store loop.
+ */
+
+#ifndef SGEMM_EPILOGUE_H
+#define SGEMM_EPILOGUE_H
+
+#include <math.h>
+#include <float.h>
+
+// Store v unchanged, as plain sgemm does
+struct no_epilogue {
+  float operator()(float v, int, int) const [[hc]] { return v; }
+};
+
+// Activations
+struct identity_activation {
+  float operator()(float x) const [[hc]] { return x; }
+};
+
+struct relu_activation {
+  float operator()(float x) const [[hc]] { return x > 0.0f ? x : 0.0f; }
+};
+
+// GELU, with the tanh approximation
+struct gelu_activation {
+  float operator()(float x) const [[hc]]
+  {
+    const float k0 = 0.7978845608f;     // sqrt(2 / pi)
+    const float k1 = 0.044715f;
+    return 0.5f * x * (1.0f + tanhf(k0 * (x + k1 * x * x * x)));
+  }
+};
+
+// act(v + rowBias[i] + colBias[j]) clamped to [lo, hi].  Either bias may
+// be NULL; the pointers must be readable by the device running the kernel.
+template <typename Activation>
+struct bias_epilogue {
+  const float *rowBias;
+  const float *colBias;
+  float lo, hi;
+  Activation act;
+
+  float operator()(float v, int i, int j) const [[hc]]
+  {
+    if (rowBias)
+      v += rowBias[i];
+    if (colBias)
+      v += colBias[j];
+    v = act(v);
+    return v < lo ? lo : (v > hi ? hi : v);
+  }
+};
+
+template <typename Activation>
+bias_epilogue<Activation> makeBiasEpilogue(const float *rowBias,
+    const float *colBias, Activation act,
+    float lo = -FLT_MAX, float hi = FLT_MAX)
+{
+  bias_epilogue<Activation> ep = {rowBias, colBias, lo, hi, act};
+  return ep;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Half-width storage formats of sgemm inputs.
+ *
+ * A and B may be stored as IEEE binary16 or bfloat16, in uint16_t, to
+ * halve the bytes the product reads.  Elements are widened to float as
+ * they are loaded, and the products are accumulated in float.  Values are
+ * narrowed with pb_FloatsToHalf() (pb_io.h), which matches these formats.
+ */
+
+#ifndef SGEMM_HALF_H
+#define SGEMM_HALF_H
+
+#include <stdint.h>
+#include <pb_io.h>
+
+// Reinterpret the bits of a float
+union sgemm_bits {
+  uint32_t u;
+  float f;
+};
+
+struct bf16_format {
+  typedef uint16_t storage;
+  static const pb_Type type = pb_Type_BF16;
+  static const char *name() { return "bf16"; }
+
+  static float widen(uint16_t h) [[hc]]
+  {
+    sgemm_bits b;
+    b.u = (uint32_t)h << 16;
+    return b.f;
+  }
+};
+
+struct fp16_format {
+  typedef uint16_t storage;
+  static const pb_Type type = pb_Type_F16;
+  static const char *name() { return "fp16"; }
+
+  static float widen(uint16_t h) [[hc]]
+  {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    sgemm_bits b;
+
+    if (exp == 0) {
+      // Zero or subnormal, mant * 2^-24
+      b.f = mant * (1.0f / 16777216.0f);
+      b.u |= sign;
+    } else if (exp == 31)
+      b.u = sign | 0x7f800000 | (mant << 13);
+    else
+      b.u = sign | ((exp + 112) << 23) | (mant << 13);
+    return b.f;
+  }
+};
+
+#endif
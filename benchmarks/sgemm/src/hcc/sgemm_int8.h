@@ -0,0 +1,63 @@
+/*
+ * Epilogues of the int8 products of regtileIgemm.
+ *
+ * A and B hold signed 8-bit integers and their products are accumulated
+ * exactly in int32.  An epilogue maps each int32 result to the element
+ * type of C as the kernel stores it:
+ *
+ *   Out operator()(int32_t acc, int i, int j) const [[hc]]
+ *
+ * int32_output stores the accumulators; requant_epilogue requantises
+ * them to int8 with scales and zero points per row and per column, as
+ * for per-channel quantised layers.
+ */
+
+#ifndef SGEMM_INT8_H
+#define SGEMM_INT8_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Store the int32 accumulators
+struct int32_output {
+  int32_t operator()(int32_t acc, int, int) const [[hc]] { return acc; }
+};
+
+// round(acc * scale * rowScale[i] * colScale[j]) + zero + rowZero[i] +
+// colZero[j], saturated to int8, rounding halves to even.  Any of the
+// arrays may be NULL; they must be readable by the device running the
+// kernel.
+struct requant_epilogue {
+  const float *rowScale;
+  const float *colScale;
+  const int32_t *rowZero;
+  const int32_t *colZero;
+  float scale;
+  int32_t zero;
+
+  int8_t operator()(int32_t acc, int i, int j) const [[hc]]
+  {
+    float s = scale;
+    int32_t z = zero;
+    if (rowScale)
+      s *= rowScale[i];
+    if (colScale)
+      s *= colScale[j];
+    if (rowZero)
+      z += rowZero[i];
+    if (colZero)
+      z += colZero[j];
+    float q = rintf((float)acc * s) + (float)z;
+    return (int8_t)(q < -128.0f ? -128.0f : (q > 127.0f ? 127.0f : q));
+  }
+};
+
+inline requant_epilogue makeRequantEpilogue(float scale, int32_t zero,
+    const float *rowScale = NULL, const float *colScale = NULL,
+    const int32_t *rowZero = NULL, const int32_t *colZero = NULL)
+{
+  requant_epilogue ep = {rowScale, colScale, rowZero, colZero, scale, zero};
+  return ep;
+}
+
+#endif
@@ -0,0 +1,349 @@
+/*
+ * Packed int8 GEMM for the host CPU: C = op(A) * op(B) with int8 A and B
+ * and exact int32 accumulation, the engine of regtileIgemm on the host
+ * backend.
+ *
+ * The loop nest is that of cpuSgemm (sgemm_cpu.cpp) without the split of
+ * k: int8 slivers are a quarter of the size of float ones, so an MR x k
+ * sliver of A and a k x NR sliver of B stay in cache for the k of the
+ * benchmark, and each micro-tile is finished in registers.  That leaves
+ * no partial sums in C, so the epilogue stores int8 straight from the
+ * registers' tile.
+ *
+ * k is packed in groups of four for vpdpbusd, which multiplies unsigned
+ * by signed bytes and adds each group of four products to an int32 lane.
+ * A is packed biased by 128, as unsigned, and 128 times the sum of each
+ * column of B is taken back off at the end.
+ *
+ * The micro-kernel is picked at run time: AVX512-VNNI 32x12, AVX-VNNI
+ * 16x6, or portable 8x4.  SGEMM_CPU_ISA=avx512|avx2|generic forces the
+ * one of that vector width, as for cpuSgemm.
+ */
+
+#include <hc.hpp>
+#include "sgemm_cpu.h"
+
+#ifdef HC_HOST_BACKEND
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace hc;
+
+namespace {
+
+// C[0:mr, 0:nr] = a * b - 128 * bsum from a packed mr x 4kq sliver of A,
+// biased, and a 4kq x nr sliver of B with its column sums bsum.
+typedef void (*int8_kernel)(int kq, const uint8_t *a, const int8_t *b,
+    const int32_t *bsum, int32_t *c, int ldc);
+
+struct int8_engine {
+  const char *name;
+  const char *isa;              // Of SGEMM_CPU_ISA
+  int mr, nr;                   // Register tile
+  int8_kernel kernel;
+};
+
+const int MAX_TILE = 32 * 12;   // Largest mr * nr
+const size_t A_BLOCK = 512 << 10;       // Bytes of a packed block of A
+const size_t B_PANEL = 4 << 20;         // Bytes of a packed panel of B
+
+template <int MR, int NR>
+void int8_generic(int kq, const uint8_t *a, const int8_t *b,
+    const int32_t *bsum, int32_t *c, int ldc)
+{
+  int32_t acc[NR][MR] = {};
+  for (int q = 0; q < kq; q++, a += 4 * MR, b += 4 * NR)
+    for (int j = 0; j < NR; j++)
+      for (int i = 0; i < MR; i++)
+        for (int t = 0; t < 4; t++)
+          acc[j][i] += (int32_t)a[4 * i + t] * b[4 * j + t];
+
+  for (int j = 0; j < NR; j++)
+    for (int i = 0; i < MR; i++)
+      c[i + j * ldc] = acc[j][i] - 128 * bsum[j];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline int32_t group(const int8_t *b)
+{
+  int32_t g;
+  memcpy(&g, b, sizeof(g));
+  return g;
+}
+
+// 16 x 6: two vectors of 8 rows per column of C, 12 accumulators.
+__attribute__((target("avx2,avxvnni")))
+void int8_avxvnni(int kq, const uint8_t *a, const int8_t *b,
+    const int32_t *bsum, int32_t *c, int ldc)
+{
+  __m256i acc[6][2];
+  for (int j = 0; j < 6; j++)
+    acc[j][0] = acc[j][1] = _mm256_setzero_si256();
+
+  for (int q = 0; q < kq; q++, a += 64, b += 24) {
+    __m256i a0 = _mm256_load_si256((const __m256i *)a);
+    __m256i a1 = _mm256_load_si256((const __m256i *)(a + 32));
+#pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) {
+      __m256i bj = _mm256_set1_epi32(group(b + 4 * j));
+      acc[j][0] = _mm256_dpbusd_avx_epi32(acc[j][0], a0, bj);
+      acc[j][1] = _mm256_dpbusd_avx_epi32(acc[j][1], a1, bj);
+    }
+  }
+
+  for (int j = 0; j < 6; j++) {
+    __m256i bias = _mm256_set1_epi32(128 * bsum[j]);
+    int32_t *cj = c + (size_t)j * ldc;
+    _mm256_storeu_si256((__m256i *)cj, _mm256_sub_epi32(acc[j][0], bias));
+    _mm256_storeu_si256((__m256i *)(cj + 8), _mm256_sub_epi32(acc[j][1], bias));
+  }
+}
+
+// 32 x 12: two vectors of 16 rows per column of C, 24 accumulators.
+__attribute__((target("avx512f,avx512vnni")))
+void int8_avx512vnni(int kq, const uint8_t *a, const int8_t *b,
+    const int32_t *bsum, int32_t *c, int ldc)
+{
+  __m512i acc[12][2];
+  for (int j = 0; j < 12; j++)
+    acc[j][0] = acc[j][1] = _mm512_setzero_si512();
+
+  for (int q = 0; q < kq; q++, a += 128, b += 48) {
+    __m512i a0 = _mm512_load_si512(a), a1 = _mm512_load_si512(a + 64);
+    _mm_prefetch((const char *)(a + 1024), _MM_HINT_T0);
+#pragma GCC unroll 12
+    for (int j = 0; j < 12; j++) {
+      __m512i bj = _mm512_set1_epi32(group(b + 4 * j));
+      acc[j][0] = _mm512_dpbusd_epi32(acc[j][0], a0, bj);
+      acc[j][1] = _mm512_dpbusd_epi32(acc[j][1], a1, bj);
+    }
+  }
+
+  for (int j = 0; j < 12; j++) {
+    __m512i bias = _mm512_set1_epi32(128 * bsum[j]);
+    int32_t *cj = c + (size_t)j * ldc;
+    _mm512_storeu_si512(cj, _mm512_sub_epi32(acc[j][0], bias));
+    _mm512_storeu_si512(cj + 16, _mm512_sub_epi32(acc[j][1], bias));
+  }
+}
+#endif
+
+const int8_engine engines[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  { "avx512vnni", "avx512", 32, 12, int8_avx512vnni },
+  { "avxvnni", "avx2", 16, 6, int8_avxvnni },
+#endif
+  { "generic", "generic", 8, 4, int8_generic<8, 4> },
+};
+
+bool supported(const int8_engine &e)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (strcmp(e.name, "avx512vnni") == 0)
+    return __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vnni");
+  if (strcmp(e.name, "avxvnni") == 0)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avxvnni");
+#endif
+  return true;
+}
+
+const int8_engine &select_engine()
+{
+  static const int8_engine *chosen = [] {
+    const char *isa = getenv("SGEMM_CPU_ISA");
+    const size_t count = sizeof(engines) / sizeof(engines[0]);
+    for (size_t i = 0; i < count; i++)
+      if (isa != NULL && *isa && strcmp(isa, engines[i].isa) == 0) {
+        if (supported(engines[i]))
+          return &engines[i];
+        std::cerr << "SGEMM_CPU_ISA=" << isa << " has no int8 kernel here" << std::endl;
+      }
+    for (size_t i = 0; i < count; i++)
+      if (supported(engines[i]))
+        return &engines[i];
+    return &engines[count - 1];
+  }();
+  return *chosen;
+}
+
+struct aligned_free {
+  void operator()(void *p) const { free(p); }
+};
+typedef std::unique_ptr<uint8_t, aligned_free> buffer;
+
+uint8_t *allocate(size_t bytes)
+{
+  bytes = (bytes + 63) / 64 * 64;
+  return static_cast<uint8_t *>(aligned_alloc(64, bytes ? bytes : 64));
+}
+
+// Pack op(A)[i0:i0+mc, 0:k] as mr-row slivers: for each group of four
+// columns, the four values of each row in turn, plus 128.  Rows and
+// columns past the ends are packed as 0.
+void packA(const int8_engine &e, bool trans, const int8_t *A, int lda,
+    int i0, int mc, int k, int kq, uint8_t *buf)
+{
+  for (int ir = 0; ir < mc; ir += e.mr, buf += (size_t)e.mr * 4 * kq) {
+    int rows = std::min(e.mr, mc - ir);
+    memset(buf, 0x80, (size_t)e.mr * 4 * kq);
+    if (!trans) {
+      for (int l = 0; l < k; l++) {
+        const int8_t *src = A + (i0 + ir) + (size_t)l * lda;
+        uint8_t *dst = buf + (size_t)(l / 4) * 4 * e.mr + l % 4;
+        for (int i = 0; i < rows; i++)
+          dst[4 * i] = (uint8_t)src[i] ^ 0x80;
+      }
+    } else {
+      // op(A)(i, l) = A[l + i*lda]: a row of op(A) is contiguous
+      for (int i = 0; i < rows; i++) {
+        const int8_t *src = A + (size_t)(i0 + ir + i) * lda;
+        for (int l = 0; l < k; l++)
+          buf[(size_t)(l / 4) * 4 * e.mr + 4 * i + l % 4] = (uint8_t)src[l] ^ 0x80;
+      }
+    }
+  }
+}
+
+// Pack op(B)[0:k, j0+jr] for the nr-column sliver starting at jr: for
+// each group of four rows, the four values of each column in turn.  The
+// sums of its columns go to bsum.  Columns past nc are 0.
+void packB(const int8_engine &e, bool trans, const int8_t *B, int ldb,
+    int k, int kq, int j0, int jr, int nc, int8_t *buf, int32_t *bsum)
+{
+  int cols = std::min(e.nr, nc - jr);
+  memset(buf, 0, (size_t)e.nr * 4 * kq);
+  for (int j = 0; j < e.nr; j++)
+    bsum[j] = 0;
+
+  if (trans) {
+    // op(B)(l, j) = B[j + l*ldb]: a row of the sliver is contiguous
+    for (int l = 0; l < k; l++) {
+      const int8_t *src = B + (j0 + jr) + (size_t)l * ldb;
+      int8_t *dst = buf + (size_t)(l / 4) * 4 * e.nr + l % 4;
+      for (int j = 0; j < cols; j++) {
+        dst[4 * j] = src[j];
+        bsum[j] += src[j];
+      }
+    }
+  } else {
+    for (int j = 0; j < cols; j++) {
+      const int8_t *src = B + (size_t)(j0 + jr + j) * ldb;
+      for (int l = 0; l < k; l++) {
+        buf[(size_t)(l / 4) * 4 * e.nr + 4 * j + l % 4] = src[l];
+        bsum[j] += src[l];
+      }
+    }
+  }
+}
+
+// Multiply a packed block of mc rows of A by the packed slivers of B
+// covering nc columns, into C at (i0, j0) or through store
+void macroKernel(const int8_engine &e, int mc, int nc, int kq,
+    const uint8_t *pa, const int8_t *pb, const int32_t *bsum,
+    int32_t *C, int ldc, const cpu_int_store *store, int i0, int j0)
+{
+  alignas(64) int32_t tile[MAX_TILE];
+
+  for (int jr = 0; jr < nc; jr += e.nr) {
+    int cols = std::min(e.nr, nc - jr);
+    const int8_t *b = pb + (size_t)jr * 4 * kq;
+    for (int ir = 0; ir < mc; ir += e.mr) {
+      int rows = std::min(e.mr, mc - ir);
+      const uint8_t *a = pa + (size_t)ir * 4 * kq;
+      if (!store && rows == e.mr && cols == e.nr) {
+        e.kernel(kq, a, b, bsum + jr, C + (i0 + ir) + (size_t)(j0 + jr) * ldc, ldc);
+        continue;
+      }
+      e.kernel(kq, a, b, bsum + jr, tile, e.mr);
+      if (store)
+        store->store(store->state, tile, e.mr, i0 + ir, j0 + jr, rows, cols);
+      else
+        for (int j = 0; j < cols; j++)
+          memcpy(C + (i0 + ir) + (size_t)(j0 + jr + j) * ldc, tile + j * e.mr,
+              rows * sizeof(int32_t));
+    }
+  }
+}
+
+bool transposed(char t) { return t == 'T' || t == 't' || t == 'C' || t == 'c'; }
+bool valid(char t) { return transposed(t) || t == 'N' || t == 'n'; }
+
+} // namespace
+
+const char *cpuIgemmKernelName()
+{
+  return select_engine().name;
+}
+
+void cpuIgemm(char transa, char transb, int m, int n, int k,
+    const int8_t *A, int lda, const int8_t *B, int ldb,
+    int32_t *C, int ldc, const cpu_int_store *store)
+{
+  if (!valid(transa) || !valid(transb)) {
+    std::cerr << "unsupported value of 'transa' or 'transb' in cpuIgemm()" << std::endl;
+    return;
+  }
+  if (m <= 0 || n <= 0)
+    return;
+  if (k < 0)
+    k = 0;
+
+  const int8_engine &e = select_engine();
+  const bool ta = transposed(transa), tb = transposed(transb);
+  const int workers = std::max(1u, accelerator().get_cu_count());
+  const int kq = (k + 3) / 4;
+
+  // Blocks of A and panels of B of about A_BLOCK and B_PANEL bytes
+  const size_t sliverA = (size_t)e.mr * 4 * std::max(kq, 1);
+  const size_t sliverB = (size_t)e.nr * 4 * std::max(kq, 1);
+  const int mc = (int)std::max<size_t>(1, A_BLOCK / sliverA) * e.mr;
+  const int nc = (int)std::max<size_t>(1, B_PANEL / sliverB) * e.nr;
+  const int panel_cols = std::min(nc, (n + e.nr - 1) / e.nr * e.nr);
+  buffer panel(allocate(sliverB / e.nr * panel_cols));
+  std::unique_ptr<int32_t[]> sums(new int32_t[panel_cols]);
+
+  for (int jc = 0; jc < n; jc += nc) {
+    const int ncols = std::min(nc, n - jc);
+    const int slivers = (ncols + e.nr - 1) / e.nr;
+    int8_t *pb = (int8_t *)panel.get();
+    int32_t *bsum = sums.get();
+
+    // As in cpuSgemm: a few tasks per worker, 8 slivers each at least
+    const int mblocks = (m + mc - 1) / mc;
+    int nsplit = std::max(1, std::min(slivers / 8, (4 * workers + mblocks - 1) / mblocks));
+    const int per_task = (slivers + nsplit - 1) / nsplit * e.nr;
+    nsplit = (ncols + per_task - 1) / per_task;
+
+    parallel_for_each(extent<1>(slivers), [=](index<1> s) {
+      int jr = s[0] * e.nr;
+      packB(e, tb, B, ldb, k, kq, jc, jr, ncols, pb + (size_t)jr * 4 * kq,
+          bsum + jr);
+    });
+
+    parallel_for_each(extent<2>(mblocks, nsplit), [=](index<2> t) {
+      static thread_local buffer block;
+      static thread_local size_t block_size;
+      size_t bytes = (size_t)mc * 4 * kq;
+      if (block_size < bytes) {
+        block.reset(allocate(bytes));
+        block_size = bytes;
+      }
+
+      const int ic = t[0] * mc, rows = std::min(mc, m - ic);
+      const int jr = t[1] * per_task, cols = std::min(per_task, ncols - jr);
+      packA(e, ta, A, lda, ic, rows, k, kq, block.get());
+      macroKernel(e, rows, cols, kq, block.get(), pb + (size_t)jr * 4 * kq,
+          bsum + jr, C, ldc, store, ic, jc + jr);
+    });
+  }
+}
+
+#endif // HC_HOST_BACKEND
@@ -33,80 +33,589 @@ for i < M ; i += 64   // thread block.x
 
 */
 
-// Parameters of tile sizes
-#define TILE_N 16
-#define TILE_TB_HEIGHT 8
-#define TILE_M (TILE_N*TILE_TB_HEIGHT)
+#ifdef HC_HOST_BACKEND
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+#include "sgemm_cpu.h"
+#endif
+#include <parboil.h>
+#include "sgemm_tune.h"
+#include "sgemm_epilogue.h"
+#include "sgemm_half.h"
+#include "sgemm_int8.h"
 
-void mysgemmNT(
-        tiled_index<2> tidx,
-        const array_view<const float>& A, int lda,
-        const array_view<const float>& B, int ldb,
-        const array_view<float>& C, int ldc, int k, float alpha, float beta ) [[hc]]
+// Tile shapes compiled into the kernel.  A thread block of TILE_N x
+// TILE_TB_HEIGHT threads computes TILE_M = TILE_N * TILE_TB_HEIGHT rows
+// by TILE_N columns of C, each thread a row of TILE_N values, and steps
+// through k TILE_TB_HEIGHT rows of B at a time.  The first is the default.
+struct sgemm_variant {
+  const char *name;
+  int tileN, tileHeight;
+};
+
+static const sgemm_variant sgemmVariants[] = {
+  {"16x8", 16, 8}, {"16x4", 16, 4}, {"8x8", 8, 8},
+  {"8x16", 8, 16}, {"32x4", 32, 4}, {"32x8", 32, 8},
+};
+static const int sgemmVariantCount =
+  sizeof(sgemmVariants) / sizeof(sgemmVariants[0]);
+
+// Element (i, l) of op(A) and (l, j) of op(B), column-major
+template <bool transA, typename Matrix>
+inline float loadA(const Matrix& A, int lda, int i, int l) [[hc]]
 {
-    // Partial results
-    index<2> threadIdx(tidx.local);
-    index<2> blockIdx(tidx.tile);
-    index<2> globalIdx(tidx.global);
-    index<2> blockDim(tidx.tile_dim);
+    return transA ? A[l + i*lda] : A[i + l*lda];
+}
+
+template <bool transB, typename Matrix>
+inline float loadB(const Matrix& B, int ldb, int l, int j) [[hc]]
+{
+    return transB ? B[j + l*ldb] : B[l + j*ldb];
+}
+
+// One TILE_M x TILE_N tile of C per thread block, the block at (bx, by)
+// of the C grid and the thread at (tx, ty) within it.  Rows of op(A) and
+// columns of op(B) past m, n and k read as zero and the matching elements
+// of C are not written, so the sizes need not be multiples of the tiles.
+// The epilogue is applied to each element as it is stored.
+template <int TILE_N, int TILE_TB_HEIGHT, bool transA, bool transB,
+          typename MatA, typename MatB, typename MatC, typename Epilogue>
+void mysgemm(
+        int tx, int ty, int bx, int by, const tile_barrier& barrier,
+        const MatA& A, int lda,
+        const MatB& B, int ldb,
+        const MatC& C, int ldc,
+        int m, int n, int k, float alpha, float beta,
+        const Epilogue& epilogue ) [[hc]]
+{
+    const int TILE_M = TILE_N * TILE_TB_HEIGHT;
 
+    // Partial results
     float c[TILE_N];
     for (int i=0; i < TILE_N; i++)
 	c[i] = 0.0f;
-    int mid = threadIdx[1] * blockDim[0] + threadIdx[0]; //flattened id
-    int m = blockIdx[0] * TILE_M + mid;
-    int n = blockIdx[1] * TILE_N + threadIdx[0];
+    int mid = ty * TILE_N + tx; //flattened id
+    int row = bx * TILE_M + mid;
+    int col0 = by * TILE_N;
+    int col = col0 + tx;
     tile_static float b_s[TILE_TB_HEIGHT][TILE_N];
     for (int i = 0; i < k; i+=TILE_TB_HEIGHT) {
 	float a;
-	b_s[threadIdx[1]][threadIdx[0]]=B[n + (i+threadIdx[1])*ldb];
-    tidx.barrier.wait();
-	for (int j = 0; j < TILE_TB_HEIGHT; j++) {
-	    a = A[m + (i+j)*lda];
+	int l = i + ty;
+	b_s[ty][tx] = (col < n && l < k) ? loadB<transB>(B, ldb, l, col) : 0.0f;
+    barrier.wait();
+	int steps = k - i < TILE_TB_HEIGHT ? k - i : TILE_TB_HEIGHT;
+	if (row < m) {
+	for (int j = 0; j < steps; j++) {
+	    a = loadA<transA>(A, lda, row, i+j);
 	    for (int kk = 0; kk < TILE_N; kk++)
 		c[kk] += a * b_s[j][kk];
 
 	}
-    tidx.barrier.wait();
+	}
+    barrier.wait();
+    }
+    if (row >= m)
+	return;
+    int cols = n - col0 < TILE_N ? n - col0 : TILE_N;
+    int t = ldc*col0 + row;
+    for (int i = 0; i < cols; i++) {
+	C[t+i*ldc] = epilogue(C[t+i*ldc] * beta + alpha * c[i], row, col0+i);
     }
-    int t = ldc*blockIdx[1] * TILE_N + m;
-    for (int i = 0; i < TILE_N; i++) {
-	C[t+i*ldc] = C[t+i*ldc] * beta + alpha * c[i];
+}
+
+// The int8 product of mysgemm: the same tiling, with the elements widened
+// to int32 and accumulated exactly.  The epilogue converts each result to
+// the element type of C.
+template <int TILE_N, int TILE_TB_HEIGHT, bool transA, bool transB,
+          typename Out, typename Epilogue>
+void myigemm(
+        int tx, int ty, int bx, int by, const tile_barrier& barrier,
+        const array_view<const int8_t>& A, int lda,
+        const array_view<const int8_t>& B, int ldb,
+        const array_view<Out>& C, int ldc,
+        int m, int n, int k, const Epilogue& epilogue ) [[hc]]
+{
+    const int TILE_M = TILE_N * TILE_TB_HEIGHT;
+
+    int32_t c[TILE_N];
+    for (int i=0; i < TILE_N; i++)
+	c[i] = 0;
+    int mid = ty * TILE_N + tx; //flattened id
+    int row = bx * TILE_M + mid;
+    int col0 = by * TILE_N;
+    int col = col0 + tx;
+    tile_static int32_t b_s[TILE_TB_HEIGHT][TILE_N];
+    for (int i = 0; i < k; i+=TILE_TB_HEIGHT) {
+	int l = i + ty;
+	b_s[ty][tx] = (col < n && l < k) ? (transB ? B[col + l*ldb] : B[l + col*ldb]) : 0;
+    barrier.wait();
+	int steps = k - i < TILE_TB_HEIGHT ? k - i : TILE_TB_HEIGHT;
+	if (row < m) {
+	for (int j = 0; j < steps; j++) {
+	    int32_t a = transA ? A[i+j + row*lda] : A[row + (i+j)*lda];
+	    for (int kk = 0; kk < TILE_N; kk++)
+		c[kk] += a * b_s[j][kk];
+	}
+	}
+    barrier.wait();
     }
+    if (row >= m)
+	return;
+    int cols = n - col0 < TILE_N ? n - col0 : TILE_N;
+    int t = ldc*col0 + row;
+    for (int i = 0; i < cols; i++)
+	C[t+i*ldc] = epilogue(c[i], row, col0+i);
 }
 
+// Matrix 'offset' elements into an array_view, as in a strided batch
+template <typename T>
+struct strided_matrix {
+  array_view<T> data;
+  long long offset;
+
+  T& operator[](int i) const [[hc]] { return data[(int)(offset + i)]; }
+};
+
+// The matrices of a batch laid out at fixed strides in three array_views.
+// A single sgemm is a batch of one.
+struct strided_batch {
+  array_view<const float> A, B;
+  array_view<float> C;
+  long long strideA, strideB, strideC;
+
+  strided_matrix<const float> a(int i) const [[hc]] { return {A, i*strideA}; }
+  strided_matrix<const float> b(int i) const [[hc]] { return {B, i*strideB}; }
+  strided_matrix<float> c(int i) const [[hc]] { return {C, i*strideC}; }
+};
+
+// Elements of a half-width matrix 'offset' elements into an array_view,
+// read as floats
+template <typename Format>
+struct half_matrix {
+  array_view<const uint16_t> data;
+  long long offset;
+
+  float operator[](int i) const [[hc]]
+  {
+    return Format::widen(data[(int)(offset + i)]);
+  }
+};
+
+// As strided_batch, with A and B stored in a half-width format
+template <typename Format>
+struct half_batch {
+  array_view<const uint16_t> A, B;
+  array_view<float> C;
+  long long strideA, strideB, strideC;
+
+  half_matrix<Format> a(int i) const [[hc]] { return {A, i*strideA}; }
+  half_matrix<Format> b(int i) const [[hc]] { return {B, i*strideB}; }
+  strided_matrix<float> c(int i) const [[hc]] { return {C, i*strideC}; }
+};
+
+// The matrices of a batch given by arrays of pointers
+struct pointer_batch {
+  array_view<const float * const> A, B;
+  array_view<float * const> C;
+
+  const float *a(int i) const [[hc]] { return A[i]; }
+  const float *b(int i) const [[hc]] { return B[i]; }
+  float *c(int i) const [[hc]] { return C[i]; }
+};
+
+// One launch for the whole batch: the batch index is the outer grid
+// dimension, with one tile of the grid per matrix along it.
+template <int TILE_N, int TILE_TB_HEIGHT, bool transA, bool transB,
+          typename Batch, typename Epilogue>
+void launchSgemm(
+        accelerator_view& av, int m, int n, int k, float alpha,
+        const Batch& batch, int lda, int ldb, float beta, int ldc,
+        int batchCount, const Epilogue& epilogue )
+{
+  const int TILE_M = TILE_N * TILE_TB_HEIGHT;
+
+  // Round the grid up to whole tiles; mysgemm masks the remainder
+  int dg[3] = {batchCount, (m + TILE_M - 1)/TILE_M*TILE_N,
+               (n + TILE_N - 1)/TILE_N*TILE_TB_HEIGHT};
+  int db[3] = {1,TILE_N,TILE_TB_HEIGHT};
+
+  parallel_for_each(av, extent<3>(dg).tile(db[0], db[1], db[2]),
+          [=] (tiled_index<3> tidx) [[hc]]
+          {
+          int i = tidx.tile[0];
+          mysgemm<TILE_N, TILE_TB_HEIGHT, transA, transB>(tidx.local[1], tidx.local[2],
+              tidx.tile[1], tidx.tile[2], tidx.barrier,
+              batch.a(i), lda, batch.b(i), ldb, batch.c(i), ldc,
+              m, n, k, alpha, beta, epilogue);
+          });
+}
+
+// The kernel of one tile shape for the transposes
+template <int TILE_N, int TILE_TB_HEIGHT, typename Batch, typename Epilogue>
+void launchTiles(
+        accelerator_view& av, bool ta, bool tb,
+        int m, int n, int k, float alpha,
+        const Batch& batch, int lda, int ldb, float beta, int ldc,
+        int batchCount, const Epilogue& epilogue )
+{
+  if (ta && tb)
+    launchSgemm<TILE_N, TILE_TB_HEIGHT, true, true>(av, m, n, k, alpha,
+        batch, lda, ldb, beta, ldc, batchCount, epilogue);
+  else if (ta)
+    launchSgemm<TILE_N, TILE_TB_HEIGHT, true, false>(av, m, n, k, alpha,
+        batch, lda, ldb, beta, ldc, batchCount, epilogue);
+  else if (tb)
+    launchSgemm<TILE_N, TILE_TB_HEIGHT, false, true>(av, m, n, k, alpha,
+        batch, lda, ldb, beta, ldc, batchCount, epilogue);
+  else
+    launchSgemm<TILE_N, TILE_TB_HEIGHT, false, false>(av, m, n, k, alpha,
+        batch, lda, ldb, beta, ldc, batchCount, epilogue);
+}
+
+// The kernel of sgemmVariants[variant]
+template <typename Batch, typename Epilogue>
+void launchVariant(
+        accelerator_view& av, int variant, bool ta, bool tb,
+        int m, int n, int k, float alpha,
+        const Batch& batch, int lda, int ldb, float beta, int ldc,
+        int batchCount, const Epilogue& epilogue )
+{
+  switch (variant) {
+  case 1: launchTiles<16, 4>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  case 2: launchTiles<8, 8>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  case 3: launchTiles<8, 16>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  case 4: launchTiles<32, 4>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  case 5: launchTiles<32, 8>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  default: launchTiles<16, 8>(av, ta, tb, m, n, k, alpha, batch, lda, ldb, beta, ldc, batchCount, epilogue); break;
+  }
+}
+
+// The int8 kernel of sgemmVariants[variant]
+template <int TILE_N, int TILE_TB_HEIGHT, bool transA, bool transB,
+          typename Out, typename Epilogue>
+void launchIgemm(
+        accelerator_view& av, int m, int n, int k,
+        const array_view<const int8_t>& A, int lda,
+        const array_view<const int8_t>& B, int ldb,
+        const array_view<Out>& C, int ldc, const Epilogue& epilogue )
+{
+  const int TILE_M = TILE_N * TILE_TB_HEIGHT;
+  int dg[2] = {(m + TILE_M - 1)/TILE_M*TILE_N, (n + TILE_N - 1)/TILE_N*TILE_TB_HEIGHT};
+
+  parallel_for_each(av, extent<2>(dg).tile(TILE_N, TILE_TB_HEIGHT),
+          [=] (tiled_index<2> tidx) [[hc]]
+          {
+          myigemm<TILE_N, TILE_TB_HEIGHT, transA, transB>(tidx.local[0],
+              tidx.local[1], tidx.tile[0], tidx.tile[1], tidx.barrier,
+              A, lda, B, ldb, C, ldc, m, n, k, epilogue);
+          });
+}
+
+template <int TILE_N, int TILE_TB_HEIGHT, typename Out, typename Epilogue>
+void launchIgemmTiles(
+        accelerator_view& av, bool ta, bool tb, int m, int n, int k,
+        const array_view<const int8_t>& A, int lda,
+        const array_view<const int8_t>& B, int ldb,
+        const array_view<Out>& C, int ldc, const Epilogue& epilogue )
+{
+  if (ta && tb)
+    launchIgemm<TILE_N, TILE_TB_HEIGHT, true, true>(av, m, n, k, A, lda, B, ldb, C, ldc, epilogue);
+  else if (ta)
+    launchIgemm<TILE_N, TILE_TB_HEIGHT, true, false>(av, m, n, k, A, lda, B, ldb, C, ldc, epilogue);
+  else if (tb)
+    launchIgemm<TILE_N, TILE_TB_HEIGHT, false, true>(av, m, n, k, A, lda, B, ldb, C, ldc, epilogue);
+  else
+    launchIgemm<TILE_N, TILE_TB_HEIGHT, false, false>(av, m, n, k, A, lda, B, ldb, C, ldc, epilogue);
+}
+
+static int findVariant(const char *name)
+{
+  for (int v = 0; v < sgemmVariantCount; v++)
+    if (strcmp(sgemmVariants[v].name, name) == 0)
+      return v;
+  return -1;
+}
+
+// Time every variant on operands of this shape and record the fastest for
+// the shape's bucket.  Returns its index.
+static int tuneSgemm(accelerator_view& av, bool ta, bool tb, int m, int n, int k)
+{
+  const int reps = 3;
+  array_view<float> A(m * k > 0 ? m * k : 1);
+  array_view<float> B(k * n > 0 ? k * n : 1);
+  array_view<float> C(m * n);
+  strided_batch one = {A, B, C, 0, 0, 0};
+  int lda = ta ? k : m, ldb = tb ? n : k;
+  int best = 0;
+  double best_gflops = 0;
+
+  std::cout << "sgemm autotune " << (ta ? 'T' : 'N') << (tb ? 'T' : 'N')
+    << " " << m << "x" << n << "x" << k << ":";
+  for (int v = 0; v < sgemmVariantCount; v++) {
+    double best_ns = 0;
+    // The first run warms up; the fastest of the others counts
+    for (int r = 0; r <= reps; r++) {
+      pb_Timestamp begin = pb_GetTimestamp();
+      launchVariant(av, v, ta, tb, m, n, k, 1.0f, one, lda, ldb, 0.0f, m, 1,
+          no_epilogue());
+      av.wait();
+      double ns = pb_TicksToNanoseconds(pb_GetTimestamp() - begin);
+      if (r > 0 && (best_ns == 0 || ns < best_ns))
+        best_ns = ns;
+    }
+    double gflops = 2.0 * m * n * k / (best_ns > 0 ? best_ns : 1);
+    std::cout << " " << sgemmVariants[v].name << " " << gflops;
+    if (gflops > best_gflops) {
+      best_gflops = gflops;
+      best = v;
+    }
+  }
+  std::cout << " GFLOP/s, using " << sgemmVariants[best].name << std::endl;
+  sgemmRecordVariant(ta ? 'T' : 'N', tb ? 'T' : 'N', m, n, k,
+      sgemmVariants[best].name, best_gflops);
+  return best;
+}
+
+// The variant to run: SGEMM_VARIANT, else the cached winner of the
+// shape's bucket, else a fresh tuning run with SGEMM_AUTOTUNE, else the
+// default
+static int selectVariant(accelerator_view& av, bool ta, bool tb, int m, int n, int k)
+{
+  const char *name = getenv("SGEMM_VARIANT");
+  int v;
+
+  if (name != NULL && *name) {
+    if ((v = findVariant(name)) >= 0)
+      return v;
+    std::cerr << "unknown SGEMM_VARIANT " << name << ", using "
+      << sgemmVariants[0].name << std::endl;
+    return 0;
+  }
+  name = sgemmTunedVariant(ta ? 'T' : 'N', tb ? 'T' : 'N', m, n, k);
+  if (name != NULL && (v = findVariant(name)) >= 0)
+    return v;
+  if (sgemmAutotuneEnabled())
+    return tuneSgemm(av, ta, tb, m, n, k);
+  return 0;
+}
+
+// Check the arguments shared by all entry points and launch the kernel
+// variant chosen for the shape
+template <typename Batch, typename Epilogue>
+void dispatchSgemm(
+        accelerator_view& av, const char *caller,
+        char transa, char transb, int m, int n, int k, float alpha,
+        const Batch& batch, int lda, int ldb, float beta, int ldc,
+        int batchCount, const Epilogue& epilogue )
+{
+  bool ta = (transa == 'T') || (transa == 't');
+  bool tb = (transb == 'T') || (transb == 't');
+
+  if (!ta && (transa != 'N') && (transa != 'n')) {
+    std::cerr << "unsupported value of 'transa' in " << caller << "()" << std::endl;
+    return;
+  }
+
+  if (!tb && (transb != 'N') && (transb != 'n')) {
+    std::cerr << "unsupported value of 'transb' in " << caller << "()" << std::endl;
+    return;
+  }
+
+  if ((m <= 0) || (n <= 0) || (batchCount <= 0))
+    return;
+
+  int variant = selectVariant(av, ta, tb, m, n, k);
+  launchVariant(av, variant, ta, tb, m, n, k, alpha, batch, lda, ldb, beta,
+      ldc, batchCount, epilogue);
+}
+
+#ifdef HC_HOST_BACKEND
+// On the host backend the packed CPU engine does the work of the kernel
+// launch; SGEMM_ENGINE=kernel runs the tiled kernel instead.
+inline bool useCpuEngine()
+{
+  const char *engine = getenv("SGEMM_ENGINE");
+  return engine == NULL || strcmp(engine, "kernel") != 0;
+}
+
+// The epilogue over a block of C stored by the CPU engine
+template <typename Epilogue>
+void applyCpuEpilogue(const void *state, float *c, int ldc, int i0, int j0,
+    int rows, int cols)
+{
+  const Epilogue& epilogue = *static_cast<const Epilogue *>(state);
+  for (int j = 0; j < cols; j++)
+    for (int i = 0; i < rows; i++)
+      c[i + (size_t)j * ldc] = epilogue(c[i + (size_t)j * ldc], i0 + i, j0 + j);
+}
+#endif
+
+// C = epilogue(alpha * op(A) * op(B) + beta * C), elementwise
+template <typename Epilogue = no_epilogue>
 void regtileSgemm(
         accelerator_view& av,
         char transa, char transb, int m, int n, int k, float alpha,
         array_view<const float>& A, int lda,
         array_view<const float>& B, int ldb, float beta,
-        array_view<float>& C, int ldc )
+        array_view<float>& C, int ldc,
+        const Epilogue& epilogue = Epilogue() )
 {
-  if ((transa != 'N') && (transa != 'n')) {
-    std::cerr << "unsupported value of 'transa' in regtileSgemm()" << std::endl;
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine()) {
+    cpu_epilogue ep = {applyCpuEpilogue<Epilogue>, &epilogue};
+    cpuSgemm(transa, transb, m, n, k, alpha, A.data(), lda, B.data(), ldb,
+        beta, C.data(), ldc, std::is_same<Epilogue, no_epilogue>::value ? NULL : &ep);
     return;
   }
+#endif
 
-  if ((transb != 'T') && (transb != 't')) {
-    std::cerr << "unsupported value of 'transb' in regtileSgemm()" << std::endl;
+  strided_batch one = {A, B, C, 0, 0, 0};
+  dispatchSgemm(av, "regtileSgemm", transa, transb, m, n, k, alpha,
+      one, lda, ldb, beta, ldc, 1, epilogue);
+}
+
+// regtileSgemm with A and B stored in a half-width Format, fp16_format or
+// bf16_format (sgemm_half.h).  Elements are widened as the kernel loads
+// them and accumulated in float, so C stays float.
+template <typename Format, typename Epilogue = no_epilogue>
+void regtileSgemmHalf(
+        accelerator_view& av,
+        char transa, char transb, int m, int n, int k, float alpha,
+        array_view<const uint16_t>& A, int lda,
+        array_view<const uint16_t>& B, int ldb, float beta,
+        array_view<float>& C, int ldc,
+        const Epilogue& epilogue = Epilogue() )
+{
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine()) {
+    cpu_epilogue ep = {applyCpuEpilogue<Epilogue>, &epilogue};
+    cpuSgemmHalf(Format::type, transa, transb, m, n, k, alpha, A.data(), lda,
+        B.data(), ldb, beta, C.data(), ldc,
+        std::is_same<Epilogue, no_epilogue>::value ? NULL : &ep);
     return;
   }
+#endif
+
+  half_batch<Format> one = {A, B, C, 0, 0, 0};
+  dispatchSgemm(av, "regtileSgemmHalf", transa, transb, m, n, k, alpha,
+      one, lda, ldb, beta, ldc, 1, epilogue);
+}
 
-  // In this code we assume the matrix sizes are multiple of tile size
-  if ((m%TILE_M) || (n%TILE_N)) {
-    std::cerr << "unsupported size of matrix. m should be multiple of " << TILE_M
-      << "; n should be multiple of " << TILE_N << std::endl;
+#ifdef HC_HOST_BACKEND
+// The int32 results of a block of the CPU engine through the epilogue
+template <typename Out, typename Epilogue>
+struct cpu_int_output {
+  Out *C;
+  int ldc;
+  const Epilogue *epilogue;
+
+  static void store(const void *state, const int32_t *acc, int ldacc,
+      int i0, int j0, int rows, int cols)
+  {
+    const cpu_int_output& out = *static_cast<const cpu_int_output *>(state);
+    for (int j = 0; j < cols; j++)
+      for (int i = 0; i < rows; i++)
+        out.C[(i0 + i) + (size_t)(j0 + j) * out.ldc] =
+          (*out.epilogue)(acc[i + (size_t)j * ldacc], i0 + i, j0 + j);
   }
+};
+#endif
 
+// C = epilogue(op(A) * op(B)) with int8 A and B, accumulated exactly in
+// int32.  C holds int32_t for int32_output, the default, or int8_t for
+// requant_epilogue (sgemm_int8.h).  The tile shape is SGEMM_VARIANT's,
+// as the autotuner times the float kernels.
+template <typename Out = int32_t, typename Epilogue = int32_output>
+void regtileIgemm(
+        accelerator_view& av,
+        char transa, char transb, int m, int n, int k,
+        array_view<const int8_t>& A, int lda,
+        array_view<const int8_t>& B, int ldb,
+        array_view<Out>& C, int ldc,
+        const Epilogue& epilogue = Epilogue() )
+{
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine()) {
+    if (std::is_same<Out, int32_t>::value &&
+        std::is_same<Epilogue, int32_output>::value) {
+      cpuIgemm(transa, transb, m, n, k, A.data(), lda, B.data(), ldb,
+          (int32_t *)C.data(), ldc);
+    } else {
+      cpu_int_output<Out, Epilogue> out = {C.data(), ldc, &epilogue};
+      cpu_int_store store = {cpu_int_output<Out, Epilogue>::store, &out};
+      cpuIgemm(transa, transb, m, n, k, A.data(), lda, B.data(), ldb,
+          NULL, 0, &store);
+    }
+    return;
+  }
+#endif
 
-  int dg[2] = {m*TILE_N/TILE_M,n*TILE_TB_HEIGHT/TILE_N};
-  int db[2] = {TILE_N,TILE_TB_HEIGHT};
+  bool ta = (transa == 'T') || (transa == 't');
+  bool tb = (transb == 'T') || (transb == 't');
+  if ((!ta && transa != 'N' && transa != 'n') ||
+      (!tb && transb != 'N' && transb != 'n')) {
+    std::cerr << "unsupported value of 'transa' or 'transb' in regtileIgemm()" << std::endl;
+    return;
+  }
+  if ((m <= 0) || (n <= 0))
+    return;
 
-  parallel_for_each(av, extent<2>(dg).tile(db[0], db[1]),
-          [=] (tiled_index<2> tidx) [[hc]]
-          {
-          mysgemmNT(tidx, A, lda, B, ldb, C, ldc, k, alpha, beta);
-          });
+  const char *name = getenv("SGEMM_VARIANT");
+  int variant = name && *name ? findVariant(name) : 0;
+  switch (variant) {
+  case 1: launchIgemmTiles<16, 4>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  case 2: launchIgemmTiles<8, 8>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  case 3: launchIgemmTiles<8, 16>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  case 4: launchIgemmTiles<32, 4>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  case 5: launchIgemmTiles<32, 8>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  default: launchIgemmTiles<16, 8>(av, ta, tb, m, n, k, A, lda, B, ldb, C, ldc, epilogue); break;
+  }
+}
+
+// batchCount products C_i = alpha * op(A_i) * op(B_i) + beta * C_i of
+// the same shape, matrix i starting i * stride elements into each view,
+// in a single launch.
+void sgemmStridedBatched(
+        accelerator_view& av,
+        char transa, char transb, int m, int n, int k, float alpha,
+        array_view<const float>& A, int lda, long long strideA,
+        array_view<const float>& B, int ldb, long long strideB, float beta,
+        array_view<float>& C, int ldc, long long strideC, int batchCount )
+{
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine()) {
+    cpuSgemmStridedBatched(transa, transb, m, n, k, alpha,
+        A.data(), lda, strideA, B.data(), ldb, strideB, beta,
+        C.data(), ldc, strideC, batchCount);
+    return;
+  }
+#endif
 
+  strided_batch batch = {A, B, C, strideA, strideB, strideC};
+  dispatchSgemm(av, "sgemmStridedBatched", transa, transb, m, n, k, alpha,
+      batch, lda, ldb, beta, ldc, batchCount, no_epilogue());
 }
 
+// As sgemmStridedBatched, with matrix i at Aarray[i], Barray[i] and
+// Carray[i].  The pointers must be usable by the accelerator.
+void sgemmBatched(
+        accelerator_view& av,
+        char transa, char transb, int m, int n, int k, float alpha,
+        array_view<const float * const>& Aarray, int lda,
+        array_view<const float * const>& Barray, int ldb, float beta,
+        array_view<float * const>& Carray, int ldc, int batchCount )
+{
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine()) {
+    cpuSgemmBatched(transa, transb, m, n, k, alpha, Aarray.data(), lda,
+        Barray.data(), ldb, beta, Carray.data(), ldc, batchCount);
+    return;
+  }
+#endif
+
+  pointer_batch batch = {Aarray, Barray, Carray};
+  dispatchSgemm(av, "sgemmBatched", transa, transb, m, n, k, alpha,
+      batch, lda, ldb, beta, ldc, batchCount, no_epilogue());
+}
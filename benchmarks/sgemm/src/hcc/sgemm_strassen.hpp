@@ -0,0 +1,261 @@
+/*
+ * Strassen-Winograd multiplication on top of regtileSgemm.
+ *
+ * Each level splits op(A), op(B) and C into quadrants and forms C from
+ * 7 products of half size instead of 8, with 15 additions, in the order
+ * of Douglas et al. that needs two temporaries per level: X of
+ * m/2 x max(k/2, n/2) and Y of k/2 x n/2 elements.  Products whose
+ * dimensions would drop below the cutoff are left to regtileSgemm.  An
+ * odd row, column or step of k is peeled off and added with the kernel.
+ * The temporaries of all levels come from one arena allocated per call.
+ *
+ *   SGEMM_STRASSEN=1             multiply with strassenSgemm
+ *   SGEMM_STRASSEN_CUTOFF=<n>    smallest dimension of a product that
+ *                                is split further, halved; 2048 by
+ *                                default, so 4096 recurses once
+ *
+ * The error bound grows by about 9 times per level relative to that of
+ * the classical product (Higham, Accuracy and Stability of Numerical
+ * Algorithms, 23.2.2), so it suits throughput jobs that can take a
+ * relative error of around 1e-4.
+ */
+
+// Operations done by strassenSgemm
+struct strassen_stats {
+  int levels;
+  double multiplyFlops;   // In the products passed to regtileSgemm
+  double addFlops;        // In the additions of the quadrants
+};
+
+// op(X) of a product: the matrix 'offset' elements into a view, with
+// leading dimension ld, transposed if trans
+struct strassen_operand {
+  array_view<const float> data;
+  long long offset;
+  int ld;
+  bool trans;
+
+  // Offset of element (i, j) of op(X)
+  long long at(int i, int j) const [[hc]]
+  {
+    return offset + (trans ? j + (long long)i * ld : i + (long long)j * ld);
+  }
+
+  // Quadrant (r, c) of quadrants of rows x cols
+  strassen_operand quadrant(int r, int c, int rows, int cols) const
+  {
+    strassen_operand q = {data, at(r * rows, c * cols), ld, trans};
+    return q;
+  }
+};
+
+// A matrix written by a step: a quadrant of C, or a temporary, which is
+// transposed like the operands it is formed from so that additions run
+// along their columns
+struct strassen_target {
+  array_view<float> data;
+  long long offset;
+  int ld;
+  bool trans;
+
+  long long at(int i, int j) const [[hc]]
+  {
+    return offset + (trans ? j + (long long)i * ld : i + (long long)j * ld);
+  }
+
+  float& operator()(int i, int j) const [[hc]]
+  {
+    return data[(int)at(i, j)];
+  }
+
+  strassen_target sub(int i, int j) const
+  {
+    strassen_target t = {data, at(i, j), ld, trans};
+    return t;
+  }
+
+  strassen_operand operand() const
+  {
+    strassen_operand o = {data, offset, ld, trans};
+    return o;
+  }
+};
+
+static int strassenCutoff()
+{
+  const char *s = getenv("SGEMM_STRASSEN_CUTOFF");
+  int cutoff = (s && *s) ? atoi(s) : 2048;
+  return cutoff < 16 ? 16 : cutoff;
+}
+
+// Z = a * X + b * Y over rows x cols elements; Z may be X or Y
+static void strassenAdd(accelerator_view& av, int rows, int cols,
+    float a, const strassen_operand& X, float b, const strassen_operand& Y,
+    const strassen_target& Z, strassen_stats *stats)
+{
+  stats->addFlops += (double)rows * cols;
+#ifdef HC_HOST_BACKEND
+  // Along with the CPU engine, a stored column at a time, which
+  // vectorizes when the three are transposed alike
+  if (useCpuEngine()) {
+    const float *x = X.data.data(), *y = Y.data.data();
+    float *z = Z.data.data();
+    if (X.trans == Z.trans && Y.trans == Z.trans) {
+      int inner = Z.trans ? cols : rows, outer = Z.trans ? rows : cols;
+      for (int j = 0; j < outer; j++) {
+        long long xj = X.offset + (long long)j * X.ld;
+        long long yj = Y.offset + (long long)j * Y.ld;
+        long long zj = Z.offset + (long long)j * Z.ld;
+        for (int i = 0; i < inner; i++)
+          z[zj + i] = a * x[xj + i] + b * y[yj + i];
+      }
+    } else {
+      for (int j = 0; j < cols; j++)
+        for (int i = 0; i < rows; i++)
+          z[Z.at(i, j)] = a * x[X.at(i, j)] + b * y[Y.at(i, j)];
+    }
+    return;
+  }
+#endif
+
+  parallel_for_each(av, extent<2>(cols, rows), [=] (index<2> idx) [[hc]]
+      {
+      int i = idx[1], j = idx[0];
+      Z(i, j) = a * X.data[(int)X.at(i, j)] + b * Y.data[(int)Y.at(i, j)];
+      });
+}
+
+// C = alpha * op(A) * op(B) + beta * C with the tiled kernel
+static void strassenLeaf(accelerator_view& av, int m, int n, int k,
+    float alpha, const strassen_operand& A, const strassen_operand& B,
+    float beta, const strassen_target& C, strassen_stats *stats)
+{
+  array_view<const float> a = A.data.section(index<1>((int)A.offset));
+  array_view<const float> b = B.data.section(index<1>((int)B.offset));
+  array_view<float> c = C.data.section(index<1>((int)C.offset));
+  regtileSgemm(av, A.trans ? 'T' : 'N', B.trans ? 'T' : 'N', m, n, k,
+      alpha, a, A.ld, b, B.ld, beta, c, C.ld);
+  stats->multiplyFlops += 2.0 * m * n * k;
+}
+
+// Number of levels of recursion for a product, and the elements of the
+// temporaries of all of them
+static int strassenLevels(int m, int n, int k, int cutoff, size_t *workspace)
+{
+  int levels = 0;
+  *workspace = 0;
+  while (m / 2 >= cutoff && n / 2 >= cutoff && k / 2 >= cutoff) {
+    m /= 2;
+    n /= 2;
+    k /= 2;
+    *workspace += (size_t)m * std::max(k, n) + (size_t)k * n;
+    levels++;
+  }
+  return levels;
+}
+
+// C = alpha * op(A) * op(B) with 'levels' levels of recursion left, the
+// temporaries 'workspace' elements into ws
+static void strassenMultiply(accelerator_view& av, int m, int n, int k,
+    float alpha, const strassen_operand& A, const strassen_operand& B,
+    const strassen_target& C, const strassen_target& ws, int levels,
+    strassen_stats *stats)
+{
+  if (levels == 0) {
+    strassenLeaf(av, m, n, k, alpha, A, B, 0.0f, C, stats);
+    return;
+  }
+
+  int mh = m / 2, nh = n / 2, kh = k / 2;
+  strassen_operand A11 = A.quadrant(0, 0, mh, kh), A12 = A.quadrant(0, 1, mh, kh);
+  strassen_operand A21 = A.quadrant(1, 0, mh, kh), A22 = A.quadrant(1, 1, mh, kh);
+  strassen_operand B11 = B.quadrant(0, 0, kh, nh), B12 = B.quadrant(0, 1, kh, nh);
+  strassen_operand B21 = B.quadrant(1, 0, kh, nh), B22 = B.quadrant(1, 1, kh, nh);
+  strassen_target C11 = C.sub(0, 0), C12 = C.sub(0, nh);
+  strassen_target C21 = C.sub(mh, 0), C22 = C.sub(mh, nh);
+  // X holds sums of quadrants of A, then P1; Y sums of quadrants of B
+  strassen_target X = {ws.data, ws.offset, A.trans ? kh : mh, A.trans};
+  strassen_target P1 = {ws.data, ws.offset, mh, false};
+  strassen_target Y = {ws.data, X.offset + (long long)mh * std::max(kh, nh),
+    B.trans ? nh : kh, B.trans};
+  strassen_target next = {ws.data, Y.offset + (long long)kh * nh, 0, false};
+  strassen_operand x = X.operand(), y = Y.operand(), p1 = P1.operand();
+#define STRASSEN_PRODUCT(P, S, T) \
+  strassenMultiply(av, mh, nh, kh, alpha, S, T, P, next, levels - 1, stats)
+
+  strassenAdd(av, mh, kh, 1, A11, -1, A21, X, stats);     // S3
+  strassenAdd(av, kh, nh, 1, B22, -1, B12, Y, stats);     // T3
+  STRASSEN_PRODUCT(C21, x, y);                            // P7 = S3 T3
+  strassenAdd(av, mh, kh, 1, A21, 1, A22, X, stats);      // S1
+  strassenAdd(av, kh, nh, 1, B12, -1, B11, Y, stats);     // T1
+  STRASSEN_PRODUCT(C22, x, y);                            // P5 = S1 T1
+  strassenAdd(av, mh, kh, 1, x, -1, A11, X, stats);       // S2 = S1 - A11
+  strassenAdd(av, kh, nh, 1, B22, -1, y, Y, stats);       // T2 = B22 - T1
+  STRASSEN_PRODUCT(C12, x, y);                            // P6 = S2 T2
+  strassenAdd(av, mh, kh, 1, A12, -1, x, X, stats);       // S4 = A12 - S2
+  STRASSEN_PRODUCT(C11, x, B22);                          // P3 = S4 B22
+  STRASSEN_PRODUCT(P1, A11, B11);                         // P1
+  strassenAdd(av, mh, nh, 1, p1, 1, C12.operand(), C12, stats);             // U2 = P1 + P6
+  strassenAdd(av, mh, nh, 1, C12.operand(), 1, C21.operand(), C21, stats);  // U3 = U2 + P7
+  strassenAdd(av, mh, nh, 1, C12.operand(), 1, C22.operand(), C12, stats);  // U4 = U2 + P5
+  strassenAdd(av, mh, nh, 1, C21.operand(), 1, C22.operand(), C22, stats);  // U7 = U3 + P5
+  strassenAdd(av, mh, nh, 1, C12.operand(), 1, C11.operand(), C12, stats);  // U5 = U4 + P3
+  strassenAdd(av, kh, nh, 1, y, -1, B21, Y, stats);       // T4 = T2 - B21
+  STRASSEN_PRODUCT(C11, A22, y);                          // P4 = A22 T4
+  strassenAdd(av, mh, nh, 1, C21.operand(), -1, C11.operand(), C21, stats); // U6 = U3 - P4
+  STRASSEN_PRODUCT(C11, A12, B21);                        // P2
+  strassenAdd(av, mh, nh, 1, p1, 1, C11.operand(), C11, stats);             // U1 = P1 + P2
+#undef STRASSEN_PRODUCT
+
+  // The odd step of k, row and column
+  int m2 = 2 * mh, n2 = 2 * nh, k2 = 2 * kh;
+  if (k2 < k)
+    strassenLeaf(av, m2, n2, 1, alpha, A.quadrant(0, k2, 1, 1),
+        B.quadrant(k2, 0, 1, 1), 1.0f, C, stats);
+  if (m2 < m)
+    strassenLeaf(av, 1, n, k, alpha, A.quadrant(m2, 0, 1, 1), B, 0.0f,
+        C.sub(m2, 0), stats);
+  if (n2 < n)
+    strassenLeaf(av, m2, 1, k, alpha, A, B.quadrant(0, n2, 1, 1), 0.0f,
+        C.sub(0, n2), stats);
+}
+
+// C = alpha * op(A) * op(B) + beta * C, as regtileSgemm, by Strassen-
+// Winograd recursion down to products of the given cutoff.  Fills *stats
+// if it is not NULL.
+void strassenSgemm(
+        accelerator_view& av,
+        char transa, char transb, int m, int n, int k, float alpha,
+        array_view<const float>& A, int lda,
+        array_view<const float>& B, int ldb, float beta,
+        array_view<float>& C, int ldc, int cutoff, strassen_stats *stats )
+{
+  strassen_stats counts = {0, 0.0, 0.0};
+  size_t workspace;
+  int levels = strassenLevels(m, n, k, cutoff, &workspace);
+  bool ta = (transa == 'T') || (transa == 't');
+  bool tb = (transb == 'T') || (transb == 't');
+
+  if (levels == 0 || (!ta && transa != 'N' && transa != 'n') ||
+      (!tb && transb != 'N' && transb != 'n')) {
+    regtileSgemm(av, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+    counts.multiplyFlops = 2.0 * m * n * k;
+  } else {
+    // Unless beta is 0, the product goes to the arena and is added to C
+    bool accumulate = beta != 0.0f;
+    array_view<float> arena((int)(workspace + (accumulate ? (size_t)m * n : 0)));
+    strassen_operand a = {A, 0, lda, ta};
+    strassen_operand b = {B, 0, ldb, tb};
+    strassen_target c = {C, 0, ldc, false};
+    strassen_target product = {arena, (long long)workspace, m, false};
+    strassen_target ws = {arena, 0, 0, false};
+
+    counts.levels = levels;
+    strassenMultiply(av, m, n, k, alpha, a, b, accumulate ? product : c, ws,
+        levels, &counts);
+    if (accumulate)
+      strassenAdd(av, m, n, 1, product.operand(), beta, c.operand(), c, &counts);
+  }
+  if (stats)
+    *stats = counts;
+}
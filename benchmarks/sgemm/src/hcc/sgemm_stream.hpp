@@ -0,0 +1,319 @@
+/*
+ * Out-of-core sgemm: C = A * B for matrices larger than host memory.
+ *
+ * A (m x k) and B^T (n x k) are mapped from container files, and C is
+ * computed in panels of nb whole columns, which are contiguous in its
+ * column-major layout and so are appended to the output container in
+ * order as they are finished.  Each panel is accumulated over k in steps
+ * of kb columns of A and the matching nb x kb block of B^T.  An I/O
+ * thread copies the next step from the mappings into one staging buffer
+ * while the kernel runs on the other, and drops the pages it copied, so
+ * memory use is that of the buffers whatever the size of the files.
+ * Finished panels are written by another thread while the next one is
+ * computed.  Steps and panels are capped at INT_MAX floats, the largest
+ * extent of an array_view.
+ *
+ *   SGEMM_STREAM=1             run out of core; A and B^T must be
+ *                              float containers (see pbconvert)
+ *   SGEMM_STREAM_MEMORY=<MB>   budget of the buffers, half of the
+ *                              physical memory by default
+ *   SGEMM_STREAM_KB=<n>        columns of A per step, 512 by default
+ *
+ * -o writes C as a container.  -V checks a sample of the elements of C
+ * against dot products computed on the CPU, and -v compares the written
+ * C with a reference container.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <future>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pb_memory.h>
+
+// One step of the stream: columns k0 to k0+kc-1 of A and the matching
+// block of rows j0 to j0+nc-1 of B^T
+struct stream_step {
+  int j0, nc, k0, kc;
+};
+
+// Staging buffer of a step, with the largest magnitudes it holds
+struct stream_buffer {
+  float *a, *bt;
+  float maxA, maxB;
+};
+
+static long envLong(const char *name, long dflt)
+{
+  const char *s = getenv(name);
+  long v = (s && *s) ? atol(s) : 0;
+  return v > 0 ? v : dflt;
+}
+
+// Drop the whole pages of a range of a mapping, which are read back from
+// the file if they are used again
+static void dropPages(const void *p, size_t bytes)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uintptr_t begin = ((uintptr_t)p + page - 1) & ~(uintptr_t)(page - 1);
+  uintptr_t end = ((uintptr_t)p + bytes) & ~(uintptr_t)(page - 1);
+  if (end > begin)
+    madvise((void *)begin, end - begin, MADV_DONTNEED);
+}
+
+// Copy a step from the mappings into a buffer.  Runs on the I/O thread.
+static void stageStep(const float *A, const float *BT, int m, int n,
+    stream_step s, stream_buffer *buf)
+{
+  const float *a = A + (size_t)s.k0 * m;
+  float maxA = 0, maxB = 0;
+
+  memcpy(buf->a, a, sizeof(float) * m * (size_t)s.kc);
+  dropPages(a, sizeof(float) * m * (size_t)s.kc);
+  for (size_t i = 0; i < (size_t)m * s.kc; i++)
+    maxA = std::max(maxA, fabsf(buf->a[i]));
+
+  for (int l = 0; l < s.kc; l++) {
+    const float *bt = BT + s.j0 + (size_t)(s.k0 + l) * n;
+    memcpy(buf->bt + (size_t)l * s.nc, bt, sizeof(float) * s.nc);
+    dropPages(bt, sizeof(float) * s.nc);
+  }
+  for (size_t i = 0; i < (size_t)s.nc * s.kc; i++)
+    maxB = std::max(maxB, fabsf(buf->bt[i]));
+
+  buf->maxA = maxA;
+  buf->maxB = maxB;
+}
+
+// The float matrix of a container, mapped for streaming
+static const float *mapStreamMatrix(const char *fn, int &nr_row, int &nr_col,
+    struct pb_Container **container)
+{
+  *container = NULL;
+  if (!pb_IsContainerFile(fn)) {
+    std::cerr << "SGEMM_STREAM needs container inputs; convert " << fn
+      << " with pbconvert" << std::endl;
+    return NULL;
+  }
+  struct pb_Container *c = pb_OpenContainer(fn, PB_OPEN_SEQUENTIAL);
+  if (!c)
+    return NULL;
+  const struct pb_Array *a = pb_ContainerArray(c, "matrix");
+  if (!a || a->type != pb_Type_F32 || a->rank != 2) {
+    std::cerr << "Expecting a float matrix 'matrix' in " << fn << std::endl;
+    pb_CloseContainer(c);
+    return NULL;
+  }
+  nr_col = a->dims[0];
+  nr_row = a->dims[1];
+  std::cerr << "Mapped file:" << fn << std::endl
+    << "Matrix dimension: " << nr_row << "x" << nr_col << std::endl;
+  *container = c;
+  return (const float *)a->data;
+}
+
+// Dot product of row i of A and row j of B^T in double, and the sum of
+// the magnitudes of its terms
+static double streamDot(const float *A, const float *BT, int m, int n, int k,
+    int i, int j, double *magnitude)
+{
+  double sum = 0, mag = 0;
+  for (int l = 0; l < k; l++) {
+    double t = (double)A[i + (size_t)l * m] * BT[j + (size_t)l * n];
+    sum += t;
+    mag += fabs(t);
+  }
+  *magnitude = mag;
+  return sum;
+}
+
+// Run the benchmark out of core.  Returns the exit status.
+static int streamSgemm(accelerator_view& av, struct pb_Parameters *params,
+    struct pb_TimerSet *timers)
+{
+  struct pb_Container *fileA, *fileBT;
+  int m, k, n, kBT;
+
+  pb_SwitchToTimer(timers, pb_TimerID_IO);
+  const float *A = mapStreamMatrix(params->inpFiles[0], m, k, &fileA);
+  const float *BT = mapStreamMatrix(params->inpFiles[2], n, kBT, &fileBT);
+  if (!A || !BT)
+    return -1;
+  if (kBT != k) {
+    std::cerr << "A has " << k << " columns but B^T has " << kBT << std::endl;
+    return -1;
+  }
+  if (params->refFile && !params->outFile) {
+    std::cerr << "SGEMM_STREAM compares with -v through the file written by -o"
+      << std::endl;
+    return -1;
+  }
+
+  // Two staging buffers of m*kb + nb*kb floats and two panels of m*nb
+  size_t budget = (size_t)envLong("SGEMM_STREAM_MEMORY",
+      (long)((size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2 >> 20)) << 20;
+  int kb = (int)std::min<long>(k, envLong("SGEMM_STREAM_KB", 512));
+  // Views are indexed with int, so no buffer may exceed INT_MAX floats
+  if ((size_t)m * kb > INT_MAX) {
+    kb = INT_MAX / m;
+    std::cout << "Clamping the step to " << kb << " columns of A, the most "
+      "an array_view can index" << std::endl;
+  }
+  double floats = budget / sizeof(float) - 2.0 * m * kb;
+  long nb = floats > 0 ? (long)(floats / (2.0 * kb + 2.0 * m)) : 0;
+  long nbMax = INT_MAX / std::max(m, kb);
+  if (nb > nbMax && nbMax < n) {
+    nb = nbMax;
+    std::cout << "Clamping panels to " << nb << " columns, the most an "
+      "array_view can index" << std::endl;
+  }
+  if (nb > n)
+    nb = n;
+  else if (nb > 16)
+    nb -= nb % 16;
+  if (nb < 1) {
+    std::cerr << "SGEMM_STREAM_MEMORY is too small for m=" << m << ", kb="
+      << kb << std::endl;
+    return -1;
+  }
+  std::cout << "Streaming " << m << "x" << n << "x" << k << " in panels of "
+    << nb << " columns, " << kb << " columns of A per step, "
+    << (2.0 * ((double)m * kb + nb * kb) + 2.0 * m * nb) * sizeof(float) / (1 << 20)
+    << " MB of buffers" << std::endl;
+
+  stream_buffer bufs[2];
+  float *panels[2];
+  for (int b = 0; b < 2; b++) {
+    bufs[b].a = (float *)pb_AllocLarge("A step", sizeof(float) * m * (size_t)kb);
+    bufs[b].bt = (float *)pb_AllocLarge("B^T step", sizeof(float) * nb * (size_t)kb);
+    panels[b] = (float *)pb_AllocLarge("C panel", sizeof(float) * m * (size_t)nb);
+    if (!bufs[b].a || !bufs[b].bt || !panels[b])
+      return -1;
+  }
+
+  struct pb_ContainerWriter *out = NULL;
+  if (params->outFile) {
+    size_t dims[2] = {(size_t)n, (size_t)m};
+    out = pb_CreateContainer(params->outFile);
+    if (!out || pb_BeginArray(out, "matrix", pb_Type_F32, sizeof(float), 2, dims))
+      return -1;
+  }
+
+  std::vector<stream_step> steps;
+  for (int j0 = 0; j0 < n; j0 += nb)
+    for (int k0 = 0; k0 < k; k0 += kb) {
+      stream_step s = {j0, (int)std::min<long>(nb, n - j0), k0, std::min(kb, k - k0)};
+      steps.push_back(s);
+    }
+
+  // Sampled check of -V, a few elements per panel
+  int panelCount = (n + nb - 1) / nb;
+  int perPanel = std::max(1, 1024 / panelCount);
+  std::vector<float> sampled, expected;
+  double sampleMagnitude = 0;
+  unsigned int seed = 12345;
+
+  std::future<void> staging, writing;
+  int writeStatus = 0;
+  float maxA = 0, maxB = 0;
+  staging = std::async(std::launch::async, stageStep, A, BT, m, n, steps[0], &bufs[0]);
+  for (size_t i = 0; i < steps.size(); i++) {
+    const stream_step &s = steps[i];
+    stream_buffer &buf = bufs[i & 1];
+    float *panel = panels[(s.j0 / nb) & 1];
+
+    // Wait for this step, then read the next one during the kernel
+    pb_SwitchToTimer(timers, pb_TimerID_IO);
+    staging.wait();
+    if (i + 1 < steps.size())
+      staging = std::async(std::launch::async, stageStep, A, BT, m, n,
+          steps[i + 1], &bufs[(i + 1) & 1]);
+    if (s.j0 == 0)
+      maxA = std::max(maxA, buf.maxA);
+    maxB = std::max(maxB, buf.maxB);
+
+    pb_SwitchToTimer(timers, pb_TimerID_KERNEL);
+    size_t sizeA = (size_t)m * s.kc, sizeB = (size_t)s.nc * s.kc,
+      sizeC = (size_t)m * s.nc;
+    assert(sizeA <= INT_MAX && sizeB <= INT_MAX && sizeC <= INT_MAX);
+    array_view<const float> dA((int)sizeA, buf.a);
+    array_view<const float> dB((int)sizeB, buf.bt);
+    array_view<float> dC((int)sizeC, panel);
+    regtileSgemm(av, 'N', 'T', m, s.nc, s.kc, 1.0f, dA, m, dB, s.nc,
+        s.k0 == 0 ? 0.0f : 1.0f, dC, m);
+    dC.synchronize();
+    if (s.k0 + s.kc < k)
+      continue;
+
+    // The panel is finished
+    if (params->verifyGold) {
+      pb_SwitchToTimer(timers, pb_TimerID_COMPUTE);
+      for (int t = 0; t < perPanel; t++) {
+        seed = seed * 1103515245u + 12345u;
+        int row = (seed >> 8) % m;
+        seed = seed * 1103515245u + 12345u;
+        int col = (seed >> 8) % s.nc;
+        double mag;
+        expected.push_back(streamDot(A, BT, m, n, k, row, s.j0 + col, &mag));
+        sampled.push_back(panel[row + (size_t)col * m]);
+        sampleMagnitude = std::max(sampleMagnitude, mag);
+      }
+    }
+    if (out) {
+      // Appends go in order, and the write of the panel before frees the
+      // buffer the next panel is computed in
+      pb_SwitchToTimer(timers, pb_TimerID_IO);
+      if (writing.valid())
+        writing.wait();
+      size_t bytes = sizeof(float) * m * (size_t)s.nc;
+      writing = std::async(std::launch::async, [out, panel, bytes, &writeStatus] {
+        if (pb_AppendArray(out, panel, bytes))
+          writeStatus = -1;
+      });
+    }
+  }
+  pb_SwitchToTimer(timers, pb_TimerID_IO);
+  if (writing.valid())
+    writing.wait();
+  if (out && (pb_EndArray(out) | pb_CloseContainerWriter(out)))
+    writeStatus = -1;
+  pb_AddWork(timers, NULL, pb_TimerID_KERNEL,
+      sizeof(float) * ((double)m * k * panelCount + (double)n * k + (double)m * n),
+      2. * m * n * k);
+
+  pb_SwitchToTimer(timers, pb_TimerID_NONE);
+  int status = writeStatus;
+  if (params->verifyGold) {
+    struct pb_Tolerance tol =
+      pb_RelativeTolerance(1e-5, (double)k * FLT_EPSILON * sampleMagnitude);
+    if (pb_CompareFloats("C (sampled CPU)", sampled.data(), expected.data(),
+          sampled.size(), &tol))
+      status = -1;
+  }
+  if (params->refFile && status == 0) {
+    int rows, cols, refRows, refCols;
+    struct pb_Container *result, *ref;
+    const float *C = mapStreamMatrix(params->outFile, rows, cols, &result);
+    const float *R = mapStreamMatrix(params->refFile, refRows, refCols, &ref);
+    struct pb_Tolerance tol =
+      pb_RelativeTolerance(1e-5, (double)k * FLT_EPSILON * maxA * maxB);
+    if (!C || !R || refRows != m || refCols != n ||
+        pb_CompareFloats("C", C, R, (size_t)m * n, &tol))
+      status = -1;
+    pb_CloseContainer(result);
+    pb_CloseContainer(ref);
+  }
+
+  double time = pb_GetElapsedTime(&(timers->timers[pb_TimerID_KERNEL]));
+  std::cout << "GFLOPs = " << 2. * m * n * k / time / 1e9 << std::endl;
+  pb_PrintTimerSet(timers);
+
+  for (int b = 0; b < 2; b++) {
+    pb_FreeLarge(bufs[b].a);
+    pb_FreeLarge(bufs[b].bt);
+    pb_FreeLarge(panels[b]);
+  }
+  pb_CloseContainer(fileA);
+  pb_CloseContainer(fileBT);
+  return status;
+}
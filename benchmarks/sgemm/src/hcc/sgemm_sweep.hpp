@@ -0,0 +1,207 @@
+/*
+ * Shape sweep: sgemm over a grid of shapes synthesised in memory, to see
+ * how throughput changes with the shape rather than for one input.
+ *
+ * For each size s and ratio r the grid has four shapes, C = A * B with
+ * A m x k and B k x n, multiplied as the benchmark does (B^T stored):
+ *
+ *   square    m = n = k = s
+ *   tall      m = s * r, n = s / r, k = s    tall-skinny C
+ *   wide      m = s / r, n = s * r, k = s    short-wide C
+ *   deep      m = n = s / r, k = s * r       k-dominant, a small C
+ *
+ *   SGEMM_SWEEP=1               run the sweep instead of reading inputs
+ *   SGEMM_SWEEP_SIZES=<list>    sizes s, 256,512,1024,2048 by default
+ *   SGEMM_SWEEP_RATIO=<r>       aspect ratio, 8 by default
+ *   SGEMM_SWEEP_SHAPES=<list>   some of square,tall,wide,deep
+ *   SGEMM_SWEEP_REPS=<n>        timed runs after one warmup, 3 by default
+ *
+ * Each shape prints its GFLOP/s, the best and mean of the timed runs,
+ * and the sweep ends with the usual "GFLOPs =" line over all of them.
+ * The results are written as CSV to -o, or to sgemm_sweep.csv.  Kernel
+ * time is accounted to one sub-timer per kind of shape.  SGEMM_ENGINE,
+ * SGEMM_VARIANT and SGEMM_STRASSEN apply as in a normal run, and
+ * SGEMM_PRECISION=int8 sweeps regtileIgemm, requantising to int8.  Only
+ * the selected precision's operands are built; fp16 and bf16 are rejected.
+ */
+
+#include <sstream>
+
+static const char *sweepKinds[] = {"square", "tall", "wide", "deep"};
+
+// Comma-separated positive integers of an environment variable, or dflt
+static std::vector<int> envInts(const char *name, const char *dflt)
+{
+  const char *s = getenv(name);
+  std::stringstream list((s && *s) ? s : dflt);
+  std::vector<int> values;
+  std::string item;
+  while (std::getline(list, item, ','))
+    if (atoi(item.c_str()) > 0)
+      values.push_back(atoi(item.c_str()));
+  return values;
+}
+
+// Whether SGEMM_SWEEP_SHAPES, by default all, lists a kind of shape
+static bool sweepKind(const char *kind)
+{
+  const char *s = getenv("SGEMM_SWEEP_SHAPES");
+  if (!s || !*s)
+    return true;
+  std::stringstream list(s);
+  std::string item;
+  while (std::getline(list, item, ','))
+    if (item == kind)
+      return true;
+  return false;
+}
+
+// Uniform values in [-0.5, 0.5) from a fixed sequence
+static void sweepFill(std::vector<float> &v, unsigned int seed)
+{
+  for (size_t i = 0; i < v.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    v[i] = (seed >> 8) * (1.0f / (1 << 24)) - 0.5f;
+  }
+}
+
+// Uniform int8 values from a fixed sequence
+static void sweepFill(std::vector<int8_t> &v, unsigned int seed)
+{
+  for (size_t i = 0; i < v.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    v[i] = (int8_t)(seed >> 24);
+  }
+}
+
+// Synthesise the operands of one shape in T, then time product(dA, dB, dC)
+// once to warm up and reps times into the kind's sub-timer.  Returns the
+// best time of the timed runs and adds them up in sum.
+template <typename T, typename Product>
+static double sweepShape(accelerator_view& av, struct pb_TimerSet *timers,
+    const char *kind, int m, int n, int k, unsigned int seed, int reps,
+    Product product, double *sum)
+{
+  pb_SwitchToTimer(timers, pb_TimerID_COMPUTE);
+  std::vector<T> matA((size_t)m * k), matBT((size_t)n * k);
+  std::vector<T> matC((size_t)m * n);
+  sweepFill(matA, seed);
+  sweepFill(matBT, seed + 1000);
+  array_view<const T> dA(matA.size(), matA.data());
+  array_view<const T> dB(matBT.size(), matBT.data());
+  array_view<T> dC(matC.size(), matC);
+  pb_SwitchToTimer(timers, pb_TimerID_COPY);
+  dA.synchronize_to(av);
+  dB.synchronize_to(av);
+
+  // One warmup, which also autotunes the shape when that is enabled
+  double best = 0, flops = 2. * m * n * k;
+  double bytes = sizeof(T) * ((double)m * k + (double)n * k + (double)m * n);
+  *sum = 0;
+  for (int r = -1; r < reps; r++) {
+    if (r >= 0)
+      pb_SwitchToSubTimer(timers, kind, pb_TimerID_KERNEL);
+    pb_Timestamp begin = pb_GetTimestamp();
+    product(dA, dB, dC);
+    dC.synchronize();
+    double t = pb_TicksToNanoseconds(pb_GetTimestamp() - begin) * 1e-9;
+    pb_SwitchToTimer(timers, pb_TimerID_COMPUTE);
+    if (r < 0)
+      continue;
+    best = r == 0 ? t : std::min(best, t);
+    *sum += t;
+    pb_AddWork(timers, kind, pb_TimerID_KERNEL, bytes, flops);
+  }
+  return best;
+}
+
+// Run the sweep.  Returns the exit status.
+static int sweepSgemm(accelerator_view& av, struct pb_Parameters *params,
+    struct pb_TimerSet *timers, pb_Type precision)
+{
+  std::vector<int> sizes = envInts("SGEMM_SWEEP_SIZES", "256,512,1024,2048");
+  std::vector<int> ratios = envInts("SGEMM_SWEEP_RATIO", "8");
+  std::vector<int> repeats = envInts("SGEMM_SWEEP_REPS", "3");
+  int ratio = ratios.empty() ? 8 : ratios[0];
+  int reps = repeats.empty() ? 3 : repeats[0];
+  if (sizes.empty()) {
+    std::cerr << "SGEMM_SWEEP_SIZES lists no sizes" << std::endl;
+    return -1;
+  }
+  bool strassen = getenv("SGEMM_STRASSEN") && atoi(getenv("SGEMM_STRASSEN"));
+  if (precision != pb_Type_F32 && precision != pb_Type_I8) {
+    std::cerr << "The sweep multiplies fp32 or int8 operands, not "
+      "SGEMM_PRECISION=" << getenv("SGEMM_PRECISION") << std::endl;
+    return -1;
+  }
+  bool int8 = precision == pb_Type_I8;
+  const char *engine = "kernel";
+#ifdef HC_HOST_BACKEND
+  if (useCpuEngine())
+    engine = int8 ? cpuIgemmKernelName() : cpuSgemmKernelName();
+#endif
+
+  const char *csvName = params->outFile ? params->outFile : "sgemm_sweep.csv";
+  FILE *csv = fopen(csvName, "w");
+  if (!csv) {
+    perror(csvName);
+    return -1;
+  }
+  fprintf(csv, "shape,m,n,k,precision,engine,strassen,reps,best_s,mean_s,"
+      "gflops_best,gflops_mean\n");
+
+  for (int i = 0; i < 4; i++)
+    pb_AddSubTimer(timers, sweepKinds[i], pb_TimerID_KERNEL);
+
+  double totalFlops = 0;
+  for (size_t s = 0; s < sizes.size(); s++)
+    for (int kind = 0; kind < 4; kind++) {
+      int size = sizes[s], small = std::max(1, size / ratio);
+      int shapes[4][3] = {{size, size, size}, {size * ratio, small, size},
+          {small, size * ratio, size}, {small, small, size * ratio}};
+      int m = shapes[kind][0], n = shapes[kind][1], k = shapes[kind][2];
+      if (!sweepKind(sweepKinds[kind]))
+        continue;
+
+      double best, sum, flops = 2. * m * n * k;
+      unsigned int seed = 1 + s * 4 + kind;
+      if (int8) {
+        best = sweepShape<int8_t>(av, timers, sweepKinds[kind], m, n, k, seed,
+            reps, [&](array_view<const int8_t>& dA,
+              array_view<const int8_t>& dB, array_view<int8_t>& dC) {
+          regtileIgemm(av, 'N', 'T', m, n, k, dA, m, dB, n, dC, m,
+              makeRequantEpilogue(1.0f / (64.0f * k), 0));
+        }, &sum);
+      } else {
+        best = sweepShape<float>(av, timers, sweepKinds[kind], m, n, k, seed,
+            reps, [&](array_view<const float>& dA,
+              array_view<const float>& dB, array_view<float>& dC) {
+          if (strassen)
+            strassenSgemm(av, 'N', 'T', m, n, k, 1.0f, dA, m, dB, n, 0.0f,
+                dC, m, strassenCutoff(), NULL);
+          else
+            regtileSgemm(av, 'N', 'T', m, n, k, 1.0f, dA, m, dB, n, 0.0f,
+                dC, m);
+        }, &sum);
+      }
+      totalFlops += flops * reps;
+
+      double mean = sum / reps;
+      std::cout << "sweep " << sweepKinds[kind] << " " << m << "x" << n
+        << "x" << k << ": GFLOPs = " << flops / best / 1e9 << " (best of "
+        << reps << ", mean " << flops / mean / 1e9 << ")" << std::endl;
+      fprintf(csv, "%s,%d,%d,%d,%s,%s,%d,%d,%.9f,%.9f,%.3f,%.3f\n",
+          sweepKinds[kind], m, n, k, int8 ? "int8" : "fp32", engine,
+          strassen && !int8 ? 1 : 0, reps, best,
+          mean, flops / best / 1e9, flops / mean / 1e9);
+    }
+
+  pb_SwitchToTimer(timers, pb_TimerID_NONE);
+  int status = fclose(csv) == 0 ? 0 : -1;
+  std::cout << "Wrote " << csvName << std::endl;
+
+  double time = pb_GetElapsedTime(&(timers->timers[pb_TimerID_KERNEL]));
+  std::cout << "GFLOPs = " << totalFlops / time / 1e9 << std::endl;
+  pb_PrintTimerSet(timers);
+  return status;
+}
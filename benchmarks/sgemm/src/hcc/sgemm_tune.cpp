@@ -0,0 +1,130 @@
+/*
+ * Autotuning cache of the tiled sgemm kernel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sgemm_tune.h"
+
+namespace {
+
+struct tuned_bucket {
+  char transa, transb;
+  int m, n, k;
+  std::string variant;
+  double gflops;
+};
+
+std::mutex cache_lock;
+std::vector<tuned_bucket> cache;
+bool cache_loaded = false;
+
+const char *cacheFile()
+{
+  const char *fn = getenv("SGEMM_TUNE_CACHE");
+  return (fn != NULL && *fn) ? fn : "sgemm_tune.cache";
+}
+
+// Smallest power of two not below x
+int bucket(int x)
+{
+  int b = 1;
+  while (b < x && b < (1 << 30))
+    b <<= 1;
+  return b;
+}
+
+char normalize(char t)
+{
+  return (char)toupper((unsigned char)t);
+}
+
+// Read the cache file, skipping malformed lines and '#' comments.  A
+// missing file is an empty cache.
+void loadCache()
+{
+  FILE *f = fopen(cacheFile(), "r");
+  char line[256];
+
+  cache_loaded = true;
+  if (f == NULL)
+    return;
+  while (fgets(line, sizeof(line), f)) {
+    tuned_bucket b;
+    char variant[64];
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, " %c %c %d %d %d %63s %lf", &b.transa, &b.transb,
+               &b.m, &b.n, &b.k, variant, &b.gflops) != 7)
+      continue;
+    b.transa = normalize(b.transa);
+    b.transb = normalize(b.transb);
+    b.variant = variant;
+    cache.push_back(b);
+  }
+  fclose(f);
+}
+
+tuned_bucket *find(char transa, char transb, int m, int n, int k)
+{
+  for (size_t i = 0; i < cache.size(); i++) {
+    tuned_bucket &b = cache[i];
+    if (b.transa == transa && b.transb == transb &&
+        b.m == m && b.n == n && b.k == k)
+      return &b;
+  }
+  return NULL;
+}
+
+} // namespace
+
+bool sgemmAutotuneEnabled()
+{
+  const char *s = getenv("SGEMM_AUTOTUNE");
+  return s != NULL && *s && strcmp(s, "0") != 0;
+}
+
+const char *sgemmTunedVariant(char transa, char transb, int m, int n, int k)
+{
+  std::lock_guard<std::mutex> guard(cache_lock);
+  if (!cache_loaded)
+    loadCache();
+  tuned_bucket *b = find(normalize(transa), normalize(transb),
+                         bucket(m), bucket(n), bucket(k));
+  return b ? b->variant.c_str() : NULL;
+}
+
+bool sgemmRecordVariant(char transa, char transb, int m, int n, int k,
+    const char *variant, double gflops)
+{
+  std::lock_guard<std::mutex> guard(cache_lock);
+  if (!cache_loaded)
+    loadCache();
+
+  tuned_bucket entry = { normalize(transa), normalize(transb),
+                         bucket(m), bucket(n), bucket(k), variant, gflops };
+  tuned_bucket *b = find(entry.transa, entry.transb, entry.m, entry.n, entry.k);
+  if (b)
+    *b = entry;
+  else
+    cache.push_back(entry);
+
+  FILE *f = fopen(cacheFile(), "w");
+  if (f == NULL) {
+    std::cerr << "Cannot write sgemm autotune cache " << cacheFile() << std::endl;
+    return false;
+  }
+  fprintf(f, "# sgemm autotune cache: transa transb m n k variant GFLOP/s\n");
+  for (size_t i = 0; i < cache.size(); i++)
+    fprintf(f, "%c %c %d %d %d %s %.2f\n", cache[i].transa, cache[i].transb,
+            cache[i].m, cache[i].n, cache[i].k, cache[i].variant.c_str(),
+            cache[i].gflops);
+  fclose(f);
+  return true;
+}
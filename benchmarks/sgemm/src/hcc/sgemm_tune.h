@@ -0,0 +1,31 @@
+/*
+ * Autotuning cache of the tiled sgemm kernel.
+ *
+ * Shapes are grouped into buckets, each of m, n and k rounded up to a
+ * power of two, per pair of transposes.  The kernel variant found fastest
+ * for a bucket is kept in a text cache file, one bucket per line:
+ *
+ *   <transa> <transb> <m> <n> <k> <variant> <GFLOP/s>
+ *
+ *   SGEMM_AUTOTUNE=1         time every variant for buckets not in the
+ *                            cache and add the winners to it
+ *   SGEMM_TUNE_CACHE=<file>  cache file, sgemm_tune.cache by default
+ *   SGEMM_VARIANT=<name>     run this variant, bypassing the cache
+ */
+
+#ifndef SGEMM_TUNE_H
+#define SGEMM_TUNE_H
+
+// Whether SGEMM_AUTOTUNE asks for buckets to be tuned
+bool sgemmAutotuneEnabled();
+
+// Name of the variant cached for the bucket of this shape, or NULL.  The
+// cache file is read on the first call.
+const char *sgemmTunedVariant(char transa, char transb, int m, int n, int k);
+
+// Record the winner for the bucket of this shape and rewrite the cache
+// file.  Returns false if the file cannot be written.
+bool sgemmRecordVariant(char transa, char transb, int m, int n, int k,
+    const char *variant, double gflops);
+
+#endif
@@ -13,6 +13,7 @@
 #include<fstream>
 #include<iostream>
 #include<vector>
+#include<pb_io.h>
 
 bool readColMajorMatrixFile(const char *fn, int &nr_row, int &nr_col, std::vector<float>&v)
 {
@@ -26,14 +27,26 @@ bool readColMajorMatrixFile(const char *fn, int &nr_row, int &nr_col, std::vecto
   f >> nr_row;
   f >> nr_col;
 
+  if (f.fail() || nr_row < 0 || nr_col < 0) {
+    std::cerr << fn << " does not start with the matrix dimensions" << std::endl;
+    return false;
+  }
+
   float data;
   std::cerr << "Matrix dimension: "<<nr_row<<"x"<<nr_col<<std::endl;
-  while (f.good() ) {
-    f >> data;
+  while (f >> data)
     v.push_back(data);
+  if (!f.eof()) {
+    std::cerr << fn << ": bad number after " << v.size() << " values"
+      << std::endl;
+    return false;
   }
-  v.pop_back(); // remove the duplicated last element
-
+  if (v.size() != (size_t)nr_row * nr_col) {
+    std::cerr << "Expecting " << nr_row << "x" << nr_col << " values in " << fn
+      << ", found " << v.size() << std::endl;
+    return false;
+  }
+  return true;
 }
 
 bool writeColMajorMatrixFile(const char *fn, int nr_row, int nr_col, std::vector<float>&v)
@@ -56,3 +69,34 @@ bool writeColMajorMatrixFile(const char *fn, int nr_row, int nr_col, std::vector
   return true;
 
 }
+
+// Load a column-major matrix from a text file into v, or map it from a
+// container file, whose "matrix" array holds nr_col columns of nr_row
+// floats.  Returns the matrix, which for a container stays valid until
+// *container is closed; NULL on error.
+const float *loadColMajorMatrix(const char *fn, int &nr_row, int &nr_col,
+    std::vector<float>&v, struct pb_Container **container)
+{
+  *container = NULL;
+  if (!pb_IsContainerFile(fn)) {
+    if (!readColMajorMatrixFile(fn, nr_row, nr_col, v))
+      return NULL;
+    return v.data();
+  }
+
+  struct pb_Container *c = pb_OpenContainer(fn, 0);
+  if (!c)
+    return NULL;
+  const struct pb_Array *a = pb_ContainerArray(c, "matrix");
+  if (!a || a->type != pb_Type_F32 || a->rank != 2) {
+    std::cerr << "Expecting a float matrix 'matrix' in " << fn << std::endl;
+    pb_CloseContainer(c);
+    return NULL;
+  }
+  nr_col = a->dims[0];
+  nr_row = a->dims[1];
+  std::cerr << "Mapped file:" << fn << std::endl
+    << "Matrix dimension: " << nr_row << "x" << nr_col << std::endl;
+  *container = c;
+  return (const float *)a->data;
+}
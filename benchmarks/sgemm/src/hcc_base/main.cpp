@@ -12,12 +12,16 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <malloc.h>
 #include <vector>
+#include <algorithm>
 #include <parboil.h>
+#include <pb_io.h>
+#include <pb_verify.h>
 #include <iostream>
 #include <hc.hpp>
 using namespace hc;
@@ -26,9 +30,65 @@ using namespace hc;
 // I/O routines
 extern bool readColMajorMatrixFile(const char *fn, int &nr_row, int &nr_col, std::vector<float>&v);
 extern bool writeColMajorMatrixFile(const char *fn, int, int, std::vector<float>&);
+extern const float *loadColMajorMatrix(const char *fn, int &nr_row, int &nr_col,
+    std::vector<float>&v, struct pb_Container **container);
+
+// C = A * B on the CPU, for verification: A is m x k and B^T is n x k,
+// both column-major, and the dot products are accumulated in double
+void computeGold(float *C, const float *A, const float *BT,
+    unsigned int m, unsigned int n, unsigned int k)
+{
+  std::vector<double> acc(m);
+  for (unsigned int j = 0; j < n; j++) {
+    std::fill(acc.begin(), acc.end(), 0.0);
+    for (unsigned int l = 0; l < k; l++) {
+      const float *a = A + (size_t)l * m;
+      double b = BT[j + (size_t)l * n];
+      for (unsigned int i = 0; i < m; i++)
+        acc[i] += a[i] * b;
+    }
+    for (unsigned int i = 0; i < m; i++)
+      C[i + (size_t)j * m] = acc[i];
+  }
+}
 
-extern "C"
-void computeGold(float *, const float*, const float*, unsigned int, unsigned int, unsigned int);
+// Check the m x n result C against the reference file (-v) and the CPU
+// product (-V).  A k-term dot product in float is off by at most about
+// k*eps times the sum of the magnitudes of its terms, which bounds the
+// absolute error.  Returns 0 if every check passes.
+static int verifyResult(struct pb_Parameters *params, const float *A,
+    const float *BT, const std::vector<float> &C, int m, int n, int k)
+{
+  float maxA = 0, maxB = 0;
+  for (size_t i = 0; i < (size_t)m * k; i++)
+    maxA = std::max(maxA, fabsf(A[i]));
+  for (size_t i = 0; i < (size_t)n * k; i++)
+    maxB = std::max(maxB, fabsf(BT[i]));
+  struct pb_Tolerance tol =
+    pb_RelativeTolerance(1e-5, (double)k * FLT_EPSILON * maxA * maxB);
+  int status = 0;
+
+  if (params->refFile) {
+    std::vector<float> ref;
+    struct pb_Container *file;
+    int rows, cols;
+    const float *R = loadColMajorMatrix(params->refFile, rows, cols, ref, &file);
+    if (!R || rows != m || cols != n) {
+      if (R)
+        std::cerr << "Expecting a " << m << "x" << n << " reference" << std::endl;
+      status = -1;
+    } else if (pb_CompareFloats("C", C.data(), R, C.size(), &tol))
+      status = -1;
+    pb_CloseContainer(file);
+  }
+  if (params->verifyGold) {
+    std::vector<float> gold(C.size());
+    computeGold(gold.data(), A, BT, m, n, k);
+    if (pb_CompareFloats("C (CPU)", C.data(), gold.data(), C.size(), &tol))
+      status = -1;
+  }
+  return status;
+}
 
 int
 main (int argc, char *argv[]) {
@@ -40,6 +100,8 @@ main (int argc, char *argv[]) {
   int matArow, matAcol;
   int matBrow, matBcol;
   std::vector<float> matA, matBT;
+  const float *A, *BT;
+  struct pb_Container *fileA, *fileBT;
 
   pb_InitializeTimerSet(&timers);
 
@@ -59,14 +121,16 @@ main (int argc, char *argv[]) {
   pb_SwitchToTimer(&timers, pb_TimerID_IO);
 
   // load A
-  readColMajorMatrixFile(params->inpFiles[0],
-      matArow, matAcol, matA);
+  A = loadColMajorMatrix(params->inpFiles[0],
+      matArow, matAcol, matA, &fileA);
   // copy A to device memory
   A_sz = matArow*matAcol;
 
   // load B^T
-  readColMajorMatrixFile(params->inpFiles[2],
-      matBcol, matBrow, matBT);
+  BT = loadColMajorMatrix(params->inpFiles[2],
+      matBcol, matBrow, matBT, &fileBT);
+  if (!A || !BT)
+    exit(-1);
 
   pb_SwitchToTimer( &timers, pb_TimerID_COMPUTE );
   B_sz = matBrow*matBcol;
@@ -76,8 +140,8 @@ main (int argc, char *argv[]) {
 
   // CUDA memory allocation
   std::vector<float> matC(matArow*matBcol);
-  array_view<const float> dA(A_sz, matA);
-  array_view<const float> dB(B_sz, matBT);
+  array_view<const float> dA(A_sz, A);
+  array_view<const float> dB(B_sz, BT);
   array_view<float> dC(C_sz, matC);
 
   // Copy A and B^T into device memory
@@ -89,9 +153,17 @@ main (int argc, char *argv[]) {
   basicSgemm('N', 'T', matArow, matBcol, matAcol, 1.0f, \
       dA, matArow, dB, matBcol, 0.0f, dC, matArow);
 
-  if (params->outFile) {
+  // A and B are read and C written once at least; C is not read as beta is 0
+  pb_AddWork(&timers, NULL, pb_TimerID_KERNEL,
+      sizeof(float) * ((double)A_sz + B_sz + C_sz),
+      2. * matArow * matBcol * matAcol);
+
+  if (params->outFile || params->refFile || params->verifyGold) {
     pb_SwitchToTimer( &timers, pb_TimerID_COPY );
     dC.synchronize();
+  }
+
+  if (params->outFile) {
     /* Write C to file */
     pb_SwitchToTimer(&timers, pb_TimerID_IO);
     writeColMajorMatrixFile(params->outFile,
@@ -100,9 +172,13 @@ main (int argc, char *argv[]) {
 
   pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
+  int status = verifyResult(params, A, BT, matC, matArow, matBcol, matAcol);
+
   double GPUtime = pb_GetElapsedTime(&(timers.timers[pb_TimerID_KERNEL]));
   std::cout<< "GFLOPs = " << 2.* matArow * matBcol * matAcol/GPUtime/1e9 << std::endl;
   pb_PrintTimerSet(&timers);
+  pb_CloseContainer(fileA);
+  pb_CloseContainer(fileBT);
   pb_FreeParameters(params);
-  return 0;
+  return status;
 }
@@ -7,8 +7,12 @@
  *cr
  ***************************************************************************/
 #include <parboil.h>
+#include <pb_io.h>
+#include <pb_verify.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include <hc.hpp>
 
 using namespace hc;
@@ -18,20 +22,79 @@ using namespace hc;
 #include "kernels.hpp"
 
 static int read_data(float *A0, int nx,int ny,int nz,FILE *fp)
-{	
-    int s=0;
-    for(int i=0;i<nz;i++)
+{
+    // x varies fastest, then y, then z, as in A0
+    size_t count = (size_t)nx*ny*nz;
+    return fread(A0, sizeof(float), count, fp) == count ? 0 : -1;
+}
+
+// The nz x ny x nx "grid" array of a container input, used in place
+static float *map_data(struct pb_Container *input, int nx,int ny,int nz)
+{
+    const struct pb_Array *grid = pb_ContainerArray(input, "grid");
+    if (grid == NULL || grid->type != pb_Type_F32 || grid->rank != 3 ||
+        grid->dims[0] != (size_t)nz || grid->dims[1] != (size_t)ny ||
+        grid->dims[2] != (size_t)nx) {
+        fprintf(stderr, "Expecting a %dx%dx%d float array 'grid' in the input\n",
+                nz, ny, nx);
+        return NULL;
+    }
+    return (float *)grid->data;
+}
+
+// The stencil on the CPU, for verification.  A0 holds the input and is
+// overwritten; returns the buffer, A0 or Anext, that holds the result.
+static float *cpu_stencil(float c0, float c1, float *A0, float *Anext,
+                          int nx,int ny,int nz, int iteration)
+{
+    memcpy(Anext, A0, sizeof(float)*nx*ny*nz);
+    for(int t=0;t<iteration;t++)
     {
-        for(int j=0;j<ny;j++)
-        {
-            for(int k=0;k<nx;k++)
-            {
-                fread(A0+s,sizeof(float),1,fp);
-                s++;
-            }
-        }
+        for(int k=1;k<nz-1;k++)
+            for(int j=1;j<ny-1;j++)
+                for(int i=1;i<nx-1;i++)
+                    Anext[Index3D (nx, ny, i, j, k)] =
+                        (A0[Index3D (nx, ny, i, j, k+1)] +
+                         A0[Index3D (nx, ny, i, j, k-1)] +
+                         A0[Index3D (nx, ny, i, j+1, k)] +
+                         A0[Index3D (nx, ny, i, j-1, k)] +
+                         A0[Index3D (nx, ny, i+1, j, k)] +
+                         A0[Index3D (nx, ny, i-1, j, k)])*c1
+                        - A0[Index3D (nx, ny, i, j, k)]*c0;
+        float *temp=A0;
+        A0=Anext;
+        Anext=temp;
+    }
+    return A0;
+}
+
+// Check the result against the reference file (-v) and, given a copy of
+// the input, the CPU stencil (-V).  Returns 0 if every check passes.
+static int verify(struct pb_Parameters *parameters, const float *result,
+                  std::vector<float> &input, float c0, float c1,
+                  int nx,int ny,int nz, int iteration)
+{
+    // Both sides sum the same terms in the same order; contraction into
+    // fused multiply-adds may still differ, and the error grows with the
+    // number of sweeps
+    struct pb_Tolerance tol = pb_UlpTolerance(4*iteration, 1e-6);
+    size_t size=(size_t)nx*ny*nz;
+    int status=0;
+
+    if (parameters->refFile) {
+        float *ref=inputData(parameters->refFile, nx,ny,nz);
+        if (ref == NULL || pb_CompareFloats("grid", result, ref, size, &tol))
+            status=-1;
+        free (ref);
     }
-    return 0;
+    if (parameters->verifyGold) {
+        std::vector<float> next(size);
+        float *gold=cpu_stencil(c0, c1, input.data(), next.data(),
+                                nx,ny,nz, iteration);
+        if (pb_CompareFloats("grid (CPU)", result, gold, size, &tol))
+            status=-1;
+    }
+    return status;
 }
 
 int main(int argc, char** argv) {
@@ -88,12 +151,31 @@ int main(int argc, char** argv) {
 
     size=nx*ny*nz;
 
-    h_A0=(float*)malloc(sizeof(float)*size);
     h_Anext=(float*)malloc(sizeof(float)*size);
     pb_SwitchToTimer(&timers, pb_TimerID_IO);
-    FILE *fp = fopen(parameters->inpFiles[0], "rb");
-    read_data(h_A0, nx,ny,nz,fp);
-    fclose(fp);
+    struct pb_Container *input = NULL;
+    if (pb_IsContainerFile(parameters->inpFiles[0])) {
+        input = pb_OpenContainer(parameters->inpFiles[0], 0);
+        h_A0 = input ? map_data(input, nx,ny,nz) : NULL;
+    } else {
+        h_A0=(float*)malloc(sizeof(float)*size);
+        FILE *fp = fopen(parameters->inpFiles[0], "rb");
+        if (fp == NULL || read_data(h_A0, nx,ny,nz,fp) != 0) {
+            fprintf(stderr, "Cannot read %dx%dx%d floats from %s\n",
+                    nx, ny, nz, parameters->inpFiles[0]);
+            exit(-1);
+        }
+        fclose(fp);
+    }
+    if (h_A0 == NULL)
+        exit(-1);
+
+    //the kernels overwrite the input, keep it for the CPU stencil
+    std::vector<float> h_input;
+    if (parameters->verifyGold) {
+        pb_SwitchToTimer(&timers, pb_TimerID_NONE);
+        h_input.assign(h_A0, h_A0+size);
+    }
 
     pb_SwitchToTimer(&timers, pb_TimerID_COPY);
     //memory allocation
@@ -115,6 +197,13 @@ int main(int argc, char** argv) {
     // int sh_size = tx*2*ty*sizeof(float);	
 
     //main execution
+    //compulsory traffic and work of one sweep, for the roofline report:
+    //the grid is read once and its interior written once, and every
+    //interior point takes 5 additions, 2 multiplications and a subtraction
+    double interior=(double)(nx-2)*(ny-2)*(nz-2);
+    double sweep_bytes=sizeof(float)*((double)size+interior);
+    double sweep_flops=8*interior;
+
     pb_SwitchToTimer(&timers, pb_TimerID_KERNEL);
     for(int t=0;t<iteration;t++)
     {
@@ -123,6 +212,7 @@ int main(int argc, char** argv) {
                 {
                 block2D_hybrid_coarsen_x(tidx, c0, c1, d_A0, d_Anext, nx, ny, nz);
                 });
+        pb_AddWork(&timers, NULL, pb_TimerID_KERNEL, sweep_bytes, sweep_flops);
         array_view<float> d_temp = std::move(d_A0);
         d_A0 = std::move(d_Anext);
         d_Anext = std::move(d_temp);
@@ -137,21 +227,29 @@ int main(int argc, char** argv) {
 
     pb_SwitchToTimer(&timers, pb_TimerID_COPY);
     d_Anext.synchronize();
+    //the sweeps alternate between the buffers, so the result is in either
+    float *h_result=d_Anext.data();
 
     if (parameters->outFile) {
         pb_SwitchToTimer(&timers, pb_TimerID_IO);
-        outputData(parameters->outFile,h_Anext,nx,ny,nz);
+        outputData(parameters->outFile,h_result,nx,ny,nz);
 
     }
+    pb_SwitchToTimer(&timers, pb_TimerID_NONE);
+    int status=verify(parameters, h_result, h_input, c0, c1,
+                      nx,ny,nz, iteration);
     pb_SwitchToTimer(&timers, pb_TimerID_COMPUTE);
 
-    free (h_A0);
+    if (input)
+        pb_CloseContainer(input);
+    else
+        free (h_A0);
     free (h_Anext);
     pb_SwitchToTimer(&timers, pb_TimerID_NONE);
 
     pb_PrintTimerSet(&timers);
     pb_FreeParameters(parameters);
 
-    return 0;
+    return status;
 
 }
@@ -32,3 +32,32 @@ void outputData(char* fName, float *h_A0,int nx,int ny,int nz)
 
   fclose (fid);
 }
+
+float *inputData(char* fName, int nx,int ny,int nz)
+{
+  FILE* fid = fopen(fName, "r");
+  uint32_t tmp32;
+  float *A;
+  if (fid == NULL)
+    {
+      fprintf(stderr, "Cannot open reference file\n");
+      return NULL;
+    }
+  if (fread(&tmp32, sizeof(uint32_t), 1, fid) != 1 ||
+      tmp32 != (uint32_t)(nx*ny*nz))
+    {
+      fprintf(stderr, "Expecting %d values in %s\n", nx*ny*nz, fName);
+      fclose (fid);
+      return NULL;
+    }
+  A = (float*)malloc(sizeof(float)*tmp32);
+  if (fread(A, sizeof(float), tmp32, fid) != tmp32)
+    {
+      fprintf(stderr, "%s is truncated\n", fName);
+      free (A);
+      A = NULL;
+    }
+
+  fclose (fid);
+  return A;
+}
@@ -7,3 +7,4 @@
  ***************************************************************************/
 
 void outputData(char* fName, float *h_A0,int nx,int ny,int nz);
+float *inputData(char* fName, int nx,int ny,int nz);
@@ -43,8 +43,8 @@ main( int argc, char** argv)
   printf("Total bins  : %i\n", NUM_BINS);
 
   //read in files
-  unsigned mem_size = (1+NUM_SETS)*num_elements*sizeof(struct cartesian);
-  unsigned f_mem_size = (1+NUM_SETS)*num_elements*sizeof(REAL);
+  size_t mem_size = (size_t)(1+NUM_SETS)*num_elements*sizeof(struct cartesian);
+  size_t f_mem_size = (size_t)(1+NUM_SETS)*num_elements*sizeof(REAL);
 
   // container for all the points read from files
   struct cartesian *h_all_data;
@@ -0,0 +1,802 @@
+/*
+ * Seeded synthetic datasets for the Parboil benchmarks.
+ *
+ *   datagen [-s SEED] [-b BYTES] [-o DIR] BENCHMARK SIZE
+ *
+ * writes DIR/input/... in the input format read by BENCHMARK and a
+ * DIR/DESCRIPTION that common/driver/bench.py runs it with.  DIR defaults
+ * to datasets/BENCHMARK/SIZE, so running from the Parboil root makes the
+ * dataset visible to `bench.py suite -d SIZE`.  BENCHMARK "all" generates
+ * every benchmark.
+ *
+ * SIZE scales the decoded input, that is the arrays a benchmark reads its
+ * input files into:
+ *
+ *   S    256 KiB                      resident in a private L2
+ *   M    16 MiB                       resident in a server's last-level cache
+ *   L    1 GiB                        DRAM
+ *   XL   1.25 x MemTotal              larger than RAM
+ *
+ * -b BYTES gives any other target, to fill in a scaling curve.  Working
+ * sets are a benchmark-specific multiple of the input: cutcp's potential
+ * lattice is about 20x its atoms and sad's table of SADs about 90x its
+ * frames.
+ *
+ * The output depends only on the benchmark, the target size and the seed.
+ * Files are streamed, so datasets larger than RAM are written in constant
+ * memory.  lbm's grid size is a compile-time constant: the DESCRIPTION of
+ * an lbm dataset records the SIZE_X/SIZE_Y/SIZE_Z to build it with.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+[[noreturn]] void
+die(const char *fmt, const std::string &arg = "")
+{
+  fprintf(stderr, "datagen: ");
+  fprintf(stderr, fmt, arg.c_str());
+  fputc('\n', stderr);
+  exit(1);
+}
+
+/* Random numbers.  Generators draw from a splitmix64 stream; values that
+ * have to be reproduced in a second pass over a file, or independently
+ * for a pair of files, come from hash() of their coordinates instead. */
+
+const uint64_t GOLDEN = 0x9e3779b97f4a7c15ULL;
+
+inline uint64_t
+finalize(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+inline uint64_t
+hash(uint64_t seed, uint64_t a, uint64_t b = 0)
+{
+  return finalize(seed + GOLDEN * finalize(a + GOLDEN * finalize(b + GOLDEN)));
+}
+
+/* A uniform double in [0, 1) from 53 bits of h */
+inline double
+unit(uint64_t h)
+{
+  return (h >> 11) * 0x1.0p-53;
+}
+
+class Random {
+public:
+  Random(uint64_t seed, const char *stream) : state(seed)
+  {
+    for (const char *c = stream; *c; c++)
+      state = finalize(state ^ (uint64_t)*c) + GOLDEN;
+  }
+
+  uint64_t next() { return finalize(state += GOLDEN); }
+  double uniform() { return unit(next()); }
+  double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+  uint64_t below(uint64_t n) { return next() % n; }
+
+  /* Standard normal, by Box-Muller */
+  double normal()
+  {
+    double u = 1.0 - uniform();
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * uniform());
+  }
+
+private:
+  uint64_t state;
+};
+
+/* Buffered output of binary records and text numbers */
+class Output {
+public:
+  explicit Output(const std::string &path) : path(path), buf(1 << 20)
+  {
+    f = fopen(path.c_str(), "wb");
+    if (!f)
+      die("cannot create %s", path + ": " + strerror(errno));
+  }
+
+  ~Output()
+  {
+    flush();
+    if (fclose(f))
+      die("cannot write %s", path + ": " + strerror(errno));
+    fprintf(stderr, "  %s\n", path.c_str());
+  }
+
+  void bytes(const void *p, size_t n)
+  {
+    if (used + n > buf.size())
+      flush();
+    if (n > buf.size()) {
+      write(p, n);
+      return;
+    }
+    memcpy(&buf[used], p, n);
+    used += n;
+  }
+
+  template <typename T>
+  void binary(T v) { bytes(&v, sizeof(v)); }
+
+  void text(const char *s) { bytes(s, strlen(s)); }
+  void ch(char c) { reserve(1); buf[used++] = c; }
+
+  void number(long long v)
+  {
+    reserve(24);
+    used = std::to_chars(&buf[used], &buf[0] + buf.size(), v).ptr - &buf[0];
+  }
+
+  /* Shortest representation that reads back to the same float */
+  void number(float v)
+  {
+    reserve(24);
+    used = std::to_chars(&buf[used], &buf[0] + buf.size(), v).ptr - &buf[0];
+  }
+
+  void fixed(double v, int precision)
+  {
+    reserve(32);
+    used = std::to_chars(&buf[used], &buf[0] + buf.size(), v,
+                         std::chars_format::fixed, precision).ptr - &buf[0];
+  }
+
+private:
+  void reserve(size_t n) { if (used + n > buf.size()) flush(); }
+
+  void flush()
+  {
+    write(&buf[0], used);
+    used = 0;
+  }
+
+  void write(const void *p, size_t n)
+  {
+    if (fwrite(p, 1, n, f) != n)
+      die("cannot write %s", path + ": " + strerror(errno));
+  }
+
+  std::string path;
+  FILE *f;
+  std::vector<char> buf;
+  size_t used = 0;
+};
+
+struct Job {
+  std::string benchmark;
+  std::string size;
+  std::string dir;
+  double bytes;			/* Target size of the decoded input */
+  uint64_t seed;
+
+  std::string input(const char *name) const { return dir + "/input/" + name; }
+};
+
+std::string
+str(long long v)
+{
+  return std::to_string(v);
+}
+
+void
+describe(const Job &job, const std::string &inputs,
+         const std::string &parameters, const char *output,
+         const std::string &note = "")
+{
+  FILE *f = fopen((job.dir + "/DESCRIPTION").c_str(), "w");
+  if (!f)
+    die("cannot create %s/DESCRIPTION", job.dir);
+  fprintf(f, "# Generated by datagen: %s %s, seed %llu, %.0f bytes\n",
+          job.benchmark.c_str(), job.size.c_str(),
+          (unsigned long long)job.seed, job.bytes);
+  if (!note.empty())
+    fprintf(f, "# %s\n", note.c_str());
+  fprintf(f, "Inputs: %s\n", inputs.c_str());
+  fprintf(f, "Parameters: %s\n", parameters.c_str());
+  fprintf(f, "Output: %s\n", output);
+  fclose(f);
+}
+
+/* Round v to a positive multiple of m */
+long long
+round_to(double v, long long m)
+{
+  return std::max(m, (long long)std::llround(v / m) * m);
+}
+
+void
+check_int(const Job &job, double count, const char *what)
+{
+  if (count > INT_MAX)
+    die("%s", job.benchmark + ": " + what +
+        " would overflow the benchmark's 32-bit int; choose a smaller size");
+}
+
+/* sgemm: A (n x n), B and B^T as column-major text matrices.  Only A and
+ * B^T are read, so they make up the input. */
+
+float
+sgemm_element(const Job &job, int matrix, long long row, long long col)
+{
+  return (float)(2.0 * unit(hash(job.seed, matrix, (row << 32) | col)) - 1.0);
+}
+
+void
+write_col_major(const Job &job, const char *name, int matrix,
+                long long rows, long long cols, bool transpose)
+{
+  Output out(job.input(name));
+  out.number(rows);
+  out.ch(' ');
+  out.number(cols);
+  out.ch('\n');
+  for (long long c = 0; c < cols; c++) {
+    for (long long r = 0; r < rows; r++) {
+      out.number(transpose ? sgemm_element(job, matrix, c, r)
+                           : sgemm_element(job, matrix, r, c));
+      out.ch(r + 1 < rows ? ' ' : '\n');
+    }
+  }
+}
+
+void
+gen_sgemm(const Job &job)
+{
+  /* The kernels tile m by 128 and n by 16 */
+  long long n = round_to(std::sqrt(job.bytes / (2 * sizeof(float))), 128);
+  check_int(job, (double)n * n, "n*n");
+
+  write_col_major(job, "matrix1.txt", 0, n, n, false);
+  write_col_major(job, "matrix2.txt", 1, n, n, false);
+  write_col_major(job, "matrix2t.txt", 1, n, n, true);
+  describe(job, "matrix1.txt matrix2.txt matrix2t.txt", "", "matrix3.txt",
+           "A, B and B^T: " + str(n) + " x " + str(n));
+}
+
+/* bfs: a directed graph with 1..11 (mean 6) out-edges per node.  Every
+ * node links to its successor, so all nodes are reachable from node 0;
+ * four in five other edges stay within 64 nodes, the rest go anywhere.
+ * Degrees and edges are hashes of the node, so the node table and the
+ * edge list are written in two passes without holding the graph. */
+
+const int BFS_MAX_DEGREE = 11;
+
+int
+bfs_degree(const Job &job, long long node)
+{
+  return 1 + (int)(hash(job.seed, node) % BFS_MAX_DEGREE);
+}
+
+long long
+bfs_edge(const Job &job, long long nodes, long long node, int edge)
+{
+  if (edge == 0)
+    return (node + 1) % nodes;
+
+  uint64_t h = hash(job.seed, node, edge);
+  if (h % 5 == 0)
+    return (long long)((h >> 8) % nodes);
+
+  long long offset = 1 + (long long)((h >> 8) % 64);
+  return (h & 0x80 ? node + offset : node + nodes - offset) % nodes;
+}
+
+void
+gen_bfs(const Job &job)
+{
+  /* Node (8 bytes), color and cost (4 each), and 6 edges of 8 bytes */
+  long long nodes = std::max(2LL, std::llround(job.bytes / 64));
+  check_int(job, (double)nodes * BFS_MAX_DEGREE, "the edge count");
+
+  Output out(job.input("graph_input.dat"));
+  long long edges = 0;
+
+  out.number(nodes);
+  out.ch('\n');
+  for (long long i = 0; i < nodes; i++) {
+    int degree = bfs_degree(job, i);
+    out.number(edges);
+    out.ch(' ');
+    out.number((long long)degree);
+    out.ch('\n');
+    edges += degree;
+  }
+
+  out.text("\n0\n\n");
+  out.number(edges);
+  out.ch('\n');
+  for (long long i = 0; i < nodes; i++) {
+    int degree = bfs_degree(job, i);
+    for (int e = 0; e < degree; e++) {
+      out.number(bfs_edge(job, nodes, i, e));
+      out.ch(' ');
+      out.number(1 + (long long)(hash(job.seed, i, e + BFS_MAX_DEGREE) % 10));
+      out.ch('\n');
+    }
+  }
+
+  describe(job, "graph_input.dat", "", "bfs.out",
+           str(nodes) + " nodes, " + str(edges) + " edges");
+}
+
+/* histo: a 256 x 384-bin histogram, four of the kernels' 24K-bin blocks,
+ * of a normally distributed image.  The prescan kernel sizes the central
+ * range of blocks as mean +- 10 standard deviations, which has to stay
+ * inside the histogram. */
+
+void
+gen_histo(const Job &job)
+{
+  const unsigned histo_width = 256, histo_height = 384;
+  const double bins = histo_width * histo_height;
+
+  /* The prescan kernel samples an eighth of the image with 64 x 512
+   * threads, each of which needs a pixel.  The intermediate histograms
+   * are img_width wide: keep it >= histo_width. */
+  long long pixels = std::max(64LL * 512 * 8,
+                              std::llround(job.bytes / sizeof(unsigned)));
+  long long width = std::max<long long>(histo_width,
+                                        2 * std::llround(std::sqrt(pixels) / 2));
+  long long height = std::max(1LL, pixels / width);
+  check_int(job, (double)width * height, "the pixel count");
+
+  Random rng(job.seed, "histo");
+  Output out(job.input("img.bin"));
+  out.binary<unsigned>(width);
+  out.binary<unsigned>(height);
+  out.binary<unsigned>(histo_width);
+  out.binary<unsigned>(histo_height);
+  for (long long i = 0; i < width * height; i++) {
+    double v = std::floor(bins / 2 + bins / 48 * rng.normal());
+    out.binary<unsigned>((unsigned)std::clamp(v, 0.0, bins - 1));
+  }
+
+  describe(job, "img.bin", "20", "ref.bmp",
+           str(width) + " x " + str(height) + " image");
+}
+
+/* stencil: a raw nx x ny x nz float grid, shaped 4:4:1 like the Parboil
+ * datasets.  The kernel processes 64 x 4 columns per tile. */
+
+void
+gen_stencil(const Job &job)
+{
+  double cells = job.bytes / sizeof(float);
+  long long nz = std::max(4LL, std::llround(std::cbrt(cells / 16)));
+  long long nxy = round_to(std::sqrt(cells / nz), 64);
+  check_int(job, (double)nxy * nxy * nz, "nx*ny*nz");
+
+  Random rng(job.seed, "stencil");
+  Output out(job.input("input.bin"));
+  for (long long i = 0; i < nxy * nxy * nz; i++)
+    out.binary<float>((float)rng.uniform());
+
+  describe(job, "input.bin",
+           str(nxy) + " " + str(nxy) + " " + str(nz) + " 100", "output.bin");
+}
+
+/* cutcp: PQR atoms at the density of water (0.1 per cubic Angstrom),
+ * placed on a jittered cubic lattice so that the 4 Angstrom bins hold
+ * about as many atoms as in a real molecule. */
+
+void
+gen_cutcp(const Job &job)
+{
+  long long atoms = std::max(8LL, std::llround(job.bytes / (4 * sizeof(float))));
+  long long side = (long long)std::ceil(std::cbrt((double)atoms));
+  const double spacing = std::cbrt(10.0);
+  check_int(job, (double)atoms, "the atom count");
+
+  Random rng(job.seed, "cutcp");
+  Output out(job.input("watbox.pqr"));
+  for (long long n = 0; n < atoms; n++) {
+    long long i = n % side, j = n / side % side, k = n / (side * side);
+    out.text("ATOM  ");
+    out.number(n + 1);
+    out.text(n % 3 ? "  H   WAT " : "  O   WAT ");
+    out.number(n / 3 + 1);
+    out.ch(' ');
+    out.fixed((i + 0.5 + rng.uniform(-0.3, 0.3)) * spacing, 3);
+    out.ch(' ');
+    out.fixed((j + 0.5 + rng.uniform(-0.3, 0.3)) * spacing, 3);
+    out.ch(' ');
+    out.fixed((k + 0.5 + rng.uniform(-0.3, 0.3)) * spacing, 3);
+    out.text(n % 3 ? " 0.4170 1.0000\n" : " -0.8340 1.7683\n");
+  }
+  out.text("END\n");
+
+  describe(job, "watbox.pqr", "", "lattice.dat", str(atoms) + " atoms");
+}
+
+/* tpacf: one clustered data catalog and ten uniformly random catalogs of
+ * the same size, as "ra dec" lines in degrees.  Parboil's own datasets
+ * have 100 random catalogs; ten keep the file count manageable. */
+
+const int TPACF_SETS = 10;
+
+void
+write_catalog(const Job &job, const std::string &name, long long points,
+              bool clustered)
+{
+  Random rng(job.seed, name.c_str());
+  Output out(job.input(name.c_str()));
+  double center_ra = 0, center_dec = 0;
+
+  for (long long i = 0; i < points; i++) {
+    double ra, dec;
+    if (clustered && i % 2 == 0) {
+      /* Half of the data points fall in clusters of about 1 degree */
+      if (i % 64 == 0) {
+        center_ra = rng.uniform(0, 360);
+        center_dec = std::asin(rng.uniform(-1, 1)) * 180 / M_PI;
+      }
+      dec = std::clamp(center_dec + rng.normal(), -90.0, 90.0);
+      ra = center_ra + rng.normal() / std::max(0.01, std::cos(dec * M_PI / 180));
+      ra = ra - 360 * std::floor(ra / 360);
+    } else {
+      ra = rng.uniform(0, 360);
+      dec = std::asin(rng.uniform(-1, 1)) * 180 / M_PI;
+    }
+    out.fixed(ra, 6);
+    out.ch(' ');
+    out.fixed(dec, 6);
+    out.ch('\n');
+  }
+}
+
+void
+gen_tpacf(const Job &job)
+{
+  long long points = std::max(1LL, std::llround(
+      job.bytes / (3 * sizeof(float) * (1 + TPACF_SETS))));
+  check_int(job, (double)points, "the point count");
+
+  std::string inputs = "Datapnts.1";
+  write_catalog(job, "Datapnts.1", points, true);
+  for (int i = 1; i <= TPACF_SETS; i++) {
+    std::string name = "Randompnts." + str(i);
+    write_catalog(job, name, points, false);
+    inputs += " " + name;
+  }
+
+  describe(job, inputs, "-n " + str(TPACF_SETS) + " -p " + str(points),
+           "tpacf.out");
+}
+
+/* mri-gridding: the .uks parameter file and its .data samples.  Samples
+ * are spread along random radial spokes, so the k-space center is sampled
+ * densely like a real non-Cartesian trajectory, with sdc as the density
+ * compensation.  The reconstructed matrix grows with the sample count up
+ * to 128^3, the size of the Parboil datasets. */
+
+struct ReconstructionSample {
+  float real;
+  float imag;
+  float kX;
+  float kY;
+  float kZ;
+  float sdc;
+};
+
+void
+gen_mri_gridding(const Job &job)
+{
+  long long samples = std::max(1LL, std::llround(
+      job.bytes / sizeof(ReconstructionSample)));
+  long long matrix = std::min(128LL, round_to(std::cbrt((double)samples), 8));
+  const double kmax = 0.5;
+  check_int(job, (double)samples, "the sample count");
+
+  {
+    Output out(job.input("small.uks"));
+    std::string m = str(matrix), g = str(2 * matrix);
+    out.text(("aquisition.numsamples=" + str(samples) + "\n").c_str());
+    out.text("aquisition.kmax=0.500000 0.500000 0.500000\n");
+    out.text(("aquisition.matrixSize=" + m + " " + m + " " + m + "\n").c_str());
+    out.text(("reconstruction.matrixSize=" + m + " " + m + " " + m + "\n").c_str());
+    out.text(("gridding.matrixSize=" + g + " " + g + " " + g + "\n").c_str());
+    out.text("gridding.oversampling=2.000000\n");
+    out.text("kernel.width=4.000000\n");
+    out.text("kernel.useLUT=1\n");
+  }
+
+  Random rng(job.seed, "mri-gridding");
+  Output out(job.input("small.uks.data"));
+  double dx = 0, dy = 0, dz = 1;
+  for (long long i = 0; i < samples; i++) {
+    /* 256 samples per spoke */
+    if (i % 256 == 0) {
+      dz = rng.uniform(-1, 1);
+      double phi = rng.uniform(0, 2 * M_PI), r = std::sqrt(1 - dz * dz);
+      dx = r * std::cos(phi);
+      dy = r * std::sin(phi);
+    }
+    double k = kmax * rng.uniform();
+    double amplitude = std::exp(-8 * k / kmax);
+    ReconstructionSample s;
+    s.real = (float)(amplitude * rng.normal());
+    s.imag = (float)(amplitude * rng.normal());
+    s.kX = (float)(k * dx);
+    s.kY = (float)(k * dy);
+    s.kZ = (float)(k * dz);
+    s.sdc = (float)(k * k / (kmax * kmax));
+    out.binary(s);
+  }
+
+  describe(job, "small.uks", "", "output.txt",
+           str(samples) + " samples, " + str(matrix) + "^3 matrix");
+}
+
+/* sad: a reference frame and a current frame of 16-bit pixels, in 4:3,
+ * with dimensions in whole macroblocks.  The current frame is the
+ * reference displaced by a motion vector of up to 8 pixels per 64 x 64
+ * region, plus noise, so the motion search has a best match to find.
+ * Pixels are hashes of their position, so both frames stream by row. */
+
+double
+sad_noise(const Job &job, long long x, long long y, int scale)
+{
+  /* Bilinear value noise on a lattice of the given spacing */
+  long long x0 = x / scale, y0 = y / scale;
+  double fx = (double)(x % scale) / scale, fy = (double)(y % scale) / scale;
+  auto v = [&](long long i, long long j) {
+    return unit(hash(job.seed + scale, i, j));
+  };
+  return (v(x0, y0) * (1 - fx) + v(x0 + 1, y0) * fx) * (1 - fy)
+       + (v(x0, y0 + 1) * (1 - fx) + v(x0 + 1, y0 + 1) * fx) * fy;
+}
+
+short
+sad_pixel(const Job &job, long long x, long long y)
+{
+  x += 1 << 20;			/* Keep displaced coordinates positive */
+  y += 1 << 20;
+  double v = 0.5 * sad_noise(job, x, y, 32) + 0.3 * sad_noise(job, x, y, 8)
+           + 0.2 * sad_noise(job, x, y, 2);
+  return (short)(v * 255);
+}
+
+void
+write_frame(const Job &job, const char *name, long long width,
+            long long height, bool displaced)
+{
+  Output out(job.input(name));
+  out.binary<unsigned short>(width);
+  out.binary<unsigned short>(height);
+  for (long long y = 0; y < height; y++) {
+    for (long long x = 0; x < width; x++) {
+      if (!displaced) {
+        out.binary(sad_pixel(job, x, y));
+        continue;
+      }
+      uint64_t h = hash(job.seed ^ 0x5ad, x / 64, y / 64);
+      long long dx = (long long)(h % 17) - 8;
+      long long dy = (long long)((h >> 8) % 17) - 8;
+      int noise = (int)(hash(job.seed, x, y) % 5) - 2;
+      int v = sad_pixel(job, x + dx, y + dy) + noise;
+      out.binary((short)std::clamp(v, 0, 255));
+    }
+  }
+}
+
+void
+gen_sad(const Job &job)
+{
+  double pixels = job.bytes / (2 * sizeof(short));
+  long long width = std::min(65520LL, round_to(std::sqrt(pixels * 4 / 3), 16));
+  long long height = std::min(65520LL, round_to(pixels / width, 16));
+
+  write_frame(job, "reference.bin", width, height, false);
+  write_frame(job, "frame.bin", width, height, true);
+  describe(job, "reference.bin frame.bin", "", "out.bin",
+           str(width) + " x " + str(height) + " frames");
+}
+
+/* lbm: an obstacle map of SIZE_X x SIZE_Y x SIZE_Z cells, shaped 4:4:5
+ * like the Parboil 120 x 120 x 150 channel, with porous spheres of random
+ * radius on a jittered 16-cell grid.  '.' is fluid, anything else an
+ * obstacle; every row and plane ends with a newline. */
+
+bool
+lbm_obstacle(const Job &job, long long x, long long y, long long z)
+{
+  const int grid = 16;
+  long long gx = x / grid, gy = y / grid, gz = z / grid;
+
+  for (long long k = gz - 1; k <= gz + 1; k++)
+    for (long long j = gy - 1; j <= gy + 1; j++)
+      for (long long i = gx - 1; i <= gx + 1; i++) {
+        if (i < 0 || j < 0 || k < 0)
+          continue;
+        uint64_t h = hash(job.seed, (uint64_t)i << 21 | j, k);
+        if (h % 3 != 0)
+          continue;		/* Two in three grid cells are empty */
+        double cx = (i + unit(finalize(h + 1))) * grid;
+        double cy = (j + unit(finalize(h + 2))) * grid;
+        double cz = (k + unit(finalize(h + 3))) * grid;
+        double r = 2 + 4 * unit(finalize(h + 4));
+        double ddx = x - cx, ddy = y - cy, ddz = z - cz;
+        if (ddx * ddx + ddy * ddy + ddz * ddz < r * r)
+          return true;
+      }
+  return false;
+}
+
+void
+gen_lbm(const Job &job)
+{
+  /* The grid holds 20 floats per cell */
+  double cells = job.bytes / (20 * sizeof(float));
+  long long s = std::max(2LL, std::llround(std::cbrt(cells / 80)));
+  long long sx = 4 * s, sy = 4 * s, sz = 5 * s;
+  check_int(job, (double)(sx + 8) * sy * (sz + 4) * 20, "the padded grid");
+
+  Output out(job.input("obstacles.dat"));
+  std::vector<char> row(sx + 1);
+  row[sx] = '\n';
+  for (long long z = 0; z < sz; z++) {
+    for (long long y = 0; y < sy; y++) {
+      for (long long x = 0; x < sx; x++)
+        row[x] = lbm_obstacle(job, x, y, z) ? '#' : '.';
+      out.bytes(&row[0], row.size());
+    }
+    out.ch('\n');
+  }
+
+  describe(job, "obstacles.dat", "100", "reference.dat",
+           "Build with APP_CXXFLAGS=\"-DSIZE_X=" + str(sx) + " -DSIZE_Y="
+           + str(sy) + " -DSIZE_Z=" + str(sz) + "\"");
+}
+
+struct Generator {
+  const char *benchmark;
+  void (*generate)(const Job &);
+};
+
+const Generator generators[] = {
+  {"bfs", gen_bfs},
+  {"cutcp", gen_cutcp},
+  {"histo", gen_histo},
+  {"lbm", gen_lbm},
+  {"mri-gridding", gen_mri_gridding},
+  {"sad", gen_sad},
+  {"sgemm", gen_sgemm},
+  {"stencil", gen_stencil},
+  {"tpacf", gen_tpacf},
+};
+
+double
+mem_total()
+{
+  FILE *f = fopen("/proc/meminfo", "r");
+  unsigned long long kb = 0;
+  if (f) {
+    if (fscanf(f, "MemTotal: %llu kB", &kb) != 1)
+      kb = 0;
+    fclose(f);
+  }
+  if (!kb)
+    die("cannot read MemTotal from /proc/meminfo; give -b instead");
+  return kb * 1024.0;
+}
+
+double
+size_bytes(const std::string &size)
+{
+  if (size == "S")
+    return 256 << 10;
+  if (size == "M")
+    return 16 << 20;
+  if (size == "L")
+    return 1 << 30;
+  if (size == "XL")
+    return 1.25 * mem_total();
+  die("unknown size %s: expected S, M, L or XL, or give -b", size);
+}
+
+void
+make_dirs(const std::string &path)
+{
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i < path.size() && path[i] != '/')
+      continue;
+    std::string prefix = path.substr(0, i);
+    if (mkdir(prefix.c_str(), 0777) && errno != EEXIST)
+      die("cannot create %s", prefix + ": " + strerror(errno));
+  }
+}
+
+void
+usage()
+{
+  fputs("usage: datagen [-s SEED] [-b BYTES] [-o DIR] BENCHMARK SIZE\n"
+        "  BENCHMARK  one of", stderr);
+  for (const Generator &g : generators)
+    fprintf(stderr, " %s", g.benchmark);
+  fputs(", or all\n"
+        "  SIZE       S, M, L or XL; with -b, any dataset name\n"
+        "  -s SEED    random seed (1)\n"
+        "  -b BYTES   target size of the decoded input\n"
+        "  -o DIR     output directory (datasets/BENCHMARK/SIZE)\n", stderr);
+  exit(2);
+}
+
+}  // namespace
+
+int
+main(int argc, char **argv)
+{
+  uint64_t seed = 1;
+  double bytes = 0;
+  std::string dir;
+  int c;
+
+  while ((c = getopt(argc, argv, "s:b:o:h")) != -1) {
+    switch (c) {
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'b':
+      bytes = strtod(optarg, NULL);
+      if (!(bytes > 0))
+        die("bad size %s", optarg);
+      break;
+    case 'o':
+      dir = optarg;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (argc - optind != 2)
+    usage();
+
+  std::string benchmark = argv[optind], size = argv[optind + 1];
+  bool all = benchmark == "all";
+  if (all && !dir.empty())
+    die("-o needs a single benchmark");
+  if (!bytes)
+    bytes = size_bytes(size);
+
+  bool found = false;
+  for (const Generator &g : generators) {
+    if (!all && benchmark != g.benchmark)
+      continue;
+    found = true;
+
+    Job job;
+    job.benchmark = g.benchmark;
+    job.size = size;
+    job.dir = dir.empty() ? "datasets/" + job.benchmark + "/" + size : dir;
+    job.bytes = bytes;
+    job.seed = seed;
+
+    fprintf(stderr, "%s %s (%.0f bytes):\n", g.benchmark, size.c_str(), bytes);
+    make_dirs(job.input(""));
+    g.generate(job);
+  }
+  if (!found)
+    die("unknown benchmark %s", benchmark);
+
+  return 0;
+}
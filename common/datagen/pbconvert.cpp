@@ -0,0 +1,329 @@
+/*
+ * Convert Parboil inputs to binary container files (see pb_io.h).
+ *
+ *   pbconvert sgemm [-t TYPE] IN OUT       column-major text matrix, stored
+ *                                          as f32 (default), f16 or bf16
+ *   pbconvert stencil NX NY NZ IN OUT      raw floats, x fastest
+ *   pbconvert bfs [-f FORMAT] IN OUT       text graph, stored as node and
+ *                                          edge records (pairs, default)
+ *                                          or as CSR arrays (csr)
+ *
+ * The benchmarks that take a container recognize it by its magic, so OUT
+ * replaces IN on the command line or in a dataset's DESCRIPTION.  Arrays
+ * are converted in chunks, so inputs larger than RAM convert in constant
+ * memory.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <pb_io.h>
+
+namespace {
+
+const size_t chunk = 1 << 20;	/* Elements per pb_AppendArray */
+const char *output;		/* Removed on error */
+
+[[noreturn]] void
+die(const char *fmt, const std::string &arg = "")
+{
+  fprintf(stderr, "pbconvert: ");
+  fprintf(stderr, fmt, arg.c_str());
+  fputc('\n', stderr);
+  if (output)
+    remove(output);
+  exit(1);
+}
+
+FILE *
+open_input(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    die("cannot open %s", path);
+  return f;
+}
+
+void
+check(int status)
+{
+  if (status != 0) {
+    if (output)
+      remove(output);
+    exit(1);
+  }
+}
+
+/* Read count integers into a chunked array of int32_t. */
+void
+convert_ints(struct pb_ContainerWriter *w, FILE *in, const char *path,
+             size_t count)
+{
+  std::vector<int32_t> buf;
+  buf.reserve(chunk);
+  for (size_t i = 0; i < count; i++) {
+    int v;
+    if (fscanf(in, "%d", &v) != 1)
+      die("%s ends early", path);
+    buf.push_back(v);
+    if (buf.size() == chunk || i + 1 == count) {
+      check(pb_AppendArray(w, buf.data(), buf.size() * sizeof(int32_t)));
+      buf.clear();
+    }
+  }
+}
+
+/* Append floats to the open array, narrowed to its element type */
+void
+append_floats(struct pb_ContainerWriter *w, enum pb_Type type,
+              const std::vector<float> &buf)
+{
+  if (type == pb_Type_F32) {
+    check(pb_AppendArray(w, buf.data(), buf.size() * sizeof(float)));
+    return;
+  }
+  std::vector<uint16_t> half(buf.size());
+  pb_FloatsToHalf(type, buf.data(), half.data(), buf.size());
+  check(pb_AppendArray(w, half.data(), half.size() * sizeof(uint16_t)));
+}
+
+/* sgemm: "rows cols" then the matrix, column by column.  The "matrix"
+ * array has dims {cols, rows}, so that it is column-major in memory, and
+ * elements of the given type. */
+void
+convert_sgemm(struct pb_ContainerWriter *w, enum pb_Type type,
+              const char *path)
+{
+  FILE *in = open_input(path);
+  long long rows, cols;
+  if (fscanf(in, "%lld %lld", &rows, &cols) != 2 || rows <= 0 || cols <= 0)
+    die("%s is not a matrix file", path);
+
+  size_t dims[2] = { (size_t)cols, (size_t)rows };
+  size_t count = dims[0] * dims[1];
+  check(pb_BeginArray(w, "matrix", type, pb_TypeSize(type), 2, dims));
+  std::vector<float> buf;
+  buf.reserve(chunk);
+  for (size_t i = 0; i < count; i++) {
+    float v;
+    if (fscanf(in, "%f", &v) != 1)
+      die("%s ends early", path);
+    buf.push_back(v);
+    if (buf.size() == chunk || i + 1 == count) {
+      append_floats(w, type, buf);
+      buf.clear();
+    }
+  }
+  check(pb_EndArray(w));
+  fclose(in);
+}
+
+/* stencil: nx*ny*nz raw floats become the nz x ny x nx "grid" array. */
+void
+convert_stencil(struct pb_ContainerWriter *w, size_t nx, size_t ny,
+                size_t nz, const char *path)
+{
+  FILE *in = open_input(path);
+  size_t dims[3] = { nz, ny, nx };
+  size_t count = nx * ny * nz;
+  check(pb_BeginArray(w, "grid", pb_Type_F32, sizeof(float), 3, dims));
+  std::vector<float> buf(chunk);
+  for (size_t done = 0; done < count; ) {
+    size_t n = std::min(chunk, count - done);
+    if (fread(buf.data(), sizeof(float), n, in) != n)
+      die("%s is shorter than the grid", path);
+    check(pb_AppendArray(w, buf.data(), n * sizeof(float)));
+    done += n;
+  }
+  check(pb_EndArray(w));
+  fclose(in);
+}
+
+/* bfs: the node count and (start, degree) pairs, the source node, the edge
+ * count and (id, cost) pairs.  They become the "nodes" and "edges" arrays
+ * of int32_t pairs and the one-element "source" array. */
+void
+convert_bfs(struct pb_ContainerWriter *w, const char *path)
+{
+  FILE *in = open_input(path);
+  long long nodes, edges;
+  int source;
+
+  if (fscanf(in, "%lld", &nodes) != 1 || nodes < 0)
+    die("%s is not a graph file", path);
+  size_t node_dims[1] = { (size_t)nodes };
+  check(pb_BeginArray(w, "nodes", pb_Type_RECORD, 2 * sizeof(int32_t), 1,
+                      node_dims));
+  convert_ints(w, in, path, 2 * node_dims[0]);
+  check(pb_EndArray(w));
+
+  if (fscanf(in, "%d %lld", &source, &edges) != 2 || edges < 0)
+    die("%s ends early", path);
+  int32_t src = source;
+  size_t source_dims[1] = { 1 };
+  check(pb_WriteArray(w, "source", pb_Type_I32, sizeof(int32_t), 1,
+                      source_dims, &src));
+
+  size_t edge_dims[1] = { (size_t)edges };
+  check(pb_BeginArray(w, "edges", pb_Type_RECORD, 2 * sizeof(int32_t), 1,
+                      edge_dims));
+  convert_ints(w, in, path, 2 * edge_dims[0]);
+  check(pb_EndArray(w));
+  fclose(in);
+}
+
+/* bfs in compressed sparse row form: "offsets" holds the nodes' first
+ * edges and the edge count as n + 1 uint64_t, "targets" the int32_t
+ * destination of every edge and "weights" their int32_t costs.  weights is
+ * left out when every edge costs 1.  The text lists each node's first edge
+ * and degree; they must describe the edges in order, as CSR does. */
+void
+convert_bfs_csr(struct pb_ContainerWriter *w, const char *path)
+{
+  FILE *in = open_input(path);
+  long long nodes, edges, start, degree, next = 0;
+  int source;
+
+  if (fscanf(in, "%lld", &nodes) != 1 || nodes < 0)
+    die("%s is not a graph file", path);
+  size_t offset_dims[1] = { (size_t)nodes + 1 };
+  check(pb_BeginArray(w, "offsets", pb_Type_U64, sizeof(uint64_t), 1,
+                      offset_dims));
+  std::vector<uint64_t> buf;
+  buf.reserve(chunk);
+  for (long long i = 0; i < nodes; i++) {
+    if (fscanf(in, "%lld %lld", &start, &degree) != 2)
+      die("%s ends early", path);
+    if (start != next || degree < 0)
+      die("the edges of %s are not in CSR order", path);
+    buf.push_back(start);
+    next = start + degree;
+    if (buf.size() == chunk) {
+      check(pb_AppendArray(w, buf.data(), buf.size() * sizeof(uint64_t)));
+      buf.clear();
+    }
+  }
+  buf.push_back(next);
+  check(pb_AppendArray(w, buf.data(), buf.size() * sizeof(uint64_t)));
+  check(pb_EndArray(w));
+
+  if (fscanf(in, "%d %lld", &source, &edges) != 2 || edges < 0)
+    die("%s ends early", path);
+  if (edges != next)
+    die("the nodes of %s do not cover its edges", path);
+  int32_t src = source;
+  size_t source_dims[1] = { 1 };
+  check(pb_WriteArray(w, "source", pb_Type_I32, sizeof(int32_t), 1,
+                      source_dims, &src));
+
+  // Targets on a first pass over the edges, and the costs on a second one
+  // if any of them is not 1
+  long where = ftell(in);
+  bool weighted = false;
+  size_t edge_dims[1] = { (size_t)edges };
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1 && !weighted)
+      break;
+    if (pass == 1 && fseek(in, where, SEEK_SET) != 0)
+      die("cannot reread %s", path);
+    check(pb_BeginArray(w, pass ? "weights" : "targets", pb_Type_I32,
+                        sizeof(int32_t), 1, edge_dims));
+    std::vector<int32_t> values;
+    values.reserve(chunk);
+    for (long long i = 0; i < edges; i++) {
+      int id, cost;
+      if (fscanf(in, "%d %d", &id, &cost) != 2)
+        die("%s ends early", path);
+      weighted |= cost != 1;
+      values.push_back(pass ? cost : id);
+      if (values.size() == chunk || i + 1 == edges) {
+        check(pb_AppendArray(w, values.data(),
+                             values.size() * sizeof(int32_t)));
+        values.clear();
+      }
+    }
+    check(pb_EndArray(w));
+  }
+  fclose(in);
+}
+
+size_t
+dimension(const char *arg)
+{
+  char *end;
+  long long v = strtoll(arg, &end, 10);
+  if (*end != '\0' || v <= 0)
+    die("bad dimension %s", arg);
+  return v;
+}
+
+void
+usage()
+{
+  fputs("usage: pbconvert sgemm [-t f32|f16|bf16] IN OUT\n"
+        "       pbconvert stencil NX NY NZ IN OUT\n"
+        "       pbconvert bfs [-f pairs|csr] IN OUT\n", stderr);
+  exit(2);
+}
+
+}  // namespace
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2)
+    usage();
+  std::string benchmark = argv[1];
+  if (benchmark != "sgemm" && benchmark != "stencil" && benchmark != "bfs")
+    usage();
+  enum pb_Type type = pb_Type_F32;
+  if (benchmark == "sgemm" && argc > 2 && strcmp(argv[2], "-t") == 0) {
+    if (argc < 4)
+      usage();
+    std::string t = argv[3];
+    if (t == "f16")
+      type = pb_Type_F16;
+    else if (t == "bf16")
+      type = pb_Type_BF16;
+    else if (t != "f32")
+      die("unknown element type %s", t);
+    argv += 2;
+    argc -= 2;
+  }
+  bool csr = false;
+  if (benchmark == "bfs" && argc > 2 && strcmp(argv[2], "-f") == 0) {
+    if (argc < 4)
+      usage();
+    std::string f = argv[3];
+    if (f == "csr")
+      csr = true;
+    else if (f != "pairs")
+      die("unknown graph format %s", f);
+    argv += 2;
+    argc -= 2;
+  }
+  int files = benchmark == "stencil" ? 5 : 2;
+  if (argc != files + 2)
+    usage();
+  const char *in = argv[argc - 2], *out = argv[argc - 1];
+
+  struct pb_ContainerWriter *w = pb_CreateContainer(out);
+  if (w == NULL)
+    return 1;
+  output = out;
+  if (benchmark == "sgemm")
+    convert_sgemm(w, type, in);
+  else if (benchmark == "stencil")
+    convert_stencil(w, dimension(argv[2]), dimension(argv[3]),
+                    dimension(argv[4]), in);
+  else if (csr)
+    convert_bfs_csr(w, in);
+  else
+    convert_bfs(w, in);
+  return pb_CloseContainerWriter(w) == 0 ? 0 : 1;
+}
@@ -0,0 +1,437 @@
+#!/usr/bin/env python3
+"""Run Parboil benchmarks repeatedly and summarize their timers.
+
+Every benchmark binary reports one sample of its pb_TimerSet per run.  This
+driver runs a command, or a set of benchmarks and datasets, with warmup
+runs and measured repetitions, reads each run's timers through
+PARBOIL_TIMER_JSON, and reports the median, median absolute deviation,
+minimum and a 95% confidence interval of the median for every timer
+bucket (categories, sub-timers and wall time).
+
+  bench.py run [options] -- BINARY ARGS...
+      Time one command line, as the `run` target of common/mk/hcc.mk
+      would execute it.
+
+  bench.py suite [options] [-v VERSION] [-d DATASETS] [BENCHMARK...]
+      Time benchmarks/<b>/build/<version>_<platform>/<b> on the datasets
+      datasets/<b>/<dataset>, whose DESCRIPTION file lists the inputs
+      (relative to the dataset's input/ directory) and parameters:
+
+          Inputs: matrix1.txt matrix2t.txt matrix2t.txt
+          Parameters:
+          Output: matrix3.txt
+
+With --verify, the output named in DESCRIPTION is not written; instead
+the benchmark compares its result in memory against the reference copy in
+the dataset's output/ directory (-v), and with --gold against its CPU
+implementation (-V).  Only the first run checks, and a mismatch fails the
+benchmark.
+
+Runs are isolated from each other: each one is a fresh process in a fresh
+working directory, its input files are evicted from the page cache
+beforehand (all caches are dropped with --drop-caches, which needs root),
+and it can be pinned to a CPU set with --cpus.
+"""
+
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))))
+
+CATEGORIES = ["io", "kernel", "copy", "driver", "copy_async", "compute",
+              "overlap"]
+
+
+class RunError(Exception):
+    pass
+
+
+###############################################################################
+# Statistics
+
+def median(xs):
+    s = sorted(xs)
+    n = len(s)
+    mid = n // 2
+    return s[mid] if n % 2 else 0.5 * (s[mid - 1] + s[mid])
+
+
+def mad(xs):
+    """Median absolute deviation from the median, unscaled."""
+    m = median(xs)
+    return median([abs(x - m) for x in xs])
+
+
+def median_ci(xs, level=0.95):
+    """Distribution-free confidence interval of the median.
+
+    The interval between the j-th smallest and the j-th largest sample
+    covers the median with probability 1 - 2 P(B <= j - 1), B ~ Bin(n, 1/2).
+    Returns the narrowest such interval with at least the requested
+    coverage, or None if even [min, max] falls short (fewer than 6 runs
+    at 95%)."""
+    s = sorted(xs)
+    n = len(s)
+    best = None
+    for j in range(1, n // 2 + 1):
+        tail = sum(math.comb(n, i) for i in range(j)) / 2.0 ** n
+        if 1 - 2 * tail < level:
+            break
+        best = (s[j - 1], s[n - j])
+    return best
+
+
+def summarize(xs):
+    return {
+        "n": len(xs),
+        "median": median(xs),
+        "mad": mad(xs),
+        "min": min(xs),
+        "ci": median_ci(xs),
+    }
+
+
+###############################################################################
+# Timer samples
+
+def read_timers(path):
+    """Timer buckets of one run, from the JSON line pb_PrintTimerSet
+    appended to path: {"kernel": s, "kernel/MainKernel": s, "wall": s}."""
+    with open(path) as f:
+        lines = [line for line in f if line.strip()]
+    if not lines:
+        raise RunError("the benchmark did not write its timers; "
+                       "was it built against common/src/parboil.c?")
+    record = json.loads(lines[-1])
+
+    buckets = {"wall": record["wall"]}
+    for name, timer in record["timers"].items():
+        buckets[name] = timer["seconds"]
+        for label, sub in timer.get("subtimers", {}).items():
+            buckets[name + "/" + label] = sub["seconds"]
+    return buckets, record.get("roofline")
+
+
+def bucket_order(name):
+    """Categories in pb_TimerID order, each followed by its sub-timers,
+    and wall time last."""
+    category = name.split("/")[0]
+    rank = CATEGORIES.index(category) if category in CATEGORIES \
+        else len(CATEGORIES)
+    return (rank, "/" in name, name)
+
+
+###############################################################################
+# Run isolation
+
+def evict_from_page_cache(paths):
+    """Drop the cached pages of the given files, so every run reads its
+    input from storage as the first one did."""
+    for path in paths:
+        try:
+            fd = os.open(path, os.O_RDONLY)
+        except OSError:
+            continue
+        try:
+            os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        finally:
+            os.close(fd)
+
+
+_drop_caches_failed = False
+
+
+def drop_caches():
+    """Drop the whole page cache, dentries and inodes (needs root)."""
+    global _drop_caches_failed
+    if _drop_caches_failed:
+        return
+    os.sync()
+    try:
+        with open("/proc/sys/vm/drop_caches", "w") as f:
+            f.write("3\n")
+    except OSError as e:
+        _drop_caches_failed = True
+        print("warning: cannot drop caches (%s); evicting inputs only"
+              % e.strerror, file=sys.stderr)
+
+
+def input_files(argv):
+    """Input files of a command line, following the pb_Parameters
+    convention of a comma-separated list after -i."""
+    files = []
+    for flag, value in zip(argv, argv[1:]):
+        if flag == "--":
+            break
+        if flag == "-i":
+            files.extend(value.split(","))
+    return files
+
+
+###############################################################################
+# Running
+
+def run_once(argv, inputs, env, opts):
+    """Run a command once in a fresh working directory and return its
+    timer buckets.  Relative paths in argv are resolved beforehand."""
+    if opts.drop_caches:
+        drop_caches()
+    evict_from_page_cache(inputs)
+
+    workdir = tempfile.mkdtemp(prefix="parboil-run-")
+    try:
+        timer_file = os.path.join(workdir, "timers.json")
+        run_env = dict(env, PARBOIL_TIMER_JSON=timer_file)
+        cpus = opts.cpus
+
+        def pin():
+            if cpus:
+                os.sched_setaffinity(0, cpus)
+
+        with open(os.path.join(workdir, "log"), "w+") as log:
+            rc = subprocess.call(argv, cwd=workdir, env=run_env,
+                                 stdin=subprocess.DEVNULL, stdout=log,
+                                 stderr=subprocess.STDOUT, preexec_fn=pin)
+            if rc != 0:
+                log.seek(0)
+                tail = log.read()[-2000:]
+                raise RunError("%s exited with status %d:\n%s"
+                               % (argv[0], rc, tail))
+        return read_timers(timer_file)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+
+def measure(argv, inputs, opts, check=()):
+    """Warm up, then collect opts.repeat samples of every timer bucket.
+    The first run gets the verification arguments in check as well."""
+    env = dict(os.environ)
+    env.pop("PARBOIL_TIMER_CSV", None)
+    samples = {}
+
+    for n in range(opts.warmup + opts.repeat):
+        buckets, roofline = run_once(argv + list(check) if n == 0 else argv,
+                                     inputs, env, opts)
+
+        # Measure the roofline ceilings once, not in every run
+        if roofline and "PARBOIL_PEAK_GBS" not in env:
+            env["PARBOIL_PEAK_GBS"] = repr(roofline["bandwidth"] / 1e9)
+        if roofline and "PARBOIL_PEAK_GFLOPS" not in env:
+            env["PARBOIL_PEAK_GFLOPS"] = repr(roofline["flops"] / 1e9)
+
+        if n < opts.warmup:
+            continue
+        for name, seconds in buckets.items():
+            samples.setdefault(name, []).append(seconds)
+
+    # Buckets that never ran carry no information
+    return {name: xs for name, xs in samples.items() if any(xs)}
+
+
+###############################################################################
+# Reporting
+
+def report(label, samples, opts, rows):
+    print("%s: %d runs after %d warmup" % (label, opts.repeat, opts.warmup))
+    print("  %-24s %12s %12s %12s   %s"
+          % ("timer", "median", "MAD", "min", "95% CI of median"))
+    for name in sorted(samples, key=bucket_order):
+        st = summarize(samples[name])
+        ci = "[%.6f, %.6f]" % st["ci"] if st["ci"] else "n/a (< 6 runs)"
+        print("  %-24s %12.6f %12.6f %12.6f   %s"
+              % (name, st["median"], st["mad"], st["min"], ci))
+        rows.append(dict(st, run=label, timer=name, samples=samples[name]))
+    print()
+    sys.stdout.flush()
+
+
+def write_outputs(rows, opts):
+    if opts.csv:
+        new = not os.path.exists(opts.csv) or os.path.getsize(opts.csv) == 0
+        with open(opts.csv, "a") as f:
+            if new:
+                f.write("run,timer,n,median,mad,min,ci_low,ci_high\n")
+            for r in rows:
+                ci = r["ci"] or ("", "")
+                f.write('"%s",%s,%d,%.9f,%.9f,%.9f,%s,%s\n'
+                        % (r["run"], r["timer"], r["n"], r["median"],
+                           r["mad"], r["min"], ci[0], ci[1]))
+    if opts.json:
+        with open(opts.json, "w") as f:
+            json.dump(rows, f, indent=1)
+            f.write("\n")
+
+
+###############################################################################
+# Benchmark suite
+
+def read_description(path):
+    """Key: value lines of a dataset DESCRIPTION file."""
+    desc = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split("#", 1)[0]
+            if ":" in line:
+                key, value = line.split(":", 1)
+                desc[key.strip().lower()] = value.strip()
+    return desc
+
+
+def dataset_command(binary, bench, dataset, opts):
+    """Command line, input files and verification arguments of a benchmark
+    on a dataset, following the pb_Parameters conventions (-i inputs,
+    -o output, then parameters)."""
+    ddir = os.path.join(ROOT, "datasets", bench, dataset)
+    desc = read_description(os.path.join(ddir, "DESCRIPTION"))
+
+    inputs = [os.path.join(ddir, "input", name)
+              for name in desc.get("inputs", "").split()]
+    argv = [binary]
+    check = []
+    if inputs:
+        argv += ["-i", ",".join(inputs)]
+    if opts.verify and desc.get("output"):
+        reference = os.path.join(ddir, "output", desc["output"])
+        if not os.path.exists(reference):
+            raise RunError("no reference output %s"
+                           % os.path.relpath(reference, ROOT))
+        check += ["-v", reference]
+    elif desc.get("output"):
+        # Relative to the run's working directory, discarded afterwards
+        argv += ["-o", desc["output"]]
+    if opts.gold:
+        check.append("-V")
+    argv += desc.get("parameters", "").split()
+    return argv, inputs, check
+
+
+def list_datasets(bench):
+    ddir = os.path.join(ROOT, "datasets", bench)
+    if not os.path.isdir(ddir):
+        return []
+    return sorted(d for d in os.listdir(ddir)
+                  if os.path.exists(os.path.join(ddir, d, "DESCRIPTION")))
+
+
+def suite(opts, rows):
+    benchmarks = opts.benchmarks or sorted(
+        os.listdir(os.path.join(ROOT, "benchmarks")))
+    failed = False
+
+    for bench in benchmarks:
+        binary = os.path.join(ROOT, "benchmarks", bench, "build",
+                              "%s_%s" % (opts.version, opts.platform), bench)
+        if not os.path.exists(binary):
+            print("%s: no %s_%s build at %s, skipped"
+                  % (bench, opts.version, opts.platform,
+                     os.path.relpath(binary, ROOT)), file=sys.stderr)
+            continue
+
+        datasets = opts.datasets or list_datasets(bench)
+        if not datasets:
+            print("%s: no datasets, skipped" % bench, file=sys.stderr)
+        for dataset in datasets:
+            label = "%s %s %s" % (bench, opts.version, dataset)
+            try:
+                argv, inputs, check = dataset_command(binary, bench,
+                                                      dataset, opts)
+                report(label, measure(argv, inputs, opts, check), opts, rows)
+            except (OSError, RunError) as e:
+                print("%s: %s" % (label, e), file=sys.stderr)
+                failed = True
+                if not opts.keep_going:
+                    return failed
+    return failed
+
+
+###############################################################################
+
+def cpu_list(text):
+    cpus = set()
+    for part in text.split(","):
+        lo, _, hi = part.partition("-")
+        cpus.update(range(int(lo), int(hi or lo) + 1))
+    return cpus
+
+
+def main():
+    common = argparse.ArgumentParser(add_help=False)
+    common.add_argument("-w", "--warmup", type=int, default=1,
+                        help="unmeasured runs first (default 1)")
+    common.add_argument("-r", "--repeat", type=int, default=10,
+                        help="measured runs (default 10)")
+    common.add_argument("--cpus", type=cpu_list,
+                        help="pin runs to these CPUs, e.g. 0-3,8")
+    common.add_argument("--drop-caches", action="store_true",
+                        help="drop the whole page cache before every run")
+    common.add_argument("--csv", help="append the summary to this CSV file")
+    common.add_argument("--json", help="write summary and samples as JSON")
+
+    parser = argparse.ArgumentParser(
+        description=__doc__.split("\n\n")[0])
+    sub = parser.add_subparsers(dest="mode", required=True)
+
+    run = sub.add_parser("run", parents=[common],
+                         help="time one command line")
+    run.add_argument("command", nargs=argparse.REMAINDER,
+                     help="-- BINARY ARGS...")
+
+    st = sub.add_parser("suite", parents=[common],
+                        help="time benchmarks on datasets")
+    st.add_argument("-v", "--version", default="hcc",
+                    help="benchmark version to run (default hcc)")
+    st.add_argument("-p", "--platform", default="default",
+                    help="platform the version was built for "
+                    "(default default)")
+    st.add_argument("-d", "--datasets", type=lambda s: s.split(","),
+                    help="comma-separated datasets (default all)")
+    st.add_argument("-k", "--keep-going", action="store_true",
+                    help="continue after a failing benchmark")
+    st.add_argument("--verify", action="store_true",
+                    help="check results against the dataset's reference "
+                    "output instead of writing them")
+    st.add_argument("--gold", action="store_true",
+                    help="check results against the benchmark's CPU "
+                    "implementation")
+    st.add_argument("benchmarks", nargs="*",
+                    help="benchmarks to run (default all)")
+
+    opts = parser.parse_args()
+    if opts.repeat < 1 or opts.warmup < 0:
+        parser.error("need at least one measured run")
+
+    rows = []
+    failed = False
+    if opts.mode == "run":
+        command = opts.command[1:] if opts.command[:1] == ["--"] \
+            else opts.command
+        if not command:
+            parser.error("no command given")
+        # Runs happen in their own directories, so make paths absolute
+        argv = [os.path.abspath(a) if os.path.exists(a) else a
+                for a in command]
+        argv = [",".join(os.path.abspath(f) if os.path.exists(f) else f
+                         for f in a.split(",")) if prev == "-i" else a
+                for prev, a in zip([None] + argv, argv)]
+        try:
+            report(" ".join(command), measure(argv, input_files(argv), opts),
+                   opts, rows)
+        except (OSError, RunError) as e:
+            print(e, file=sys.stderr)
+            failed = True
+    else:
+        failed = suite(opts, rows)
+
+    write_outputs(rows, opts)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,634 @@
+/*
+ * CPU implementation of the subset of the HC C++ API used by the HCC
+ * benchmarks: index/extent, tiled launches with tile_static memory and
+ * tile barriers, array_view over host memory, copy() and the atomics.
+ *
+ * Built through common/platform/hcc.host.mk, so the benchmark sources
+ * compile unchanged with the host C++ compiler.  array_view always
+ * aliases host memory, which makes synchronize()/synchronize_to() and
+ * copies between a view and its own source free.  Launches complete
+ * before parallel_for_each returns.
+ *
+ * When the Parboil timeline is recorded (PARBOIL_TRACE, see parboil.h),
+ * every launch adds a span with its extent and tile size.
+ */
+
+#ifndef HC_HOST_HPP
+#define HC_HOST_HPP
+
+#define HC_HOST_BACKEND 1
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cxxabi.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+#include "hc_host_runtime.hpp"
+
+/* Timeline hooks of the Parboil library.  Weak, so that the runtime also
+ * links without it; launches are then not recorded. */
+extern "C" {
+int pb_TraceEnabled(void) __attribute__((weak));
+unsigned long long pb_GetTimestamp(void) __attribute__((weak));
+void pb_TraceSpan(const char *name, const char *category,
+                  unsigned long long begin, unsigned long long end,
+                  const char *args) __attribute__((weak));
+}
+
+/* Work-items of a tile share the worker thread they run on, so per-thread
+ * storage is per-tile storage. */
+#define tile_static static thread_local
+
+namespace hc {
+
+template <int N> class extent;
+
+/*---------------------------------------------------------------------------*/
+/* index / extent                                                            */
+
+template <int N>
+class index {
+public:
+  static const int rank = N;
+
+  index() { for (int d = 0; d < N; d++) v_[d] = 0; }
+  explicit index(int i0) { static_assert(N == 1, "rank mismatch"); v_[0] = i0; }
+  index(int i0, int i1) { static_assert(N == 2, "rank mismatch"); v_[0] = i0; v_[1] = i1; }
+  index(int i0, int i1, int i2)
+  {
+    static_assert(N == 3, "rank mismatch");
+    v_[0] = i0; v_[1] = i1; v_[2] = i2;
+  }
+  explicit index(const int components[]) { for (int d = 0; d < N; d++) v_[d] = components[d]; }
+
+  int operator[](int d) const { return v_[d]; }
+  int &operator[](int d) { return v_[d]; }
+
+  index &operator+=(const index &o) { for (int d = 0; d < N; d++) v_[d] += o.v_[d]; return *this; }
+  index &operator-=(const index &o) { for (int d = 0; d < N; d++) v_[d] -= o.v_[d]; return *this; }
+  index operator+(const index &o) const { index r(*this); return r += o; }
+  index operator-(const index &o) const { index r(*this); return r -= o; }
+
+  bool operator==(const index &o) const
+  {
+    for (int d = 0; d < N; d++)
+      if (v_[d] != o.v_[d]) return false;
+    return true;
+  }
+  bool operator!=(const index &o) const { return !(*this == o); }
+
+private:
+  int v_[N];
+};
+
+template <int N> class tiled_extent;
+
+template <int N>
+class extent {
+public:
+  static const int rank = N;
+
+  extent() { for (int d = 0; d < N; d++) v_[d] = 0; }
+  explicit extent(int e0) { static_assert(N == 1, "rank mismatch"); v_[0] = e0; }
+  extent(int e0, int e1) { static_assert(N == 2, "rank mismatch"); v_[0] = e0; v_[1] = e1; }
+  extent(int e0, int e1, int e2)
+  {
+    static_assert(N == 3, "rank mismatch");
+    v_[0] = e0; v_[1] = e1; v_[2] = e2;
+  }
+  explicit extent(const int components[]) { for (int d = 0; d < N; d++) v_[d] = components[d]; }
+
+  int operator[](int d) const { return v_[d]; }
+  int &operator[](int d) { return v_[d]; }
+
+  unsigned int size() const
+  {
+    unsigned int s = 1;
+    for (int d = 0; d < N; d++) s *= (unsigned int) v_[d];
+    return s;
+  }
+
+  bool contains(const index<N> &i) const
+  {
+    for (int d = 0; d < N; d++)
+      if (i[d] < 0 || i[d] >= v_[d]) return false;
+    return true;
+  }
+
+  tiled_extent<N> tile(int t0) const;
+  tiled_extent<N> tile(int t0, int t1) const;
+  tiled_extent<N> tile(int t0, int t1, int t2) const;
+
+  bool operator==(const extent &o) const
+  {
+    for (int d = 0; d < N; d++)
+      if (v_[d] != o.v_[d]) return false;
+    return true;
+  }
+  bool operator!=(const extent &o) const { return !(*this == o); }
+
+private:
+  int v_[N];
+};
+
+// A launch domain split into tiles.  The global extent does not have to be
+// a multiple of the tile size; trailing tiles are then partial.
+template <int N>
+class tiled_extent : public extent<N> {
+public:
+  static const int rank = N;
+  int tile_dim[N];
+
+  tiled_extent() { for (int d = 0; d < N; d++) tile_dim[d] = 0; }
+  tiled_extent(const extent<N> &e, const int t[]) : extent<N>(e)
+  {
+    for (int d = 0; d < N; d++) tile_dim[d] = t[d];
+  }
+
+  extent<N> get_tile_extent() const { return extent<N>(tile_dim); }
+
+  // Number of tiles along dimension d.
+  int tile_count(int d) const { return ((*this)[d] + tile_dim[d] - 1) / tile_dim[d]; }
+};
+
+template <int N>
+tiled_extent<N> extent<N>::tile(int t0) const
+{
+  static_assert(N == 1, "rank mismatch");
+  int t[1] = {t0};
+  return tiled_extent<N>(*this, t);
+}
+
+template <int N>
+tiled_extent<N> extent<N>::tile(int t0, int t1) const
+{
+  static_assert(N == 2, "rank mismatch");
+  int t[2] = {t0, t1};
+  return tiled_extent<N>(*this, t);
+}
+
+template <int N>
+tiled_extent<N> extent<N>::tile(int t0, int t1, int t2) const
+{
+  static_assert(N == 3, "rank mismatch");
+  int t[3] = {t0, t1, t2};
+  return tiled_extent<N>(*this, t);
+}
+
+/*---------------------------------------------------------------------------*/
+/* tiles                                                                     */
+
+class tile_barrier {
+public:
+  void wait() const { detail::current_worker()->barrier_wait(); }
+  void wait_with_all_memory_fence() const { wait(); }
+  void wait_with_global_memory_fence() const { wait(); }
+  void wait_with_tile_static_memory_fence() const { wait(); }
+};
+
+template <int N>
+class tiled_index {
+public:
+  static const int rank = N;
+
+  const index<N> global;
+  const index<N> local;
+  const index<N> tile;
+  const index<N> tile_origin;
+  const tile_barrier barrier;
+  const index<N> tile_dim;
+
+  tiled_index(const index<N> &g, const index<N> &l, const index<N> &t,
+              const index<N> &o, const index<N> &dim)
+    : global(g), local(l), tile(t), tile_origin(o), barrier(), tile_dim(dim) {}
+
+  operator const index<N>() const { return global; }
+};
+
+/*---------------------------------------------------------------------------*/
+/* accelerators                                                              */
+
+class completion_future {
+public:
+  void wait() const {}
+  void get() const {}
+  bool is_ready() const { return true; }
+};
+
+class accelerator;
+
+class accelerator_view {
+public:
+  void wait() const {}
+  void flush() const {}
+  accelerator get_accelerator() const;
+};
+
+class accelerator {
+public:
+  accelerator() {}
+  explicit accelerator(const std::wstring &) {}
+
+  accelerator_view get_default_view() const { return accelerator_view(); }
+  accelerator_view create_view() const { return accelerator_view(); }
+  std::wstring get_description() const { return L"host"; }
+  std::wstring get_device_path() const { return L"cpu"; }
+  bool get_is_emulated() const { return false; }
+  unsigned get_cu_count() const { return detail::thread_pool::instance().size(); }
+};
+
+inline accelerator accelerator_view::get_accelerator() const { return accelerator(); }
+
+/*---------------------------------------------------------------------------*/
+/* array_view                                                                */
+
+template <typename T, int N = 1>
+class array_view {
+public:
+  typedef T value_type;
+  static const int rank = N;
+
+  // Views without a data source own zero-filled, cache-line aligned storage.
+  explicit array_view(const extent<N> &e) : ext_(e) { allocate(); }
+  explicit array_view(int e0) : ext_(e0) { allocate(); }
+  array_view(int e0, int e1) : ext_(e0, e1) { allocate(); }
+  array_view(int e0, int e1, int e2) : ext_(e0, e1, e2) { allocate(); }
+
+  array_view(const extent<N> &e, T *src) : p_(src), ext_(e) {}
+  array_view(int e0, T *src) : p_(src), ext_(e0) {}
+  array_view(int e0, int e1, T *src) : p_(src), ext_(e0, e1) {}
+  array_view(int e0, int e1, int e2, T *src) : p_(src), ext_(e0, e1, e2) {}
+
+  template <typename Container>
+  array_view(const extent<N> &e, Container &src,
+             typename std::enable_if<std::is_class<Container>::value>::type * = 0)
+    : p_(src.data()), ext_(e) {}
+  template <typename Container>
+  array_view(int e0, Container &src,
+             typename std::enable_if<std::is_class<Container>::value>::type * = 0)
+    : p_(src.data()), ext_(e0) {}
+
+  // array_view<T> converts to array_view<const T>.
+  template <typename U>
+  array_view(const array_view<U, N> &o) : p_(o.p_), ext_(o.ext_), owner_(o.owner_) {}
+
+  extent<N> get_extent() const { return ext_; }
+
+  T &operator[](const index<N> &i) const { return p_[linear(i)]; }
+  T &operator[](int i0) const { static_assert(N == 1, "rank mismatch"); return p_[i0]; }
+  T &operator()(const index<N> &i) const { return p_[linear(i)]; }
+  T &operator()(int i0) const { static_assert(N == 1, "rank mismatch"); return p_[i0]; }
+  T &operator()(int i0, int i1) const { return (*this)[index<N>(i0, i1)]; }
+  T &operator()(int i0, int i1, int i2) const { return (*this)[index<N>(i0, i1, i2)]; }
+
+  T *data() const { return p_; }
+
+  array_view section(const index<N> &origin, const extent<N> &e) const
+  {
+    static_assert(N == 1, "only rank-1 sections are supported");
+    return array_view(e, p_ + origin[0], owner_);
+  }
+  array_view section(const index<N> &origin) const
+  {
+    static_assert(N == 1, "only rank-1 sections are supported");
+    return array_view(extent<N>(ext_[0] - origin[0]), p_ + origin[0], owner_);
+  }
+  array_view section(int i0, int e0) const
+  {
+    return section(index<N>(i0), extent<N>(e0));
+  }
+
+  template <typename U>
+  array_view<U, 1> reinterpret_as() const
+  {
+    int n = (int) ((size_t) ext_.size() * sizeof(T) / sizeof(U));
+    return array_view<U, 1>(extent<1>(n), reinterpret_cast<U *>(p_), owner_);
+  }
+
+  template <int K>
+  array_view<T, K> view_as(const extent<K> &e) const
+  {
+    return array_view<T, K>(e, p_, owner_);
+  }
+
+  void synchronize() const {}
+  completion_future synchronize_async() const { return completion_future(); }
+  void synchronize_to(const accelerator_view &) const {}
+  void refresh() const {}
+  void discard_data() const {}
+
+private:
+  template <typename U, int M> friend class array_view;
+
+  array_view(const extent<N> &e, T *p, const std::shared_ptr<void> &owner)
+    : p_(p), ext_(e), owner_(owner) {}
+
+  void allocate()
+  {
+    size_t bytes = (size_t) ext_.size() * sizeof(T);
+    size_t padded = (bytes + 63) / 64 * 64;
+    void *p = aligned_alloc(64, padded ? padded : 64);
+    if (p == NULL)
+      detail::fatal("cannot allocate array_view storage");
+    memset(p, 0, padded);
+    owner_ = std::shared_ptr<void>(p, free);
+    p_ = static_cast<T *>(p);
+  }
+
+  size_t linear(const index<N> &i) const
+  {
+    size_t off = (size_t) i[0];
+    for (int d = 1; d < N; d++)
+      off = off * (size_t) ext_[d] + (size_t) i[d];
+    return off;
+  }
+
+  T *p_;
+  extent<N> ext_;
+  std::shared_ptr<void> owner_;
+};
+
+/*---------------------------------------------------------------------------*/
+/* copy                                                                      */
+
+template <typename T, typename U, int N>
+void copy(const array_view<T, N> &src, const array_view<U, N> &dst)
+{
+  if ((const void *) src.data() != (const void *) dst.data())
+    memmove((void *) dst.data(), (const void *) src.data(),
+            (size_t) src.get_extent().size() * sizeof(T));
+}
+
+template <typename InputIter, typename T, int N>
+void copy(InputIter first, InputIter last, const array_view<T, N> &dst)
+{
+  std::copy(first, last, dst.data());
+}
+
+template <typename InputIter, typename T, int N>
+void copy(InputIter first, const array_view<T, N> &dst)
+{
+  std::copy(first, first + dst.get_extent().size(), dst.data());
+}
+
+template <typename T, int N, typename OutputIter>
+void copy(const array_view<T, N> &src, OutputIter dst)
+{
+  std::copy(src.data(), src.data() + src.get_extent().size(), dst);
+}
+
+/*---------------------------------------------------------------------------*/
+/* atomics                                                                   */
+
+#define HC_HOST_ATOMIC_RMW(name, builtin, type)                         \
+  inline type name(type *dest, type val)                                \
+  {                                                                     \
+    return builtin(dest, val, __ATOMIC_SEQ_CST);                        \
+  }
+
+#define HC_HOST_ATOMIC_INTEGRAL(type)                                   \
+  HC_HOST_ATOMIC_RMW(atomic_exchange, __atomic_exchange_n, type)        \
+  HC_HOST_ATOMIC_RMW(atomic_fetch_add, __atomic_fetch_add, type)        \
+  HC_HOST_ATOMIC_RMW(atomic_fetch_sub, __atomic_fetch_sub, type)        \
+  HC_HOST_ATOMIC_RMW(atomic_fetch_and, __atomic_fetch_and, type)        \
+  HC_HOST_ATOMIC_RMW(atomic_fetch_or, __atomic_fetch_or, type)          \
+  HC_HOST_ATOMIC_RMW(atomic_fetch_xor, __atomic_fetch_xor, type)        \
+  inline type atomic_fetch_inc(type *dest) { return atomic_fetch_add(dest, (type) 1); } \
+  inline type atomic_fetch_dec(type *dest) { return atomic_fetch_sub(dest, (type) 1); } \
+  inline type atomic_fetch_min(type *dest, type val)                    \
+  {                                                                     \
+    type old = __atomic_load_n(dest, __ATOMIC_SEQ_CST);                 \
+    while (val < old &&                                                 \
+           !__atomic_compare_exchange_n(dest, &old, val, true,          \
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) \
+      ;                                                                 \
+    return old;                                                         \
+  }                                                                     \
+  inline type atomic_fetch_max(type *dest, type val)                    \
+  {                                                                     \
+    type old = __atomic_load_n(dest, __ATOMIC_SEQ_CST);                 \
+    while (val > old &&                                                 \
+           !__atomic_compare_exchange_n(dest, &old, val, true,          \
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) \
+      ;                                                                 \
+    return old;                                                         \
+  }                                                                     \
+  inline bool atomic_compare_exchange(type *dest, type *expected, type val) \
+  {                                                                     \
+    return __atomic_compare_exchange_n(dest, expected, val, false,      \
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+  }
+
+HC_HOST_ATOMIC_INTEGRAL(int)
+HC_HOST_ATOMIC_INTEGRAL(unsigned int)
+HC_HOST_ATOMIC_INTEGRAL(long)
+HC_HOST_ATOMIC_INTEGRAL(unsigned long)
+HC_HOST_ATOMIC_INTEGRAL(long long)
+HC_HOST_ATOMIC_INTEGRAL(unsigned long long)
+
+#define HC_HOST_ATOMIC_FLOAT(type)                                      \
+  inline type atomic_exchange(type *dest, type val)                     \
+  {                                                                     \
+    type old;                                                           \
+    __atomic_exchange(dest, &val, &old, __ATOMIC_SEQ_CST);              \
+    return old;                                                         \
+  }                                                                     \
+  inline type atomic_fetch_add(type *dest, type val)                    \
+  {                                                                     \
+    type old = *dest, sum;                                              \
+    do {                                                                \
+      sum = old + val;                                                  \
+    } while (!__atomic_compare_exchange(dest, &old, &sum, true,         \
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)); \
+    return old;                                                         \
+  }                                                                     \
+  inline type atomic_fetch_sub(type *dest, type val) { return atomic_fetch_add(dest, -val); }
+
+HC_HOST_ATOMIC_FLOAT(float)
+HC_HOST_ATOMIC_FLOAT(double)
+
+#undef HC_HOST_ATOMIC_FLOAT
+#undef HC_HOST_ATOMIC_INTEGRAL
+#undef HC_HOST_ATOMIC_RMW
+
+/*---------------------------------------------------------------------------*/
+/* parallel_for_each                                                         */
+
+namespace detail {
+
+// Row-major decomposition of a linear number over 'dims' (last fastest).
+template <int N>
+inline index<N> delinearize(long n, const int dims[])
+{
+  index<N> r;
+  for (int d = N - 1; d >= 0; d--) {
+    r[d] = (int) (n % dims[d]);
+    n /= dims[d];
+  }
+  return r;
+}
+
+template <int N, typename Kernel>
+struct tile_items {
+  const Kernel *kernel;
+  index<N> tile, origin, dim;
+  int span[N];  // work-items actually present along each dimension
+
+  static void run(const void *self, int item)
+  {
+    const tile_items &t = *static_cast<const tile_items *>(self);
+    index<N> local = delinearize<N>(item, t.span);
+    tiled_index<N> tidx(t.origin + local, local, t.tile, t.origin, t.dim);
+    (*t.kernel)(tidx);
+  }
+};
+
+template <int N, typename Kernel>
+struct tiled_launch {
+  const Kernel *kernel;
+  tiled_extent<N> ext;
+  int tiles[N];
+
+  static void run(const void *self, long t)
+  {
+    const tiled_launch &l = *static_cast<const tiled_launch *>(self);
+    tile_items<N, Kernel> items;
+    items.kernel = l.kernel;
+    items.tile = delinearize<N>(t, l.tiles);
+    int n = 1;
+    for (int d = 0; d < N; d++) {
+      items.dim[d] = l.ext.tile_dim[d];
+      items.origin[d] = items.tile[d] * l.ext.tile_dim[d];
+      items.span[d] = std::min(l.ext.tile_dim[d], l.ext[d] - items.origin[d]);
+      n *= items.span[d];
+    }
+    current_worker()->run_items(n, &tile_items<N, Kernel>::run, &items);
+  }
+};
+
+// Untiled launches have no barriers; each pool task is a contiguous chunk
+// of work-items run back to back.
+template <int N, typename Kernel>
+struct flat_launch {
+  const Kernel *kernel;
+  extent<N> ext;
+  long total, chunk;
+
+  static void run(const void *self, long c)
+  {
+    const flat_launch &l = *static_cast<const flat_launch *>(self);
+    int dims[N];
+    for (int d = 0; d < N; d++) dims[d] = l.ext[d];
+    long end = std::min(l.total, (c + 1) * l.chunk);
+    for (long i = c * l.chunk; i < end; i++)
+      (*l.kernel)(delinearize<N>(i, dims));
+  }
+};
+
+inline bool tracing() { return pb_TraceEnabled != NULL && pb_TraceEnabled(); }
+
+// Name of a kernel type for the timeline.  Parameter lists are dropped, so
+// a lambda in regtileSgemm(...) reads "regtileSgemm::{lambda#1}".
+template <typename Kernel>
+const char *kernel_name()
+{
+  static const std::string name = [] {
+    int status;
+    char *full = abi::__cxa_demangle(typeid(Kernel).name(), NULL, NULL, &status);
+    std::string s, in = status == 0 ? full : typeid(Kernel).name();
+    int depth = 0;
+    for (char c : in) {
+      if (c == '(') depth++;
+      else if (c == ')') depth--;
+      else if (depth == 0) s += c;
+    }
+    free(full);
+    return s;
+  }();
+  return name.c_str();
+}
+
+// Record a launch that started at 'begin' and has just completed.  tile is
+// NULL for untiled launches.
+template <int N>
+void trace_launch(const char *name, unsigned long long begin, const extent<N> &ext,
+                  const int *tile, long tasks)
+{
+  char args[256];
+  int n = snprintf(args, sizeof(args), "\"extent\":[");
+  for (int d = 0; d < N; d++)
+    n += snprintf(args + n, sizeof(args) - n, "%s%d", d ? "," : "", ext[d]);
+  if (tile != NULL) {
+    n += snprintf(args + n, sizeof(args) - n, "],\"tile\":[");
+    for (int d = 0; d < N; d++)
+      n += snprintf(args + n, sizeof(args) - n, "%s%d", d ? "," : "", tile[d]);
+  }
+  snprintf(args + n, sizeof(args) - n, "],\"%s\":%ld,\"threads\":%u",
+           tile != NULL ? "tiles" : "chunks", tasks, thread_pool::instance().size());
+  pb_TraceSpan(name, "launch", begin, pb_GetTimestamp(), args);
+}
+
+} // namespace detail
+
+template <int N, typename Kernel>
+completion_future parallel_for_each(const accelerator_view &, const tiled_extent<N> &ext,
+                                    const Kernel &f)
+{
+  detail::tiled_launch<N, Kernel> l;
+  l.kernel = &f;
+  l.ext = ext;
+  long ntiles = 1;
+  for (int d = 0; d < N; d++) {
+    if (ext.tile_dim[d] <= 0)
+      detail::fatal("tile dimension must be positive");
+    l.tiles[d] = ext.tile_count(d);
+    ntiles *= l.tiles[d];
+  }
+  bool trace = detail::tracing();
+  unsigned long long begin = trace ? pb_GetTimestamp() : 0;
+  detail::thread_pool::instance().run(ntiles, &detail::tiled_launch<N, Kernel>::run, &l);
+  if (trace)
+    detail::trace_launch<N>(detail::kernel_name<Kernel>(), begin, ext, ext.tile_dim, ntiles);
+  return completion_future();
+}
+
+template <int N, typename Kernel>
+completion_future parallel_for_each(const accelerator_view &, const extent<N> &ext,
+                                    const Kernel &f)
+{
+  detail::flat_launch<N, Kernel> l;
+  l.kernel = &f;
+  l.ext = ext;
+  l.total = (long) ext.size();
+  long tasks = 8L * detail::thread_pool::instance().size();
+  l.chunk = std::max(1L, (l.total + tasks - 1) / tasks);
+  long chunks = (l.total + l.chunk - 1) / l.chunk;
+  bool trace = detail::tracing();
+  unsigned long long begin = trace ? pb_GetTimestamp() : 0;
+  detail::thread_pool::instance().run(chunks, &detail::flat_launch<N, Kernel>::run, &l);
+  if (trace)
+    detail::trace_launch<N>(detail::kernel_name<Kernel>(), begin, ext, NULL, chunks);
+  return completion_future();
+}
+
+template <int N, typename Kernel>
+completion_future parallel_for_each(const tiled_extent<N> &ext, const Kernel &f)
+{
+  return parallel_for_each(accelerator_view(), ext, f);
+}
+
+template <int N, typename Kernel>
+completion_future parallel_for_each(const extent<N> &ext, const Kernel &f)
+{
+  return parallel_for_each(accelerator_view(), ext, f);
+}
+
+} // namespace hc
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Force-included ahead of every source by hcc.host.mk.
+ *
+ * glibc declares the BSD function index() in <strings.h>, which <string.h>
+ * pulls in.  With 'using namespace hc' that name collides with hc::index<N>
+ * in every kernel.  Declare it once here under another name; the include
+ * guard keeps later includes from bringing it back.
+ */
+
+#ifndef HC_HOST_PRELUDE_H
+#define HC_HOST_PRELUDE_H
+
+#define index __hc_host_libc_index
+#include <strings.h>
+#undef index
+
+#endif
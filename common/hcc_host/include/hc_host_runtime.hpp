@@ -0,0 +1,507 @@
+/*
+ * Host execution runtime behind the CPU implementation of <hc.hpp>.
+ *
+ * Tiles of a parallel_for_each launch are distributed over a pool of
+ * worker threads that split and steal ranges of tile numbers.  All
+ * work-items of one tile run on the same worker as cooperative fibers:
+ * a work-item runs until it reaches tidx.barrier.wait(), then control
+ * returns to the worker, which resumes the next work-item of the tile.
+ * tile_static variables are thread_local, so each worker owns exactly
+ * one tile_static region and it is shared by every fiber of the tile
+ * it is currently running.
+ *
+ * Fiber stacks come from one mmap'd arena per worker that is reused
+ * across tiles and launches.  Tuning knobs (environment):
+ *   HC_HOST_THREADS     number of workers, including the launching thread
+ *   HC_HOST_STACK_SIZE  bytes of stack per work-item fiber (default 64K)
+ *   HC_HOST_BIND=1      run worker i > 0 on the i-th CPU the process may
+ *                       use; worker 0, the launching thread, keeps its
+ *                       affinity.  pb_AllocLarge first-touches the slab
+ *                       each worker starts with from the same CPU, so it
+ *                       is local to that worker.
+ */
+
+#ifndef HC_HOST_RUNTIME_HPP
+#define HC_HOST_RUNTIME_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(__x86_64__) || defined(HC_HOST_USE_UCONTEXT)
+#include <ucontext.h>
+#define HC_HOST_UCONTEXT 1
+#endif
+
+#ifndef HC_HOST_UCONTEXT
+/* Minimal SysV x86-64 context switch: save the callee-saved registers on
+ * the current stack, store the stack pointer to *from, load 'to' and pop
+ * the registers saved there.  A fresh fiber stack is laid out so that the
+ * first switch "returns" into hc_host_fiber_start, which calls the entry
+ * point left in r12.  Emitted into a COMDAT group so that every translation
+ * unit including this header shares a single copy. */
+extern "C" void hc_host_swap_context(void **from, void *to);
+extern "C" void hc_host_fiber_start();
+__asm__(
+    ".pushsection .text.hc_host_swap_context,\"axG\",@progbits,hc_host_swap_context,comdat\n"
+    ".weak hc_host_swap_context\n"
+    ".type hc_host_swap_context,@function\n"
+    "hc_host_swap_context:\n"
+    "  pushq %rbp\n"
+    "  pushq %rbx\n"
+    "  pushq %r12\n"
+    "  pushq %r13\n"
+    "  pushq %r14\n"
+    "  pushq %r15\n"
+    "  movq %rsp, (%rdi)\n"
+    "  movq %rsi, %rsp\n"
+    "  popq %r15\n"
+    "  popq %r14\n"
+    "  popq %r13\n"
+    "  popq %r12\n"
+    "  popq %rbx\n"
+    "  popq %rbp\n"
+    "  ret\n"
+    ".size hc_host_swap_context, .-hc_host_swap_context\n"
+    ".weak hc_host_fiber_start\n"
+    ".type hc_host_fiber_start,@function\n"
+    "hc_host_fiber_start:\n"
+    "  callq *%r12\n"
+    "  ud2\n"
+    ".size hc_host_fiber_start, .-hc_host_fiber_start\n"
+    ".popsection\n");
+#endif
+
+namespace hc {
+namespace detail {
+
+// Work for one work-item of a tile, and for one tile of a launch.
+typedef void (*item_fn)(const void *ctx, int item);
+typedef void (*tile_fn)(const void *ctx, long tile);
+
+inline void fatal(const char *msg)
+{
+  fprintf(stderr, "hc host backend: %s\n", msg);
+  abort();
+}
+
+inline long env_long(const char *name, long dflt)
+{
+  const char *s = getenv(name);
+  if (s == NULL || *s == '\0')
+    return dflt;
+  long v = atol(s);
+  return v > 0 ? v : dflt;
+}
+
+// Pin the calling thread to the i-th CPU of the process's affinity mask,
+// wrapping around, when HC_HOST_BIND=1.
+inline void bind_to_cpu(unsigned i)
+{
+#ifdef __linux__
+  static const std::vector<int> cpus = [] {
+    std::vector<int> v;
+    cpu_set_t allowed;
+    if (env_long("HC_HOST_BIND", 0) == 1 &&
+        sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+      for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+          v.push_back(c);
+    return v;
+  }();
+  if (cpus.empty())
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus[i % cpus.size()], &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void) i;
+#endif
+}
+
+inline size_t fiber_stack_size()
+{
+  static const size_t sz = (size_t) env_long("HC_HOST_STACK_SIZE", 64 * 1024);
+  return sz;
+}
+
+// One contiguous mapping holding a guarded stack per work-item.  Grows to
+// the largest tile seen and is never shrunk.
+class stack_arena {
+public:
+  stack_arena() : base_(NULL), stride_(0), count_(0), guard_(0) {}
+  ~stack_arena() { release(); }
+
+  void reserve(size_t n)
+  {
+    if (n <= count_)
+      return;
+    release();
+    guard_ = (size_t) sysconf(_SC_PAGESIZE);
+    stride_ = (fiber_stack_size() + guard_ - 1) / guard_ * guard_ + guard_;
+    void *p = mmap(NULL, n * stride_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+      fatal("cannot map fiber stacks");
+    base_ = (char *) p;
+    count_ = n;
+    // Each guard splits the mapping, so large tiles on many workers can
+    // run into vm.max_map_count; an unguarded stack would overflow into
+    // its neighbour unnoticed
+    for (size_t i = 0; i < n; i++)
+      if (mprotect(base_ + i * stride_, guard_, PROT_NONE) != 0)
+        fatal("cannot protect fiber stack guard pages (raise "
+              "vm.max_map_count or use fewer HC_HOST_THREADS)");
+  }
+
+  char *bottom(size_t i) const { return base_ + i * stride_ + guard_; }
+  char *top(size_t i) const { return base_ + (i + 1) * stride_; }
+  size_t size() const { return stride_ - guard_; }
+
+private:
+  void release()
+  {
+    if (base_)
+      munmap(base_, count_ * stride_);
+    base_ = NULL;
+    count_ = 0;
+  }
+
+  char *base_;
+  size_t stride_, count_, guard_;
+};
+
+class worker;
+
+inline worker *&current_worker()
+{
+  static thread_local worker *w = NULL;
+  return w;
+}
+
+// Per-thread execution state: the deque of tile ranges this worker owns
+// and the fibers of the tile it is currently running.
+class worker {
+public:
+  typedef std::pair<long, long> range;
+
+  worker() : sched_sp_(), current_(0), items_(0), fibers_(false),
+             fn_(NULL), ctx_(NULL) {}
+
+  void push(const range &r)
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    ranges_.push_back(r);
+  }
+
+  // Owner end: most recently split (smallest, cache-warm) range.
+  bool pop(range &r)
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    if (ranges_.empty())
+      return false;
+    r = ranges_.back();
+    ranges_.pop_back();
+    return true;
+  }
+
+  // Thief end: oldest (largest) range.
+  bool steal(range &r)
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    if (ranges_.empty())
+      return false;
+    r = ranges_.front();
+    ranges_.pop_front();
+    return true;
+  }
+
+  // Run the 'n' work-items of one tile.  Work-item 0 always starts on a
+  // fiber; if it finishes without reaching a barrier the kernel has no
+  // barrier on this path (barriers are tile-uniform), so the remaining
+  // items run directly on the worker stack without any switching.
+  void run_items(int n, item_fn fn, const void *ctx)
+  {
+    fn_ = fn;
+    ctx_ = ctx;
+    items_ = n;
+    if (n <= 0)
+      return;
+    stacks_.reserve((size_t) n);
+    if ((int) done_.size() < n) {
+      done_.resize(n);
+      sp_.resize(n);
+    }
+
+    fibers_ = true;
+    start_fiber(0);
+    resume(0);
+    if (done_[0]) {
+      fibers_ = false;
+      for (int i = 1; i < n; i++)
+        fn(ctx, i);
+      return;
+    }
+
+    for (int i = 1; i < n; i++)
+      start_fiber(i);
+    int live = n;
+    bool first = true;
+    while (live > 0) {
+      for (int i = first ? 1 : 0; i < n; i++) {
+        if (done_[i])
+          continue;
+        resume(i);
+        if (done_[i])
+          live--;
+      }
+      first = false;
+    }
+    fibers_ = false;
+  }
+
+  void barrier_wait()
+  {
+    if (fibers_) {
+      switch_context(&sp_[current_], sched_sp_);
+      return;
+    }
+    if (items_ > 1)
+      fatal("tile_barrier::wait() reached by only part of a tile");
+  }
+
+private:
+#ifndef HC_HOST_UCONTEXT
+  typedef void *context;
+
+  void switch_context(context *from, context to)
+  {
+    hc_host_swap_context(from, to);
+  }
+
+  void start_fiber(int i)
+  {
+    void **sp = (void **) stacks_.top((size_t) i);
+    *--sp = (void *) &hc_host_fiber_start;  // return address
+    *--sp = NULL;                           // rbp
+    *--sp = NULL;                           // rbx
+    *--sp = (void *) &fiber_main;           // r12
+    *--sp = NULL;                           // r13
+    *--sp = NULL;                           // r14
+    *--sp = NULL;                           // r15
+    sp_[i] = sp;
+    done_[i] = 0;
+  }
+
+  void resume(int i)
+  {
+    current_ = i;
+    hc_host_swap_context(&sched_sp_, sp_[i]);
+  }
+#else
+  typedef ucontext_t context;
+
+  void switch_context(context *from, context &to)
+  {
+    swapcontext(from, &to);
+  }
+
+  void start_fiber(int i)
+  {
+    getcontext(&sp_[i]);
+    sp_[i].uc_stack.ss_sp = stacks_.bottom((size_t) i);
+    sp_[i].uc_stack.ss_size = stacks_.size();
+    sp_[i].uc_link = NULL;
+    makecontext(&sp_[i], &fiber_main, 0);
+    done_[i] = 0;
+  }
+
+  void resume(int i)
+  {
+    current_ = i;
+    swapcontext(&sched_sp_, &sp_[i]);
+  }
+#endif
+
+  static void fiber_main()
+  {
+    worker *w = current_worker();
+    int i = w->current_;
+    w->fn_(w->ctx_, i);
+    w->done_[i] = 1;
+    w->switch_context(&w->sp_[i], w->sched_sp_);
+  }
+
+  std::mutex lock_;
+  std::deque<range> ranges_;
+
+  stack_arena stacks_;
+  std::vector<context> sp_;
+  std::vector<unsigned char> done_;
+  context sched_sp_;
+  int current_, items_;
+  bool fibers_;
+  item_fn fn_;
+  const void *ctx_;
+};
+
+// Persistent pool.  The thread calling run() takes part as worker 0 and
+// returns only after every participating worker has left the launch.
+class thread_pool {
+public:
+  static thread_pool &instance()
+  {
+    static thread_pool pool;
+    return pool;
+  }
+
+  unsigned size() const { return (unsigned) workers_.size(); }
+
+  void run(long ntiles, tile_fn fn, const void *ctx)
+  {
+    if (ntiles <= 0)
+      return;
+    if (current_worker() != NULL)
+      fatal("parallel_for_each called from inside a kernel");
+
+    std::lock_guard<std::mutex> launch(launch_lock_);
+    unsigned nw = size();
+    if ((long) nw > ntiles)
+      nw = (unsigned) ntiles;
+
+    fn_ = fn;
+    ctx_ = ctx;
+    remaining_.store(ntiles);
+    checked_in_.store(0);
+    for (unsigned i = 0; i < nw; i++)
+      workers_[i]->push(worker::range(ntiles * i / nw, ntiles * (i + 1) / nw));
+
+    if (nw > 1) {
+      std::lock_guard<std::mutex> g(sleep_lock_);
+      participants_ = nw;
+      generation_.fetch_add(1);
+      wake_.notify_all();
+    }
+
+    current_worker() = workers_[0];
+    drain(*workers_[0]);
+    current_worker() = NULL;
+
+    while (checked_in_.load() != nw - 1)
+      std::this_thread::yield();
+  }
+
+private:
+  thread_pool() : generation_(0), stop_(false), fn_(NULL), ctx_(NULL),
+                  remaining_(0), participants_(0), checked_in_(0)
+  {
+    long n = env_long("HC_HOST_THREADS", (long) std::thread::hardware_concurrency());
+    if (n < 1)
+      n = 1;
+    for (long i = 0; i < n; i++)
+      workers_.push_back(new worker());
+    for (long i = 1; i < n; i++)
+      threads_.push_back(std::thread(&thread_pool::worker_loop, this, (unsigned) i));
+  }
+
+  ~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> g(sleep_lock_);
+      stop_ = true;
+      generation_.fetch_add(1);
+      wake_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++)
+      threads_[i].join();
+    for (size_t i = 0; i < workers_.size(); i++)
+      delete workers_[i];
+  }
+
+  void worker_loop(unsigned id)
+  {
+    worker &self = *workers_[id];
+    current_worker() = &self;
+    bind_to_cpu(id);
+    unsigned long seen = 0;
+    for (;;) {
+      // Spin briefly before sleeping: launches often come back to back.
+      for (int spin = 0; spin < 4096 && generation_.load() == seen; spin++)
+        std::this_thread::yield();
+
+      unsigned participants;
+      {
+        std::unique_lock<std::mutex> g(sleep_lock_);
+        wake_.wait(g, [&] { return generation_.load() != seen; });
+        if (stop_)
+          return;
+        seen = generation_.load();
+        participants = participants_;
+      }
+      if (id >= participants)
+        continue;
+      drain(self);
+      checked_in_.fetch_add(1);
+    }
+  }
+
+  void drain(worker &self)
+  {
+    size_t nw = workers_.size();
+    size_t victim = 0;
+    for (;;) {
+      worker::range r;
+      bool found = self.pop(r);
+      for (size_t i = 0; !found && i < nw; i++) {
+        victim = (victim + 1) % nw;
+        if (workers_[victim] != &self)
+          found = workers_[victim]->steal(r);
+      }
+      if (!found) {
+        if (remaining_.load() == 0)
+          return;
+        std::this_thread::yield();
+        continue;
+      }
+      // Lazy binary splitting: keep the lower half, expose the upper half
+      // to thieves, down to single tiles.
+      while (r.second - r.first > 1) {
+        long mid = r.first + (r.second - r.first) / 2;
+        self.push(worker::range(mid, r.second));
+        r.second = mid;
+      }
+      fn_(ctx_, r.first);
+      remaining_.fetch_sub(1);
+    }
+  }
+
+  std::vector<worker *> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex launch_lock_, sleep_lock_;
+  std::condition_variable wake_;
+  std::atomic<unsigned long> generation_;
+  bool stop_;
+
+  tile_fn fn_;
+  const void *ctx_;
+  std::atomic<long> remaining_;
+  unsigned participants_;
+  std::atomic<unsigned> checked_in_;
+};
+
+} // namespace detail
+} // namespace hc
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * CPU implementation of <hc_math.hpp>.  Kernels call the C math library
+ * directly; only the functions it lacks are provided here.
+ */
+
+#ifndef HC_HOST_MATH_HPP
+#define HC_HOST_MATH_HPP
+
+#include <math.h>
+
+namespace hc {
+namespace precise_math {
+
+inline float rsqrtf(float x) { return 1.0f / sqrtf(x); }
+inline double rsqrt(double x) { return 1.0 / sqrt(x); }
+
+} // namespace precise_math
+
+namespace fast_math {
+
+using precise_math::rsqrtf;
+
+} // namespace fast_math
+
+using precise_math::rsqrtf;
+using precise_math::rsqrt;
+
+} // namespace hc
+
+#endif
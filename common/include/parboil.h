@@ -0,0 +1,274 @@
+/*
+ * Parboil benchmark support library: command line parameters and timers.
+ *
+ * Every benchmark brackets its phases with pb_SwitchToTimer() so that the
+ * time spent in IO, copies, kernels and host computation is accounted
+ * separately.  Timers read a monotonic clock with nanosecond resolution
+ * (the invariant TSC where the kernel trusts it), and a switch costs a
+ * single clock read, so they can stay around short kernels.
+ *
+ * Besides the human-readable table printed by pb_PrintTimerSet(), the same
+ * numbers can be written in machine-readable form:
+ *
+ *   PARBOIL_TIMER_JSON=<file>   append one JSON object per run (JSON lines)
+ *   PARBOIL_TIMER_CSV=<file>    append "category,subtimer,seconds,switches"
+ *
+ * A file name of "-" writes to stdout.
+ *
+ * With PARBOIL_COUNTERS=1, every timer also accumulates the hardware
+ * counters listed in enum pb_CounterID over the intervals it ran, read
+ * through perf_event_open.  Counters the kernel refuses to open are
+ * reported as missing; timing works as usual.  Reading the counters costs
+ * a few microseconds per switch, so leave them off for timing runs.
+ *
+ * Benchmarks declare the bytes moved and flops done by their kernels with
+ * pb_AddWork().  The report then adds a roofline table: achieved GB/s,
+ * GFLOP/s and arithmetic intensity of each timer, against the host's
+ * STREAM triad bandwidth and FMA peak, measured once when the report is
+ * printed.  PARBOIL_PEAK_GBS and PARBOIL_PEAK_GFLOPS replace the measured
+ * ceilings, for example with an accelerator's datasheet numbers.
+ *
+ *   PARBOIL_TRACE=<file>        write a timeline of the run
+ *
+ * The timeline holds one span per interval each timer ran, and the spans
+ * recorded with pb_TraceSpan(), such as the kernel launches of the host HC
+ * runtime with their extents and tile sizes.  It is written by
+ * pb_PrintTimerSet() as Chrome trace events, for chrome://tracing or
+ * https://ui.perfetto.dev.
+ */
+
+#ifndef PARBOIL_HEADER
+#define PARBOIL_HEADER
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Command line parameters for benchmarks */
+struct pb_Parameters {
+  char *outFile;		/* If not NULL, the output file name (-o) */
+  char **inpFiles;		/* NULL-terminated list of input files (-i) */
+  int synchronizeGpu;		/* Nonzero if -S was given */
+  char *refFile;		/* If not NULL, a reference output to verify
+				 * the result against (-v) */
+  int verifyGold;		/* Nonzero if -V was given: verify the result
+				 * against the benchmark's CPU implementation */
+};
+
+/* Read command-line parameters.
+ *
+ * The argc and argv parameters to main are read, and any parameters
+ * interpreted by this function are removed from the argument list.
+ *
+ * A new instance of struct pb_Parameters is returned.
+ * If there is an error, then an error message is printed on stderr
+ * and NULL is returned.
+ */
+struct pb_Parameters *
+pb_ReadParameters(int *_argc, char **argv);
+
+/* Free an instance of struct pb_Parameters. */
+void
+pb_FreeParameters(struct pb_Parameters *p);
+
+/* Count the number of input files in a pb_Parameters instance. */
+int
+pb_Parameters_CountInputs(struct pb_Parameters *p);
+
+/* A time or duration, in clock ticks. */
+typedef unsigned long long pb_Timestamp;
+
+/* Read the monotonic clock. */
+pb_Timestamp
+pb_GetTimestamp(void);
+
+/* Convert a duration in clock ticks to nanoseconds. */
+pb_Timestamp
+pb_TicksToNanoseconds(pb_Timestamp ticks);
+
+enum pb_TimerState {
+  pb_Timer_STOPPED,
+  pb_Timer_RUNNING,
+};
+
+/* Hardware events counted while a timer runs */
+enum pb_CounterID {
+  pb_Counter_CYCLES = 0,	/* Core cycles */
+  pb_Counter_INSTRUCTIONS,	/* Retired instructions */
+  pb_Counter_LLC_MISSES,	/* Last-level cache misses */
+  pb_Counter_BRANCH_MISSES,	/* Mispredicted branches */
+  pb_Counter_DTLB_MISSES,	/* Data TLB read misses */
+  pb_Counter_LAST		/* Number of counters */
+};
+
+struct pb_Timer {
+  enum pb_TimerState state;
+  pb_Timestamp elapsed;		/* Accumulated ticks, excluding the running
+				 * interval */
+  pb_Timestamp init;		/* Start of the running interval */
+  unsigned long switches;	/* Number of times the timer was started */
+  unsigned long long counters[pb_Counter_LAST];
+				/* Accumulated events, excluding the running
+				 * interval */
+  unsigned long long counters_init[pb_Counter_LAST];
+				/* Counter values at the start of the running
+				 * interval */
+  double bytes;			/* Declared memory traffic, see pb_AddWork */
+  double flops;			/* Declared floating-point operations */
+};
+
+/* Reset a timer.
+ * Use this to initialize a timer or to clear
+ * its elapsed time.  The reset timer is stopped.
+ */
+void
+pb_ResetTimer(struct pb_Timer *timer);
+
+/* Start a timer.  The timer is set to RUNNING mode and
+ * time elapsed while the timer is running is added to
+ * the timer.
+ * The timer should not already be running.
+ */
+void
+pb_StartTimer(struct pb_Timer *timer);
+
+/* Stop a timer.
+ * This stops adding elapsed time to the timer.
+ * The timer should not already be stopped.
+ */
+void
+pb_StopTimer(struct pb_Timer *timer);
+
+/* Get the elapsed time in seconds. */
+double
+pb_GetElapsedTime(struct pb_Timer *timer);
+
+/* Nonzero if the given hardware counter is being collected. */
+int
+pb_CounterAvailable(enum pb_CounterID counter);
+
+/* Get the number of events of the given counter accumulated by a timer,
+ * or 0 if the counter is not collected. */
+unsigned long long
+pb_GetCounter(struct pb_Timer *timer, enum pb_CounterID counter);
+
+/* Execution time is assigned to one of these categories. */
+enum pb_TimerID {
+  pb_TimerID_NONE = 0,
+  pb_TimerID_IO,		/* Time spent in input/output */
+  pb_TimerID_KERNEL,		/* Time spent computing on the device,
+				 * recorded asynchronously */
+  pb_TimerID_COPY,		/* Time spent synchronously moving data
+				 * to/from device and allocating/freeing
+				 * memory on the device */
+  pb_TimerID_DRIVER,		/* Time spent in the host interacting with the
+				 * driver, primarily for recording the time
+                                 * spent queueing asynchronous operations */
+  pb_TimerID_COPY_ASYNC,	/* Time spent in asynchronous transfers */
+  pb_TimerID_COMPUTE,		/* Time for all program execution other
+				 * than parsing command line arguments,
+				 * I/O, kernel, and copy */
+  pb_TimerID_OVERLAP,		/* Time double-counted in asynchronous and
+				 * host activity: automatically filled in,
+				 * not intended for direct usage */
+  pb_TimerID_LAST		/* Number of timer IDs */
+};
+
+/* A named timer accounted inside one of the categories above. */
+struct pb_SubTimer {
+  char *label;
+  struct pb_Timer timer;
+  struct pb_SubTimer *next;
+};
+
+struct pb_SubTimerList {
+  struct pb_SubTimer *current;
+  struct pb_SubTimer *subtimer_list;
+};
+
+/* A set of timers for recording execution times. */
+struct pb_TimerSet {
+  enum pb_TimerID current;
+  pb_Timestamp wall_begin;
+  pb_Timestamp wall_end;	/* Set by pb_PrintTimerSet, else 0 */
+  struct pb_Timer timers[pb_TimerID_LAST];
+  struct pb_SubTimerList *sub_timer_list[pb_TimerID_LAST];
+};
+
+/* Reset all timers in the set. */
+void
+pb_InitializeTimerSet(struct pb_TimerSet *timers);
+
+/* Register a sub-timer of the given category.  The label is copied. */
+void
+pb_AddSubTimer(struct pb_TimerSet *timers, const char *label,
+               enum pb_TimerID pb_Category);
+
+/* Select which timer the next interval of time should be accounted
+ * to. The selected timer is started and other timers are stopped.
+ * Using pb_TimerID_NONE stops all timers. */
+void
+pb_SwitchToTimer(struct pb_TimerSet *timers, enum pb_TimerID timer);
+
+/* Like pb_SwitchToTimer, but the time is also accounted to the sub-timer
+ * with the given label.  A NULL or unknown label runs the category alone. */
+void
+pb_SwitchToSubTimer(struct pb_TimerSet *timers, const char *label,
+                    enum pb_TimerID category);
+
+/* Declare the memory traffic and floating-point operations of one kernel
+ * invocation.  The work is accounted to the category and, when label names
+ * one of its sub-timers, to that sub-timer as well. */
+void
+pb_AddWork(struct pb_TimerSet *timers, const char *label,
+           enum pb_TimerID category, double bytes, double flops);
+
+/* Ceilings of the roofline model */
+struct pb_Roofline {
+  double bandwidth;		/* Memory bandwidth in bytes per second */
+  double flops;			/* Floating-point peak in flops per second */
+};
+
+/* Get the roofline ceilings of this machine.  They are measured on the
+ * first call, which takes a fraction of a second. */
+void
+pb_GetRoofline(struct pb_Roofline *roofline);
+
+/* Nonzero if PARBOIL_TRACE is set and a timeline is being recorded. */
+int
+pb_TraceEnabled(void);
+
+/* Record a span of the timeline, on the track of the given category.
+ * args is NULL or the members of a JSON object shown with the span, for
+ * example "\"extent\":[1024,1024]".  The strings are copied.  Does nothing
+ * when no timeline is being recorded; may be called from any thread. */
+void
+pb_TraceSpan(const char *name, const char *category, pb_Timestamp begin,
+             pb_Timestamp end, const char *args);
+
+/* Print timer values to standard output, and to the files named by
+ * PARBOIL_TIMER_JSON, PARBOIL_TIMER_CSV and PARBOIL_TRACE when they are
+ * set. */
+void
+pb_PrintTimerSet(struct pb_TimerSet *timers);
+
+/* Write the timer values as a single-line JSON object. */
+void
+pb_WriteTimerSetJSON(struct pb_TimerSet *timers, FILE *f);
+
+/* Write the timer values as CSV rows; the header is written when
+ * header is nonzero. */
+void
+pb_WriteTimerSetCSV(struct pb_TimerSet *timers, FILE *f, int header);
+
+/* Release timer resources */
+void
+pb_DestroyTimerSet(struct pb_TimerSet * timers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PARBOIL_HEADER */
@@ -0,0 +1,244 @@
+/*
+ * Parboil benchmark support library: binary container files.
+ *
+ * A container holds named, typed arrays of up to four dimensions.  The file
+ * is memory-mapped and every array starts on a page boundary, so an array
+ * is used in place: its pointer goes straight into an array_view, and
+ * loading a dataset that is already in the page cache costs a few page
+ * table updates instead of a parse and a copy.
+ *
+ * Layout, all integers little-endian:
+ *
+ *   struct pb_ContainerHeader     at offset 0
+ *   array data                    each at a multiple of the alignment
+ *   struct pb_ContainerEntry[]    the table, at table_offset
+ *
+ * The header and the table carry CRC-32C checksums that are verified on
+ * every open.  The checksum of each array's data is verified only when
+ * asked for, with PB_OPEN_VERIFY or PARBOIL_IO_VERIFY=1, because it reads
+ * the whole file.
+ *
+ * Mappings are private: benchmarks may write to their input arrays, and
+ * the pages they touch are copied rather than written back.
+ *
+ * Containers are written with pb_CreateContainer(); common/datagen/pbconvert
+ * converts the Parboil text and raw inputs.
+ */
+
+#ifndef PB_IO_HEADER
+#define PB_IO_HEADER
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PB_CONTAINER_MAGIC "PBCNTNR"	/* 8 bytes with the terminator */
+#define PB_CONTAINER_VERSION 1
+#define PB_CONTAINER_ALIGNMENT 4096
+#define PB_MAX_RANK 4
+#define PB_MAX_NAME 48
+
+/* Element types.  pb_Type_RECORD arrays hold structures of elem_size
+ * bytes, whose layout is a convention of the benchmark reading them.
+ * pb_Type_F16 is IEEE binary16 and pb_Type_BF16 bfloat16, the upper half
+ * of a float; both are stored as uint16_t. */
+enum pb_Type {
+  pb_Type_RECORD = 0,
+  pb_Type_I8,
+  pb_Type_U8,
+  pb_Type_I16,
+  pb_Type_U16,
+  pb_Type_I32,
+  pb_Type_U32,
+  pb_Type_I64,
+  pb_Type_U64,
+  pb_Type_F32,
+  pb_Type_F64,
+  pb_Type_F16,
+  pb_Type_BF16,
+  pb_Type_LAST
+};
+
+struct pb_ContainerHeader {	/* 64 bytes */
+  char magic[8];		/* PB_CONTAINER_MAGIC */
+  uint32_t version;		/* PB_CONTAINER_VERSION */
+  uint32_t alignment;		/* Of every array's offset */
+  uint64_t file_size;
+  uint64_t table_offset;
+  uint32_t array_count;
+  uint32_t table_checksum;	/* CRC-32C of the table */
+  uint8_t reserved[20];
+  uint32_t header_checksum;	/* CRC-32C of the bytes above */
+};
+
+struct pb_ContainerEntry {	/* 128 bytes */
+  char name[PB_MAX_NAME];	/* NUL-terminated */
+  uint32_t type;		/* enum pb_Type */
+  uint32_t elem_size;		/* Bytes per element */
+  uint32_t rank;		/* Number of dimensions used in dims */
+  uint32_t checksum;		/* CRC-32C of the data */
+  uint64_t dims[PB_MAX_RANK];	/* Slowest-varying first */
+  uint64_t offset;		/* Of the data, from the start of the file */
+  uint64_t bytes;		/* elem_size times the product of dims */
+  uint8_t reserved[16];
+};
+
+/* An array of an open container */
+struct pb_Array {
+  const char *name;
+  enum pb_Type type;
+  size_t elem_size;
+  int rank;
+  size_t dims[PB_MAX_RANK];
+  size_t count;			/* Number of elements */
+  void *data;			/* Page-aligned, valid until the container
+				 * is closed */
+};
+
+struct pb_Container;
+struct pb_ContainerWriter;
+
+/* Flags of pb_OpenContainer */
+#define PB_OPEN_VERIFY 1	/* Verify the checksum of every array */
+#define PB_OPEN_POPULATE 2	/* Read the whole file in while opening,
+				 * instead of faulting pages in on first use */
+#define PB_OPEN_SEQUENTIAL 4	/* The file is streamed through once: do not
+				 * read it all ahead, read ahead of accesses */
+
+/* Nonzero if the file exists and starts with the container magic. */
+int
+pb_IsContainerFile(const char *path);
+
+/* Map a container file.  On error, a message is printed on stderr and
+ * NULL is returned. */
+struct pb_Container *
+pb_OpenContainer(const char *path, int flags);
+
+/* Unmap a container.  Arrays obtained from it become invalid. */
+void
+pb_CloseContainer(struct pb_Container *c);
+
+/* Number of arrays in a container. */
+int
+pb_ContainerSize(struct pb_Container *c);
+
+/* The i-th array of a container, in the order they were written. */
+const struct pb_Array *
+pb_ContainerArrayAt(struct pb_Container *c, int i);
+
+/* The array with the given name, or NULL. */
+const struct pb_Array *
+pb_ContainerArray(struct pb_Container *c, const char *name);
+
+/* Verify the checksums of all arrays.  Returns 0 if they match; otherwise
+ * prints the arrays that do not and returns -1. */
+int
+pb_VerifyContainer(struct pb_Container *c);
+
+/* Start writing a container.  On error, a message is printed on stderr
+ * and NULL is returned. */
+struct pb_ContainerWriter *
+pb_CreateContainer(const char *path);
+
+/* Start an array of the given shape.  Its data is then written with any
+ * number of pb_AppendArray() calls, and ends with pb_EndArray().
+ * These functions return 0, or -1 after printing an error. */
+int
+pb_BeginArray(struct pb_ContainerWriter *w, const char *name,
+              enum pb_Type type, size_t elem_size,
+              int rank, const size_t *dims);
+
+int
+pb_AppendArray(struct pb_ContainerWriter *w, const void *data, size_t bytes);
+
+int
+pb_EndArray(struct pb_ContainerWriter *w);
+
+/* Write a whole array at once. */
+int
+pb_WriteArray(struct pb_ContainerWriter *w, const char *name,
+              enum pb_Type type, size_t elem_size,
+              int rank, const size_t *dims, const void *data);
+
+/* Write the table and the header and close the file.  Returns 0, or -1
+ * after printing an error; the writer is freed either way. */
+int
+pb_CloseContainerWriter(struct pb_ContainerWriter *w);
+
+/* Size in bytes of an element of a type, or 0 for pb_Type_RECORD. */
+size_t
+pb_TypeSize(enum pb_Type type);
+
+/* Convert n floats to pb_Type_F16 or pb_Type_BF16, rounding to nearest
+ * even; values too large for binary16 become infinities.  Returns 0, or
+ * -1 if type is neither. */
+int
+pb_FloatsToHalf(enum pb_Type type, const float *src, uint16_t *dst, size_t n);
+
+/* Convert n pb_Type_F16 or pb_Type_BF16 values to floats, exactly.
+ * Returns 0, or -1 if type is neither. */
+int
+pb_HalfToFloats(enum pb_Type type, const uint16_t *src, float *dst, size_t n);
+
+/* CRC-32C (Castagnoli) of a buffer, continuing from crc (0 to start). */
+uint32_t
+pb_Crc32c(uint32_t crc, const void *data, size_t bytes);
+
+#ifdef __cplusplus
+}
+
+/* Typed views of container arrays */
+
+template <typename T> struct pb_TypeOf { static const pb_Type value = pb_Type_RECORD; };
+template <> struct pb_TypeOf<int8_t> { static const pb_Type value = pb_Type_I8; };
+template <> struct pb_TypeOf<uint8_t> { static const pb_Type value = pb_Type_U8; };
+template <> struct pb_TypeOf<int16_t> { static const pb_Type value = pb_Type_I16; };
+template <> struct pb_TypeOf<uint16_t> { static const pb_Type value = pb_Type_U16; };
+template <> struct pb_TypeOf<int32_t> { static const pb_Type value = pb_Type_I32; };
+template <> struct pb_TypeOf<uint32_t> { static const pb_Type value = pb_Type_U32; };
+template <> struct pb_TypeOf<int64_t> { static const pb_Type value = pb_Type_I64; };
+template <> struct pb_TypeOf<uint64_t> { static const pb_Type value = pb_Type_U64; };
+template <> struct pb_TypeOf<float> { static const pb_Type value = pb_Type_F32; };
+template <> struct pb_TypeOf<double> { static const pb_Type value = pb_Type_F64; };
+
+template <typename T>
+struct pb_Span {
+  T *data;
+  size_t size;
+
+  T *begin() const { return data; }
+  T *end() const { return data + size; }
+  T &operator[](size_t i) const { return data[i]; }
+  bool empty() const { return size == 0; }
+};
+
+/* The named array as a span of T.  Structures match pb_Type_RECORD arrays
+ * of the same element size.  If the array is missing or its type does not
+ * match, a message is printed on stderr and an empty span is returned. */
+template <typename T>
+inline pb_Span<T>
+pb_GetSpan(struct pb_Container *c, const char *name)
+{
+  pb_Span<T> span = { NULL, 0 };
+  const struct pb_Array *a = pb_ContainerArray(c, name);
+
+  if (a == NULL)
+    fprintf(stderr, "Container has no array '%s'\n", name);
+  else if (a->type != pb_TypeOf<T>::value || a->elem_size != sizeof(T))
+    fprintf(stderr, "Array '%s' has elements of type %d and size %zu, "
+            "expected type %d and size %zu\n", name, (int)a->type,
+            a->elem_size, (int)pb_TypeOf<T>::value, sizeof(T));
+  else {
+    span.data = static_cast<T *>(a->data);
+    span.size = a->count;
+  }
+  return span;
+}
+
+#endif
+
+#endif /* PB_IO_HEADER */
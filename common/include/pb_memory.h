@@ -0,0 +1,52 @@
+/*
+ * Parboil benchmark support library: large host buffers.
+ *
+ * Buffers of tens of megabytes and more take a TLB miss every few pages
+ * and, on a multi-socket host, land on whichever NUMA node touched them
+ * first.  pb_AllocLarge() maps them on huge pages when it can and faults
+ * them in from one thread per worker of the host HC runtime, each writing
+ * the slab of the buffer that the worker starts out processing:
+ * parallel_for_each gives worker i the i-th contiguous share of the tiles.
+ * The calling thread touches the first slab, as the launching thread is
+ * worker 0, and touch thread i > 0 runs on the i-th CPU the process may
+ * use.  With HC_HOST_BIND=1 worker i runs there too, so every slab is
+ * local to the worker that processes it.
+ *
+ *   PARBOIL_HUGEPAGES=auto|1g|2m|thp|off
+ *       auto (default) tries reserved 1 GB pages for buffers of 1 GB and
+ *       more, then reserved 2 MB pages, then transparent huge pages; 1g
+ *       and 2m try only that size before transparent huge pages; off uses
+ *       base pages.
+ *   PARBOIL_ALLOC_THREADS=<n>
+ *       first-touch threads; defaults to HC_HOST_THREADS, else the number
+ *       of online CPUs, as the runtime does.
+ *   PARBOIL_ALLOC_REPORT=1
+ *       print a report line for each allocation: its page size,
+ *       first-touch time and the minor and major page faults it took.
+ *       Off by default, to keep benchmark output unchanged.
+ */
+
+#ifndef PB_MEMORY_HEADER
+#define PB_MEMORY_HEADER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate a zeroed buffer of the given size, aligned to at least a page,
+ * and fault it in.  The label names it in the report.  On error, a
+ * message is printed on stderr and NULL is returned. */
+void *
+pb_AllocLarge(const char *label, size_t bytes);
+
+/* Free a buffer returned by pb_AllocLarge.  NULL is ignored. */
+void
+pb_FreeLarge(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PB_MEMORY_HEADER */
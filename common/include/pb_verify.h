@@ -0,0 +1,76 @@
+/*
+ * Parboil benchmark support library: output verification.
+ *
+ * Benchmarks check their results in memory, against a reference output
+ * named with -v or, with -V, against a CPU implementation run in the same
+ * process, instead of writing an output file to be compared offline.  A
+ * run that verifies nothing needs no -o, so timing runs can skip writing
+ * their output and still fail on wrong answers.
+ *
+ * Each comparison is made under a tolerance chosen by the benchmark:
+ *
+ *   pb_Tolerance_EXACT      equal
+ *   pb_Tolerance_ULP        at most ulps representable values apart
+ *   pb_Tolerance_RELATIVE   |result - reference| <= rel * |reference|
+ *
+ * and any difference of at most abs passes as well, so that values that
+ * should be zero are not held to a relative bound.  A NaN matches only a
+ * NaN.  The first mismatches and the largest error are printed;
+ * PARBOIL_VERIFY_REPORT sets how many mismatches are listed (10).
+ */
+
+#ifndef PB_VERIFY_HEADER
+#define PB_VERIFY_HEADER
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pb_ToleranceKind {
+  pb_Tolerance_EXACT,
+  pb_Tolerance_ULP,
+  pb_Tolerance_RELATIVE
+};
+
+struct pb_Tolerance {
+  enum pb_ToleranceKind kind;
+  double ulps;			/* Bound of pb_Tolerance_ULP */
+  double rel;			/* Bound of pb_Tolerance_RELATIVE */
+  double abs;			/* Absolute difference that always passes */
+};
+
+/* Tolerance constructors */
+struct pb_Tolerance
+pb_ExactTolerance(void);
+
+struct pb_Tolerance
+pb_UlpTolerance(double ulps, double abs);
+
+struct pb_Tolerance
+pb_RelativeTolerance(double rel, double abs);
+
+/* Compare count results with their reference values and print a report
+ * under the given label.  Returns 0 if all of them are within the
+ * tolerance, else -1. */
+int
+pb_CompareFloats(const char *label, const float *result,
+                 const float *reference, size_t count,
+                 const struct pb_Tolerance *tolerance);
+
+int
+pb_CompareDoubles(const char *label, const double *result,
+                  const double *reference, size_t count,
+                  const struct pb_Tolerance *tolerance);
+
+/* Integers are compared exactly. */
+int
+pb_CompareInts(const char *label, const int *result,
+               const int *reference, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PB_VERIFY_HEADER */
@@ -38,7 +38,7 @@ ifneq ("$(notdir $(patsubst %/,%,$(dir $(BUILDDIR))))", "build")
 $(error $$BUILDDIR is not set correctly)
 endif
 
-.PHONY: run
+.PHONY: run bench
 
 ########################################
 # Derived variables
@@ -48,6 +48,14 @@ ifeq ($(DEBUGGER),)
 DEBUGGER=gdb
 endif
 
+ifeq ($(WARMUP),)
+WARMUP=1
+endif
+
+ifeq ($(REPEAT),)
+REPEAT=10
+endif
+
 OBJS = $(call INBUILDDIR,$(SRCDIR_OBJS))
 
 ########################################
@@ -59,6 +67,10 @@ default: $(BUILDDIR) $(BIN)
 run:
 	@$(BIN) $(ARGS)
 
+# The run command line, repeated with warmups and summarized per timer
+bench:
+	@$(PARBOIL_ROOT)/common/driver/bench.py run -w $(WARMUP) -r $(REPEAT) -- $(BIN) $(ARGS)
+
 debug:
 	@$(DEBUGGER) --args $(BIN) $(ARGS)
 
@@ -70,7 +82,8 @@ clean :
 #	$(HCC_BIN) $^ -o $@ $(LDFLAGS)
 
 CPP_FILES := $(wildcard $(SRCDIR)/*.cpp)
-$(BIN) : $(CPP_FILES) $(BUILDDIR)/parboil.o
+$(BIN) : $(CPP_FILES) $(BUILDDIR)/parboil.o $(BUILDDIR)/pb_io.o \
+	   $(BUILDDIR)/pb_verify.o $(BUILDDIR)/pb_memory.o
 	$(HCC_BIN) $(CXXFLAGS) $^ -o $@ $(LDFLAGS)
 
 $(BUILDDIR) :
@@ -82,6 +95,15 @@ $(BUILDDIR)/%.o : $(SRCDIR)/%.c
 $(BUILDDIR)/parboil.o: $(PARBOIL_ROOT)/common/src/parboil.c
 	$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@
 
+$(BUILDDIR)/pb_io.o: $(PARBOIL_ROOT)/common/src/pb_io.c
+	$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@
+
+$(BUILDDIR)/pb_verify.o: $(PARBOIL_ROOT)/common/src/pb_verify.c
+	$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@
+
+$(BUILDDIR)/pb_memory.o: $(PARBOIL_ROOT)/common/src/pb_memory.c
+	$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@
+
 #$(BUILDDIR)/%.o : $(SRCDIR)/%.cc
 #	$(CXX) $(CXXFLAGS) -c $< -o $@
 #
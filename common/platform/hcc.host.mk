@@ -0,0 +1,20 @@
+# HCC sources built for the host CPU instead of an HC accelerator.
+
+# Kernels run on the multi-threaded fiber runtime in common/hcc_host;
+# see common/hcc_host/include/hc.hpp.
+
+########################################
+# Variables
+########################################
+
+# c.default is the base along with CUDA configuration in this setting
+include $(PARBOIL_ROOT)/common/platform/c.default.mk
+
+# Programs
+HCC_BIN=$(CXX)
+
+# Flags
+HCC_HOST_PATH=$(PARBOIL_ROOT)/common/hcc_host
+PLATFORM_CXXFLAGS=-std=c++17 -O3 -march=native -pthread -Wno-attributes \
+                  -I$(HCC_HOST_PATH)/include -include hc_host_prelude.h
+PLATFORM_LDFLAGS=-lm -lpthread
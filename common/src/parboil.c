@@ -0,0 +1,1495 @@
+/*
+ * Parboil benchmark support library: command line parameters and timers.
+ */
+
+#define _GNU_SOURCE
+
+#include <parboil.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*****************************************************************************/
+/* Parameter parsing */
+
+/* Split a comma-separated list of file names into a NULL-terminated list. */
+static char **
+read_string_array(char *in)
+{
+  char **ret;
+  int i;
+  int count;			/* Number of items in the input */
+  char *substring;		/* Current substring within 'in' */
+
+  /* Count the number of items in the string */
+  count = 1;
+  for (i = 0; in[i]; i++) if (in[i] == ',') count++;
+
+  /* Allocate storage */
+  ret = (char **)malloc((count + 1) * sizeof(char *));
+
+  /* Create copies of the strings from the list */
+  substring = in;
+  for (i = 0; i < count; i++) {
+    char *substring_end;
+    int substring_length;
+
+    /* Find length of substring */
+    for (substring_end = substring;
+	 (*substring_end != ',') && (*substring_end != 0);
+	 substring_end++);
+
+    substring_length = substring_end - substring;
+
+    /* Allocate memory and copy the substring */
+    ret[i] = (char *)malloc(substring_length + 1);
+    memcpy(ret[i], substring, substring_length);
+    ret[i][substring_length] = 0;
+
+    /* go to next substring */
+    substring = substring_end + 1;
+  }
+  ret[i] = NULL;		/* Write the sentinel value */
+
+  return ret;
+}
+
+static void
+free_string_array(char **string_array)
+{
+  char **p;
+
+  if (!string_array) return;
+  for (p = string_array; *p; p++) free(*p);
+  free(string_array);
+}
+
+struct pb_Parameters *
+pb_ReadParameters(int *_argc, char **argv)
+{
+  char *err_message;
+  struct pb_Parameters *ret =
+    (struct pb_Parameters *)malloc(sizeof(struct pb_Parameters));
+
+  /* Initialize the parameters structure */
+  ret->outFile = NULL;
+  ret->inpFiles = (char **)malloc(sizeof(char *));
+  ret->inpFiles[0] = NULL;
+  ret->synchronizeGpu = 0;
+  ret->refFile = NULL;
+  ret->verifyGold = 0;
+
+  /* Each argument is copied to argv[argc_out] unless it is consumed here.
+   * Arguments after "--" are passed through untouched. */
+  {
+    int argc = *_argc;
+    int argc_out = 1;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+      char *arg = argv[i];
+
+      if (strcmp(arg, "--") == 0) {
+	for (i++; i < argc; i++) argv[argc_out++] = argv[i];
+	break;
+      }
+      else if (strcmp(arg, "-o") == 0) {
+	if (++i == argc) {
+	  err_message = "Expecting file name after '-o'\n";
+	  goto error;
+	}
+	free(ret->outFile);
+	ret->outFile = strdup(argv[i]);
+      }
+      else if (strcmp(arg, "-i") == 0) {
+	if (++i == argc) {
+	  err_message = "Expecting file name after '-i'\n";
+	  goto error;
+	}
+	free_string_array(ret->inpFiles);
+	ret->inpFiles = read_string_array(argv[i]);
+      }
+      else if (strcmp(arg, "-S") == 0) {
+	ret->synchronizeGpu = 1;
+      }
+      else if (strcmp(arg, "-v") == 0) {
+	if (++i == argc) {
+	  err_message = "Expecting file name after '-v'\n";
+	  goto error;
+	}
+	free(ret->refFile);
+	ret->refFile = strdup(argv[i]);
+      }
+      else if (strcmp(arg, "-V") == 0) {
+	ret->verifyGold = 1;
+      }
+      else {
+	argv[argc_out++] = arg;
+      }
+    }
+
+    argv[argc_out] = NULL;
+    *_argc = argc_out;
+  }
+
+  return ret;
+
+ error:
+  fputs(err_message, stderr);
+  pb_FreeParameters(ret);
+  return NULL;
+}
+
+void
+pb_FreeParameters(struct pb_Parameters *p)
+{
+  if (!p) return;
+  free(p->outFile);
+  free(p->refFile);
+  free_string_array(p->inpFiles);
+  free(p);
+}
+
+int
+pb_Parameters_CountInputs(struct pb_Parameters *p)
+{
+  int n;
+
+  for (n = 0; p->inpFiles[n]; n++);
+  return n;
+}
+
+/*****************************************************************************/
+/* Timer routines */
+
+/* Timestamps are raw ticks of the cheapest trustworthy clock.  On x86 that
+ * is the invariant TSC, provided the kernel itself uses it as clocksource;
+ * elsewhere, or with PARBOIL_TIMER_CLOCK=monotonic, it is CLOCK_MONOTONIC
+ * in nanoseconds.  Ticks are converted to nanoseconds only when a duration
+ * is read, using the rate observed against CLOCK_MONOTONIC since the first
+ * timestamp, so the calibration gets more precise as the run goes on. */
+
+static int clock_ready;
+static int clock_use_tsc;
+static pb_Timestamp clock_base_ticks;	/* Ticks at the first timestamp */
+static pb_Timestamp clock_base_ns;	/* CLOCK_MONOTONIC at the same time */
+static double clock_ns_per_tick = 1.0;
+
+static pb_Timestamp
+monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (pb_Timestamp)ts.tv_sec * 1000000000ULL + (pb_Timestamp)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int
+tsc_usable(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  char source[32] = "";
+  FILE *f;
+
+  /* Invariant TSC: constant rate, keeps counting in deep C-states */
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+    return 0;
+
+  /* The kernel drops the TSC clocksource when it finds it unsynchronized
+   * between sockets or unstable, which is exactly when we must not use it */
+  f = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource",
+            "r");
+  if (f == NULL) return 0;
+  if (fgets(source, sizeof(source), f) == NULL) source[0] = 0;
+  fclose(f);
+  return strncmp(source, "tsc", 3) == 0;
+}
+
+#define read_ticks() (clock_use_tsc ? (pb_Timestamp)__rdtsc() : monotonic_ns())
+#else
+static int tsc_usable(void) { return 0; }
+#define read_ticks() monotonic_ns()
+#endif
+
+static void
+init_clock(void)
+{
+  const char *choice = getenv("PARBOIL_TIMER_CLOCK");
+
+  clock_use_tsc = !(choice && strcmp(choice, "monotonic") == 0) && tsc_usable();
+  clock_base_ns = monotonic_ns();
+  clock_base_ticks = read_ticks();
+  clock_ready = 1;
+}
+
+pb_Timestamp
+pb_GetTimestamp(void)
+{
+  if (!clock_ready) init_clock();
+  return read_ticks();
+}
+
+pb_Timestamp
+pb_TicksToNanoseconds(pb_Timestamp ticks)
+{
+  if (!clock_ready) init_clock();
+
+  if (clock_use_tsc) {
+    pb_Timestamp ns = monotonic_ns() - clock_base_ns;
+
+    /* Calibrate over at least 10 ms, which bounds the rate error to a few
+     * parts per million; stop refining after 10 s */
+    while (ns < 10000000ULL) ns = monotonic_ns() - clock_base_ns;
+    if (ns < 10000000000ULL || clock_ns_per_tick == 1.0)
+      clock_ns_per_tick = (double)ns / (double)(read_ticks() - clock_base_ticks);
+  }
+
+  return (pb_Timestamp)(ticks * clock_ns_per_tick + 0.5);
+}
+
+/* Hardware counters.  One counter per event is opened for the whole
+ * process, inherited by threads created afterwards (the workers of a
+ * parallel runtime), and read at every timer switch.  The events are opened
+ * as one group so that they are scheduled together and their ratios stay
+ * meaningful.  Counts are not scaled when the PMU multiplexes the group:
+ * scaling cumulative values by the time-running ratio is not monotonic
+ * once inherited threads exit, so the report warns instead. */
+
+static const char *counter_names[] = {
+  "cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"
+};
+
+static int counters_opened;
+static int counters_enabled;		/* Nonzero if any counter is open */
+static int counters_multiplexed;	/* Nonzero if a counter did not run
+					 * all the time it was enabled */
+
+#ifdef __linux__
+static int counter_fd[pb_Counter_LAST];
+
+static void
+open_counters(void)
+{
+  static const struct { unsigned int type; unsigned long long config; }
+    events[pb_Counter_LAST] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+			  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  };
+  const char *choice = getenv("PARBOIL_COUNTERS");
+  int leader = -1;
+  int err = 0;
+  int n;
+
+  counters_opened = 1;
+  for (n = 0; n < pb_Counter_LAST; n++) counter_fd[n] = -1;
+  if (choice == NULL || choice[0] == 0 || strcmp(choice, "0") == 0) return;
+
+  for (n = 0; n < pb_Counter_LAST; n++) {
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[n].type;
+    attr.config = events[n].config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;	/* Allowed at perf_event_paranoid 2 */
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader,
+                 PERF_FLAG_FD_CLOEXEC);
+
+    /* An event the group cannot take may still work on its own */
+    if (fd < 0 && leader >= 0)
+      fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+
+    if (fd < 0) {
+      err = errno;
+      continue;
+    }
+    if (leader < 0) leader = fd;
+    counter_fd[n] = fd;
+    counters_enabled = 1;
+  }
+
+  if (!counters_enabled) {
+    if (err == EACCES || err == EPERM)
+      fprintf(stderr, "Hardware counters are not permitted (%s); "
+              "check /proc/sys/kernel/perf_event_paranoid\n", strerror(err));
+    else
+      fprintf(stderr, "Hardware counters are unavailable (%s)\n",
+              strerror(err));
+    return;
+  }
+
+  for (n = 0; n < pb_Counter_LAST; n++)
+    if (counter_fd[n] < 0)
+      fprintf(stderr, "Hardware counter %s is unavailable (%s)\n",
+              counter_names[n], strerror(err));
+}
+
+static void
+read_counters(unsigned long long *values)
+{
+  int n;
+
+  for (n = 0; n < pb_Counter_LAST; n++) {
+    unsigned long long buf[3];	/* value, time enabled, time running */
+
+    values[n] = 0;
+    if (counter_fd[n] < 0 || read(counter_fd[n], buf, sizeof(buf)) != sizeof(buf))
+      continue;
+    values[n] = buf[0];
+    if (buf[2] < buf[1]) counters_multiplexed = 1;
+  }
+}
+#else
+static void
+open_counters(void)
+{
+  counters_opened = 1;
+  if (getenv("PARBOIL_COUNTERS"))
+    fputs("Hardware counters are only supported on Linux\n", stderr);
+}
+
+static void
+read_counters(unsigned long long *values)
+{
+  memset(values, 0, pb_Counter_LAST * sizeof(*values));
+}
+#endif
+
+int
+pb_CounterAvailable(enum pb_CounterID counter)
+{
+  if (!counters_opened) open_counters();
+#ifdef __linux__
+  return counter_fd[counter] >= 0;
+#else
+  (void)counter;
+  return 0;
+#endif
+}
+
+/* Trace timeline.  With PARBOIL_TRACE set, every interval a timer or
+ * sub-timer ran and every span passed to pb_TraceSpan is kept in memory,
+ * and pb_PrintTimerSet writes them out as Chrome trace events.  Timer
+ * intervals are recorded when they stop, from the sample that stops them,
+ * so tracing adds no clock read to a switch. */
+
+#define TRACE_MAX_TRACKS 16
+
+struct trace_event {
+  pb_Timestamp begin, end;
+  int track;			/* 0 for timers, else a span category */
+  enum pb_TimerID category;	/* Of a timer interval */
+  struct pb_SubTimer *subtimer;	/* Of a sub-timer interval, else NULL */
+  char *name;			/* Of a span */
+  char *args;			/* Of a span: JSON object members, or NULL */
+};
+
+static int trace_state = -1;	/* -1 until PARBOIL_TRACE is read */
+static pb_Timestamp trace_base;	/* Time 0 of the trace */
+static struct trace_event *trace_events;
+static size_t trace_count, trace_capacity;
+static char *trace_tracks[TRACE_MAX_TRACKS];	/* Span categories */
+static int trace_track_count = 1;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int
+pb_TraceEnabled(void)
+{
+  if (trace_state < 0) {
+    const char *name = getenv("PARBOIL_TRACE");
+    trace_state = name != NULL && name[0] != 0;
+    trace_base = pb_GetTimestamp();
+  }
+  return trace_state;
+}
+
+/* Append an event; the caller holds trace_lock.  Returns NULL when out of
+ * memory, and the event is dropped. */
+static struct trace_event *
+trace_append(void)
+{
+  if (trace_count == trace_capacity) {
+    size_t capacity = trace_capacity ? 2 * trace_capacity : 4096;
+    struct trace_event *events = (struct trace_event *)
+      realloc(trace_events, capacity * sizeof(struct trace_event));
+    if (events == NULL) return NULL;
+    trace_events = events;
+    trace_capacity = capacity;
+  }
+  return &trace_events[trace_count++];
+}
+
+/* Record the interval of a timer that is stopping at 'end'. */
+static void
+trace_timer(enum pb_TimerID category, struct pb_SubTimer *subtimer,
+            pb_Timestamp begin, pb_Timestamp end)
+{
+  struct trace_event *e;
+
+  pthread_mutex_lock(&trace_lock);
+  e = trace_append();
+  if (e != NULL) {
+    e->begin = begin;
+    e->end = end;
+    e->track = 0;
+    e->category = category;
+    e->subtimer = subtimer;
+    e->name = NULL;
+    e->args = NULL;
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/* Track of a span category; the caller holds trace_lock.  Categories past
+ * TRACE_MAX_TRACKS share the last track. */
+static int
+trace_track(const char *category)
+{
+  int i;
+
+  for (i = 1; i < trace_track_count; i++)
+    if (strcmp(trace_tracks[i], category) == 0) return i;
+  if (trace_track_count == TRACE_MAX_TRACKS) return TRACE_MAX_TRACKS - 1;
+  trace_tracks[trace_track_count] = strdup(category);
+  return trace_track_count++;
+}
+
+void
+pb_TraceSpan(const char *name, const char *category, pb_Timestamp begin,
+             pb_Timestamp end, const char *args)
+{
+  struct trace_event *e;
+
+  if (!pb_TraceEnabled()) return;
+
+  pthread_mutex_lock(&trace_lock);
+  e = trace_append();
+  if (e != NULL) {
+    e->begin = begin;
+    e->end = end;
+    e->track = trace_track(category ? category : "span");
+    e->category = pb_TimerID_NONE;
+    e->subtimer = NULL;
+    e->name = strdup(name);
+    e->args = args ? strdup(args) : NULL;
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+/* A reading of the clock and, when enabled, the hardware counters.  Timer
+ * switches take one sample, so that the stopped and the started timer see
+ * the same values and nothing falls between the two intervals. */
+struct sample {
+  pb_Timestamp time;
+  unsigned long long counters[pb_Counter_LAST];
+};
+
+static inline void
+take_sample(struct sample *s)
+{
+  s->time = pb_GetTimestamp();
+  if (counters_enabled) read_counters(s->counters);
+}
+
+static inline void
+start_timer_at(struct pb_Timer *timer, const struct sample *s)
+{
+  timer->state = pb_Timer_RUNNING;
+  timer->init = s->time;
+  timer->switches++;
+  if (counters_enabled)
+    memcpy(timer->counters_init, s->counters, sizeof(s->counters));
+}
+
+static inline void
+stop_timer_at(struct pb_Timer *timer, const struct sample *s)
+{
+  int n;
+
+  timer->state = pb_Timer_STOPPED;
+  timer->elapsed += s->time - timer->init;
+  if (counters_enabled)
+    for (n = 0; n < pb_Counter_LAST; n++)
+      timer->counters[n] += s->counters[n] - timer->counters_init[n];
+}
+
+void
+pb_ResetTimer(struct pb_Timer *timer)
+{
+  timer->state = pb_Timer_STOPPED;
+  timer->elapsed = 0;
+  timer->init = 0;
+  timer->switches = 0;
+  memset(timer->counters, 0, sizeof(timer->counters));
+  memset(timer->counters_init, 0, sizeof(timer->counters_init));
+  timer->bytes = 0;
+  timer->flops = 0;
+}
+
+void
+pb_StartTimer(struct pb_Timer *timer)
+{
+  struct sample now;
+
+  if (timer->state != pb_Timer_STOPPED) {
+    fputs("Ignoring attempt to start a running timer\n", stderr);
+    return;
+  }
+  take_sample(&now);
+  start_timer_at(timer, &now);
+}
+
+void
+pb_StopTimer(struct pb_Timer *timer)
+{
+  struct sample now;
+
+  if (timer->state != pb_Timer_RUNNING) {
+    fputs("Ignoring attempt to stop a stopped timer\n", stderr);
+    return;
+  }
+  take_sample(&now);
+  stop_timer_at(timer, &now);
+}
+
+double
+pb_GetElapsedTime(struct pb_Timer *timer)
+{
+  pb_Timestamp elapsed = timer->elapsed;
+
+  /* A running timer reports the time accumulated so far */
+  if (timer->state == pb_Timer_RUNNING)
+    elapsed += pb_GetTimestamp() - timer->init;
+
+  return pb_TicksToNanoseconds(elapsed) / 1e9;
+}
+
+unsigned long long
+pb_GetCounter(struct pb_Timer *timer, enum pb_CounterID counter)
+{
+  unsigned long long count = timer->counters[counter];
+
+  if (!counters_enabled) return 0;
+
+  /* A running timer reports the events counted so far */
+  if (timer->state == pb_Timer_RUNNING) {
+    unsigned long long values[pb_Counter_LAST];
+    read_counters(values);
+    count += values[counter] - timer->counters_init[counter];
+  }
+
+  return count;
+}
+
+void
+pb_InitializeTimerSet(struct pb_TimerSet *timers)
+{
+  int n;
+
+  if (!counters_opened) open_counters();
+  pb_TraceEnabled();
+
+  timers->current = pb_TimerID_NONE;
+  timers->wall_begin = pb_GetTimestamp();
+  timers->wall_end = 0;
+
+  for (n = 0; n < pb_TimerID_LAST; n++) {
+    pb_ResetTimer(&timers->timers[n]);
+    timers->sub_timer_list[n] = NULL;
+  }
+}
+
+void
+pb_AddSubTimer(struct pb_TimerSet *timers, const char *label,
+               enum pb_TimerID pb_Category)
+{
+  struct pb_SubTimerList *subtimerlist;
+  struct pb_SubTimer *subtimer;
+  struct pb_SubTimer **tail;
+
+  subtimer = (struct pb_SubTimer *)malloc(sizeof(struct pb_SubTimer));
+  subtimer->label = strdup(label);
+  subtimer->next = NULL;
+  pb_ResetTimer(&subtimer->timer);
+
+  subtimerlist = timers->sub_timer_list[pb_Category];
+  if (subtimerlist == NULL) {
+    subtimerlist =
+      (struct pb_SubTimerList *)malloc(sizeof(struct pb_SubTimerList));
+    subtimerlist->current = NULL;
+    subtimerlist->subtimer_list = NULL;
+    timers->sub_timer_list[pb_Category] = subtimerlist;
+  }
+
+  /* Keep the order of registration for printing */
+  for (tail = &subtimerlist->subtimer_list; *tail; tail = &(*tail)->next);
+  *tail = subtimer;
+}
+
+/* Stop the running category and its running sub-timer, if any.  The
+ * category timer keeps running when it is also the next one. */
+static inline void
+stop_current(struct pb_TimerSet *timers, enum pb_TimerID next,
+             const struct sample *now)
+{
+  enum pb_TimerID current = timers->current;
+  struct pb_SubTimerList *subtimerlist;
+
+  if (current == pb_TimerID_NONE) return;
+
+  subtimerlist = timers->sub_timer_list[current];
+  if (subtimerlist != NULL && subtimerlist->current != NULL) {
+    struct pb_SubTimer *sub = subtimerlist->current;
+    if (trace_state > 0)
+      trace_timer(current, sub, sub->timer.init, now->time);
+    stop_timer_at(&sub->timer, now);
+    subtimerlist->current = NULL;
+  }
+
+  if (current != next) {
+    if (trace_state > 0)
+      trace_timer(current, NULL, timers->timers[current].init, now->time);
+    stop_timer_at(&timers->timers[current], now);
+  }
+}
+
+void
+pb_SwitchToTimer(struct pb_TimerSet *timers, enum pb_TimerID timer)
+{
+  struct sample now;
+
+  take_sample(&now);
+  stop_current(timers, timer, &now);
+
+  if (timer != pb_TimerID_NONE && timer != timers->current)
+    start_timer_at(&timers->timers[timer], &now);
+
+  timers->current = timer;
+}
+
+static struct pb_SubTimer *
+find_subtimer(struct pb_SubTimerList *subtimerlist, const char *label)
+{
+  struct pb_SubTimer *subtimer;
+
+  if (subtimerlist == NULL || label == NULL) return NULL;
+
+  for (subtimer = subtimerlist->subtimer_list; subtimer;
+       subtimer = subtimer->next)
+    if (strcmp(subtimer->label, label) == 0) return subtimer;
+
+  return NULL;
+}
+
+void
+pb_SwitchToSubTimer(struct pb_TimerSet *timers, const char *label,
+                    enum pb_TimerID category)
+{
+  struct pb_SubTimerList *subtimerlist = timers->sub_timer_list[category];
+  struct pb_SubTimer *subtimer = find_subtimer(subtimerlist, label);
+  struct sample now;
+
+  take_sample(&now);
+  stop_current(timers, category, &now);
+
+  if (category != pb_TimerID_NONE) {
+    if (category != timers->current)
+      start_timer_at(&timers->timers[category], &now);
+    if (subtimer != NULL) {
+      start_timer_at(&subtimer->timer, &now);
+      subtimerlist->current = subtimer;
+    }
+  }
+
+  timers->current = category;
+}
+
+void
+pb_AddWork(struct pb_TimerSet *timers, const char *label,
+           enum pb_TimerID category, double bytes, double flops)
+{
+  struct pb_SubTimer *subtimer =
+    find_subtimer(timers->sub_timer_list[category], label);
+
+  timers->timers[category].bytes += bytes;
+  timers->timers[category].flops += flops;
+  if (subtimer != NULL) {
+    subtimer->timer.bytes += bytes;
+    subtimer->timer.flops += flops;
+  }
+}
+
+/*****************************************************************************/
+/* Roofline ceilings */
+
+/* The bandwidth ceiling is the STREAM triad a[i] = b[i] + s*c[i] over
+ * arrays well beyond the last-level cache, counting 24 bytes per element
+ * as STREAM does.  The compute ceiling is single-precision FMA throughput
+ * on enough independent chains to cover the FMA latency.  Both run on one
+ * thread per online CPU, and the best of several repetitions is kept. */
+
+#define STREAM_ELEMENTS (1L << 23)	/* 64 MB per array */
+#define STREAM_REPS 5
+#define FMA_ITERATIONS (1L << 22)
+#define FMA_CHAINS 12
+
+/* Apply OP to the FMA_CHAINS accumulators x0..x11.  They are spelled out
+ * rather than kept in an array, which compilers leave in memory at -O2. */
+#define FMA_EACH(OP) \
+  OP(x0) OP(x1) OP(x2) OP(x3) OP(x4) OP(x5) \
+  OP(x6) OP(x7) OP(x8) OP(x9) OP(x10) OP(x11)
+
+struct ceiling_job {
+  pthread_t thread;
+  int id;
+  int nthreads;
+  double *a, *b, *c;
+  pthread_barrier_t *barrier;
+  double bandwidth;		/* Results, filled in by thread 0 */
+  double flops;
+  volatile float sink;		/* Keeps the FMA chains alive */
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx512f")))
+static double
+fma_loop_avx512(long iterations, volatile float *sink)
+{
+  const __m512 m = _mm512_set1_ps(0.999999f);
+  const __m512 c = _mm512_set1_ps(1e-7f);
+  __m512 sum = _mm512_setzero_ps();
+  long i;
+
+#define FMA_INIT(x) __m512 x = _mm512_set1_ps(1.0f);
+#define FMA_STEP(x) x = _mm512_fmadd_ps(x, m, c);
+#define FMA_SUM(x) sum = _mm512_add_ps(sum, x);
+  FMA_EACH(FMA_INIT)
+  for (i = 0; i < iterations; i++) {
+    FMA_EACH(FMA_STEP)
+  }
+  FMA_EACH(FMA_SUM)
+#undef FMA_INIT
+#undef FMA_STEP
+#undef FMA_SUM
+
+  *sink = _mm512_reduce_add_ps(sum);
+  return (double)iterations * FMA_CHAINS * 16 * 2;
+}
+
+__attribute__((target("avx2,fma")))
+static double
+fma_loop_avx2(long iterations, volatile float *sink)
+{
+  const __m256 m = _mm256_set1_ps(0.999999f);
+  const __m256 c = _mm256_set1_ps(1e-7f);
+  __m256 sum = _mm256_setzero_ps();
+  float out[8];
+  long i;
+
+#define FMA_INIT(x) __m256 x = _mm256_set1_ps(1.0f);
+#define FMA_STEP(x) x = _mm256_fmadd_ps(x, m, c);
+#define FMA_SUM(x) sum = _mm256_add_ps(sum, x);
+  FMA_EACH(FMA_INIT)
+  for (i = 0; i < iterations; i++) {
+    FMA_EACH(FMA_STEP)
+  }
+  FMA_EACH(FMA_SUM)
+#undef FMA_INIT
+#undef FMA_STEP
+#undef FMA_SUM
+
+  _mm256_storeu_ps(out, sum);
+  *sink = out[0];
+  return (double)iterations * FMA_CHAINS * 8 * 2;
+}
+#endif
+
+/* Portable version, for the baseline ISA */
+static double
+fma_loop_generic(long iterations, volatile float *sink)
+{
+  float sum = 0;
+  long i;
+
+#define FMA_INIT(x) float x = 1.0f;
+#define FMA_STEP(x) x = x * 0.999999f + 1e-7f;
+#define FMA_SUM(x) sum += x;
+  FMA_EACH(FMA_INIT)
+  for (i = 0; i < iterations; i++) {
+    FMA_EACH(FMA_STEP)
+  }
+  FMA_EACH(FMA_SUM)
+#undef FMA_INIT
+#undef FMA_STEP
+#undef FMA_SUM
+
+  *sink = sum;
+  return (double)iterations * FMA_CHAINS * 2;
+}
+
+static double
+fma_loop(long iterations, volatile float *sink)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return fma_loop_avx512(iterations, sink);
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return fma_loop_avx2(iterations, sink);
+#endif
+  return fma_loop_generic(iterations, sink);
+}
+
+static void *
+ceiling_thread(void *arg)
+{
+  struct ceiling_job *job = (struct ceiling_job *)arg;
+  long chunk = (STREAM_ELEMENTS + job->nthreads - 1) / job->nthreads;
+  long begin = job->id * chunk;
+  long end = begin + chunk < STREAM_ELEMENTS ? begin + chunk : STREAM_ELEMENTS;
+  double *a = job->a, *b = job->b, *c = job->c;
+  pb_Timestamp start = 0;
+  double flops;
+  long i;
+  int rep;
+
+  /* Each thread touches its own part first, so the pages are local */
+  for (i = begin; i < end; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+
+  for (rep = 0; rep < STREAM_REPS; rep++) {
+    pthread_barrier_wait(job->barrier);
+    if (job->id == 0) start = monotonic_ns();
+    for (i = begin; i < end; i++) a[i] = b[i] + 3.0 * c[i];
+    pthread_barrier_wait(job->barrier);
+    if (job->id == 0) {
+      double bw = 3.0 * sizeof(double) * STREAM_ELEMENTS /
+                  ((monotonic_ns() - start) / 1e9);
+      if (bw > job->bandwidth) job->bandwidth = bw;
+    }
+  }
+
+  for (rep = 0; rep < 2; rep++) {
+    pthread_barrier_wait(job->barrier);
+    if (job->id == 0) start = monotonic_ns();
+    flops = fma_loop(FMA_ITERATIONS, &job->sink);
+    pthread_barrier_wait(job->barrier);
+    if (job->id == 0) {
+      double rate = flops * job->nthreads / ((monotonic_ns() - start) / 1e9);
+      if (rate > job->flops) job->flops = rate;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+measure_roofline(struct pb_Roofline *roofline)
+{
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t bytes = STREAM_ELEMENTS * sizeof(double);
+  pthread_barrier_t barrier;
+  struct ceiling_job *jobs;
+  double *a, *b, *c;
+  int n;
+
+  if (nthreads < 1) nthreads = 1;
+  a = (double *)malloc(bytes);
+  b = (double *)malloc(bytes);
+  c = (double *)malloc(bytes);
+  jobs = (struct ceiling_job *)calloc(nthreads, sizeof(struct ceiling_job));
+  if (!a || !b || !c || !jobs) {
+    fputs("Cannot allocate memory to measure the roofline\n", stderr);
+    goto done;
+  }
+
+  pthread_barrier_init(&barrier, NULL, nthreads);
+  for (n = 0; n < nthreads; n++) {
+    jobs[n].id = n;
+    jobs[n].nthreads = nthreads;
+    jobs[n].a = a;
+    jobs[n].b = b;
+    jobs[n].c = c;
+    jobs[n].barrier = &barrier;
+    if (n > 0) pthread_create(&jobs[n].thread, NULL, ceiling_thread, &jobs[n]);
+  }
+  ceiling_thread(&jobs[0]);
+  for (n = 1; n < nthreads; n++) pthread_join(jobs[n].thread, NULL);
+  pthread_barrier_destroy(&barrier);
+
+  roofline->bandwidth = jobs[0].bandwidth;
+  roofline->flops = jobs[0].flops;
+
+ done:
+  free(a);
+  free(b);
+  free(c);
+  free(jobs);
+}
+
+void
+pb_GetRoofline(struct pb_Roofline *roofline)
+{
+  static struct pb_Roofline measured;
+  static int measured_ready;
+  const char *gbs = getenv("PARBOIL_PEAK_GBS");
+  const char *gflops = getenv("PARBOIL_PEAK_GFLOPS");
+
+  /* Measure unless both ceilings are given */
+  if (!measured_ready && !(gbs && gflops)) {
+    measure_roofline(&measured);
+    measured_ready = 1;
+  }
+
+  roofline->bandwidth = gbs ? atof(gbs) * 1e9 : measured.bandwidth;
+  roofline->flops = gflops ? atof(gflops) * 1e9 : measured.flops;
+}
+
+/*****************************************************************************/
+/* Timer output */
+
+static const char *categories[] = {
+  "IO", "Kernel", "Copy", "Driver", "Copy Async", "Compute"
+};
+
+/* Names used in machine-readable output */
+static const char *category_keys[] = {
+  "io", "kernel", "copy", "driver", "copy_async", "compute", "overlap"
+};
+
+static const int maxCategoryLength = 10;
+
+/* Write a string as a JSON string literal. */
+static void
+write_json_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+    else if (c < 0x20) fprintf(f, "\\u%04x", c);
+    else fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+/* Write a string as a CSV field, quoting it when needed. */
+static void
+write_csv_string(FILE *f, const char *s)
+{
+  if (strpbrk(s, ",\"\n") == NULL) {
+    fputs(s, f);
+    return;
+  }
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"') fputc('"', f);
+    fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+/* Print the counters of a timer on one line under its time. */
+static void
+print_counters(struct pb_Timer *timer)
+{
+  int n;
+
+  if (!counters_enabled || timer->switches == 0) return;
+
+  fputs("   ", stdout);
+  for (n = 0; n < pb_Counter_LAST; n++)
+    if (pb_CounterAvailable(n))
+      printf(" %s=%llu", counter_names[n], pb_GetCounter(timer, n));
+
+  if (pb_CounterAvailable(pb_Counter_CYCLES) &&
+      pb_CounterAvailable(pb_Counter_INSTRUCTIONS) &&
+      pb_GetCounter(timer, pb_Counter_CYCLES) != 0)
+    printf(" IPC=%.2f",
+           (double)pb_GetCounter(timer, pb_Counter_INSTRUCTIONS) /
+           pb_GetCounter(timer, pb_Counter_CYCLES));
+  putchar('\n');
+}
+
+static void
+write_json_counters(struct pb_Timer *timer, FILE *f)
+{
+  int n;
+  int first = 1;
+
+  if (!counters_enabled) return;
+
+  fputs(",\"counters\":{", f);
+  for (n = 0; n < pb_Counter_LAST; n++) {
+    if (!pb_CounterAvailable(n)) continue;
+    fprintf(f, "%s\"%s\":%llu", first ? "" : ",", counter_names[n],
+            pb_GetCounter(timer, n));
+    first = 0;
+  }
+  fputc('}', f);
+}
+
+/* Counter columns are always present and left empty when not collected. */
+static void
+write_csv_counters(struct pb_Timer *timer, FILE *f)
+{
+  int n;
+
+  for (n = 0; n < pb_Counter_LAST; n++) {
+    if (counters_enabled && pb_CounterAvailable(n))
+      fprintf(f, ",%llu", pb_GetCounter(timer, n));
+    else
+      fputc(',', f);
+  }
+  fputc('\n', f);
+}
+
+/* Wall time of the run in seconds: up to pb_PrintTimerSet when it recorded
+ * the end, so that measuring the roofline is not included, else up to now */
+static double
+wall_time(struct pb_TimerSet *timers)
+{
+  pb_Timestamp end = timers->wall_end ? timers->wall_end : pb_GetTimestamp();
+
+  return pb_TicksToNanoseconds(end - timers->wall_begin) / 1e9;
+}
+
+/* Nonzero if any timer had work declared with pb_AddWork. */
+static int
+has_work(struct pb_TimerSet *timers)
+{
+  int i;
+
+  for (i = pb_TimerID_IO; i < pb_TimerID_LAST; i++)
+    if (timers->timers[i].bytes != 0 || timers->timers[i].flops != 0)
+      return 1;
+  return 0;
+}
+
+/* Print one row of the roofline table. */
+static void
+print_work(const char *label, const char *prefix, int width,
+           struct pb_Timer *timer, const struct pb_Roofline *roof)
+{
+  double seconds = pb_GetElapsedTime(timer);
+  double bandwidth, rate, attainable;
+
+  if ((timer->bytes == 0 && timer->flops == 0) || seconds == 0) return;
+
+  bandwidth = timer->bytes / seconds;
+  rate = timer->flops / seconds;
+  printf("%s%-*s: %8.2f GB/s %9.2f GFLOP/s", prefix, width, label,
+         bandwidth / 1e9, rate / 1e9);
+
+  if (timer->bytes == 0) {
+    printf("                 %5.1f%% of FLOP/s peak\n",
+           100 * rate / roof->flops);
+    return;
+  }
+  if (timer->flops == 0) {
+    printf("                 %5.1f%% of bandwidth\n",
+           100 * bandwidth / roof->bandwidth);
+    return;
+  }
+
+  /* The roof at this intensity is the lower of the two ceilings */
+  attainable = timer->flops / timer->bytes * roof->bandwidth;
+  if (attainable > roof->flops) attainable = roof->flops;
+  printf(" %7.2f flop/B  %5.1f%% of roof, %s bound\n",
+         timer->flops / timer->bytes, 100 * rate / attainable,
+         attainable < roof->flops ? "memory" : "compute");
+}
+
+static void
+print_roofline(struct pb_TimerSet *timers)
+{
+  struct pb_Roofline roof;
+  struct pb_SubTimer *sub;
+  int width = maxCategoryLength;
+  int i;
+
+  /* Align all rows, sub-timers included */
+  for (i = pb_TimerID_IO; i < pb_TimerID_OVERLAP; i++) {
+    if (timers->sub_timer_list[i] == NULL) continue;
+    for (sub = timers->sub_timer_list[i]->subtimer_list; sub; sub = sub->next)
+      if ((int)strlen(sub->label) + 2 > width) width = strlen(sub->label) + 2;
+  }
+
+  pb_GetRoofline(&roof);
+  printf("Roofline: %.2f GB/s, %.2f GFLOP/s, ridge at %.2f flop/B\n",
+         roof.bandwidth / 1e9, roof.flops / 1e9, roof.flops / roof.bandwidth);
+
+  for (i = pb_TimerID_IO; i < pb_TimerID_OVERLAP; i++) {
+    print_work(categories[i - 1], "", width, &timers->timers[i], &roof);
+    if (timers->sub_timer_list[i] == NULL) continue;
+    for (sub = timers->sub_timer_list[i]->subtimer_list; sub; sub = sub->next)
+      print_work(sub->label, " -", width - 2, &sub->timer, &roof);
+  }
+}
+
+static void
+write_json_work(struct pb_Timer *timer, FILE *f)
+{
+  if (timer->bytes != 0 || timer->flops != 0)
+    fprintf(f, ",\"bytes\":%.0f,\"flops\":%.0f", timer->bytes, timer->flops);
+}
+
+void
+pb_WriteTimerSetJSON(struct pb_TimerSet *timers, FILE *f)
+{
+  int i;
+  struct pb_SubTimer *sub;
+
+  fprintf(f, "{\"wall\":%.9f,", wall_time(timers));
+
+  if (has_work(timers)) {
+    struct pb_Roofline roof;
+    pb_GetRoofline(&roof);
+    fprintf(f, "\"roofline\":{\"bandwidth\":%.0f,\"flops\":%.0f},",
+            roof.bandwidth, roof.flops);
+  }
+
+  fputs("\"timers\":{", f);
+
+  for (i = pb_TimerID_IO; i < pb_TimerID_LAST; i++) {
+    struct pb_Timer *timer = &timers->timers[i];
+
+    if (i != pb_TimerID_IO) fputc(',', f);
+    fprintf(f, "\"%s\":{\"seconds\":%.9f,\"switches\":%lu",
+            category_keys[i - 1], pb_GetElapsedTime(timer), timer->switches);
+    write_json_work(timer, f);
+    write_json_counters(timer, f);
+
+    if (timers->sub_timer_list[i] != NULL) {
+      fputs(",\"subtimers\":{", f);
+      for (sub = timers->sub_timer_list[i]->subtimer_list; sub;
+           sub = sub->next) {
+        if (sub != timers->sub_timer_list[i]->subtimer_list) fputc(',', f);
+        write_json_string(f, sub->label);
+        fprintf(f, ":{\"seconds\":%.9f,\"switches\":%lu",
+                pb_GetElapsedTime(&sub->timer), sub->timer.switches);
+        write_json_work(&sub->timer, f);
+        write_json_counters(&sub->timer, f);
+        fputc('}', f);
+      }
+      fputc('}', f);
+    }
+    fputc('}', f);
+  }
+  fputs("}}\n", f);
+}
+
+void
+pb_WriteTimerSetCSV(struct pb_TimerSet *timers, FILE *f, int header)
+{
+  int i;
+  struct pb_SubTimer *sub;
+
+  if (header) {
+    fputs("category,subtimer,seconds,switches,bytes,flops", f);
+    for (i = 0; i < pb_Counter_LAST; i++) fprintf(f, ",%s", counter_names[i]);
+    fputc('\n', f);
+  }
+
+  for (i = pb_TimerID_IO; i < pb_TimerID_LAST; i++) {
+    struct pb_Timer *timer = &timers->timers[i];
+
+    fprintf(f, "%s,,%.9f,%lu,%.0f,%.0f", category_keys[i - 1],
+            pb_GetElapsedTime(timer), timer->switches, timer->bytes,
+            timer->flops);
+    write_csv_counters(timer, f);
+
+    if (timers->sub_timer_list[i] == NULL) continue;
+    for (sub = timers->sub_timer_list[i]->subtimer_list; sub;
+         sub = sub->next) {
+      fprintf(f, "%s,", category_keys[i - 1]);
+      write_csv_string(f, sub->label);
+      fprintf(f, ",%.9f,%lu,%.0f,%.0f", pb_GetElapsedTime(&sub->timer),
+              sub->timer.switches, sub->timer.bytes, sub->timer.flops);
+      write_csv_counters(&sub->timer, f);
+    }
+  }
+  fprintf(f, "wall,,%.9f,1,,", wall_time(timers));
+  for (i = 0; i < pb_Counter_LAST; i++) fputc(',', f);
+  fputc('\n', f);
+}
+
+/* Append the timer set to the file named by an environment variable. */
+static void
+write_timer_file(struct pb_TimerSet *timers, const char *var, int csv)
+{
+  const char *name = getenv(var);
+  FILE *f;
+  int empty;
+
+  if (name == NULL || name[0] == 0) return;
+
+  if (strcmp(name, "-") == 0) {
+    if (csv) pb_WriteTimerSetCSV(timers, stdout, 1);
+    else pb_WriteTimerSetJSON(timers, stdout);
+    return;
+  }
+
+  f = fopen(name, "a");
+  if (f == NULL) {
+    fprintf(stderr, "Cannot open timer output file %s (%s)\n", name, var);
+    return;
+  }
+
+  /* Write the CSV header only at the top of a new file */
+  fseek(f, 0, SEEK_END);
+  empty = ftell(f) == 0;
+
+  if (csv) pb_WriteTimerSetCSV(timers, f, empty);
+  else pb_WriteTimerSetJSON(timers, f);
+  fclose(f);
+}
+
+/* Microseconds from the start of the trace. */
+static double
+trace_us(pb_Timestamp t)
+{
+  return t > trace_base ? pb_TicksToNanoseconds(t - trace_base) / 1e3 : 0;
+}
+
+/* Write one complete ("X") event. */
+static void
+write_trace_event(FILE *f, const char *name, const char *category, int track,
+                  pb_Timestamp begin, pb_Timestamp end, const char *args)
+{
+  double ts = trace_us(begin);
+
+  fputs(",\n{\"name\":", f);
+  write_json_string(f, name);
+  fputs(",\"cat\":", f);
+  write_json_string(f, category);
+  fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+          track, ts, end > begin ? trace_us(end) - ts : 0.0);
+  if (args != NULL) fprintf(f, ",\"args\":{%s}", args);
+  fputc('}', f);
+}
+
+static const char *
+trace_timer_name(enum pb_TimerID category)
+{
+  return category < pb_TimerID_OVERLAP ? categories[category - 1]
+                                       : category_keys[category - 1];
+}
+
+static void
+write_trace_timer(FILE *f, enum pb_TimerID category,
+                  struct pb_SubTimer *subtimer, pb_Timestamp begin,
+                  pb_Timestamp end)
+{
+  if (subtimer != NULL)
+    write_trace_event(f, subtimer->label, category_keys[category - 1], 0,
+                      begin, end, NULL);
+  else
+    write_trace_event(f, trace_timer_name(category), "timer", 0, begin, end,
+                      NULL);
+}
+
+/* Write the recorded events to the file named by PARBOIL_TRACE, in the
+ * JSON trace event format read by chrome://tracing and Perfetto, and
+ * start a new trace.  Timers still running end at the end of the run. */
+static void
+write_trace_file(struct pb_TimerSet *timers)
+{
+  const char *name = getenv("PARBOIL_TRACE");
+  struct pb_SubTimerList *subtimerlist;
+  FILE *f;
+  size_t i;
+  int t;
+
+  if (trace_state <= 0) return;
+
+  if (strcmp(name, "-") == 0) f = stdout;
+  else if ((f = fopen(name, "w")) == NULL) {
+    fprintf(stderr, "Cannot open trace file %s (PARBOIL_TRACE)\n", name);
+    return;
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"args\":{\"name\":\"parboil\"}}", f);
+  for (t = 0; t < trace_track_count; t++) {
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":", t);
+    write_json_string(f, t == 0 ? "timers" : trace_tracks[t]);
+    fputs("}}", f);
+  }
+
+  for (i = 0; i < trace_count; i++) {
+    struct trace_event *e = &trace_events[i];
+
+    if (e->track == 0)
+      write_trace_timer(f, e->category, e->subtimer, e->begin, e->end);
+    else
+      write_trace_event(f, e->name, trace_tracks[e->track], e->track,
+                        e->begin, e->end, e->args);
+    free(e->name);
+    free(e->args);
+  }
+  trace_count = 0;
+
+  if (timers->current != pb_TimerID_NONE) {
+    write_trace_timer(f, timers->current, NULL,
+                      timers->timers[timers->current].init, timers->wall_end);
+    subtimerlist = timers->sub_timer_list[timers->current];
+    if (subtimerlist != NULL && subtimerlist->current != NULL)
+      write_trace_timer(f, timers->current, subtimerlist->current,
+                        subtimerlist->current->timer.init, timers->wall_end);
+  }
+  pthread_mutex_unlock(&trace_lock);
+
+  fputs("\n]}\n", f);
+  if (f != stdout) fclose(f);
+}
+
+/* Copy the timer set into snapshot with its running timers stopped at now.
+ * Release the copy with pb_DestroyTimerSet. */
+static void
+snapshot_timer_set(struct pb_TimerSet *snapshot, struct pb_TimerSet *timers,
+                   const struct sample *now)
+{
+  int i;
+
+  *snapshot = *timers;
+  snapshot->current = pb_TimerID_NONE;
+
+  for (i = 0; i < pb_TimerID_LAST; i++) {
+    struct pb_SubTimerList *subtimerlist = timers->sub_timer_list[i];
+    struct pb_SubTimer *sub, **tail;
+
+    if (snapshot->timers[i].state == pb_Timer_RUNNING)
+      stop_timer_at(&snapshot->timers[i], now);
+
+    if (subtimerlist == NULL) continue;
+    snapshot->sub_timer_list[i] =
+      (struct pb_SubTimerList *)malloc(sizeof(struct pb_SubTimerList));
+    snapshot->sub_timer_list[i]->current = NULL;
+    tail = &snapshot->sub_timer_list[i]->subtimer_list;
+    for (sub = subtimerlist->subtimer_list; sub; sub = sub->next) {
+      *tail = (struct pb_SubTimer *)malloc(sizeof(struct pb_SubTimer));
+      **tail = *sub;
+      (*tail)->label = strdup(sub->label);
+      if ((*tail)->timer.state == pb_Timer_RUNNING)
+        stop_timer_at(&(*tail)->timer, now);
+      tail = &(*tail)->next;
+    }
+    *tail = NULL;
+  }
+}
+
+void
+pb_PrintTimerSet(struct pb_TimerSet *timers)
+{
+  struct pb_TimerSet snapshot;
+  struct pb_Timer *t = snapshot.timers;
+  struct pb_SubTimer *sub;
+  struct sample now;
+  int maxSubLength;
+  int i;
+
+  /* Report the timers as they stand here, so that measuring the roofline
+   * adds to neither the running timers nor the wall time written to the
+   * timer files after it */
+  take_sample(&now);
+  timers->wall_end = now.time;
+  snapshot_timer_set(&snapshot, timers, &now);
+
+  /* Exclude NONE and OVERLAP from this format */
+  for (i = pb_TimerID_IO; i < pb_TimerID_OVERLAP; i++) {
+    if (pb_GetElapsedTime(&t[i]) == 0) continue;
+
+    /* Print Category Timer */
+    printf("%-*s: %f\n", maxCategoryLength, categories[i - 1],
+           pb_GetElapsedTime(&t[i]));
+    print_counters(&t[i]);
+
+    if (snapshot.sub_timer_list[i] == NULL) continue;
+
+    /* Fit sub-timer labels to the category column */
+    maxSubLength = maxCategoryLength;
+    for (sub = snapshot.sub_timer_list[i]->subtimer_list; sub;
+         sub = sub->next) {
+      int len = (int)strlen(sub->label);
+      if (len > maxSubLength) maxSubLength = len;
+    }
+
+    for (sub = snapshot.sub_timer_list[i]->subtimer_list; sub;
+         sub = sub->next) {
+      printf(" -%-*s: %f\n", maxSubLength, sub->label,
+             pb_GetElapsedTime(&sub->timer));
+      print_counters(&sub->timer);
+    }
+  }
+
+  if (pb_GetElapsedTime(&t[pb_TimerID_OVERLAP]) != 0)
+    printf("CPU/Kernel Overlap: %f\n",
+           pb_GetElapsedTime(&t[pb_TimerID_OVERLAP]));
+
+  if (counters_multiplexed)
+    puts("Hardware counters were multiplexed; counts cover only the time "
+         "they were scheduled");
+
+  printf("Timer Wall Time: %f\n", wall_time(&snapshot));
+
+  if (has_work(&snapshot)) print_roofline(&snapshot);
+
+  write_timer_file(&snapshot, "PARBOIL_TIMER_JSON", 0);
+  write_timer_file(&snapshot, "PARBOIL_TIMER_CSV", 1);
+  write_trace_file(timers);
+  pb_DestroyTimerSet(&snapshot);
+}
+
+void
+pb_DestroyTimerSet(struct pb_TimerSet *timers)
+{
+  int i;
+
+  for (i = 0; i < pb_TimerID_LAST; i++) {
+    struct pb_SubTimerList *subtimerlist = timers->sub_timer_list[i];
+    struct pb_SubTimer *sub, *next;
+
+    if (subtimerlist == NULL) continue;
+    for (sub = subtimerlist->subtimer_list; sub; sub = next) {
+      next = sub->next;
+      free(sub->label);
+      free(sub);
+    }
+    free(subtimerlist);
+    timers->sub_timer_list[i] = NULL;
+  }
+}
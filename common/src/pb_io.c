@@ -0,0 +1,633 @@
+/*
+ * Parboil benchmark support library: binary container files.
+ */
+
+#define _GNU_SOURCE
+
+#include <pb_io.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+# error "Container I/O is not implemented for this system: wrong endianness."
+#endif
+
+/* The on-disk structures have no padding */
+typedef char check_header_size[sizeof(struct pb_ContainerHeader) == 64 ? 1 : -1];
+typedef char check_entry_size[sizeof(struct pb_ContainerEntry) == 128 ? 1 : -1];
+
+/*****************************************************************************/
+/* CRC-32C */
+
+static uint32_t crc_table[256];
+
+static void
+init_crc_table(void)
+{
+  uint32_t i, j;
+
+  for (i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (j = 0; j < 8; j++)
+      c = (c >> 1) ^ (0x82f63b78 & -(c & 1));
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t
+crc32c_table(uint32_t crc, const unsigned char *p, size_t n)
+{
+  if (crc_table[1] == 0) init_crc_table();
+  while (n--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+/* SSE4.2 computes 8 bytes per instruction */
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *p, size_t n)
+{
+  uint64_t c = crc;
+
+  for (; n && ((uintptr_t)p & 7); n--)
+    c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = __builtin_ia32_crc32di(c, v);
+  }
+  for (; n; n--)
+    c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+  return (uint32_t)c;
+}
+#endif
+
+uint32_t
+pb_Crc32c(uint32_t crc, const void *data, size_t bytes)
+{
+  crc = ~crc;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    return ~crc32c_sse42(crc, data, bytes);
+#endif
+  return ~crc32c_table(crc, data, bytes);
+}
+
+/*****************************************************************************/
+/* Half-width floats */
+
+static uint32_t
+float_bits(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, 4);
+  return u;
+}
+
+static float
+bits_float(uint32_t u)
+{
+  float f;
+  memcpy(&f, &u, 4);
+  return f;
+}
+
+static uint16_t
+float_to_bf16(float f)
+{
+  uint32_t u = float_bits(f);
+  if ((u & 0x7fffffff) > 0x7f800000)
+    return (uint16_t)((u >> 16) | 0x40);	/* Keep NaNs quiet */
+  u += 0x7fff + ((u >> 16) & 1);
+  return (uint16_t)(u >> 16);
+}
+
+/* Round to nearest even; subnormals are rounded by the FPU, adding a
+ * magic number that puts their bits at the bottom of the mantissa */
+static uint16_t
+float_to_f16(float f)
+{
+  const uint32_t f32_infinity = 255u << 23;
+  const uint32_t f16_max = (127u + 16) << 23;
+  const uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+  uint32_t u = float_bits(f);
+  uint32_t sign = u & 0x80000000u;
+  uint16_t h;
+
+  u ^= sign;
+  if (u >= f16_max)
+    h = u > f32_infinity ? 0x7e00 : 0x7c00;
+  else if (u < (113u << 23))
+    h = (uint16_t)(float_bits(bits_float(u) + bits_float(denorm_magic))
+                   - denorm_magic);
+  else {
+    uint32_t odd = (u >> 13) & 1;
+    u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+    h = (uint16_t)(u >> 13);
+  }
+  return h | (uint16_t)(sign >> 16);
+}
+
+static float
+f16_to_float(uint16_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+
+  if (exp == 0) {			/* Zero or subnormal */
+    float f = mant * (1.0f / 16777216.0f);
+    return bits_float(float_bits(f) | sign);
+  }
+  if (exp == 31)
+    return bits_float(sign | 0x7f800000 | (mant << 13));
+  return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+#if defined(__x86_64__)
+/* F16C converts 8 values per instruction */
+__attribute__((target("f16c,avx")))
+static void
+floats_to_f16_f16c(const float *src, uint16_t *dst, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(dst + i), h);
+  }
+  for (; i < n; i++) dst[i] = float_to_f16(src[i]);
+}
+
+__attribute__((target("f16c,avx")))
+static void
+f16_to_floats_f16c(const uint16_t *src, float *dst, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dst + i,
+                     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+  for (; i < n; i++) dst[i] = f16_to_float(src[i]);
+}
+#endif
+
+int
+pb_FloatsToHalf(enum pb_Type type, const float *src, uint16_t *dst, size_t n)
+{
+  size_t i;
+
+  if (type == pb_Type_BF16) {
+    for (i = 0; i < n; i++) dst[i] = float_to_bf16(src[i]);
+    return 0;
+  }
+  if (type != pb_Type_F16) return -1;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("f16c")) {
+    floats_to_f16_f16c(src, dst, n);
+    return 0;
+  }
+#endif
+  for (i = 0; i < n; i++) dst[i] = float_to_f16(src[i]);
+  return 0;
+}
+
+int
+pb_HalfToFloats(enum pb_Type type, const uint16_t *src, float *dst, size_t n)
+{
+  size_t i;
+
+  if (type == pb_Type_BF16) {
+    for (i = 0; i < n; i++) dst[i] = bits_float((uint32_t)src[i] << 16);
+    return 0;
+  }
+  if (type != pb_Type_F16) return -1;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("f16c")) {
+    f16_to_floats_f16c(src, dst, n);
+    return 0;
+  }
+#endif
+  for (i = 0; i < n; i++) dst[i] = f16_to_float(src[i]);
+  return 0;
+}
+
+/*****************************************************************************/
+/* Reading */
+
+struct pb_Container {
+  char *path;
+  void *map;
+  size_t size;
+  int count;
+  struct pb_ContainerEntry *entries;	/* Inside the mapping */
+  struct pb_Array *arrays;
+};
+
+static const size_t type_sizes[pb_Type_LAST] = {
+  0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2, 2
+};
+
+size_t
+pb_TypeSize(enum pb_Type type)
+{
+  return (unsigned)type < pb_Type_LAST ? type_sizes[type] : 0;
+}
+
+static uint32_t
+header_checksum(const struct pb_ContainerHeader *h)
+{
+  return pb_Crc32c(0, h, offsetof(struct pb_ContainerHeader, header_checksum));
+}
+
+int
+pb_IsContainerFile(const char *path)
+{
+  char magic[8];
+  FILE *f = fopen(path, "rb");
+  int ret;
+
+  if (!f) return 0;
+  ret = fread(magic, 1, 8, f) == 8 && memcmp(magic, PB_CONTAINER_MAGIC, 8) == 0;
+  fclose(f);
+  return ret;
+}
+
+/* Check one table entry against the file.  Returns an error message or
+ * NULL. */
+static const char *
+check_entry(const struct pb_ContainerEntry *e, size_t file_size,
+            uint32_t alignment)
+{
+  uint64_t bytes = e->elem_size;
+  uint32_t i;
+
+  if (memchr(e->name, 0, PB_MAX_NAME) == NULL)
+    return "unterminated array name";
+  if (e->type >= pb_Type_LAST)
+    return "unknown element type";
+  if (e->elem_size == 0 ||
+      (e->type != pb_Type_RECORD && e->elem_size != type_sizes[e->type]))
+    return "element size does not match the type";
+  if (e->rank < 1 || e->rank > PB_MAX_RANK)
+    return "bad rank";
+  for (i = 0; i < e->rank; i++) {
+    if (e->dims[i] && bytes > UINT64_MAX / e->dims[i])
+      return "dimensions overflow";
+    bytes *= e->dims[i];
+  }
+  if (bytes != e->bytes)
+    return "size does not match the dimensions";
+  if (e->offset % alignment)
+    return "misaligned data";
+  if (e->offset > file_size || e->bytes > file_size - e->offset)
+    return "data extends past the end of the file";
+  return NULL;
+}
+
+struct pb_Container *
+pb_OpenContainer(const char *path, int flags)
+{
+  struct pb_Container *c;
+  const struct pb_ContainerHeader *h;
+  const char *err = NULL;
+  struct stat st;
+  const char *verify_env;
+  int fd;
+  int i;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Cannot open container '%s': %s\n", path, strerror(errno));
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  if ((size_t)st.st_size < sizeof(struct pb_ContainerHeader)) {
+    fprintf(stderr, "Container '%s' is truncated\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  c = (struct pb_Container *)calloc(1, sizeof(struct pb_Container));
+  c->path = strdup(path);
+  c->size = st.st_size;
+  c->map = mmap(NULL, c->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | (flags & PB_OPEN_POPULATE ? MAP_POPULATE : 0),
+                fd, 0);
+  close(fd);
+  if (c->map == MAP_FAILED) {
+    fprintf(stderr, "Cannot map container '%s': %s\n", path, strerror(errno));
+    c->map = NULL;
+    pb_CloseContainer(c);
+    return NULL;
+  }
+  if (flags & PB_OPEN_SEQUENTIAL)
+    madvise(c->map, c->size, MADV_SEQUENTIAL);
+  else if (!(flags & PB_OPEN_POPULATE))
+    madvise(c->map, c->size, MADV_WILLNEED);
+
+  /* Header */
+  h = (const struct pb_ContainerHeader *)c->map;
+  if (memcmp(h->magic, PB_CONTAINER_MAGIC, 8) != 0)
+    err = "not a container file";
+  else if (h->header_checksum != header_checksum(h))
+    err = "header checksum mismatch";
+  else if (h->version > PB_CONTAINER_VERSION)
+    err = "written by a newer version of the library";
+  else if (h->file_size != c->size)
+    err = "file size does not match the header (truncated?)";
+  else if (h->alignment == 0 || PB_CONTAINER_ALIGNMENT % h->alignment)
+    err = "unsupported alignment";
+  else if (h->table_offset > c->size ||
+           (c->size - h->table_offset) / sizeof(struct pb_ContainerEntry)
+           < h->array_count)
+    err = "table extends past the end of the file";
+  else if (h->table_offset % 8)
+    err = "misaligned table";
+  if (err) goto error;
+
+  /* Table */
+  c->count = h->array_count;
+  c->entries = (struct pb_ContainerEntry *)((char *)c->map + h->table_offset);
+  if (pb_Crc32c(0, c->entries, c->count * sizeof(struct pb_ContainerEntry))
+      != h->table_checksum) {
+    err = "table checksum mismatch";
+    goto error;
+  }
+
+  c->arrays = (struct pb_Array *)calloc(c->count ? c->count : 1,
+                                        sizeof(struct pb_Array));
+  for (i = 0; i < c->count; i++) {
+    const struct pb_ContainerEntry *e = &c->entries[i];
+    struct pb_Array *a = &c->arrays[i];
+    uint32_t d;
+
+    if ((err = check_entry(e, c->size, h->alignment)) != NULL) {
+      fprintf(stderr, "Container '%s', array %d: %s\n", path, i, err);
+      pb_CloseContainer(c);
+      return NULL;
+    }
+    a->name = e->name;
+    a->type = (enum pb_Type)e->type;
+    a->elem_size = e->elem_size;
+    a->rank = e->rank;
+    a->count = 1;
+    for (d = 0; d < e->rank; d++) {
+      a->dims[d] = e->dims[d];
+      a->count *= e->dims[d];
+    }
+    a->data = (char *)c->map + e->offset;
+  }
+
+  verify_env = getenv("PARBOIL_IO_VERIFY");
+  if (verify_env && *verify_env && strcmp(verify_env, "0") != 0)
+    flags |= PB_OPEN_VERIFY;
+  if ((flags & PB_OPEN_VERIFY) && pb_VerifyContainer(c) != 0) {
+    pb_CloseContainer(c);
+    return NULL;
+  }
+
+  return c;
+
+ error:
+  fprintf(stderr, "Container '%s': %s\n", path, err);
+  pb_CloseContainer(c);
+  return NULL;
+}
+
+void
+pb_CloseContainer(struct pb_Container *c)
+{
+  if (!c) return;
+  if (c->map) munmap(c->map, c->size);
+  free(c->arrays);
+  free(c->path);
+  free(c);
+}
+
+int
+pb_ContainerSize(struct pb_Container *c)
+{
+  return c->count;
+}
+
+const struct pb_Array *
+pb_ContainerArrayAt(struct pb_Container *c, int i)
+{
+  return i >= 0 && i < c->count ? &c->arrays[i] : NULL;
+}
+
+const struct pb_Array *
+pb_ContainerArray(struct pb_Container *c, const char *name)
+{
+  int i;
+
+  for (i = 0; i < c->count; i++)
+    if (strcmp(c->arrays[i].name, name) == 0) return &c->arrays[i];
+  return NULL;
+}
+
+int
+pb_VerifyContainer(struct pb_Container *c)
+{
+  int ret = 0;
+  int i;
+
+  for (i = 0; i < c->count; i++) {
+    const struct pb_ContainerEntry *e = &c->entries[i];
+    if (pb_Crc32c(0, (char *)c->map + e->offset, e->bytes) != e->checksum) {
+      fprintf(stderr, "Container '%s': checksum mismatch in array '%s'\n",
+              c->path, e->name);
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+/*****************************************************************************/
+/* Writing */
+
+struct pb_ContainerWriter {
+  char *path;
+  FILE *f;
+  uint64_t offset;		/* Current end of the file */
+  int count;
+  int capacity;
+  struct pb_ContainerEntry *entries;
+  int in_array;			/* Nonzero between BeginArray and EndArray */
+  uint64_t written;		/* Bytes of the current array so far */
+  int failed;
+};
+
+static int
+write_error(struct pb_ContainerWriter *w, const char *what)
+{
+  if (!w->failed)
+    fprintf(stderr, "Cannot write container '%s': %s\n", w->path, what);
+  w->failed = 1;
+  return -1;
+}
+
+static int
+write_bytes(struct pb_ContainerWriter *w, const void *data, size_t bytes)
+{
+  if (w->failed) return -1;
+  if (fwrite(data, 1, bytes, w->f) != bytes)
+    return write_error(w, strerror(errno));
+  w->offset += bytes;
+  return 0;
+}
+
+/* Zero-fill up to the next multiple of the alignment */
+static int
+pad_to(struct pb_ContainerWriter *w, uint64_t alignment)
+{
+  static const char zeros[PB_CONTAINER_ALIGNMENT];
+  uint64_t pad = (alignment - w->offset % alignment) % alignment;
+  return write_bytes(w, zeros, pad);
+}
+
+struct pb_ContainerWriter *
+pb_CreateContainer(const char *path)
+{
+  struct pb_ContainerWriter *w;
+  struct pb_ContainerHeader h;
+
+  w = (struct pb_ContainerWriter *)calloc(1, sizeof(struct pb_ContainerWriter));
+  w->path = strdup(path);
+  w->f = fopen(path, "wb");
+  if (!w->f) {
+    fprintf(stderr, "Cannot create container '%s': %s\n", path, strerror(errno));
+    free(w->path);
+    free(w);
+    return NULL;
+  }
+
+  /* Placeholder, rewritten by pb_CloseContainerWriter */
+  memset(&h, 0, sizeof(h));
+  write_bytes(w, &h, sizeof(h));
+  return w;
+}
+
+int
+pb_BeginArray(struct pb_ContainerWriter *w, const char *name,
+              enum pb_Type type, size_t elem_size,
+              int rank, const size_t *dims)
+{
+  struct pb_ContainerEntry *e;
+  int i;
+
+  if (w->in_array)
+    return write_error(w, "pb_BeginArray called inside an array");
+  if (strlen(name) >= PB_MAX_NAME)
+    return write_error(w, "array name too long");
+  if ((unsigned)type >= pb_Type_LAST || elem_size == 0 ||
+      (type != pb_Type_RECORD && elem_size != type_sizes[type]))
+    return write_error(w, "bad element type or size");
+  if (rank < 1 || rank > PB_MAX_RANK)
+    return write_error(w, "bad rank");
+  if (pad_to(w, PB_CONTAINER_ALIGNMENT)) return -1;
+
+  if (w->count == w->capacity) {
+    w->capacity = w->capacity ? 2 * w->capacity : 8;
+    w->entries = (struct pb_ContainerEntry *)
+      realloc(w->entries, w->capacity * sizeof(struct pb_ContainerEntry));
+  }
+  e = &w->entries[w->count++];
+  memset(e, 0, sizeof(*e));
+  strcpy(e->name, name);
+  e->type = type;
+  e->elem_size = elem_size;
+  e->rank = rank;
+  e->bytes = elem_size;
+  for (i = 0; i < rank; i++) {
+    e->dims[i] = dims[i];
+    e->bytes *= dims[i];
+  }
+  e->offset = w->offset;
+
+  w->in_array = 1;
+  w->written = 0;
+  return 0;
+}
+
+int
+pb_AppendArray(struct pb_ContainerWriter *w, const void *data, size_t bytes)
+{
+  struct pb_ContainerEntry *e = &w->entries[w->count - 1];
+
+  if (!w->in_array)
+    return write_error(w, "pb_AppendArray called outside an array");
+  if (bytes > e->bytes - w->written)
+    return write_error(w, "more data than the array's dimensions hold");
+  e->checksum = pb_Crc32c(e->checksum, data, bytes);
+  w->written += bytes;
+  return write_bytes(w, data, bytes);
+}
+
+int
+pb_EndArray(struct pb_ContainerWriter *w)
+{
+  struct pb_ContainerEntry *e = &w->entries[w->count - 1];
+
+  if (!w->in_array)
+    return write_error(w, "pb_EndArray called outside an array");
+  w->in_array = 0;
+  if (w->written != e->bytes)
+    return write_error(w, "less data than the array's dimensions hold");
+  return w->failed ? -1 : 0;
+}
+
+int
+pb_WriteArray(struct pb_ContainerWriter *w, const char *name,
+              enum pb_Type type, size_t elem_size,
+              int rank, const size_t *dims, const void *data)
+{
+  if (pb_BeginArray(w, name, type, elem_size, rank, dims)) return -1;
+  if (pb_AppendArray(w, data, w->entries[w->count - 1].bytes)) return -1;
+  return pb_EndArray(w);
+}
+
+int
+pb_CloseContainerWriter(struct pb_ContainerWriter *w)
+{
+  struct pb_ContainerHeader h;
+  size_t table_bytes = w->count * sizeof(struct pb_ContainerEntry);
+  int ret;
+
+  if (w->in_array)
+    write_error(w, "pb_CloseContainerWriter called inside an array");
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, PB_CONTAINER_MAGIC, 8);
+  h.version = PB_CONTAINER_VERSION;
+  h.alignment = PB_CONTAINER_ALIGNMENT;
+  h.array_count = w->count;
+  h.table_checksum = pb_Crc32c(0, w->entries, table_bytes);
+
+  pad_to(w, 8);
+  h.table_offset = w->offset;
+  write_bytes(w, w->entries, table_bytes);
+  h.file_size = w->offset;
+  h.header_checksum = header_checksum(&h);
+
+  if (!w->failed && (fseek(w->f, 0, SEEK_SET) != 0 ||
+                     fwrite(&h, sizeof(h), 1, w->f) != 1))
+    write_error(w, strerror(errno));
+  if (fclose(w->f) != 0)
+    write_error(w, strerror(errno));
+
+  ret = w->failed ? -1 : 0;
+  if (ret) remove(w->path);
+  free(w->entries);
+  free(w->path);
+  free(w);
+  return ret;
+}
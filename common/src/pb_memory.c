@@ -0,0 +1,312 @@
+/*
+ * Parboil benchmark support library: large host buffers.
+ */
+
+#define _GNU_SOURCE
+
+#include <pb_memory.h>
+#include <parboil.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define SIZE_2M (2UL << 20)
+#define SIZE_1G (1UL << 30)
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+/* How the pages of a buffer were obtained */
+enum page_kind { PAGES_1G, PAGES_2M, PAGES_THP, PAGES_BASE };
+
+static const char *page_names[] = {
+  "1 GB pages", "2 MB pages", "transparent huge pages", "base pages"
+};
+
+/* A mapping made by pb_AllocLarge, kept to unmap it */
+struct mapping {
+  void *addr;
+  size_t length;
+  struct mapping *next;
+};
+
+static struct mapping *mappings;
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long
+env_long(const char *name, long dflt)
+{
+  const char *s = getenv(name);
+  long v;
+
+  if (s == NULL || *s == 0) return dflt;
+  v = atol(s);
+  return v > 0 ? v : dflt;
+}
+
+static void *
+map_anonymous(size_t length, int flags)
+{
+  void *p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/* Map from the reserved huge page pool.  Fails unless the administrator
+ * set aside enough pages of that size (vm.nr_hugepages or the per-size
+ * sysfs knob), which is the usual case for 1 GB pages. */
+static void *
+map_hugetlb(size_t *length, size_t page, int size_flag)
+{
+#ifdef MAP_HUGETLB
+  size_t rounded = (*length + page - 1) / page * page;
+  void *p = map_anonymous(rounded, MAP_HUGETLB | size_flag);
+  if (p != NULL) *length = rounded;
+  return p;
+#else
+  (void)length; (void)page; (void)size_flag;
+  return NULL;
+#endif
+}
+
+/* Map at a 2 MB boundary, so that the kernel can back the buffer with
+ * transparent huge pages from its first byte, and ask for them. */
+static void *
+map_thp(size_t *length)
+{
+  size_t rounded = (*length + SIZE_2M - 1) / SIZE_2M * SIZE_2M;
+  char *p = (char *)map_anonymous(rounded + SIZE_2M, 0);
+  char *aligned;
+
+  if (p == NULL) return NULL;
+  aligned = (char *)(((uintptr_t)p + SIZE_2M - 1) & ~(uintptr_t)(SIZE_2M - 1));
+  if (aligned > p) munmap(p, aligned - p);
+  munmap(aligned + rounded, p + SIZE_2M - aligned);
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, rounded, MADV_HUGEPAGE);
+#endif
+  *length = rounded;
+  return aligned;
+}
+
+/* Map a buffer according to PARBOIL_HUGEPAGES; buffers under 2 MB always
+ * get base pages.  On return, *length is the mapped length and *kind and
+ * *page describe the pages. */
+static void *
+map_buffer(size_t *length, enum page_kind *kind, size_t *page)
+{
+  const char *policy = getenv("PARBOIL_HUGEPAGES");
+  int try_1g, try_2m;
+  void *p;
+
+  if (policy == NULL || *policy == 0) policy = "auto";
+  if (strcmp(policy, "off") == 0 || *length < SIZE_2M) {
+    *kind = PAGES_BASE;
+    *page = (size_t)sysconf(_SC_PAGESIZE);
+    *length = (*length + *page - 1) / *page * *page;
+    p = map_anonymous(*length, 0);
+#ifdef MADV_NOHUGEPAGE
+    /* Keep "off" comparable where THP is enabled system-wide */
+    if (p != NULL) madvise(p, *length, MADV_NOHUGEPAGE);
+#endif
+    return p;
+  }
+  try_1g = strcmp(policy, "1g") == 0 ||
+    (strcmp(policy, "auto") == 0 && *length >= SIZE_1G);
+  try_2m = strcmp(policy, "2m") == 0 ||
+    (strcmp(policy, "auto") == 0 && *length >= SIZE_2M);
+
+  if (try_1g && (p = map_hugetlb(length, SIZE_1G, MAP_HUGE_1GB)) != NULL) {
+    *kind = PAGES_1G;
+    *page = SIZE_1G;
+    return p;
+  }
+  if (try_2m && (p = map_hugetlb(length, SIZE_2M, MAP_HUGE_2MB)) != NULL) {
+    *kind = PAGES_2M;
+    *page = SIZE_2M;
+    return p;
+  }
+  *kind = PAGES_THP;
+  *page = SIZE_2M;
+  return map_thp(length);
+}
+
+/* Number of first-touch threads, the worker count of the host runtime */
+static int
+touch_threads(void)
+{
+  long n = env_long("PARBOIL_ALLOC_THREADS",
+                    env_long("HC_HOST_THREADS", sysconf(_SC_NPROCESSORS_ONLN)));
+  return n < 1 ? 1 : (int)n;
+}
+
+struct touch_job {
+  char *base;
+  size_t begin, end;		/* Byte range of the slab */
+  size_t stride;		/* Bytes between writes */
+  int cpu;			/* CPU to run on, or -1 */
+};
+
+static void *
+touch_slab(void *arg)
+{
+  struct touch_job *job = (struct touch_job *)arg;
+  volatile char *p = job->base;
+  size_t off;
+
+#ifdef __linux__
+  if (job->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(job->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#endif
+  for (off = job->begin; off < job->end; off += job->stride) p[off] = 0;
+  return NULL;
+}
+
+/* Fault a buffer in from 'threads' threads, thread i writing the i-th of
+ * as many contiguous slabs, split at page boundaries, and running on the
+ * i-th CPU the process may use.  Returns the number of threads used. */
+static int
+first_touch(char *base, size_t length, size_t page, size_t stride,
+            int threads)
+{
+  size_t pages = (length + page - 1) / page;
+  struct touch_job *jobs;
+  pthread_t *ids;
+  int cpus[CPU_SETSIZE];
+  int ncpus = 0;
+  int *started;
+  int i;
+
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    for (i = 0; i < CPU_SETSIZE; i++)
+      if (CPU_ISSET(i, &allowed)) cpus[ncpus++] = i;
+#endif
+
+  if ((size_t)threads > pages) threads = (int)pages;
+  if (threads < 1) threads = 1;
+  jobs = (struct touch_job *)malloc(threads * sizeof(struct touch_job));
+  ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  started = (int *)calloc(threads, sizeof(int));
+
+  for (i = 0; i < threads; i++) {
+    jobs[i].base = base;
+    jobs[i].begin = pages * i / threads * page;
+    jobs[i].end = pages * (i + 1) / threads * page;
+    if (jobs[i].end > length) jobs[i].end = length;
+    jobs[i].stride = stride;
+    jobs[i].cpu = ncpus ? cpus[i % ncpus] : -1;
+  }
+
+  /* The calling thread takes the first slab, like worker 0 of the runtime,
+   * and keeps its own affinity */
+  jobs[0].cpu = -1;
+  for (i = 1; i < threads; i++)
+    started[i] = pthread_create(&ids[i], NULL, touch_slab, &jobs[i]) == 0;
+  touch_slab(&jobs[0]);
+  for (i = 1; i < threads; i++) {
+    if (started[i]) pthread_join(ids[i], NULL);
+    else {
+      jobs[i].cpu = -1;
+      touch_slab(&jobs[i]);
+    }
+  }
+
+  free(jobs);
+  free(ids);
+  free(started);
+  return threads;
+}
+
+void *
+pb_AllocLarge(const char *label, size_t bytes)
+{
+  const char *report = getenv("PARBOIL_ALLOC_REPORT");
+  struct mapping *m;
+  struct rusage before, after;
+  enum page_kind kind;
+  size_t length = bytes ? bytes : 1;
+  size_t page;
+  pb_Timestamp begin, end;
+  int threads;
+  void *p;
+
+  p = map_buffer(&length, &kind, &page);
+  if (p == NULL) {
+    fprintf(stderr, "pb_AllocLarge: cannot map %zu bytes for %s (%s)\n",
+            bytes, label, strerror(errno));
+    return NULL;
+  }
+
+  m = (struct mapping *)malloc(sizeof(struct mapping));
+  m->addr = p;
+  m->length = length;
+  pthread_mutex_lock(&mappings_lock);
+  m->next = mappings;
+  mappings = m;
+  pthread_mutex_unlock(&mappings_lock);
+
+  /* Slabs are split at huge page boundaries, but every base page is
+   * written, in case the kernel had no transparent huge page to give */
+  getrusage(RUSAGE_SELF, &before);
+  begin = pb_GetTimestamp();
+  threads = first_touch((char *)p, length, page,
+                        kind == PAGES_1G || kind == PAGES_2M
+                        ? page : (size_t)sysconf(_SC_PAGESIZE),
+                        touch_threads());
+  end = pb_GetTimestamp();
+  getrusage(RUSAGE_SELF, &after);
+
+  if (report != NULL && atoi(report))
+    printf("pb_AllocLarge: %s, %.1f MB on %s, touched by %d threads in "
+           "%.3f ms, %ld minor and %ld major page faults\n",
+           label, bytes / (1024.0 * 1024.0), page_names[kind], threads,
+           pb_TicksToNanoseconds(end - begin) / 1e6,
+           after.ru_minflt - before.ru_minflt,
+           after.ru_majflt - before.ru_majflt);
+  return p;
+}
+
+void
+pb_FreeLarge(void *ptr)
+{
+  struct mapping **link, *m = NULL;
+
+  if (ptr == NULL) return;
+
+  pthread_mutex_lock(&mappings_lock);
+  for (link = &mappings; *link; link = &(*link)->next)
+    if ((*link)->addr == ptr) {
+      m = *link;
+      *link = m->next;
+      break;
+    }
+  pthread_mutex_unlock(&mappings_lock);
+
+  if (m == NULL) {
+    fputs("pb_FreeLarge: pointer was not allocated by pb_AllocLarge\n",
+          stderr);
+    return;
+  }
+  munmap(m->addr, m->length);
+  free(m);
+}
@@ -0,0 +1,222 @@
+/*
+ * Parboil benchmark support library: output verification.
+ */
+
+#include <pb_verify.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_REPORT 10
+
+struct pb_Tolerance
+pb_ExactTolerance(void)
+{
+  struct pb_Tolerance t = { pb_Tolerance_EXACT, 0, 0, 0 };
+  return t;
+}
+
+struct pb_Tolerance
+pb_UlpTolerance(double ulps, double abs)
+{
+  struct pb_Tolerance t = { pb_Tolerance_ULP, ulps, 0, abs };
+  return t;
+}
+
+struct pb_Tolerance
+pb_RelativeTolerance(double rel, double abs)
+{
+  struct pb_Tolerance t = { pb_Tolerance_RELATIVE, 0, rel, abs };
+  return t;
+}
+
+/* Element types of a comparison */
+enum elem_type { ELEM_FLOAT, ELEM_DOUBLE, ELEM_INT };
+
+/* Position of a value among all values of its type, so that neighbouring
+ * representable values differ by one and -0 and +0 coincide */
+static int64_t
+float_order(float x)
+{
+  int32_t i;
+  memcpy(&i, &x, sizeof i);
+  return i < 0 ? -(int64_t)(i & 0x7fffffff) : i;
+}
+
+static int64_t
+double_order(double x)
+{
+  int64_t i;
+  memcpy(&i, &x, sizeof i);
+  return i < 0 ? -(i & 0x7fffffffffffffffLL) : i;
+}
+
+/* Distance between two positions.  It is taken in uint64_t, where it
+ * cannot overflow, and only then rounded to double, so that values one ulp
+ * apart are not lost to the rounding of their positions. */
+static double
+order_distance(int64_t a, int64_t b)
+{
+  return a < b ? (double)((uint64_t)b - (uint64_t)a)
+               : (double)((uint64_t)a - (uint64_t)b);
+}
+
+/* The error of one value under the tolerance, 0 when the values are equal
+ * or within the absolute bound, and INFINITY when they cannot match. */
+static double
+value_error(enum elem_type type, const void *result, const void *reference,
+            size_t i, const struct pb_Tolerance *tol)
+{
+  double r, e;
+
+  switch (type) {
+  case ELEM_FLOAT:
+    r = ((const float *)result)[i];
+    e = ((const float *)reference)[i];
+    break;
+  case ELEM_DOUBLE:
+    r = ((const double *)result)[i];
+    e = ((const double *)reference)[i];
+    break;
+  default:
+    return ((const int *)result)[i] == ((const int *)reference)[i]
+      ? 0 : INFINITY;
+  }
+
+  if (isnan(r) || isnan(e))
+    return isnan(r) && isnan(e) ? 0 : INFINITY;
+  if (r == e)
+    return 0;
+  if (fabs(r - e) <= tol->abs)
+    return 0;
+
+  switch (tol->kind) {
+  case pb_Tolerance_ULP:
+    if (type == ELEM_FLOAT)
+      return order_distance(float_order((float)r), float_order((float)e));
+    return order_distance(double_order(r), double_order(e));
+  case pb_Tolerance_RELATIVE:
+    return e == 0 ? INFINITY : fabs(r - e) / fabs(e);
+  default:
+    return fabs(r - e);
+  }
+}
+
+static int
+mismatch(double error, const struct pb_Tolerance *tol)
+{
+  switch (tol->kind) {
+  case pb_Tolerance_ULP:
+    return error > tol->ulps;
+  case pb_Tolerance_RELATIVE:
+    return error > tol->rel;
+  default:
+    return error > 0;
+  }
+}
+
+static void
+print_value(enum elem_type type, const void *values, size_t i)
+{
+  switch (type) {
+  case ELEM_FLOAT:
+    printf("%.9g", ((const float *)values)[i]);
+    break;
+  case ELEM_DOUBLE:
+    printf("%.17g", ((const double *)values)[i]);
+    break;
+  default:
+    printf("%d", ((const int *)values)[i]);
+  }
+}
+
+static void
+print_tolerance(enum elem_type type, const struct pb_Tolerance *tol)
+{
+  if (type == ELEM_INT || tol->kind == pb_Tolerance_EXACT)
+    printf("exact");
+  else if (tol->kind == pb_Tolerance_ULP)
+    printf("%g ulp", tol->ulps);
+  else
+    printf("relative %g", tol->rel);
+  if (type != ELEM_INT && tol->abs > 0)
+    printf(" or absolute %g", tol->abs);
+}
+
+static size_t
+report_limit(void)
+{
+  const char *s = getenv("PARBOIL_VERIFY_REPORT");
+  return s ? (size_t)strtoul(s, NULL, 10) : DEFAULT_REPORT;
+}
+
+static int
+compare(const char *label, enum elem_type type, const void *result,
+        const void *reference, size_t count, const struct pb_Tolerance *tol)
+{
+  size_t limit = report_limit();
+  size_t mismatches = 0, worst = 0;
+  double max_error = 0;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    double error = value_error(type, result, reference, i, tol);
+
+    if (error > max_error) {
+      max_error = error;
+      worst = i;
+    }
+    if (!mismatch(error, tol))
+      continue;
+    if (mismatches++ < limit) {
+      if (mismatches == 1) {
+        printf("%s: mismatches under tolerance ", label);
+        print_tolerance(type, tol);
+        printf(":\n");
+      }
+      printf("  [%zu] ", i);
+      print_value(type, result, i);
+      printf(", expected ");
+      print_value(type, reference, i);
+      if (type != ELEM_INT)
+        printf(", error %g", error);
+      printf("\n");
+    }
+  }
+  if (mismatches > limit)
+    printf("  ... %zu more\n", mismatches - limit);
+
+  printf("%s: %s, %zu of %zu values mismatch", label,
+         mismatches ? "FAILED" : "PASSED", mismatches, count);
+  if (type != ELEM_INT && max_error > 0)
+    printf(", max error %g at [%zu]", max_error, worst);
+  printf("\n");
+  fflush(stdout);
+  return mismatches ? -1 : 0;
+}
+
+int
+pb_CompareFloats(const char *label, const float *result,
+                 const float *reference, size_t count,
+                 const struct pb_Tolerance *tolerance)
+{
+  return compare(label, ELEM_FLOAT, result, reference, count, tolerance);
+}
+
+int
+pb_CompareDoubles(const char *label, const double *result,
+                  const double *reference, size_t count,
+                  const struct pb_Tolerance *tolerance)
+{
+  return compare(label, ELEM_DOUBLE, result, reference, count, tolerance);
+}
+
+int
+pb_CompareInts(const char *label, const int *result,
+               const int *reference, size_t count)
+{
+  struct pb_Tolerance exact = pb_ExactTolerance();
+  return compare(label, ELEM_INT, result, reference, count, &exact);
+}